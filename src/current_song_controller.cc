@@ -25,25 +25,31 @@ namespace wavplayeralsa
 
     }
 
-    void CurrentSongController::Initialize(const std::string &player_uuid, const std::string &wav_dir)
+    void CurrentSongController::Initialize(const std::string &player_uuid, const std::string &wav_dir, const std::string &zone_name, const std::string &status_topic,
+        StatusMessagesListenerIfc *status_listener)
     {
         player_uuid_ = player_uuid;
         wav_dir_ = boost::filesystem::path(wav_dir);
+        zone_name_ = zone_name;
+        status_topic_ = status_topic;
+        status_listener_ = status_listener;
 
         json j;
 		j["song_is_playing"] = false;
 		UpdateLastStatusMsg(j, play_seq_id_);
     }
 
-    void CurrentSongController::NewSongStatus(const std::string &file_id, uint32_t play_seq_id, uint64_t start_time_millis_since_epoch, double speed)
+    void CurrentSongController::NewSongStatus(const std::string &file_id, uint32_t play_seq_id, uint64_t start_time_micros_since_epoch, double speed)
     {
 		json j;
 		j["song_is_playing"] = true;
 		j["file_id"] = file_id;
-		j["start_time_millis_since_epoch"] = start_time_millis_since_epoch;
+		j["start_time_millis_since_epoch"] = start_time_micros_since_epoch / 1000;
+		j["start_time_micros_since_epoch"] = start_time_micros_since_epoch;
 		j["speed"] = speed;
 
         ios_.post(std::bind(&CurrentSongController::UpdateLastStatusMsg, this, j, play_seq_id));
+        ios_.post(std::bind(&CurrentSongController::OnSongStarted, this, play_seq_id));
     }
 
     void CurrentSongController::NoSongPlayingStatus(const std::string &file_id, uint32_t play_seq_id)       
@@ -53,24 +59,62 @@ namespace wavplayeralsa
 		j["stopped_file_id"] = file_id;
         
         ios_.post(std::bind(&CurrentSongController::UpdateLastStatusMsg, this, j, play_seq_id));
+        ios_.post(std::bind(&CurrentSongController::OnSongEnded, this, play_seq_id));
     }
 
 	bool CurrentSongController::NewSongRequest(
         const std::string &file_id, 
         int64_t start_offset_ms, 
+        uint64_t start_at_epoch_us,
         std::stringstream &out_msg,
         uint32_t *play_seq_id) 
     {
-		bool prev_file_was_playing = false;
-		std::string prev_file_id;
+		return LoadSong(file_id, start_offset_ms, start_at_epoch_us, false, out_msg, play_seq_id);
+	}
 
-		if(alsa_service_ != nullptr) {
-			prev_file_id = alsa_service_->GetFileId();
-			prev_file_was_playing = alsa_service_->Stop();
-			delete alsa_service_;
-			alsa_service_ = nullptr;
+	bool CurrentSongController::PrepareSongRequest(
+        const std::string &file_id, 
+        int64_t start_offset_ms, 
+        std::stringstream &out_msg,
+        uint32_t *play_seq_id) 
+    {
+		return LoadSong(file_id, start_offset_ms, 0, true, out_msg, play_seq_id);
+	}
+
+	bool CurrentSongController::GoRequest(
+        std::stringstream &out_msg,
+        uint32_t *play_seq_id) 
+    {
+        // the id of the prepared file. play_seq_id_ can already be reserved for the queue head
+        if(play_seq_id != nullptr)
+        {
+            *play_seq_id = service_play_seq_id_;
+        }
+
+		if(alsa_service_ == nullptr || !alsa_service_->Go()) {
+			out_msg << "no audio file is prepared and waiting for go, so go had no effect";
+			return false;
 		}
 
+		out_msg << "prepared audio file '" << alsa_service_->GetFileId() << "' started playing";
+		return true;
+	}
+
+	/*
+	Load file_id to a new playback service, and either play it (now, or at start_at_epoch_us if not 0), 
+	or only prepare it and wait for go if wait_for_go is true.
+	 */
+	bool CurrentSongController::LoadSong(
+        const std::string &file_id, 
+        int64_t start_offset_ms, 
+        uint64_t start_at_epoch_us,
+        bool wait_for_go,
+        std::stringstream &out_msg,
+        uint32_t *play_seq_id) 
+    {
+		bool prev_file_was_playing = false;
+		std::string prev_file_id;
+
 		// create a new unique id for this play
 		uint32_t new_play_seq_id = play_seq_id_ + 1;
         play_seq_id_ = new_play_seq_id;
@@ -79,6 +123,52 @@ namespace wavplayeralsa
             *play_seq_id = play_seq_id_;
         }
 
+		// the requested file is already playing (or prepared). change its position in place, 
+		// without reloading the file and restarting the playback.
+		// preparing and scheduling are not done in place, since the current file might already be audible
+		if(!wait_for_go && start_at_epoch_us == 0 && alsa_service_ != nullptr && alsa_service_->GetFileId() == file_id) {
+			if(alsa_service_->Seek(start_offset_ms, new_play_seq_id)) {
+				// seek drops the file queued in the playback service. it is queued again when the new position is reported
+				service_play_seq_id_ = new_play_seq_id;
+				queue_head_play_seq_id_ = 0;
+				queue_head_rejected_ = false;
+				// in case the file was only prepared
+				alsa_service_->Go();
+				out_msg << "changed position of the current file '" << file_id << "'. new position in ms is: " << start_offset_ms << std::endl;
+				return true;
+			}
+		}
+
+		// another file is playing. if crossfade is enabled, the playback service fades it out
+		// while fading the requested file in, in the same stream
+		if(!wait_for_go && start_at_epoch_us == 0 && alsa_service_ != nullptr) {
+			try {
+				boost::filesystem::path crossfadePath = boost::filesystem::canonical(wav_dir_ / boost::filesystem::path(file_id));
+				std::string crossfade_from_file_id = alsa_service_->GetFileId();
+				if(alsa_service_->CrossfadeTo(crossfadePath.string(), file_id, start_offset_ms, new_play_seq_id)) {
+					// like seek, it drops the file queued in the playback service
+					service_play_seq_id_ = new_play_seq_id;
+					queue_head_play_seq_id_ = 0;
+					queue_head_rejected_ = false;
+					out_msg << "crossfading from audio file '" << crossfade_from_file_id << "' to '" << file_id <<
+						"' starting at position " << start_offset_ms << " ms" << std::endl;
+					return true;
+				}
+			}
+			catch(const std::runtime_error &e) {
+				// the file is loaded again below, which reports the failure
+			}
+		}
+
+		if(alsa_service_ != nullptr) {
+			prev_file_id = alsa_service_->GetFileId();
+			prev_file_was_playing = alsa_service_->Stop();
+			delete alsa_service_;
+			alsa_service_ = nullptr;
+		}
+		queue_head_play_seq_id_ = 0;
+		queue_head_rejected_ = false;
+
 		boost::filesystem::path songPathInWavDir(file_id);
 		boost::filesystem::path songFullPath = wav_dir_ / songPathInWavDir;
 		std::string canonicalFullPath;
@@ -89,6 +179,7 @@ namespace wavplayeralsa
 				file_id,
 				new_play_seq_id
 			);
+			service_play_seq_id_ = new_play_seq_id;
 		}
 		catch(const std::runtime_error &e) {
 			out_msg << "failed loading new audio file '" << file_id << "'. currently no audio file is loaded in the player and it is not playing. " <<
@@ -107,7 +198,11 @@ namespace wavplayeralsa
 			uint64_t minutes = start_offset_sec / 60;
 			uint64_t seconds = start_offset_sec % 60;
 			if(prev_file_was_playing && !prev_file_id.empty()) {
-				out_msg << "audio file successfully changed from '" << prev_file_id << "' to '" << file_id << "' and will be played ";
+				out_msg << "audio file successfully changed from '" << prev_file_id << "' to '" << file_id << "' and " << 
+					(wait_for_go ? "is prepared to be played on go " : "will be played ");
+			}
+			else if(wait_for_go) {
+				out_msg << "prepared audio file '" << file_id << "' to be played on go ";
 			}
 			else {
 				out_msg << "will play audio file '" << file_id << "' ";
@@ -120,10 +215,21 @@ namespace wavplayeralsa
 				out_msg << " in the future";
 			}
 			out_msg << ")";
+			if(start_at_epoch_us != 0) {
+				out_msg << " at " << start_at_epoch_us << " micro-seconds since epoch";
+			}
 		}
 
         try {
-			alsa_service_->Play(start_offset_ms);
+			if(wait_for_go) {
+				alsa_service_->Prepare(start_offset_ms);
+			}
+			else if(start_at_epoch_us != 0) {
+				alsa_service_->PlayAt(start_offset_ms, start_at_epoch_us);
+			}
+			else {
+				alsa_service_->Play(start_offset_ms);
+			}
         }
         catch(const std::runtime_error &e) {
             out_msg << "playing new audio file '" << file_id << "' failed. currently player is not playing. " <<
@@ -146,6 +252,8 @@ namespace wavplayeralsa
 			delete alsa_service_;
 			alsa_service_ = nullptr;
 		}
+		queue_head_play_seq_id_ = 0;
+		queue_head_rejected_ = false;
 
 		if(current_file_id.empty() || !was_playing) {
 			out_msg << "no audio file is being played, so stop had no effect";			
@@ -162,10 +270,154 @@ namespace wavplayeralsa
 		return true;
 	}
 
+	bool CurrentSongController::QueueInsertRequest(
+        const std::string &file_id,
+        int64_t index,
+        std::stringstream &out_msg)
+	{
+		boost::filesystem::path songFullPath = wav_dir_ / boost::filesystem::path(file_id);
+		if(!boost::filesystem::is_regular_file(songFullPath)) {
+			out_msg << "audio file '" << file_id << "' is not found, and was not added to the queue";
+			return false;
+		}
+
+		size_t position = (index < 0 || (uint64_t)index > queue_.size()) ? queue_.size() : (size_t)index;
+		if(position == 0 && queue_head_play_seq_id_ != 0) {
+			// the head is already queued in the playback service. it can be replaced only if it was not read yet
+			if(alsa_service_ != nullptr && alsa_service_->ClearNext()) {
+				queue_head_play_seq_id_ = 0;
+			}
+			else {
+				position = 1;
+				out_msg << "audio file '" << queue_.front() << "' is already buffered to be played next. ";
+			}
+		}
+		if(position == 0) {
+			queue_head_rejected_ = false;
+		}
+		queue_.insert(queue_.begin() + position, file_id);
+		out_msg << "audio file '" << file_id << "' added to the queue at position " << position << 
+			". number of files in queue: " << queue_.size();
+
+		QueueHeadToService();
+		return true;
+	}
+
+	bool CurrentSongController::QueueClearRequest(
+        std::stringstream &out_msg)
+	{
+		size_t prev_size = queue_.size();
+		if(queue_head_play_seq_id_ != 0 && (alsa_service_ == nullptr || !alsa_service_->ClearNext())) {
+			// the head is already read by the playback service, and is played anyway
+			queue_.erase(queue_.begin() + 1, queue_.end());
+			out_msg << "removed " << (prev_size - 1) << " files from the queue. audio file '" << queue_.front() << 
+				"' is already buffered and will be played next";
+			return true;
+		}
+
+		queue_.clear();
+		queue_head_play_seq_id_ = 0;
+		queue_head_rejected_ = false;
+		out_msg << "removed " << prev_size << " files from the queue";
+		return true;
+	}
+
+	PlayQueueStatus CurrentSongController::QueryPlayQueue()
+	{
+		PlayQueueStatus status;
+		status.file_ids.assign(queue_.begin(), queue_.end());
+		status.next_preloaded = (queue_head_play_seq_id_ != 0);
+		return status;
+	}
+
+	void CurrentSongController::OnSongStarted(uint32_t play_seq_id)
+	{
+		if(queue_head_play_seq_id_ != 0 && play_seq_id == queue_head_play_seq_id_) {
+			OnQueueHeadStarted(play_seq_id);
+		}
+		started_play_seq_id_ = play_seq_id;
+		QueueHeadToService();
+	}
+
+	void CurrentSongController::OnSongEnded(uint32_t play_seq_id)
+	{
+		// a very short file might end before its start is reported
+		if(queue_head_play_seq_id_ != 0 && play_seq_id == queue_head_play_seq_id_) {
+			OnQueueHeadStarted(play_seq_id);
+		}
+
+		// events of files which are no longer the current one are ignored
+		if(alsa_service_ == nullptr || play_seq_id != service_play_seq_id_ || queue_.empty()) {
+			return;
+		}
+
+		// the head of the queue could not be played gapless (different audio format, or queued too late).
+		// play it now, after a short gap
+		PlayQueueHead();
+	}
+
+	/*
+	The playback service continued from the current file to the head of the queue, in the same stream.
+	*/
+	void CurrentSongController::OnQueueHeadStarted(uint32_t play_seq_id)
+	{
+		queue_.pop_front();
+		queue_head_play_seq_id_ = 0;
+		queue_head_rejected_ = false;
+		service_play_seq_id_ = play_seq_id;
+	}
+
+	/*
+	Open the head of the queue in the playback service, to be played gapless right after the current file.
+	It is done once the current file is reported as playing, so the file has the whole duration 
+	of the current one to be opened and read ahead.
+	*/
+	void CurrentSongController::QueueHeadToService()
+	{
+		if(alsa_service_ == nullptr || queue_.empty() || queue_head_play_seq_id_ != 0 || queue_head_rejected_) {
+			return;
+		}
+		if(started_play_seq_id_ != service_play_seq_id_ || play_seq_id_ != service_play_seq_id_) {
+			return;
+		}
+
+		const std::string &file_id = queue_.front();
+		uint32_t next_play_seq_id = play_seq_id_ + 1;
+		try {
+			boost::filesystem::path songFullPath = wav_dir_ / boost::filesystem::path(file_id);
+			std::string canonicalFullPath = boost::filesystem::canonical(songFullPath).string();
+			if(!alsa_service_->QueueNext(canonicalFullPath, file_id, next_play_seq_id)) {
+				queue_head_rejected_ = true;
+				return;
+			}
+		}
+		catch(const std::runtime_error &) {
+			// it is loaded again when the current file ends, and skipped if it still fails
+			queue_head_rejected_ = true;
+			return;
+		}
+
+		play_seq_id_ = next_play_seq_id;
+		queue_head_play_seq_id_ = next_play_seq_id;
+	}
+
+	void CurrentSongController::PlayQueueHead()
+	{
+		while(!queue_.empty()) {
+			std::string file_id = queue_.front();
+			queue_.pop_front();
+			std::stringstream out_msg;
+			if(LoadSong(file_id, 0, 0, false, out_msg, nullptr)) {
+				return;
+			}
+		}
+	}
+
 	void CurrentSongController::UpdateLastStatusMsg(const json &alsa_data, uint32_t play_seq_id)
 	{
         json full_msg(alsa_data);
         full_msg["uuid"] = player_uuid_;
+        full_msg["zone"] = zone_name_;
         full_msg["play_seq_id"] = play_seq_id;
 
 		const std::string msg_json_str = full_msg.dump();
@@ -175,6 +427,9 @@ namespace wavplayeralsa
 		}
 
 		last_status_msg_ = msg_json_str;
+        if(status_listener_ != nullptr) {
+            status_listener_->OnStatusMessage(zone_name_, msg_json_str);
+        }
 
         if(!throttle_timer_set_) {
             throttle_timer_.expires_from_now(boost::posix_time::milliseconds(THROTTLE_WAIT_TIME_MS));
@@ -189,8 +444,8 @@ namespace wavplayeralsa
         if(error)
             return;
 
-        mqtt_service_->ReportCurrentSong(last_status_msg_);
-        ws_service_->ReportCurrentSong(last_status_msg_);        
+        mqtt_service_->ReportCurrentSong(status_topic_, last_status_msg_);
+        ws_service_->ReportCurrentSong(zone_name_, last_status_msg_);
     }
 
 }
@@ -2,6 +2,7 @@
 #define CURRENT_SONG_CONTROLLER_H_
 
 #include <string>
+#include <deque>
 #include <boost/asio/deadline_timer.hpp>
 #include <boost/filesystem.hpp>
 #include "nlohmann/json_fwd.hpp"
@@ -18,7 +19,8 @@ namespace wavplayeralsa {
 
     class CurrentSongController : 
         public PlayerEventsIfc,
-        public CurrentSongActionsIfc
+        public CurrentSongActionsIfc,
+        public PlayQueueActionsIfc
     {
 
     public:
@@ -27,10 +29,13 @@ namespace wavplayeralsa {
             WebSocketsApi *ws_service, 
             AlsaPlaybackServiceFactory *alsa_playback_service_factory);
 
-        void Initialize(const std::string &player_uuid, const std::string &wav_dir);
+        // status is published with the zone name, and to status_topic on mqtt.
+        // status_listener (if not nullptr) receives every status message, with no throttling
+        void Initialize(const std::string &player_uuid, const std::string &wav_dir, const std::string &zone_name, const std::string &status_topic,
+            StatusMessagesListenerIfc *status_listener);
 
     public:
-        void NewSongStatus(const std::string &file_id, uint32_t play_seq_id, uint64_t start_time_millis_since_epoch, double speed);
+        void NewSongStatus(const std::string &file_id, uint32_t play_seq_id, uint64_t start_time_micros_since_epoch, double speed);
         void NoSongPlayingStatus(const std::string &file_id, uint32_t play_seq_id);
 
     public:
@@ -40,6 +45,17 @@ namespace wavplayeralsa {
 		bool NewSongRequest(
             const std::string &file_id, 
             int64_t start_offset_ms, 
+            uint64_t start_at_epoch_us,
+            std::stringstream &out_msg,
+            uint32_t *play_seq_id);
+
+		bool PrepareSongRequest(
+            const std::string &file_id, 
+            int64_t start_offset_ms, 
+            std::stringstream &out_msg,
+            uint32_t *play_seq_id);
+
+		bool GoRequest(
             std::stringstream &out_msg,
             uint32_t *play_seq_id);
 
@@ -47,7 +63,35 @@ namespace wavplayeralsa {
             std::stringstream &out_msg,
             uint32_t *play_seq_id);
 
+    public:
+
+        // wavplayeralsa::PlayQueueActionsIfc
+
+        bool QueueInsertRequest(
+            const std::string &file_id,
+            int64_t index,
+            std::stringstream &out_msg);
+
+        bool QueueClearRequest(
+            std::stringstream &out_msg);
+
+        PlayQueueStatus QueryPlayQueue();
+
     private:
+        bool LoadSong(
+            const std::string &file_id, 
+            int64_t start_offset_ms, 
+            uint64_t start_at_epoch_us,
+            bool wait_for_go,
+            std::stringstream &out_msg,
+            uint32_t *play_seq_id);
+
+        void OnSongStarted(uint32_t play_seq_id);
+        void OnSongEnded(uint32_t play_seq_id);
+        void OnQueueHeadStarted(uint32_t play_seq_id);
+        void QueueHeadToService();
+        void PlayQueueHead();
+
         void UpdateLastStatusMsg(const json &alsa_data, uint32_t play_seq_id);
         void ReportCurrentSongToServices(const boost::system::error_code& error);
 
@@ -62,11 +106,27 @@ namespace wavplayeralsa {
         // static config
         std::string player_uuid_;
         boost::filesystem::path wav_dir_;
+        std::string zone_name_;
+        std::string status_topic_;
+        StatusMessagesListenerIfc *status_listener_ = nullptr;
 
     private:
     	std::string last_status_msg_;
         uint32_t play_seq_id_;
 
+    private:
+        // files to play after the current one, in order
+        std::deque<std::string> queue_;
+        // the play_seq_id of the file alsa_service_ is playing now
+        uint32_t service_play_seq_id_ = 0;
+        // the last play_seq_id reported as playing
+        uint32_t started_play_seq_id_ = 0;
+        // play_seq_id reserved for the head of the queue, once it is queued in the playback service 
+        // to be played gapless after the current file. 0 if it is not
+        uint32_t queue_head_play_seq_id_ = 0;
+        // the playback service cannot play the head of the queue gapless. it is loaded when the current file ends
+        bool queue_head_rejected_ = false;
+
     private:
         // throttling issues:
         const int THROTTLE_WAIT_TIME_MS = 50;
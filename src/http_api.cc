@@ -1,6 +1,8 @@
 
 #include "http_api.h"
 
+#include <chrono>
+
 #include <boost/filesystem.hpp>
 #include "nlohmann/json.hpp"
 
@@ -10,25 +12,42 @@ using json = nlohmann::json;
 
 namespace wavplayeralsa {
 
+	const int64_t HttpApi::MAX_START_AT_AHEAD_MS;
+
 	void HttpApi::Initialize(
 		std::shared_ptr<spdlog::logger> logger, 
 		const std::string &player_uuid,
 		boost::asio::io_service *io_service, 
-		CurrentSongActionsIfc *current_song_action_callback, 
+		ZonesActionsIfc *zones_action_callback, 
 		PlayerFilesActionsIfc *player_files_action_callback, 
+		AudioCacheActionsIfc *audio_cache_action_callback,
 		uint16_t http_listen_port) 
 	{
 
 		// set class members
 		player_uuid_ = player_uuid;
-		current_song_action_callback_ = current_song_action_callback;
+		zones_action_callback_ = zones_action_callback;
 		player_files_action_callback_ = player_files_action_callback;
+		audio_cache_action_callback_ = audio_cache_action_callback;
 		logger_ = logger;
 
 	  	server_.config.port = http_listen_port;
 	  	server_.io_service = std::shared_ptr<boost::asio::io_service>(io_service);
+		server_.resource["^/api/zones$"]["GET"] = std::bind(&HttpApi::OnGetZones, this, std::placeholders::_1, std::placeholders::_2);
 		server_.resource["^/api/available-files$"]["GET"] = std::bind(&HttpApi::OnGetAvailableFiles, this, std::placeholders::_1, std::placeholders::_2);
 		server_.resource["^/api/current-song$"]["PUT"] = std::bind(&HttpApi::OnPutCurrentSong, this, std::placeholders::_1, std::placeholders::_2);
+		server_.resource["^/api/current-song/prepare$"]["PUT"] = std::bind(&HttpApi::OnPutCurrentSongPrepare, this, std::placeholders::_1, std::placeholders::_2);
+		server_.resource["^/api/current-song/go$"]["PUT"] = std::bind(&HttpApi::OnPutCurrentSongGo, this, std::placeholders::_1, std::placeholders::_2);
+		server_.resource["^/api/audio-cache$"]["GET"] = std::bind(&HttpApi::OnGetAudioCache, this, std::placeholders::_1, std::placeholders::_2);
+		server_.resource["^/api/xruns$"]["GET"] = std::bind(&HttpApi::OnGetXruns, this, std::placeholders::_1, std::placeholders::_2);
+		server_.resource["^/api/audio-device$"]["GET"] = std::bind(&HttpApi::OnGetAudioDevice, this, std::placeholders::_1, std::placeholders::_2);
+		server_.resource["^/api/queue$"]["GET"] = std::bind(&HttpApi::OnGetQueue, this, std::placeholders::_1, std::placeholders::_2);
+		server_.resource["^/api/queue$"]["POST"] = std::bind(&HttpApi::OnPostQueue, this, std::placeholders::_1, std::placeholders::_2);
+		server_.resource["^/api/queue$"]["DELETE"] = std::bind(&HttpApi::OnDeleteQueue, this, std::placeholders::_1, std::placeholders::_2);
+		server_.resource["^/api/cues$"]["GET"] = std::bind(&HttpApi::OnGetCues, this, std::placeholders::_1, std::placeholders::_2);
+		server_.resource["^/api/cues$"]["POST"] = std::bind(&HttpApi::OnPostCues, this, std::placeholders::_1, std::placeholders::_2);
+		server_.resource["^/api/volume$"]["GET"] = std::bind(&HttpApi::OnGetVolume, this, std::placeholders::_1, std::placeholders::_2);
+		server_.resource["^/api/volume$"]["PUT"] = std::bind(&HttpApi::OnPutVolume, this, std::placeholders::_1, std::placeholders::_2);
 		server_.default_resource["GET"] = std::bind(&HttpApi::OnWebGet, this, std::placeholders::_1, std::placeholders::_2);
 		server_.on_error = std::bind(&HttpApi::OnServerError, this, std::placeholders::_1, std::placeholders::_2);
 
@@ -71,15 +90,430 @@ namespace wavplayeralsa {
 	  	logger_->info("http request succeeded. returning msg: {}", json_str);
 	}
 
+	/*
+	Requests which act on a zone select it with the 'zone' query parameter (e.g. /api/current-song?zone=stage).
+	Without it, they act on the default zone.
+	On failure, a bad request response is written, and false is returned.
+	 */
+	bool HttpApi::FindRequestZone(
+		std::shared_ptr<HttpServer::Response> response, 
+		std::shared_ptr<HttpServer::Request> request, 
+		ZoneActions *zone) 
+	{
+		std::string zone_name;
+		const SimpleWeb::CaseInsensitiveMultimap query_fields = request->parse_query_string();
+		auto zone_it = query_fields.find("zone");
+		if(zone_it != query_fields.end()) {
+			zone_name = zone_it->second;
+		}
+
+		if(!zones_action_callback_->FindZone(zone_name, zone)) {
+			std::stringstream err_stream;
+			err_stream << "unknown zone '" << zone_name << "'";
+			WriteResponseBadRequest(response, err_stream);
+			return false;
+		}
+		return true;
+	}
+
+	void HttpApi::OnGetZones(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request) {
+		const std::list<std::string> zone_names = zones_action_callback_->QueryZones();
+		WriteJsonResponseSuccess(response, zone_names);
+	}
+
 	void HttpApi::OnGetAvailableFiles(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request) {
 		const std::list<std::string> fileIds = player_files_action_callback_->QueryFiles();
 		WriteJsonResponseSuccess(response, fileIds);
 	}
 
+	void HttpApi::OnGetAudioCache(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request) {
+		const AudioCacheStats stats = audio_cache_action_callback_->QueryAudioCacheStats();
+		json response_json;
+		response_json["hits"] = stats.hits;
+		response_json["misses"] = stats.misses;
+		response_json["resident_bytes"] = stats.resident_bytes;
+		response_json["budget_bytes"] = stats.budget_bytes;
+		response_json["entries"] = stats.entries;
+		WriteJsonResponseSuccess(response, response_json);
+	}
+
+	void HttpApi::OnGetXruns(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request) {
+		ZoneActions zone;
+		if(!FindRequestZone(response, request, &zone)) {
+			return;
+		}
+		const XrunStats stats = zone.xrun_stats->QueryXrunStats();
+		json response_json;
+		response_json["zone"] = zone.zone_name;
+		response_json["count"] = stats.count;
+		response_json["total_duration_us"] = stats.total_duration_us;
+		response_json["max_duration_us"] = stats.max_duration_us;
+		json recent_json = json::array();
+		for(const XrunEvent &xrun : stats.recent) {
+			recent_json.push_back({ {"time_ms_since_epoch", xrun.time_ms_since_epoch}, {"duration_us", xrun.duration_us} });
+		}
+		response_json["recent"] = recent_json;
+		WriteJsonResponseSuccess(response, response_json);
+	}
+
+	void HttpApi::OnGetAudioDevice(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request) {
+		ZoneActions zone;
+		if(!FindRequestZone(response, request, &zone)) {
+			return;
+		}
+		const AudioDeviceStatus status = zone.audio_device->QueryAudioDeviceStatus();
+		json response_json;
+		response_json["zone"] = zone.zone_name;
+		response_json["device"] = status.device;
+		response_json["configured"] = status.configured;
+		if(status.configured) {
+			response_json["access"] = status.mmap_access ? "mmap" : "rw";
+			response_json["frame_rate"] = status.frame_rate;
+			response_json["num_of_channels"] = status.num_of_channels;
+			response_json["buffer_size_frames"] = status.buffer_size_frames;
+			response_json["period_size_frames"] = status.period_size_frames;
+			response_json["buffer_time_us"] = status.buffer_time_us;
+			response_json["period_time_us"] = status.period_time_us;
+			response_json["periods"] = status.periods;
+			response_json["ring"] = { 
+				{"capacity_frames", status.ring_capacity_frames}, 
+				{"fill_frames", status.ring_fill_frames}, 
+				{"min_fill_frames", status.ring_min_fill_frames}, 
+				{"underruns", status.ring_underruns} 
+			};
+			json mirrors_json = json::array();
+			for(const MirrorDeviceStatus &mirror : status.mirrors) {
+				json mirror_json = {
+					{"device", mirror.device},
+					{"playing", mirror.playing},
+					{"offset_us", mirror.offset_us},
+					{"drift_ppm", mirror.drift_ppm},
+					{"resample_ratio", mirror.resample_ratio},
+					{"realigns", mirror.realigns},
+					{"xruns", mirror.xruns}
+				};
+				if(!mirror.error.empty()) {
+					mirror_json["error"] = mirror.error;
+				}
+				mirrors_json.push_back(mirror_json);
+			}
+			response_json["mirrors"] = mirrors_json;
+		}
+		WriteJsonResponseSuccess(response, response_json);
+	}
+
+	void HttpApi::OnGetQueue(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request) {
+		ZoneActions zone;
+		if(!FindRequestZone(response, request, &zone)) {
+			return;
+		}
+		std::stringstream handler_msg;
+		WriteQueueResponse(response, zone, true, handler_msg);
+	}
+
+	void HttpApi::OnPostQueue(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request) {
+		std::string request_json_str = request->content.string();
+		logger_->info("http received post request for queue: {}", request_json_str);
+
+		ZoneActions zone;
+		if(!FindRequestZone(response, request, &zone)) {
+			return;
+		}
+
+		json request_json;
+		try {
+			request_json = json::parse(request_json_str);
+		}
+		catch(json::exception &e) {
+			std::stringstream err_stream;
+			err_stream << "http request content is not a json string. error msg: '" << e.what() << "'";
+			WriteResponseBadRequest(response, err_stream);
+		    return;
+		}
+
+		std::string file_id;
+		int64_t index = -1;
+		try {
+			file_id = request_json.at("file_id").get<std::string>();
+			// use it only if it is found in the json. default is to append
+			if(request_json.find("index") != request_json.end()) {
+				index = request_json["index"].get<int64_t>();
+			}
+		}
+		catch(json::exception &e) {
+			std::stringstream err_stream;
+			err_stream << "cannot find valid values for 'file_id' and 'index' in request json. error msg: '" << e.what() << "'";
+			WriteResponseBadRequest(response, err_stream);
+		    return;
+		}
+
+		std::stringstream handler_msg;
+		bool success = zone.play_queue->QueueInsertRequest(file_id, index, handler_msg);
+		WriteQueueResponse(response, zone, success, handler_msg);
+	}
+
+	void HttpApi::OnDeleteQueue(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request) {
+		logger_->info("http received delete request for queue");
+		ZoneActions zone;
+		if(!FindRequestZone(response, request, &zone)) {
+			return;
+		}
+		std::stringstream handler_msg;
+		bool success = zone.play_queue->QueueClearRequest(handler_msg);
+		WriteQueueResponse(response, zone, success, handler_msg);
+	}
+
+	void HttpApi::OnGetCues(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request) {
+		ZoneActions zone;
+		if(!FindRequestZone(response, request, &zone)) {
+			return;
+		}
+		const std::list<std::string> cue_ids = zone.cues->QueryCues();
+		WriteJsonResponseSuccess(response, cue_ids);
+	}
+
+	void HttpApi::OnPostCues(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request) {
+		std::string request_json_str = request->content.string();
+		logger_->info("http received post request for cues: {}", request_json_str);
+
+		ZoneActions zone;
+		if(!FindRequestZone(response, request, &zone)) {
+			return;
+		}
+
+		json request_json;
+		try {
+			request_json = json::parse(request_json_str);
+		}
+		catch(json::exception &e) {
+			std::stringstream err_stream;
+			err_stream << "http request content is not a json string. error msg: '" << e.what() << "'";
+			WriteResponseBadRequest(response, err_stream);
+		    return;
+		}
+
+		std::string cue_id;
+		double gain_db = 0.0;
+		try {
+			cue_id = request_json.at("cue_id").get<std::string>();
+			// use it only if it is found in the json. default is the level of the cue file
+			if(request_json.find("gain_db") != request_json.end()) {
+				gain_db = request_json["gain_db"].get<double>();
+			}
+		}
+		catch(json::exception &e) {
+			std::stringstream err_stream;
+			err_stream << "cannot find valid values for 'cue_id' and 'gain_db' in request json. error msg: '" << e.what() << "'";
+			WriteResponseBadRequest(response, err_stream);
+		    return;
+		}
+
+		std::stringstream handler_msg;
+		bool success = zone.cues->TriggerCueRequest(cue_id, gain_db, handler_msg);
+		json response_json;
+		response_json["operation_desc"] = handler_msg.str();
+		response_json["uuid"] = player_uuid_;
+		response_json["zone"] = zone.zone_name;
+		if(success) {
+			WriteJsonResponseSuccess(response, response_json);
+		}
+		else {
+			WriteJsonResponseBadRequest(response, response_json);
+		}
+	}
+
+	void HttpApi::WriteVolumeResponse(std::shared_ptr<HttpServer::Response> response, const ZoneActions &zone, bool success, const std::stringstream &handler_msg) {
+		const VolumeStatus status = zone.volume->QueryVolume();
+		json response_json;
+		response_json["operation_desc"] = handler_msg.str();
+		response_json["uuid"] = player_uuid_;
+		response_json["zone"] = zone.zone_name;
+		response_json["gain_db"] = status.zone_gain_db;
+		response_json["track_gain_db"] = status.track_gain_db;
+		response_json["muted"] = status.muted;
+		if(success) {
+			WriteJsonResponseSuccess(response, response_json);
+		}
+		else {
+			WriteJsonResponseBadRequest(response, response_json);
+		}
+	}
+
+	void HttpApi::OnGetVolume(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request) {
+		ZoneActions zone;
+		if(!FindRequestZone(response, request, &zone)) {
+			return;
+		}
+		std::stringstream handler_msg;
+		WriteVolumeResponse(response, zone, true, handler_msg);
+	}
+
+	void HttpApi::OnPutVolume(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request) {
+		std::string request_json_str = request->content.string();
+		logger_->info("http received put request for volume: {}", request_json_str);
+
+		ZoneActions zone;
+		if(!FindRequestZone(response, request, &zone)) {
+			return;
+		}
+
+		json request_json;
+		try {
+			request_json = json::parse(request_json_str);
+		}
+		catch(json::exception &e) {
+			std::stringstream err_stream;
+			err_stream << "http request content is not a json string. error msg: '" << e.what() << "'";
+			WriteResponseBadRequest(response, err_stream);
+		    return;
+		}
+
+		// all the values are optional. only the ones which are found in the json are changed
+		bool has_gain = false, has_track_gain = false, has_muted = false;
+		double gain_db = 0.0;
+		double track_gain_db = 0.0;
+		bool muted = false;
+		int64_t ramp_ms = 0;
+		int64_t at_position_ms = -1;
+		try {
+			if(request_json.find("gain_db") != request_json.end()) {
+				gain_db = request_json["gain_db"].get<double>();
+				has_gain = true;
+			}
+			if(request_json.find("track_gain_db") != request_json.end()) {
+				track_gain_db = request_json["track_gain_db"].get<double>();
+				has_track_gain = true;
+			}
+			if(request_json.find("muted") != request_json.end()) {
+				muted = request_json["muted"].get<bool>();
+				has_muted = true;
+			}
+			if(request_json.find("ramp_ms") != request_json.end()) {
+				ramp_ms = request_json["ramp_ms"].get<int64_t>();
+			}
+			if(request_json.find("at_position_ms") != request_json.end()) {
+				at_position_ms = request_json["at_position_ms"].get<int64_t>();
+			}
+		}
+		catch(json::exception &e) {
+			std::stringstream err_stream;
+			err_stream << "cannot find valid values for 'gain_db', 'track_gain_db', 'muted', 'ramp_ms' and 'at_position_ms' in request json. error msg: '" << e.what() << "'";
+			WriteResponseBadRequest(response, err_stream);
+		    return;
+		}
+		if(!has_gain && !has_track_gain && !has_muted) {
+			std::stringstream err_stream;
+			err_stream << "request json should have at least one of 'gain_db', 'track_gain_db' or 'muted'";
+			WriteResponseBadRequest(response, err_stream);
+		    return;
+		}
+
+		std::stringstream handler_msg;
+		bool success = true;
+		if(has_gain) {
+			success = zone.volume->SetZoneGainRequest(gain_db, ramp_ms, handler_msg);
+		}
+		if(success && has_track_gain) {
+			handler_msg << (has_gain ? ". " : "");
+			success = zone.volume->SetTrackGainRequest(track_gain_db, ramp_ms, at_position_ms, handler_msg);
+		}
+		if(success && has_muted) {
+			handler_msg << (has_gain || has_track_gain ? ". " : "");
+			success = zone.volume->SetMuteRequest(muted, ramp_ms, handler_msg);
+		}
+		WriteVolumeResponse(response, zone, success, handler_msg);
+	}
+
 	void HttpApi::OnPutCurrentSong(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request) {
 		std::string request_json_str = request->content.string();
 		logger_->info("http received put request for current-song: {}", request_json_str);
 
+		ZoneActions zone;
+		if(!FindRequestZone(response, request, &zone)) {
+			return;
+		}
+
+		std::string file_id;
+		int64_t start_offset_ms = 0;
+		uint64_t start_at_epoch_us = 0;
+		if(!ParseCurrentSongRequest(response, request_json_str, &file_id, &start_offset_ms, &start_at_epoch_us)) {
+			return;
+		}
+
+		std::stringstream handler_msg;
+		bool success;
+		uint32_t play_seq_id = 0;
+		if(file_id.empty()) {
+			success = zone.current_song->StopPlayRequest(handler_msg, &play_seq_id);
+		}
+		else {
+			success = zone.current_song->NewSongRequest(file_id, start_offset_ms, start_at_epoch_us, handler_msg, &play_seq_id);	
+		} 
+
+		WriteCurrentSongResponse(response, zone, success, handler_msg, play_seq_id);
+	}
+
+	void HttpApi::OnPutCurrentSongPrepare(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request) {
+		std::string request_json_str = request->content.string();
+		logger_->info("http received put request for current-song/prepare: {}", request_json_str);
+
+		ZoneActions zone;
+		if(!FindRequestZone(response, request, &zone)) {
+			return;
+		}
+
+		std::string file_id;
+		int64_t start_offset_ms = 0;
+		uint64_t start_at_epoch_us = 0;
+		if(!ParseCurrentSongRequest(response, request_json_str, &file_id, &start_offset_ms, &start_at_epoch_us)) {
+			return;
+		}
+
+		if(start_at_epoch_us != 0) {
+			std::stringstream err_stream;
+			err_stream << "start time cannot be set in prepare request json. the prepared file starts on go";
+			WriteResponseBadRequest(response, err_stream);
+			return;
+		}
+
+		if(file_id.empty()) {
+			std::stringstream err_stream;
+			err_stream << "'file_id' is required in prepare request json";
+			WriteResponseBadRequest(response, err_stream);
+			return;
+		}
+
+		std::stringstream handler_msg;
+		uint32_t play_seq_id = 0;
+		bool success = zone.current_song->PrepareSongRequest(file_id, start_offset_ms, handler_msg, &play_seq_id);
+		WriteCurrentSongResponse(response, zone, success, handler_msg, play_seq_id);
+	}
+
+	void HttpApi::OnPutCurrentSongGo(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request) {
+		// go is handled before anything else, including logging, to keep its latency minimal
+		ZoneActions zone;
+		if(!FindRequestZone(response, request, &zone)) {
+			return;
+		}
+		std::stringstream handler_msg;
+		uint32_t play_seq_id = 0;
+		bool success = zone.current_song->GoRequest(handler_msg, &play_seq_id);
+
+		logger_->info("http received put request for current-song/go");
+		WriteCurrentSongResponse(response, zone, success, handler_msg, play_seq_id);
+	}
+
+	/*
+	Parse the json body of current-song requests.
+	On failure, a bad request response is written, and false is returned.
+	 */
+	bool HttpApi::ParseCurrentSongRequest(
+		std::shared_ptr<HttpServer::Response> response, 
+		const std::string &request_json_str, 
+		std::string *file_id, 
+		int64_t *start_offset_ms,
+		uint64_t *start_at_epoch_us) 
+	{
 		// parse to json
 		json request_json;
 		try {
@@ -89,50 +523,84 @@ namespace wavplayeralsa {
 			std::stringstream err_stream;
 			err_stream << "http request content is not a json string. error msg: '" << e.what() << "'";
 			WriteResponseBadRequest(response, err_stream);
-		    return;
+		    return false;
 		}
 
 		// validate song name
-		std::string file_id;
 		if(request_json.find("file_id") != request_json.end()) {
 			try {
-				file_id = request_json["file_id"].get<std::string>();
+				*file_id = request_json["file_id"].get<std::string>();
 			}
 			catch(json::exception &e) {
 				std::stringstream err_stream;
 				err_stream << "cannot find valid value for 'file_id' in request json. error msg: '" << e.what() << "'";
 				WriteResponseBadRequest(response, err_stream);
-			    return;
+			    return false;
 			}
 		}
 
-		int64_t start_offset_ms = 0;
 		// use it only if it is found in the json
 		if(request_json.find("start_offset_ms") != request_json.end()) {
 			try {
-				start_offset_ms = request_json["start_offset_ms"].get<int64_t>();
+				*start_offset_ms = request_json["start_offset_ms"].get<int64_t>();
 			}
 			catch(json::exception &e) {
 				std::stringstream err_stream;
 				err_stream << "cannot find valid value for 'start_offset_ms' in request json. error msg: '" << e.what() << "'";
 				WriteResponseBadRequest(response, err_stream);
-			    return;
+			    return false;
 			}
 		}
 
-		std::stringstream handler_msg;
-		bool success;
-		uint32_t play_seq_id = 0;
-		if(file_id.empty()) {
-			success = current_song_action_callback_->StopPlayRequest(handler_msg, &play_seq_id);
+		// absolute start time can be given in ms or us since epoch
+		bool has_start_at_ms = (request_json.find("start_at_epoch_ms") != request_json.end());
+		bool has_start_at_us = (request_json.find("start_at_epoch_us") != request_json.end());
+		if(has_start_at_ms && has_start_at_us) {
+			std::stringstream err_stream;
+			err_stream << "only one of 'start_at_epoch_ms' and 'start_at_epoch_us' can be set in request json";
+			WriteResponseBadRequest(response, err_stream);
+			return false;
 		}
-		else {
-			success = current_song_action_callback_->NewSongRequest(file_id, start_offset_ms, handler_msg, &play_seq_id);	
-		} 
+		if(has_start_at_ms || has_start_at_us) {
+			const char *field_name = has_start_at_ms ? "start_at_epoch_ms" : "start_at_epoch_us";
+			int64_t start_at = 0;
+			try {
+				start_at = request_json[field_name].get<int64_t>();
+			}
+			catch(json::exception &e) {
+				std::stringstream err_stream;
+				err_stream << "cannot find valid value for '" << field_name << "' in request json. error msg: '" << e.what() << "'";
+				WriteResponseBadRequest(response, err_stream);
+			    return false;
+			}
+			// compared in the unit of the field, so a huge value does not overflow when converted to us
+			const int64_t units_per_ms = has_start_at_ms ? 1 : 1000;
+			const int64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+				std::chrono::system_clock::now().time_since_epoch()).count();
+			if(start_at <= 0 || start_at / units_per_ms > now_ms + MAX_START_AT_AHEAD_MS) {
+				std::stringstream err_stream;
+				err_stream << "'" << field_name << "' should be a time since epoch, at most " << 
+					MAX_START_AT_AHEAD_MS / 3600000 << " hours from now. got " << start_at;
+				WriteResponseBadRequest(response, err_stream);
+				return false;
+			}
+			*start_at_epoch_us = (uint64_t)start_at * (1000 / units_per_ms);
+		}
+
+		return true;
+	}
 
+	void HttpApi::WriteCurrentSongResponse(
+		std::shared_ptr<HttpServer::Response> response, 
+		const ZoneActions &zone,
+		bool success, 
+		const std::stringstream &handler_msg, 
+		uint32_t play_seq_id)
+	{
 		json response_json;
 		response_json["operation_desc"] = handler_msg.str();
 		response_json["uuid"] = player_uuid_;
+		response_json["zone"] = zone.zone_name;
 		if(play_seq_id > 0)
 		{
 			response_json["play_seq_id"] = play_seq_id;
@@ -144,7 +612,30 @@ namespace wavplayeralsa {
 		else {
 			WriteJsonResponseSuccess(response, response_json);			
 		}
+	}
+
+	void HttpApi::WriteQueueResponse(
+		std::shared_ptr<HttpServer::Response> response, 
+		const ZoneActions &zone,
+		bool success, 
+		const std::stringstream &handler_msg)
+	{
+		const PlayQueueStatus status = zone.play_queue->QueryPlayQueue();
+		json response_json;
+		if(!handler_msg.str().empty()) {
+			response_json["operation_desc"] = handler_msg.str();
+		}
+		response_json["uuid"] = player_uuid_;
+		response_json["zone"] = zone.zone_name;
+		response_json["queue"] = status.file_ids;
+		response_json["next_preloaded"] = status.next_preloaded;
 
+		if(!success) {
+			WriteJsonResponseBadRequest(response, response_json);
+		}
+		else {
+			WriteJsonResponseSuccess(response, response_json);			
+		}
 	}
 
 	void HttpApi::OnWebGet(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request) {
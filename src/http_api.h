@@ -23,13 +23,27 @@ namespace wavplayeralsa {
 			std::shared_ptr<spdlog::logger> logger, 
 			const std::string &player_uuid,
 			boost::asio::io_service *io_service, 
-			CurrentSongActionsIfc *current_song_action_callback, 
+			ZonesActionsIfc *zones_action_callback, 
 			PlayerFilesActionsIfc *player_files_action_callback, 
+			AudioCacheActionsIfc *audio_cache_action_callback,
 			uint16_t http_listen_port);
 
 	private:
+		void OnGetZones(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request);
 		void OnGetAvailableFiles(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request);
 		void OnPutCurrentSong(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request);
+		void OnPutCurrentSongPrepare(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request);
+		void OnPutCurrentSongGo(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request);
+		void OnGetAudioCache(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request);
+		void OnGetXruns(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request);
+		void OnGetAudioDevice(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request);
+		void OnGetQueue(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request);
+		void OnPostQueue(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request);
+		void OnDeleteQueue(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request);
+		void OnGetCues(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request);
+		void OnPostCues(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request);
+		void OnGetVolume(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request);
+		void OnPutVolume(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request);
 		void OnWebGet(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request);
 		void OnServerError(std::shared_ptr<HttpServer::Request> /*request*/, const SimpleWeb::error_code & ec);
 
@@ -39,13 +53,25 @@ namespace wavplayeralsa {
 		void WriteJsonResponseBadRequest(std::shared_ptr<HttpServer::Response> response, const nlohmann::json &body_json);
 		void WriteJsonResponseSuccess(std::shared_ptr<HttpServer::Response> response, const nlohmann::json &body_json);
 
+	private:
+		bool FindRequestZone(std::shared_ptr<HttpServer::Response> response, std::shared_ptr<HttpServer::Request> request, ZoneActions *zone);
+		bool ParseCurrentSongRequest(std::shared_ptr<HttpServer::Response> response, const std::string &request_json_str, std::string *file_id, int64_t *start_offset_ms, uint64_t *start_at_epoch_us);
+		void WriteCurrentSongResponse(std::shared_ptr<HttpServer::Response> response, const ZoneActions &zone, bool success, const std::stringstream &handler_msg, uint32_t play_seq_id);
+		void WriteQueueResponse(std::shared_ptr<HttpServer::Response> response, const ZoneActions &zone, bool success, const std::stringstream &handler_msg);
+		void WriteVolumeResponse(std::shared_ptr<HttpServer::Response> response, const ZoneActions &zone, bool success, const std::stringstream &handler_msg);
+
 	private:
 		// outside configurartion
-		CurrentSongActionsIfc *current_song_action_callback_;
+		ZonesActionsIfc *zones_action_callback_;
 		PlayerFilesActionsIfc *player_files_action_callback_;
+		AudioCacheActionsIfc *audio_cache_action_callback_;
 		std::shared_ptr<spdlog::logger> logger_;
         std::string player_uuid_;
 
+	private:
+		// a start time further in the future is probably a mistake in its unit
+		static const int64_t MAX_START_AT_AHEAD_MS = 24 * 60 * 60 * 1000;
+
 	private:
 		// class private members
 		HttpServer server_;
@@ -6,6 +6,8 @@
 
 namespace wavplayeralsa {
 
+	constexpr const char *MqttApi::CURRENT_SONG_TOPIC;
+
 	MqttApi::MqttApi(boost::asio::io_service &io_service) :
 		io_service_(io_service),
 		reconnect_timer_(io_service)
@@ -20,7 +22,7 @@ namespace wavplayeralsa {
 
 		const char *mqtt_client_id = "wavplayeralsa";
 		logger_->info("creating mqtt connection to host {} on port {} with client id {}", mqtt_host, mqtt_port, mqtt_client_id);
-		logger_->info("will publish current song updates on topic {}", CURRENT_SONG_TOPIC);
+		logger_->info("will publish current song updates on topic {} (or {}/<zone> if zones are configured)", CURRENT_SONG_TOPIC, CURRENT_SONG_TOPIC);
 
     	mqtt_client_ = mqtt::make_sync_client(io_service_, mqtt_host, mqtt_port);
         mqtt_client_->set_client_id(mqtt_client_id);
@@ -34,10 +36,18 @@ namespace wavplayeralsa {
 
 	}
 
-	void MqttApi::ReportCurrentSong(const std::string &json_str)
+	void MqttApi::ReportCurrentSong(const std::string &topic, const std::string &json_str)
+	{
+		last_status_msgs_[topic] = json_str;
+		PublishCurrentSong(topic);
+	}
+
+	std::string MqttApi::CurrentSongTopic(const std::string &zone_name)
 	{
-		last_status_msg_ = json_str;
-		PublishCurrentSong();
+		if(zone_name.empty()) {
+			return CURRENT_SONG_TOPIC;
+		}
+		return std::string(CURRENT_SONG_TOPIC) + "/" + zone_name;
 	}
 
 	void MqttApi::OnError(boost::system::error_code ec)
@@ -61,19 +71,22 @@ namespace wavplayeralsa {
 	bool MqttApi::OnConnAck(bool session_present, std::uint8_t connack_return_code)
 	{
 		logger_->info("connack handler called. clean session: {}. coonack rerturn code: {}", session_present, mqtt::connect_return_code_to_str(connack_return_code));
-		PublishCurrentSong();
+		for(const auto &topic_msg : last_status_msgs_) {
+			PublishCurrentSong(topic_msg.first);
+		}
 		return true;
 	}
 
-	void MqttApi::PublishCurrentSong()
+	void MqttApi::PublishCurrentSong(const std::string &topic)
 	{
 		if(!this->mqtt_client_)
 			return;
 
-		if(last_status_msg_.empty())
+		const std::string &last_status_msg = last_status_msgs_[topic];
+		if(last_status_msg.empty())
 			return;
 
-		this->mqtt_client_->publish_exactly_once(CURRENT_SONG_TOPIC, last_status_msg_, true);
+		this->mqtt_client_->publish_exactly_once(topic, last_status_msg, true);
 	}
 
 }
\ No newline at end of file
@@ -2,6 +2,8 @@
 #define WAVPLAYERALSA_MQTT_API_H_
 
 #include <cstdint>
+#include <string>
+#include <map>
 
 #include <boost/asio.hpp>
 #include <boost/asio/deadline_timer.hpp>
@@ -23,7 +25,11 @@ namespace wavplayeralsa {
 			uint16_t mqtt_port);
 
 	public:
-		void ReportCurrentSong(const std::string &json_str);
+		// the retained message on topic is replaced with json_str
+		void ReportCurrentSong(const std::string &topic, const std::string &json_str);
+
+		// topic for the current song of a zone. an empty zone_name is the player with no zones configured
+		static std::string CurrentSongTopic(const std::string &zone_name);
 
 	private:
 		void OnError(boost::system::error_code ec);
@@ -31,11 +37,11 @@ namespace wavplayeralsa {
 		bool OnConnAck(bool session_present, std::uint8_t connack_return_code);
 
 	private:
-		void PublishCurrentSong();
+		void PublishCurrentSong(const std::string &topic);
 
 	private:
 		const int RECONNECT_WAIT_MS = 2000;
-		const char *CURRENT_SONG_TOPIC = "current-song";
+		static constexpr const char *CURRENT_SONG_TOPIC = "current-song";
 
 	private:
 		// outside services
@@ -46,7 +52,8 @@ namespace wavplayeralsa {
 		std::shared_ptr<mqtt::sync_client<mqtt::tcp_endpoint<mqtt::as::ip::tcp::socket, mqtt::as::io_service::strand>>> mqtt_client_ = nullptr;
 		boost::asio::deadline_timer reconnect_timer_;
 
-		std::string last_status_msg_;
+		// last status message of each topic
+		std::map<std::string, std::string> last_status_msgs_;
 	};
 
 }
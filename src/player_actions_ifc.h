@@ -5,6 +5,7 @@
 #include <cstdint>
 #include <sstream>
 #include <list>
+#include <vector>
 
 /*
 This interface describe the actions that can be performed on the player externally
@@ -16,12 +17,28 @@ namespace wavplayeralsa {
 	
 	public:
 
+		// start_at_epoch_us is the wall clock time (micro-seconds since epoch) at which start_offset_ms
+		// should be audible. 0 means start now
 		virtual bool NewSongRequest(
 			const std::string &file_id, 
 			int64_t start_offset_ms, 
+			uint64_t start_at_epoch_us,
 			std::stringstream &out_msg,
 			uint32_t *play_seq_id) = 0;
 
+		// load the file and fill the audio device buffer from start_offset_ms,
+		// but do not start playing until GoRequest
+		virtual bool PrepareSongRequest(
+			const std::string &file_id, 
+			int64_t start_offset_ms, 
+			std::stringstream &out_msg,
+			uint32_t *play_seq_id) = 0;
+
+		// start playing the prepared file
+		virtual bool GoRequest(
+			std::stringstream &out_msg, 
+			uint32_t *play_seq_id) = 0;
+
 		virtual bool StopPlayRequest(
 			std::stringstream &out_msg, 
 			uint32_t *play_seq_id) = 0;
@@ -34,6 +51,174 @@ namespace wavplayeralsa {
 
 	};
 
+	struct AudioCacheStats {
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		uint64_t resident_bytes = 0;
+		uint64_t budget_bytes = 0;
+		uint32_t entries = 0;
+	};
+
+	class AudioCacheActionsIfc {
+
+	public:
+		virtual AudioCacheStats QueryAudioCacheStats() = 0;
+
+	};
+
+	struct XrunEvent {
+		uint64_t time_ms_since_epoch = 0; // when the xrun happened
+		uint64_t duration_us = 0; // from the xrun until the audio device was recovered
+	};
+
+	struct XrunStats {
+		uint64_t count = 0;
+		uint64_t total_duration_us = 0;
+		uint64_t max_duration_us = 0;
+		std::vector<XrunEvent> recent; // oldest first
+	};
+
+	class XrunStatsActionsIfc {
+
+	public:
+		virtual XrunStats QueryXrunStats() = 0;
+
+	};
+
+	// files to play after the current one
+	struct PlayQueueStatus {
+		std::list<std::string> file_ids; // in play order
+		// the first file is already opened by the playback service, and will be played gapless after the current one
+		bool next_preloaded = false;
+	};
+
+	class PlayQueueActionsIfc {
+
+	public:
+		// insert file_id to the queue before position index. a negative index (or past the end) appends it
+		virtual bool QueueInsertRequest(
+			const std::string &file_id,
+			int64_t index,
+			std::stringstream &out_msg) = 0;
+
+		virtual bool QueueClearRequest(
+			std::stringstream &out_msg) = 0;
+
+		virtual PlayQueueStatus QueryPlayQueue() = 0;
+
+	};
+
+	// short sounds played on top of the current song
+	class CueActionsIfc {
+
+	public:
+		// play cue_id once, mixed into the playing song. gain_db is relative to the cue file level
+		virtual bool TriggerCueRequest(
+			const std::string &cue_id,
+			double gain_db,
+			std::stringstream &out_msg) = 0;
+
+		virtual std::list<std::string> QueryCues() = 0;
+
+	};
+
+	struct VolumeStatus {
+		double zone_gain_db = 0.0;
+		double track_gain_db = 0.0; // gain of the track which is playing. reset to 0 when another track starts
+		bool muted = false;
+	};
+
+	// software volume of a zone, for devices with no mixer control.
+	// gains change with a ramp of ramp_ms, so the change is not heard as a click
+	class VolumeActionsIfc {
+
+	public:
+		// gain of everything played on the zone, kept across tracks
+		virtual bool SetZoneGainRequest(
+			double gain_db,
+			int64_t ramp_ms,
+			std::stringstream &out_msg) = 0;
+
+		// gain of the track which is playing. the ramp starts at at_position_ms in the track, or right away if it is negative
+		virtual bool SetTrackGainRequest(
+			double gain_db,
+			int64_t ramp_ms,
+			int64_t at_position_ms,
+			std::stringstream &out_msg) = 0;
+
+		virtual bool SetMuteRequest(
+			bool muted,
+			int64_t ramp_ms,
+			std::stringstream &out_msg) = 0;
+
+		virtual VolumeStatus QueryVolume() = 0;
+
+	};
+
+	// an extra audio device which plays the same audio as the main device of a zone
+	struct MirrorDeviceStatus {
+		std::string device;
+		bool playing = false;
+		// time difference in playing the same frame. positive if the device plays behind the main device
+		int64_t offset_us = 0;
+		// clock drift relative to the main device, as measured while playing
+		double drift_ppm = 0.0;
+		// output frames per input frame, which keeps the device in sync
+		double resample_ratio = 1.0;
+		// large offsets which were corrected by padding silence or dropping frames
+		uint64_t realigns = 0;
+		uint64_t xruns = 0;
+		std::string error; // the last error which stopped the device. empty if none
+	};
+
+	// buffer params as negotiated with the audio device
+	struct AudioDeviceStatus {
+		std::string device;
+		bool configured = false; // false until the first file is played
+		bool mmap_access = false;
+		unsigned int frame_rate = 0;
+		unsigned int num_of_channels = 0;
+		uint64_t buffer_size_frames = 0;
+		uint64_t period_size_frames = 0;
+		unsigned int buffer_time_us = 0;
+		unsigned int period_time_us = 0;
+		unsigned int periods = 0;
+		// frames read ahead of the audio device. see AudioRingMetrics
+		uint64_t ring_capacity_frames = 0;
+		uint64_t ring_fill_frames = 0;
+		uint64_t ring_min_fill_frames = 0;
+		uint64_t ring_underruns = 0;
+		std::vector<MirrorDeviceStatus> mirrors;
+	};
+
+	class AudioDeviceActionsIfc {
+
+	public:
+		virtual AudioDeviceStatus QueryAudioDeviceStatus() = 0;
+
+	};
+
+	// the actions of a single zone (player on its own audio device)
+	struct ZoneActions {
+		std::string zone_name;
+		CurrentSongActionsIfc *current_song = nullptr;
+		PlayQueueActionsIfc *play_queue = nullptr;
+		XrunStatsActionsIfc *xrun_stats = nullptr;
+		AudioDeviceActionsIfc *audio_device = nullptr;
+		CueActionsIfc *cues = nullptr;
+		VolumeActionsIfc *volume = nullptr;
+	};
+
+	class ZonesActionsIfc {
+
+	public:
+		// an empty zone_name finds the default zone. returns false if there is no zone with this name
+		virtual bool FindZone(const std::string &zone_name, ZoneActions *out_zone) = 0;
+
+		virtual std::list<std::string> QueryZones() = 0;
+
+	};
+
 }
 
 
@@ -14,12 +14,21 @@ namespace wavplayeralsa {
 
 	public:
 
-		virtual void NewSongStatus(const std::string &file_id, uint32_t play_seq_id, uint64_t start_time_millis_since_epoch, double speed) = 0;
+		virtual void NewSongStatus(const std::string &file_id, uint32_t play_seq_id, uint64_t start_time_micros_since_epoch, double speed) = 0;
 		virtual void NoSongPlayingStatus(const std::string &file_id, uint32_t play_seq_id) = 0;
 
 
 	};
 
+	// receives the status messages of the zones, as they are published to the clients
+	class StatusMessagesListenerIfc {
+
+	public:
+
+		virtual void OnStatusMessage(const std::string &zone_name, const std::string &json_str) = 0;
+
+	};
+
 
 }
 
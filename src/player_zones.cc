@@ -0,0 +1,133 @@
+#include "player_zones.h"
+
+namespace wavplayeralsa {
+
+	PlayerZone::PlayerZone(boost::asio::io_service &io_service, MqttApi *mqtt_service, WebSocketsApi *ws_service) :
+		current_song_controller_(
+			io_service,
+			mqtt_service,
+			ws_service,
+			&alsa_playback_service_factory_)
+	{
+
+	}
+
+	static AlsaPcmBufferConfig ToAlsaBufferConfig(const AudioDeviceConfig &device)
+	{
+		AlsaPcmBufferConfig buffer_config;
+		buffer_config.buffer_time_us = device.buffer_time_us;
+		buffer_config.period_time_us = device.period_time_us;
+		buffer_config.periods = device.periods;
+		return buffer_config;
+	}
+
+	void PlayerZone::Initialize(
+		std::shared_ptr<spdlog::logger> logger,
+		const ConfigService &config,
+		const std::string &zone_name,
+		const std::string &audio_device,
+		const std::string &status_topic,
+		const std::string &player_uuid,
+		AudioCache *audio_cache,
+		const CueSoundBank *cue_sound_bank,
+		RenderClock *render_clock,
+		StatusMessagesListenerIfc *status_listener)
+	{
+		name_ = zone_name;
+		logger->info("initializing zone '{}' on audio device '{}'. status is published on mqtt topic '{}'", zone_name, audio_device, status_topic);
+
+		// 'main+mirror1+mirror2' plays the same audio on all the devices, in sync with the main one.
+		// each device can have its own buffer size
+		std::vector<AudioDeviceConfig> devices = config.GetAudioDevices(audio_device);
+		std::vector<MirrorDeviceConfig> mirror_devices;
+		for(size_t i = 1; i < devices.size(); i++) {
+			MirrorDeviceConfig mirror_device;
+			mirror_device.audio_device = devices[i].audio_device;
+			mirror_device.buffer_config = ToAlsaBufferConfig(devices[i]);
+			mirror_devices.push_back(mirror_device);
+		}
+
+		cue_mixer_.Initialize(logger->clone("cue_mixer." + zone_name), cue_sound_bank);
+		volume_control_.Initialize(logger->clone("volume_control." + zone_name));
+
+		// controllers
+		current_song_controller_.Initialize(player_uuid, config.GetWavDir(), zone_name, status_topic, status_listener);
+
+		// services
+		alsa_playback_service_factory_.Initialize(
+			logger->clone("alsa_playback_service_factory." + zone_name),
+			&current_song_controller_,
+			audio_cache,
+			&cue_mixer_,
+			&volume_control_,
+			devices[0].audio_device,
+			mirror_devices,
+			render_clock,
+			config.UseMmapAccess(),
+			config.GetAlsaTstampType(),
+			ToAlsaBufferConfig(devices[0]),
+			config.GetAudioRingMs(),
+			config.GetPositionReportErrorUs(),
+			config.UseDriftCompensation(),
+			config.GetCrossfadeMs(),
+			config.GetCrossfadeCurve(),
+			config.GetAudioThreadRtPriority(),
+			config.GetAudioThreadCpu()
+		);
+	}
+
+	ZoneActions PlayerZone::GetActions()
+	{
+		ZoneActions actions;
+		actions.zone_name = name_;
+		actions.current_song = &current_song_controller_;
+		actions.play_queue = &current_song_controller_;
+		actions.xrun_stats = &alsa_playback_service_factory_;
+		actions.audio_device = &alsa_playback_service_factory_;
+		actions.cues = &cue_mixer_;
+		actions.volume = &volume_control_;
+		return actions;
+	}
+
+	void PlayerZones::Add(std::unique_ptr<PlayerZone> zone)
+	{
+		zones_.push_back(std::move(zone));
+	}
+
+	PlayerZone *PlayerZones::GetDefaultZone()
+	{
+		if(zones_.empty()) {
+			return nullptr;
+		}
+		return zones_.front().get();
+	}
+
+	bool PlayerZones::FindZone(const std::string &zone_name, ZoneActions *out_zone)
+	{
+		if(zone_name.empty()) {
+			if(zones_.empty()) {
+				return false;
+			}
+			*out_zone = zones_.front()->GetActions();
+			return true;
+		}
+
+		for(const std::unique_ptr<PlayerZone> &zone : zones_) {
+			if(zone->GetName() == zone_name) {
+				*out_zone = zone->GetActions();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	std::list<std::string> PlayerZones::QueryZones()
+	{
+		std::list<std::string> zone_names;
+		for(const std::unique_ptr<PlayerZone> &zone : zones_) {
+			zone_names.push_back(zone->GetName());
+		}
+		return zone_names;
+	}
+
+}
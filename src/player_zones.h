@@ -0,0 +1,87 @@
+#ifndef WAVPLAYERALSA_PLAYER_ZONES_H_
+#define WAVPLAYERALSA_PLAYER_ZONES_H_
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <list>
+
+#include <boost/asio.hpp>
+#include "spdlog/spdlog.h"
+
+#include "player_actions_ifc.h"
+#include "current_song_controller.h"
+#include "mqtt_api.h"
+#include "web_sockets_api.h"
+#include "services/alsa_service.h"
+#include "services/audio_cache.h"
+#include "services/config_service.h"
+#include "services/cue_mixer.h"
+#include "services/volume_control.h"
+#include "services/render_clock.h"
+
+namespace wavplayeralsa {
+
+	/*
+	A player on a single audio device: the playback services for the device (with their own audio threads),
+	the controller which decides what is played, with its own play_seq_id and status, the cues mixed into it, and its volume.
+	The network apis, the audio files and the audio cache are shared by all the zones.
+	*/
+	class PlayerZone {
+
+	public:
+		PlayerZone(boost::asio::io_service &io_service, MqttApi *mqtt_service, WebSocketsApi *ws_service);
+
+		// will throw std::runtime_error in case of error
+		void Initialize(
+			std::shared_ptr<spdlog::logger> logger,
+			const ConfigService &config,
+			const std::string &zone_name,
+			const std::string &audio_device,
+			const std::string &status_topic,
+			const std::string &player_uuid,
+			AudioCache *audio_cache,
+			const CueSoundBank *cue_sound_bank,
+			RenderClock *render_clock,
+			StatusMessagesListenerIfc *status_listener);
+
+	public:
+		const std::string &GetName() const { return name_; }
+		ZoneActions GetActions();
+		CurrentSongController &GetCurrentSongController() { return current_song_controller_; }
+
+	private:
+		std::string name_;
+		AlsaPlaybackServiceFactory alsa_playback_service_factory_;
+		CueMixer cue_mixer_;
+		VolumeControl volume_control_;
+		CurrentSongController current_song_controller_;
+
+	};
+
+	/*
+	All the zones of the player, by name. The first zone is the default one, for requests with no zone.
+	Zones are added on initialization only, and are not changed after it.
+	*/
+	class PlayerZones :
+		public ZonesActionsIfc
+	{
+
+	public:
+		void Add(std::unique_ptr<PlayerZone> zone);
+		// nullptr if no zone was added
+		PlayerZone *GetDefaultZone();
+
+	public:
+		// ZonesActionsIfc
+		bool FindZone(const std::string &zone_name, ZoneActions *out_zone);
+		std::list<std::string> QueryZones();
+
+	private:
+		std::vector<std::unique_ptr<PlayerZone>> zones_;
+
+	};
+
+}
+
+#endif // WAVPLAYERALSA_PLAYER_ZONES_H_
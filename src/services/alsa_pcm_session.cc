@@ -0,0 +1,519 @@
+#include "services/alsa_pcm_session.h"
+
+#include <sstream>
+#include <chrono>
+#include <algorithm>
+#include <cerrno>
+
+namespace wavplayeralsa
+{
+
+	AlsaPcmSession::~AlsaPcmSession()
+	{
+		Close();
+	}
+
+	void AlsaPcmSession::Initialize(
+			std::shared_ptr<spdlog::logger> logger,
+			const std::string &audio_device,
+			bool use_mmap_access,
+			const std::string &tstamp_type,
+			const AlsaPcmBufferConfig &buffer_config
+		)
+	{
+		logger_ = logger;
+		audio_device_ = audio_device;
+		use_mmap_access_ = use_mmap_access;
+		tstamp_type_ = tstamp_type;
+		buffer_config_ = buffer_config;
+		status_.device = audio_device;
+	}
+
+	AudioDeviceStatus AlsaPcmSession::QueryStatus()
+	{
+		std::lock_guard<std::mutex> guard(status_mutex_);
+		return status_;
+	}
+
+	/*
+	Test the params against the configuration space of the device, without installing them.
+	The params which are already configured are known to be supported, so the common case
+	(same format as the previous stream) does not query the device.
+	*/
+	bool AlsaPcmSession::IsStreamParamsSupported(const AlsaPcmStreamParams &params)
+	{
+		if(has_params_ && params == curr_params_) {
+			return true;
+		}
+		if(alsa_playback_handle_ == nullptr) {
+			Open();
+		}
+
+		int err;
+		snd_pcm_hw_params_t *hw_params;
+		if( (err = snd_pcm_hw_params_malloc(&hw_params)) < 0 ) {
+			std::stringstream err_desc;
+			err_desc << "cannot allocate hardware parameter structure (" << snd_strerror(err) << ")";
+			throw std::runtime_error(err_desc.str());
+		}
+		std::unique_ptr<snd_pcm_hw_params_t, decltype(&snd_pcm_hw_params_free)> hw_params_guard(hw_params, &snd_pcm_hw_params_free);
+
+		if( (err = snd_pcm_hw_params_any(alsa_playback_handle_, hw_params)) < 0) {
+			std::stringstream err_desc;
+			err_desc << "cannot initialize hardware parameter structure (" << snd_strerror(err) << ")";
+			throw std::runtime_error(err_desc.str());
+		}
+
+		// each set narrows the space, so the params are tested together
+		bool access_supported = 
+			(use_mmap_access_ && snd_pcm_hw_params_test_access(alsa_playback_handle_, hw_params, SND_PCM_ACCESS_MMAP_INTERLEAVED) == 0) ||
+			snd_pcm_hw_params_test_access(alsa_playback_handle_, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED) == 0;
+		return access_supported && 
+			snd_pcm_hw_params_set_format(alsa_playback_handle_, hw_params, params.format) == 0 &&
+			snd_pcm_hw_params_set_channels(alsa_playback_handle_, hw_params, params.num_of_channels) == 0 &&
+			snd_pcm_hw_params_set_rate(alsa_playback_handle_, hw_params, params.frame_rate, 0) == 0;
+	}
+
+	void AlsaPcmSession::StartStream(const AlsaPcmStreamParams &params)
+	{
+		auto start_time = std::chrono::steady_clock::now();
+
+		bool renegotiated = false;
+		try {
+			if(alsa_playback_handle_ == nullptr) {
+				Open();
+			}
+
+			if(!has_params_ || params != curr_params_) {
+				// drop moves the pcm to SETUP state, in which new hw params can be installed
+				if(has_params_) {
+					Drop();
+				}
+				SetHwParams(params);
+				SetSwParams();
+				renegotiated = true;
+			}
+			else {
+				Drop();
+			}
+
+			Prepare();
+		}
+		catch(const std::runtime_error &e) {
+			// the device is in unknown state. close it so that the next stream
+			// will start from a freshly opened device
+			Close();
+			throw;
+		}
+
+		auto duration_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_time).count();
+		logger_->info("pcm ready for new stream in {} us (hw params renegotiated: {})", duration_us, (renegotiated ? "yes" : "no"));
+	}
+
+	void AlsaPcmSession::DropAndPrepare()
+	{
+		Drop();
+		Prepare();
+	}
+
+	void AlsaPcmSession::Drop()
+	{
+		int err;
+		if( (err = snd_pcm_drop(alsa_playback_handle_)) < 0 ) {
+			std::stringstream err_desc;
+			err_desc << "snd_pcm_drop failed (" << snd_strerror(err) << ")";
+			throw std::runtime_error(err_desc.str());
+		}
+	}
+
+	int AlsaPcmSession::Start()
+	{
+		return snd_pcm_start(alsa_playback_handle_);
+	}
+
+	snd_pcm_state_t AlsaPcmSession::GetState()
+	{
+		return snd_pcm_state(alsa_playback_handle_);
+	}
+
+	snd_pcm_sframes_t AlsaPcmSession::AvailUpdate()
+	{
+		return snd_pcm_avail_update(alsa_playback_handle_);
+	}
+
+	int AlsaPcmSession::GetDelay(snd_pcm_sframes_t *delay)
+	{
+		return snd_pcm_delay(alsa_playback_handle_, delay);
+	}
+
+	snd_pcm_sframes_t AlsaPcmSession::Write(const void *buffer, snd_pcm_uframes_t frames)
+	{
+		return snd_pcm_writei(alsa_playback_handle_, buffer, frames);
+	}
+
+	int AlsaPcmSession::MmapBegin(const snd_pcm_channel_area_t **areas, snd_pcm_uframes_t *offset, snd_pcm_uframes_t *frames)
+	{
+		return snd_pcm_mmap_begin(alsa_playback_handle_, areas, offset, frames);
+	}
+
+	snd_pcm_sframes_t AlsaPcmSession::MmapCommit(snd_pcm_uframes_t offset, snd_pcm_uframes_t frames)
+	{
+		return snd_pcm_mmap_commit(alsa_playback_handle_, offset, frames);
+	}
+
+	std::vector<struct pollfd> AlsaPcmSession::GetPollDescriptors() const
+	{
+		int count = snd_pcm_poll_descriptors_count(alsa_playback_handle_);
+		if(count <= 0) {
+			std::stringstream err_desc;
+			err_desc << "cannot get number of pcm poll descriptors (" << snd_strerror(count) << ")";
+			throw std::runtime_error(err_desc.str());
+		}
+
+		std::vector<struct pollfd> poll_fds(count);
+		int err;
+		if( (err = snd_pcm_poll_descriptors(alsa_playback_handle_, poll_fds.data(), poll_fds.size())) < 0) {
+			std::stringstream err_desc;
+			err_desc << "cannot get pcm poll descriptors (" << snd_strerror(err) << ")";
+			throw std::runtime_error(err_desc.str());
+		}
+		poll_fds.resize(err);
+		return poll_fds;
+	}
+
+	unsigned short AlsaPcmSession::GetPollRevents(std::vector<struct pollfd> &poll_fds)
+	{
+		unsigned short revents = 0;
+		int err;
+		if( (err = snd_pcm_poll_descriptors_revents(alsa_playback_handle_, poll_fds.data(), poll_fds.size(), &revents)) < 0) {
+			std::stringstream err_desc;
+			err_desc << "cannot get pcm poll revents (" << snd_strerror(err) << ")";
+			throw std::runtime_error(err_desc.str());
+		}
+		return revents;
+	}
+
+	/*
+	The pcm status of a stopped (xrun) pcm holds the time at which it stopped, 
+	so the duration of the xrun is known when it is recovered.
+	*/
+	uint64_t AlsaPcmSession::RecoverXrun(int err)
+	{
+		int64_t xrun_tstamp_us = 0;
+		snd_pcm_status_t *status;
+		snd_pcm_status_alloca(&status);
+		if(snd_pcm_status(alsa_playback_handle_, status) == 0) {
+			snd_htimestamp_t trigger_tstamp;
+			snd_pcm_status_get_trigger_htstamp(status, &trigger_tstamp);
+			xrun_tstamp_us = (int64_t)trigger_tstamp.tv_sec * 1000000 + trigger_tstamp.tv_nsec / 1000;
+		}
+
+		int recover_err;
+		if( (recover_err = snd_pcm_recover(alsa_playback_handle_, err, 1)) < 0) {
+			std::stringstream err_desc;
+			err_desc << "cannot recover pcm from " << (err == -ESTRPIPE ? "suspend" : "xrun") << " (" << snd_strerror(recover_err) << ")";
+			throw std::runtime_error(err_desc.str());
+		}
+
+		struct timespec tstamp_now, epoch_now;
+		clock_gettime(tstamp_clock_id_, &tstamp_now);
+		clock_gettime(CLOCK_REALTIME, &epoch_now);
+		int64_t tstamp_now_us = (int64_t)tstamp_now.tv_sec * 1000000 + tstamp_now.tv_nsec / 1000;
+		int64_t epoch_now_us = (int64_t)epoch_now.tv_sec * 1000000 + epoch_now.tv_nsec / 1000;
+		int64_t duration_us = (xrun_tstamp_us > 0 && xrun_tstamp_us <= tstamp_now_us) ? (tstamp_now_us - xrun_tstamp_us) : 0;
+
+		XrunEvent xrun;
+		xrun.time_ms_since_epoch = (epoch_now_us - duration_us) / 1000;
+		xrun.duration_us = duration_us;
+		xrun_stats_.Record(xrun);
+
+		logger_->warn("recovered pcm from {}. duration {} us", (err == -ESTRPIPE ? "suspend" : "xrun"), duration_us);
+		return xrun.duration_us;
+	}
+
+	XrunStats AlsaPcmSession::QueryXrunStats()
+	{
+		return xrun_stats_.Query();
+	}
+
+	AlsaPcmPositionSnapshot AlsaPcmSession::GetPositionSnapshot()
+	{
+		snd_pcm_status_t *status;
+		snd_pcm_status_alloca(&status);
+
+		int err;
+		if( (err = snd_pcm_status(alsa_playback_handle_, status)) < 0) {
+			std::stringstream err_desc;
+			err_desc << "cannot query pcm status (" << snd_strerror(err) << ")";
+			throw std::runtime_error(err_desc.str());
+		}
+
+		snd_htimestamp_t tstamp;
+		snd_pcm_status_get_htstamp(status, &tstamp);
+
+		AlsaPcmPositionSnapshot snapshot;
+		snapshot.state = snd_pcm_status_get_state(status);
+		snapshot.delay = snd_pcm_status_get_delay(status);
+		snapshot.tstamp_us = (int64_t)tstamp.tv_sec * 1000000 + tstamp.tv_nsec / 1000;
+		return snapshot;
+	}
+
+	void AlsaPcmSession::Open()
+	{
+		int err;
+		if( (err = snd_pcm_open(&alsa_playback_handle_, audio_device_.c_str(), SND_PCM_STREAM_PLAYBACK, 0)) < 0) {
+			alsa_playback_handle_ = nullptr;
+			std::stringstream err_desc;
+			err_desc << "cannot open audio device " << audio_device_ << " (" << snd_strerror(err) << ")";
+			throw std::runtime_error(err_desc.str());
+		}
+		has_params_ = false;
+		logger_->info("opened audio device '{}'", audio_device_);
+	}
+
+	void AlsaPcmSession::Close()
+	{
+		if(alsa_playback_handle_ != nullptr) {
+			snd_pcm_close(alsa_playback_handle_);
+			alsa_playback_handle_ = nullptr;
+		}
+		has_params_ = false;
+		std::lock_guard<std::mutex> guard(status_mutex_);
+		status_.configured = false;
+	}
+
+	/*
+	Negotiate the hw params of the pcm according to the params of the stream.
+	throw std::runtime_error in case of error
+	 */
+	void AlsaPcmSession::SetHwParams(const AlsaPcmStreamParams &params)
+	{
+		int err;
+		std::stringstream err_desc;
+
+		has_params_ = false;
+
+		snd_pcm_hw_params_t *hw_params;
+
+		if( (err = snd_pcm_hw_params_malloc(&hw_params)) < 0 ) {
+			err_desc << "cannot allocate hardware parameter structure (" << snd_strerror(err) << ")";
+			throw std::runtime_error(err_desc.str());
+		}
+		std::unique_ptr<snd_pcm_hw_params_t, decltype(&snd_pcm_hw_params_free)> hw_params_guard(hw_params, &snd_pcm_hw_params_free);
+
+		if( (err = snd_pcm_hw_params_any(alsa_playback_handle_, hw_params)) < 0) {
+			err_desc << "cannot initialize hardware parameter structure (" << snd_strerror(err) << ")";
+			throw std::runtime_error(err_desc.str());
+		}
+
+		mmap_access_ = false;
+		if(use_mmap_access_) {
+			if( (err = snd_pcm_hw_params_set_access(alsa_playback_handle_, hw_params, SND_PCM_ACCESS_MMAP_INTERLEAVED)) < 0) {
+				logger_->warn("audio device does not support mmap access ({}). falling back to read-write access", snd_strerror(err));
+			}
+			else {
+				mmap_access_ = true;
+			}
+		}
+
+		if(!mmap_access_) {
+			if( (err = snd_pcm_hw_params_set_access(alsa_playback_handle_, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0) {
+				err_desc << "cannot set access type (" << snd_strerror(err) << ")";
+				throw std::runtime_error(err_desc.str());
+			}
+		}
+
+		if( (err = snd_pcm_hw_params_set_format(alsa_playback_handle_, hw_params, params.format)) < 0) {
+			err_desc << "cannot set sample format (" << snd_strerror(err) << ")";
+			throw std::runtime_error(err_desc.str());
+		}
+
+		if( (err = snd_pcm_hw_params_set_rate(alsa_playback_handle_, hw_params, params.frame_rate, 0)) < 0) {
+			err_desc << "cannot set sample rate (" << snd_strerror(err) << ")";
+			throw std::runtime_error(err_desc.str());
+		}
+
+		if( (err = snd_pcm_hw_params_set_channels(alsa_playback_handle_, hw_params, params.num_of_channels)) < 0) {
+			err_desc << "cannot set channel count (" << snd_strerror(err) << ")";
+			throw std::runtime_error(err_desc.str());
+		}
+
+		SetBufferParams(hw_params);
+
+		if( (err = snd_pcm_hw_params(alsa_playback_handle_, hw_params)) < 0) {
+			err_desc << "cannot set alsa hw parameters (" << snd_strerror(err) << ")";
+			throw std::runtime_error(err_desc.str());
+		}
+
+		if( (err = snd_pcm_hw_params_get_period_size(hw_params, &period_size_, nullptr)) < 0) {
+			err_desc << "cannot get period size (" << snd_strerror(err) << ")";
+			throw std::runtime_error(err_desc.str());
+		}
+
+		curr_params_ = params;
+		has_params_ = true;
+		UpdateStatus(hw_params);
+	}
+
+	/*
+	Request the configured buffer and period times. The buffer time is set first, 
+	so the period is chosen to fit in it.
+	The device rounds the values to what it supports, and the negotiated values are 
+	reported after the hw params are installed.
+	 */
+	void AlsaPcmSession::SetBufferParams(snd_pcm_hw_params_t *hw_params)
+	{
+		int err;
+		std::stringstream err_desc;
+
+		if(buffer_config_.buffer_time_us > 0) {
+			unsigned int buffer_time_us = buffer_config_.buffer_time_us;
+			if( (err = snd_pcm_hw_params_set_buffer_time_near(alsa_playback_handle_, hw_params, &buffer_time_us, nullptr)) < 0) {
+				err_desc << "cannot set buffer time " << buffer_config_.buffer_time_us << " us (" << snd_strerror(err) << ")";
+				throw std::runtime_error(err_desc.str());
+			}
+		}
+
+		if(buffer_config_.period_time_us > 0) {
+			unsigned int period_time_us = buffer_config_.period_time_us;
+			if( (err = snd_pcm_hw_params_set_period_time_near(alsa_playback_handle_, hw_params, &period_time_us, nullptr)) < 0) {
+				err_desc << "cannot set period time " << buffer_config_.period_time_us << " us (" << snd_strerror(err) << ")";
+				throw std::runtime_error(err_desc.str());
+			}
+		}
+		else if(buffer_config_.periods > 0) {
+			unsigned int periods = buffer_config_.periods;
+			if( (err = snd_pcm_hw_params_set_periods_near(alsa_playback_handle_, hw_params, &periods, nullptr)) < 0) {
+				err_desc << "cannot set number of periods " << buffer_config_.periods << " (" << snd_strerror(err) << ")";
+				throw std::runtime_error(err_desc.str());
+			}
+		}
+	}
+
+	void AlsaPcmSession::UpdateStatus(snd_pcm_hw_params_t *hw_params)
+	{
+		AudioDeviceStatus status;
+		status.device = audio_device_;
+		status.configured = true;
+		status.mmap_access = mmap_access_;
+		status.frame_rate = curr_params_.frame_rate;
+		status.num_of_channels = curr_params_.num_of_channels;
+		status.period_size_frames = period_size_;
+
+		// these are only reported, so failing to query them is not an error
+		snd_pcm_uframes_t buffer_size = 0;
+		snd_pcm_hw_params_get_buffer_size(hw_params, &buffer_size);
+		status.buffer_size_frames = buffer_size;
+		snd_pcm_hw_params_get_buffer_time(hw_params, &status.buffer_time_us, nullptr);
+		snd_pcm_hw_params_get_period_time(hw_params, &status.period_time_us, nullptr);
+		snd_pcm_hw_params_get_periods(hw_params, &status.periods, nullptr);
+
+		logger_->info("negotiated pcm buffer of {} frames ({} us) in {} periods of {} frames ({} us)", 
+			status.buffer_size_frames, status.buffer_time_us, status.periods, status.period_size_frames, status.period_time_us);
+
+		std::lock_guard<std::mutex> guard(status_mutex_);
+		status_ = status;
+	}
+
+	void AlsaPcmSession::SetSwParams()
+	{
+		int err;
+		std::stringstream err_desc;
+
+		snd_pcm_sw_params_t *sw_params;
+
+		if( (err = snd_pcm_sw_params_malloc(&sw_params)) < 0) {
+			err_desc << "cannot allocate software parameters structure (" << snd_strerror(err) << ")";
+			throw std::runtime_error(err_desc.str());
+		}
+		std::unique_ptr<snd_pcm_sw_params_t, decltype(&snd_pcm_sw_params_free)> sw_params_guard(sw_params, &snd_pcm_sw_params_free);
+
+		if( (err = snd_pcm_sw_params_current(alsa_playback_handle_, sw_params)) < 0) {
+			err_desc << "cannot initialize software parameters structure (" << snd_strerror(err) << ")";
+			throw std::runtime_error(err_desc.str());
+		}
+
+		// how many frames should be in the buffer before alsa start to play it.
+		// we set it to the boundary -> pcm is never started automatically.
+		// the playback service starts it explicitly, which allows preparing a stream, and starting it later.
+		snd_pcm_uframes_t boundary;
+		if( (err = snd_pcm_sw_params_get_boundary(sw_params, &boundary)) < 0) {
+			err_desc << "cannot get boundary (" << snd_strerror(err) << ")";
+			throw std::runtime_error(err_desc.str());
+		}
+		if( (err = snd_pcm_sw_params_set_start_threshold(alsa_playback_handle_, sw_params, boundary)) < 0) {
+			err_desc << "cannot set start mode (" << snd_strerror(err) << ")";
+			throw std::runtime_error(err_desc.str());
+		}
+
+		SetTimestampType(sw_params);
+
+		// poll descriptors wake up the transfer loop when a full period can be written
+		if( (err = snd_pcm_sw_params_set_avail_min(alsa_playback_handle_, sw_params, period_size_)) < 0) {
+			err_desc << "cannot set avail min (" << snd_strerror(err) << ")";
+			throw std::runtime_error(err_desc.str());
+		}
+
+		if( (err = snd_pcm_sw_params(alsa_playback_handle_, sw_params)) < 0) {
+			err_desc << "cannot set software parameters (" << snd_strerror(err) << ")";
+			throw std::runtime_error(err_desc.str());
+		}
+	}
+
+	/*
+	Enable timestamps in the pcm status, so the delay is reported with the time at which 
+	the hw pointer was updated. 
+	The configured clock is used if the driver supports it. otherwise fall back to a clock
+	which it supports (monotonic_raw -> monotonic -> gettimeofday).
+	 */
+	void AlsaPcmSession::SetTimestampType(snd_pcm_sw_params_t *sw_params)
+	{
+		int err;
+		std::stringstream err_desc;
+
+		if( (err = snd_pcm_sw_params_set_tstamp_mode(alsa_playback_handle_, sw_params, SND_PCM_TSTAMP_ENABLE)) < 0) {
+			err_desc << "cannot enable timestamps (" << snd_strerror(err) << ")";
+			throw std::runtime_error(err_desc.str());
+		}
+
+		struct TstampType {
+			const char *name;
+			snd_pcm_tstamp_type_t type;
+			clockid_t clock_id;
+		};
+		static const TstampType tstamp_types[] = {
+			{ "monotonic_raw", SND_PCM_TSTAMP_TYPE_MONOTONIC_RAW, CLOCK_MONOTONIC_RAW },
+			{ "monotonic", SND_PCM_TSTAMP_TYPE_MONOTONIC, CLOCK_MONOTONIC },
+			{ "gettimeofday", SND_PCM_TSTAMP_TYPE_GETTIMEOFDAY, CLOCK_REALTIME }
+		};
+		static const size_t num_of_tstamp_types = sizeof(tstamp_types) / sizeof(tstamp_types[0]);
+
+		size_t i = 0;
+		while(i < num_of_tstamp_types && tstamp_type_ != tstamp_types[i].name) {
+			i++;
+		}
+		for(; i < num_of_tstamp_types; i++) {
+			if( (err = snd_pcm_sw_params_set_tstamp_type(alsa_playback_handle_, sw_params, tstamp_types[i].type)) < 0) {
+				logger_->warn("audio device does not support '{}' timestamps ({})", tstamp_types[i].name, snd_strerror(err));
+				continue;
+			}
+			tstamp_clock_id_ = tstamp_types[i].clock_id;
+			logger_->info("pcm timestamps are taken with '{}' clock", tstamp_types[i].name);
+			return;
+		}
+
+		err_desc << "cannot set timestamp type '" << tstamp_type_ << "'";
+		throw std::runtime_error(err_desc.str());
+	}
+
+	void AlsaPcmSession::Prepare()
+	{
+		int err;
+		if( (err = snd_pcm_prepare(alsa_playback_handle_)) < 0) {
+			std::stringstream err_desc;
+			err_desc << "cannot prepare audio interface for use (" << snd_strerror(err) << ")";
+			throw std::runtime_error(err_desc.str());
+		}
+	}
+
+}
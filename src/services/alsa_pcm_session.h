@@ -0,0 +1,112 @@
+#ifndef WAVPLAYERALSA_ALSA_PCM_SESSION_H__
+#define WAVPLAYERALSA_ALSA_PCM_SESSION_H__
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <mutex>
+#include <time.h>
+
+#include "alsa/asoundlib.h"
+#include "spdlog/spdlog.h"
+
+#include "player_actions_ifc.h"
+#include "services/audio_sink.h"
+
+namespace wavplayeralsa
+{
+
+    /*
+    Owns the alsa pcm device for the lifetime of the player.
+    Opening the pcm and negotiating hw/sw params is expensive (tens of ms on
+    some devices), so the device is opened once, and the hw params are only
+    renegotiated when the stream parameters (format, rate, channels) change.
+    When they are the same as the previous stream, starting a new stream
+    only drops the pending frames and prepares the pcm.
+    */
+    class AlsaPcmSession :
+        public AudioSink
+    {
+
+    public:
+        ~AlsaPcmSession();
+
+        void Initialize(
+            std::shared_ptr<spdlog::logger> logger,
+            const std::string &audio_device,
+            bool use_mmap_access,
+            const std::string &tstamp_type,
+            const AlsaPcmBufferConfig &buffer_config
+        );
+
+    public:
+        // AudioSink
+        bool IsStreamParamsSupported(const AlsaPcmStreamParams &params);
+        void StartStream(const AlsaPcmStreamParams &params);
+        void DropAndPrepare();
+        void Drop();
+        int Start();
+        snd_pcm_state_t GetState();
+        snd_pcm_sframes_t AvailUpdate();
+        int GetDelay(snd_pcm_sframes_t *delay);
+        snd_pcm_sframes_t Write(const void *buffer, snd_pcm_uframes_t frames);
+
+        // mmap is used if configured, and the device supports it.
+        bool IsMmapAccess() const { return mmap_access_; }
+        int MmapBegin(const snd_pcm_channel_area_t **areas, snd_pcm_uframes_t *offset, snd_pcm_uframes_t *frames);
+        snd_pcm_sframes_t MmapCommit(snd_pcm_uframes_t offset, snd_pcm_uframes_t frames);
+
+        snd_pcm_uframes_t GetPeriodSize() const { return period_size_; }
+
+        // the alsa descriptors. some plugins handle internal events in GetPollRevents
+        std::vector<struct pollfd> GetPollDescriptors() const;
+        unsigned short GetPollRevents(std::vector<struct pollfd> &poll_fds);
+
+        uint64_t RecoverXrun(int err);
+        AlsaPcmPositionSnapshot GetPositionSnapshot();
+        clockid_t GetTimestampClockId() const { return tstamp_clock_id_; }
+
+        // the buffer params negotiated for the current stream
+        AudioDeviceStatus QueryStatus();
+        XrunStats QueryXrunStats();
+
+    private:
+        void Open();
+        void Close();
+        void SetHwParams(const AlsaPcmStreamParams &params);
+        void SetBufferParams(snd_pcm_hw_params_t *hw_params);
+        void UpdateStatus(snd_pcm_hw_params_t *hw_params);
+        void SetSwParams();
+        void SetTimestampType(snd_pcm_sw_params_t *sw_params);
+        void Prepare();
+
+    private:
+        std::shared_ptr<spdlog::logger> logger_;
+        std::string audio_device_;
+        bool use_mmap_access_ = false;
+        std::string tstamp_type_ = "monotonic_raw"; // 'gettimeofday', 'monotonic' or 'monotonic_raw'
+        AlsaPcmBufferConfig buffer_config_;
+
+    private:
+        snd_pcm_t *alsa_playback_handle_ = nullptr;
+
+        // params which are currently configured on the device. only valid if has_params_ is true
+        bool has_params_ = false;
+        AlsaPcmStreamParams curr_params_;
+        snd_pcm_uframes_t period_size_ = 0;
+        bool mmap_access_ = false;
+        clockid_t tstamp_clock_id_ = CLOCK_MONOTONIC;
+
+    private:
+        std::mutex status_mutex_;
+        AudioDeviceStatus status_;
+
+    private:
+        XrunStatsRecorder xrun_stats_;
+
+    };
+
+}
+
+#endif // WAVPLAYERALSA_ALSA_PCM_SESSION_H__
@@ -1,20 +1,42 @@
 #include "services/alsa_service.h"
 
 #include <sstream>
+#include <cstring>
 #include <iostream>
 #include <functional>
+#include <atomic>
+#include <future>
+#include <chrono>
+#include <mutex>
+#include <cmath>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
 
 #include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
 
 #include "alsa/asoundlib.h"
-#include "sndfile.hh"
+#include "services/audio_file_reader.h"
+#include "services/audio_cache.h"
+#include "services/audio_position_estimator.h"
+#include "services/drift_resampler.h"
+#include "services/crossfader.h"
+#include "services/cue_mixer.h"
+#include "services/mirror_outputs.h"
+#include "services/sample_converter.h"
+#include "services/format_converter.h"
+#include "services/audio_frames_ring.h"
 #include "spdlog/spdlog.h"
 #include "spdlog/async.h"
 
 namespace wavplayeralsa
 {
 
-    class AlsaPlaybackService : public IAlsaPlaybackService
+    class AlsaPlaybackService : 
+		public IAlsaPlaybackService,
+		public AudioWorkerCommandHandlerIfc,
+		public AudioProducerJobIfc
     {
 
     public:
@@ -24,7 +46,18 @@ namespace wavplayeralsa
 			PlayerEventsIfc *player_events_callback_,
             const std::string &full_file_name, 
             const std::string &file_id,
-			const std::string &audio_device,
+			AudioSink *audio_sink,
+			AudioWorker *audio_worker,
+			AudioProducer *audio_producer,
+			AudioCache *audio_cache,
+			CueMixer *cue_mixer,
+			VolumeControl *volume_control,
+			MirrorOutputs *mirror_outputs,
+			int audio_ring_ms,
+			int position_report_error_us,
+			bool drift_compensation,
+			int crossfade_ms,
+			Crossfader::Curve crossfade_curve,
 			uint32_t play_seq_id
         );
 
@@ -32,562 +65,1704 @@ namespace wavplayeralsa
 
 	public:
 		void Play(int64_t offset_in_ms);
+		void PlayAt(int64_t offset_in_ms, uint64_t start_at_epoch_us);
+		void Prepare(int64_t offset_in_ms);
+		bool Go();
+		bool Seek(int64_t offset_in_ms, uint32_t play_seq_id);
 		bool Stop();
-		const std::string GetFileId() const { return file_id_; }
+		bool QueueNext(const std::string &full_file_name, const std::string &file_id, uint32_t play_seq_id);
+		bool ClearNext();
+		bool CrossfadeTo(const std::string &full_file_name, const std::string &file_id, int64_t offset_in_ms, uint32_t play_seq_id);
+		const std::string GetFileId() const;
+
+	public:
+		// AudioWorkerCommandHandlerIfc
+		void HandleAudioCommand(const AudioWorkerCommand &command);
+
+		// AudioProducerJobIfc
+		bool ProduceAudio(const std::atomic<bool> &stop_requested);
 
     private:
 
-        void InitSndFile(const std::string &full_file_name);  
-		void InitAlsa(const std::string &audio_device);      
+		void InitAlsa(int audio_ring_ms);
+		AlsaPcmStreamParams ChooseDeviceParams(const AlsaPcmStreamParams &file_params);
+		struct PlaybackTrack;
+		std::shared_ptr<PlaybackTrack> OpenTrack(const std::string &full_file_name, const std::string &file_id, uint32_t play_seq_id);
 
+	// all the functions below run on the audio worker thread
 	private:
-		void PlayingThreadMain();
-		void FramesToPcmTransferLoop(boost::system::error_code error_code);
-		void PcmDrainLoop(boost::system::error_code error_code);
+		void StartStream(int64_t offset_in_ms, bool start_pcm);
+		void StartStreamAt(int64_t offset_in_ms, uint64_t start_at_epoch_us);
+		void OnScheduledStart(const boost::system::error_code &error_code);
+		void GoStream();
+		void StartPcmIfNeeded();
+		void SeekStream(int64_t offset_in_ms, uint32_t play_seq_id);
+		void CrossfadeStream(int64_t offset_in_ms, uint32_t play_seq_id);
+		void StopStream(std::promise<bool> *done);
+		void SetPosition(int64_t offset_in_ms);
+		void SetPositionFrames(int64_t position_frames);
+		void RestartProducerAt(int64_t position_frames, bool keep_next_track);
+		void StopProducerAt(int64_t position_frames, bool keep_next_track);
+		snd_pcm_sframes_t FramesBeforeTrackBoundary() const;
+		void StartWritingNextTrack();
+		void SwitchWritingTrack(std::shared_ptr<PlaybackTrack> track, int64_t position_frames);
+		void ScheduleLoop();
+		void ScheduleLoopOnPcmReady();
+		void ScheduleLoopAfterDrainWait(snd_pcm_sframes_t delay);
+		void ScheduleLoopAfterWait(int64_t wait_us);
+		void CancelLoopWait();
+		void OnPcmDescriptorReady(size_t fd_index, boost::system::error_code error_code);
+		void OnLoopWakeup(boost::system::error_code error_code);
+		bool CompletePendingStop();
+		void FinishStream();
+		void FramesToPcmTransferLoop();
+		snd_pcm_sframes_t TransferFramesRw(snd_pcm_sframes_t frames_to_deliver);
+		snd_pcm_sframes_t TransferFramesMmap(snd_pcm_sframes_t frames_to_deliver);
+		snd_pcm_sframes_t ProduceFrames(char *dest, snd_pcm_sframes_t max_frames, snd_pcm_sframes_t *frames_read);
+		void AdvancePosition(snd_pcm_sframes_t frames_produced, snd_pcm_sframes_t frames_written);
+		void ResetPositionTracking();
+		bool RecoverFromXrun(int err);
+		void PcmDrainLoop();
 		void PcmDrop();
 		void CheckSongStartTime();
+		void UpdateDriftCompensation(int64_t time_us);
 		bool IsAlsaStatePlaying();
 
+	// runs on the audio producer thread while it is started, and on the worker thread when it is stopped
+	private:
+		snd_pcm_sframes_t ReadFrames(PlaybackTrack &track, int64_t *position_frames, char *dest, snd_pcm_sframes_t max_frames);
+		bool StartReadingNextTrack();
+		void MixFadingTrack(char *dest, snd_pcm_sframes_t frames);
+
     private:
         std::shared_ptr<spdlog::logger> logger_;
-		boost::asio::io_service ios_;
-		boost::asio::deadline_timer alsa_wait_timer_;
-		std::thread playing_thread_;
+		AudioWorker *audio_worker_ = nullptr;
+		AudioProducer *audio_producer_ = nullptr;
+		boost::asio::deadline_timer alsa_wait_timer_; // used while draining
+		boost::asio::steady_timer start_timer_; // used to start a stream at a scheduled time
+
+		// the pcm poll descriptors, wrapped for async waiting on the worker io_service.
+		// the transfer loop waits on them until a period of frames can be written.
+		std::vector<struct pollfd> poll_fds_;
+		std::vector<std::unique_ptr<boost::asio::posix::stream_descriptor>> poll_descriptors_;
+		size_t pending_poll_waits_ = 0;
+		bool poll_fired_ = false;
 		bool initialized_ = false;
+		bool play_requested_ = false; // service can only be played once
+
+		// true from the moment play is requested, until the stream ends or stopped.
+		// written by the worker thread, read by the controller to decide if seek is possible.
+		std::atomic<bool> is_playing_;
+		// true from the moment prepare is requested, until go is requested.
+		std::atomic<bool> waiting_for_go_;
 
 	// config
 	private:
-		const std::string file_id_;
-		const uint32_t play_seq_id_;
+		// the file of the frames which are written to the pcm. changes when the stream continues to the next track
+		std::string file_id_;
+		mutable std::mutex file_id_mutex_; // file_id_ is read by the controller while the worker thread changes it
+		uint32_t play_seq_id_; // can change on seek. accessed only from the worker thread once playing started
+		AudioCache *audio_cache_ = nullptr;
+
+	// stream state, accessed only from the worker thread
+	private:
+		enum StreamState {
+			StreamStateIdle = 0, // not playing
+			StreamStateTransfer = 1, // writing frames from file to pcm
+			StreamStateDrain = 2 // all frames written, waiting for pcm to play them
+		};
+		StreamState stream_state_ = StreamStateIdle;
+		// if false, frames are written to the pcm, but it is not started (prepared stream waiting for go)
+		bool start_pcm_ = true;
+		// there is at most one pending wakeup of the transfer loop at any time (posted, waiting on timer, or waiting on the pcm descriptors).
+		bool loop_pending_ = false;
+		// waiting on start_timer_ to start the pcm at scheduled_start_time_
+		bool start_wait_pending_ = false;
+		std::chrono::steady_clock::time_point scheduled_start_time_;
+		int64_t scheduled_start_position_frames_ = 0;
+		// set when stop is requested while a loop handler (or scheduled start) is pending. fulfilled when they exit.
+		std::promise<bool> *pending_stop_ = nullptr;
+		bool pending_stop_result_ = false;
 
     // alsa
     private:
-    	static const int TRANSFER_BUFFER_SIZE = 4096 * 16; // 64KB this is the buffer used to pass frames to alsa. this is the maximum number of bytes to pass as one chunk
-		snd_pcm_t *alsa_playback_handle_ = nullptr;
+		// time needed to fill the pcm buffer before a scheduled start
+		static const int SCHEDULED_START_PREFILL_US = 20000;
+		// the scheduled start timer wakes up this early, and the exact time is awaited by spinning
+		static const int SCHEDULED_START_SPIN_US = 500;
+		AudioSink *audio_sink_ = nullptr;
+		// the buffer used to pass frames to alsa (rw access). holds one period of frames, 
+		// which is the maximum number of frames to pass as one chunk
+		std::vector<char> transfer_buffer_;
+		snd_pcm_format_t alsa_format_ = SND_PCM_FORMAT_S16_LE;
 
 		// what is the next frame to be delivered to alsa
 		int64_t curr_position_frames_ = 0;
-
-    // snd file
+		// frames are read ahead of curr_position_frames_ by the producer thread, into the ring
+		AudioFramesRing ring_;
+		// the next frame the producer reads into the ring. owned by the producer thread while it is started
+		int64_t read_position_frames_ = 0;
+		// the producer reads at most this many bytes at a time, so it stops quickly when requested
+		static const int PRODUCER_CHUNK_SIZE = 4096 * 16;
+		// if the ring is empty, the transfer loop checks it again after this time
+		static const int RING_EMPTY_WAIT_US = 1000;
+		bool in_ring_underrun_ = false;
+		// frames written to the pcm since it was last prepared. 
+		// differs from the frames read from the file when resampling
+		int64_t frames_written_to_pcm_ = 0;
+		// free frames in the pcm buffer, as of the last avail update, minus the frames written since
+		int64_t pcm_free_frames_ = 0;
+
+	// drift compensation
+	private:
+		bool drift_compensation_ = false;
+		DriftResampler resampler_;
+		std::vector<char> resampler_input_;
+		// measures the speed of the sound card clock, on the frames it played
+		AudioPositionEstimator card_clock_estimator_;
+		// phase error is corrected over about this time, with a rate change of at most MAX_DRIFT_CORRECTION_PPM
+		static const int64_t DRIFT_CORRECTION_TIME_US = 10 * 1000000LL;
+		static const int MAX_DRIFT_CORRECTION_PPM = 200;
+
+    // tracks
     private:
-    	SndfileHandle snd_file_;
+		// a file played in the stream. the first track is the file the service was created with, 
+		// and the stream continues to queued tracks without stopping the pcm
+		struct PlaybackTrack {
+			std::string file_id;
+			uint32_t play_seq_id = 0;
+			AudioFileReader reader;
+		};
+		// the track of curr_position_frames_. accessed only from the worker thread
+		std::shared_ptr<PlaybackTrack> writing_track_;
+		// the track of read_position_frames_. owned by the producer thread while it is started
+		std::shared_ptr<PlaybackTrack> reading_track_;
+		// queued by the controller, and taken by the producer when reading_track_ ends
+		std::mutex tracks_mutex_;
+		std::shared_ptr<PlaybackTrack> next_track_;
+		bool reading_ended_ = false; // the producer reached the end of the last track. guarded by tracks_mutex_
+		// set by the producer when it starts reading the next track into the ring, and cleared by the worker 
+		// thread when all the frames before it were written to the pcm. there is at most one pending boundary,
+		// since the next track is only queued after the previous one started playing.
+		// the index and track are written before it is set, and read after it is seen
+		std::atomic<bool> track_boundary_pending_;
+		size_t track_boundary_ring_index_ = 0; // bytes written to the ring before the first frame of the next track
+		std::shared_ptr<PlaybackTrack> track_boundary_next_;
+
+	// crossfade
+	private:
+		int crossfade_ms_ = 0; // 0 means crossfade is disabled
+		Crossfader::Curve crossfade_curve_ = Crossfader::CurveEqualPower;
+		bool crossfade_supported_ = false; // the format of the stream can be mixed
+		// opened by the controller, and taken by the worker thread when it handles the crossfade command. guarded by tracks_mutex_
+		std::shared_ptr<PlaybackTrack> crossfade_track_;
+		// the outgoing track, mixed into the frames read from reading_track_ until the fade is done.
+		// owned by the producer thread while it is started
+		std::shared_ptr<PlaybackTrack> fading_track_;
+		int64_t fading_position_frames_ = 0;
+		std::vector<char> fading_buffer_;
+		Crossfader crossfader_;
+
+	// cues, mixed on the audio worker thread right before frames are written to the pcm
+	private:
+		void MixCues(char *dest, snd_pcm_sframes_t frames);
+		CueMixer *cue_mixer_ = nullptr;
+		bool cues_supported_ = false; // the format of the stream can be mixed
+		SampleConverter cue_converter_;
+		std::vector<float> cue_mix_buffer_;
 
-	    enum SampleType {
-	    	SampleTypeSigned = 0,
-	    	SampleTypeUnsigned = 1,
-	    	SampleTypeFloat = 2
-	    };
-	    static const char *SampleTypeToString(SampleType sample_type);
-		bool GetFormatForAlsa(snd_pcm_format_t &out_format) const;
+	// software volume, applied on the audio worker thread after the cues are mixed
+	private:
+		void ApplyVolume(char *dest, snd_pcm_sframes_t frames);
+		VolumeControl *volume_control_ = nullptr;
+		bool volume_supported_ = false; // the format of the stream can be scaled
+		GainScaler gain_scaler_;
 
-		// from file
+	// mirror devices, which are fed with the frames written to the pcm (after cues and resampling), 
+	// and aligned on every position measurement
+	private:
+		MirrorOutputs *mirror_outputs_ = nullptr;
+
+	// stream params of the pcm (and the ring), from the first track
+	private:
 	    unsigned int frame_rate_ = 44100;
 	    unsigned int num_of_channels_ = 2;
-	    bool is_endian_little_ = true; // if false the endian is big :)
-	    SampleType sample_type_ = SampleTypeSigned;
-	    unsigned int bytes_per_sample_ = 2;
-	    uint64_t total_frame_in_file_ = 0;
-
-	    // calculated
 		unsigned int bytes_per_frame_ = 1;
-		snd_pcm_sframes_t frames_capacity_in_buffer_ = 0; // how many frames can be stored in a buffer with size TRANSFER_BUFFER_SIZE
+		// params of the first track. a queued track must have the same params.
+		// if the device cannot play them, the frames are converted to the params of the pcm as they are read
+		AlsaPcmStreamParams file_params_;
+		bool converting_ = false;
+		FormatConverter format_converter_;
+		std::vector<char> conversion_buffer_; // frames read from the file, before conversion
+		snd_pcm_sframes_t frames_capacity_in_buffer_ = 0; // how many frames can be stored in transfer_buffer_ (one period)
 
 	// postions reporting
 	private:
-		uint64_t audio_start_time_ms_since_epoch_ = 0;
+		// offset from the pcm timestamps clock to wall clock. calculated once for the stream
+		bool has_tstamp_to_epoch_offset_ = false;
+		int64_t tstamp_to_epoch_offset_us_ = 0;
+		AudioPositionEstimator position_estimator_;
+		// the last start time and speed reported to clients
+		bool has_reported_start_time_ = false;
+		double reported_start_time_us_ = 0.0;
+		double reported_speed_ = 1.0;
+		// a new report is sent when the last one is off by more than this
+		int position_report_error_us_ = 500;
+		// report the start time of a new track, even if the previous report is still accurate
+		bool report_new_track_ = false;
 		PlayerEventsIfc *player_events_callback_ = nullptr;
 		
     };
 
+	const int AlsaPlaybackService::SCHEDULED_START_PREFILL_US;
+	const int AlsaPlaybackService::SCHEDULED_START_SPIN_US;
+
     AlsaPlaybackService::AlsaPlaybackService(
             std::shared_ptr<spdlog::logger> logger,
 			PlayerEventsIfc *player_events_callback,
             const std::string &full_file_name, 
             const std::string &file_id,
-			const std::string &audio_device,
+			AudioSink *audio_sink,
+			AudioWorker *audio_worker,
+			AudioProducer *audio_producer,
+			AudioCache *audio_cache,
+			CueMixer *cue_mixer,
+			VolumeControl *volume_control,
+			MirrorOutputs *mirror_outputs,
+			int audio_ring_ms,
+			int position_report_error_us,
+			bool drift_compensation,
+			int crossfade_ms,
+			Crossfader::Curve crossfade_curve,
 			uint32_t play_seq_id
         ) :
+            logger_(logger),
+			audio_worker_(audio_worker),
+			audio_producer_(audio_producer),
+			alsa_wait_timer_(audio_worker->GetIoService()),
+			start_timer_(audio_worker->GetIoService()),
+			is_playing_(false),
+			waiting_for_go_(false),
 			file_id_(file_id),
 			play_seq_id_(play_seq_id),
-            logger_(logger),
-			alsa_wait_timer_(ios_),
+			audio_cache_(audio_cache),
+			audio_sink_(audio_sink),
+			track_boundary_pending_(false),
+			crossfade_ms_(crossfade_ms),
+			crossfade_curve_(crossfade_curve),
+			cue_mixer_(cue_mixer),
+			volume_control_(volume_control),
+			mirror_outputs_(mirror_outputs),
+			position_report_error_us_(position_report_error_us),
 			player_events_callback_(player_events_callback)
     {
-        InitSndFile(full_file_name);
-		InitAlsa(audio_device);
+		writing_track_ = std::make_shared<PlaybackTrack>();
+		writing_track_->file_id = file_id;
+		writing_track_->play_seq_id = play_seq_id;
+		writing_track_->reader.Open(logger_, full_file_name, audio_cache);
+		reading_track_ = writing_track_;
+		frame_rate_ = writing_track_->reader.GetFrameRate();
+		num_of_channels_ = writing_track_->reader.GetNumOfChannels();
+		position_estimator_.Initialize(frame_rate_);
+		card_clock_estimator_.Initialize(frame_rate_);
+		drift_compensation_ = drift_compensation;
+		InitAlsa(audio_ring_ms);
 		initialized_ = true;
     }
 
 	AlsaPlaybackService::~AlsaPlaybackService() {
 
 		this->Stop();
+		// the stream usually stops the producer itself. it must not run after the instance is deleted
+		audio_producer_->Stop();
+	}
+
+	/*
+	Make the audio sink ready for playing the current wav file.
+	The device is only reconfigured if the params of the file are different from the
+	previously played file.
+	throw std::runtime_error in case of error
+	 */
+	void AlsaPlaybackService::InitAlsa(int audio_ring_ms) {
+
+		if(writing_track_->reader.GetFormatForAlsa(file_params_.format) != true) {
+			throw std::runtime_error("the wav format is not supported by this player of alsa");
+		}
+		file_params_.frame_rate = frame_rate_;
+		file_params_.num_of_channels = num_of_channels_;
+
+		AlsaPcmStreamParams stream_params = ChooseDeviceParams(file_params_);
+		converting_ = (stream_params != file_params_);
+		alsa_format_ = stream_params.format;
+		num_of_channels_ = stream_params.num_of_channels;
+		bytes_per_frame_ = (snd_pcm_format_physical_width(alsa_format_) / 8) * num_of_channels_;
+		if(converting_) {
+			conversion_buffer_.resize((PRODUCER_CHUNK_SIZE / bytes_per_frame_ + 1) * format_converter_.GetInBytesPerFrame());
+		}
+
+		crossfade_supported_ = crossfader_.Initialize(alsa_format_, num_of_channels_);
+		cues_supported_ = cue_converter_.Initialize(alsa_format_);
+		if(crossfade_ms_ > 0 && !crossfade_supported_) {
+			logger_->warn("crossfade is not supported for format {}. files will be switched without it", snd_pcm_format_name(alsa_format_));
+		}
+		volume_supported_ = gain_scaler_.Initialize(alsa_format_, num_of_channels_);
+		if(!volume_supported_) {
+			logger_->warn("volume control is not supported for format {}. playing at unity gain", snd_pcm_format_name(alsa_format_));
+		}
+
+		if(drift_compensation_ && !resampler_.Initialize(alsa_format_, num_of_channels_)) {
+			logger_->warn("drift compensation is not supported for format {}. playing without it", snd_pcm_format_name(alsa_format_));
+			drift_compensation_ = false;
+		}
+
+		audio_sink_->StartStream(stream_params);
+		mirror_outputs_->StartStream(stream_params, audio_sink_->GetTimestampClockId());
 
-		if(alsa_playback_handle_ != nullptr) {
-			snd_pcm_close(alsa_playback_handle_);
-			alsa_playback_handle_ = nullptr;
+		// frames are transfered a period at a time. the period size sets both how often the 
+		// audio thread wakes up, and how much audio it handles on each wakeup
+		frames_capacity_in_buffer_ = std::max((snd_pcm_sframes_t)audio_sink_->GetPeriodSize(), (snd_pcm_sframes_t)1);
+		transfer_buffer_.resize(frames_capacity_in_buffer_ * bytes_per_frame_);
+		if(drift_compensation_) {
+			resampler_input_.resize(frames_capacity_in_buffer_ * bytes_per_frame_);
 		}
 
+		// the ring should at least hold a couple of transfers
+		uint64_t ring_frames = std::max((uint64_t)audio_ring_ms * frame_rate_ / 1000, (uint64_t)frames_capacity_in_buffer_ * 2);
+		ring_.Initialize(ring_frames * bytes_per_frame_);
+		if(crossfade_supported_) {
+			fading_buffer_.resize(PRODUCER_CHUNK_SIZE);
+		}
+
+		// the descriptors are owned by alsa. they are duplicated, so that the asio
+		// wrappers can close their own copy
+		poll_fds_ = audio_sink_->GetPollDescriptors();
+		for(const struct pollfd &poll_fd : poll_fds_) {
+			int fd = dup(poll_fd.fd);
+			if(fd < 0) {
+				throw std::runtime_error("cannot duplicate pcm poll descriptor");
+			}
+			poll_descriptors_.emplace_back(new boost::asio::posix::stream_descriptor(audio_worker_->GetIoService(), fd));
+		}
 	}
 
 	/*
-	Read the file content from disk, extract relevant metadata from the
-	wav header, and save it to the relevant members of the class.
-	The function will also initialize the snd_file member, which allows to
-	read the wav file frames.
-	Will throw std::runtime_error in case of error.
+	The params of the file if the device can play them. Otherwise, the first params which the device 
+	supports, and the frames can be converted to. If there are none, the params of the file are used, 
+	and starting the stream fails with the reason the device cannot play them.
+	Leaves format_converter_ initialized for the returned params.
 	 */
-    void AlsaPlaybackService::InitSndFile(const std::string &full_file_name)
-    {
-		snd_file_ = SndfileHandle(full_file_name);
-		if(snd_file_.error() != 0) {
-			std::stringstream errorDesc;
-			errorDesc << "The file '" << full_file_name << "' cannot be opened. error msg: '" << snd_file_.strError() << "'";
-			throw std::runtime_error(errorDesc.str());
+	AlsaPcmStreamParams AlsaPlaybackService::ChooseDeviceParams(const AlsaPcmStreamParams &file_params) {
+
+		for(const AlsaPcmStreamParams &params : FormatConverter::GetDeviceParamsCandidates(file_params)) {
+			if(params != file_params && !format_converter_.Initialize(file_params, params)) {
+				continue;
+			}
+			if(!audio_sink_->IsStreamParamsSupported(params)) {
+				continue;
+			}
+			if(params != file_params) {
+				logger_->info("audio device cannot play format {} with {} channels. frames are converted to format {} with {} channels", 
+					snd_pcm_format_name(file_params.format), file_params.num_of_channels, snd_pcm_format_name(params.format), params.num_of_channels);
+			}
+			return params;
 		}
+		logger_->warn("audio device cannot play format {} with {} channels, or any format it can be converted to", 
+			snd_pcm_format_name(file_params.format), file_params.num_of_channels);
+		return file_params;
+	}
 
-		// set the parameters from read from the SndFile and produce log messages
+	void AlsaPlaybackService::Play(int64_t offset_in_ms) {
 
-		frame_rate_ = snd_file_.samplerate();
-		num_of_channels_ = snd_file_.channels();
+		if(!initialized_) {
+			throw std::runtime_error("tried to play wav file on an uninitialzed alsa service");
+		}
 
-		int major_type = snd_file_.format() & SF_FORMAT_TYPEMASK;
-		int minor_type = snd_file_.format() & SF_FORMAT_SUBMASK;
+		if(play_requested_) {
+			throw std::runtime_error("this instance of alsa playback service has already played in the past. it cannot be reused. create a new instance to play again");
+		}
+		play_requested_ = true;
 
-		switch(minor_type) {
-			case SF_FORMAT_PCM_S8: 
-				bytes_per_sample_ = 1;
-				sample_type_ = SampleTypeSigned;
-				break;
-			case SF_FORMAT_PCM_16: 
-				bytes_per_sample_ = 2;
-				sample_type_ = SampleTypeSigned;
-				break;
-			case SF_FORMAT_PCM_24: 
-				bytes_per_sample_ = 3;
-				sample_type_ = SampleTypeSigned;
-				break;
-			case SF_FORMAT_PCM_32: 
-				bytes_per_sample_ = 4;
-				sample_type_ = SampleTypeSigned;
-				break;
-			case SF_FORMAT_FLOAT:
-				bytes_per_sample_ = 4;
-				sample_type_ = SampleTypeFloat;
-				break;
-			case SF_FORMAT_DOUBLE:
-				bytes_per_sample_ = 8;
-				sample_type_ = SampleTypeFloat;
-				break;
-			default:
-				std::stringstream err_desc;
-				err_desc << "wav file is in unsupported format. minor format as read from sndFile is: " << std::hex << minor_type;
-				throw std::runtime_error(err_desc.str());
+		logger_->info("start playing file {} from position {} mili-seconds ({} seconds)", file_id_, offset_in_ms, (double)offset_in_ms / 1000.0);
+
+		is_playing_ = true;
+		AudioWorkerCommand command;
+		command.type = AudioWorkerCommand::Play;
+		command.handler = this;
+		command.offset_in_ms = offset_in_ms;
+		audio_worker_->SendCommand(command);
+	}
+
+	/*
+	Play such that the frame at offset_in_ms is audible exactly at start_at_epoch_us.
+	The time is independent of when the request is processed, so network and processing 
+	latency do not affect the start time. If the time has already passed, playing starts 
+	as soon as possible, from the position which should be audible at that time.
+	 */
+	void AlsaPlaybackService::PlayAt(int64_t offset_in_ms, uint64_t start_at_epoch_us) {
+
+		if(!initialized_) {
+			throw std::runtime_error("tried to play wav file on an uninitialzed alsa service");
 		}
 
-		switch(major_type) {
-			case SF_FORMAT_WAV:
-				is_endian_little_ = true;
-				break;
-			case SF_FORMAT_AIFF:
-				is_endian_little_ = false;
-				break;
-			default:
-				std::stringstream err_desc;
-				err_desc << "wav file is in unsupported format. major format as read from sndFile is: " << std::hex << major_type;
-				throw std::runtime_error(err_desc.str());
-		}
-
-		total_frame_in_file_ = snd_file_.frames();
-		uint64_t number_of_ms = total_frame_in_file_ * 1000 / frame_rate_;
-		int number_of_minutes = number_of_ms / (1000 * 60);
-		int seconds_modulo = (number_of_ms / 1000) % 60;	
-
-		bytes_per_frame_ = num_of_channels_ * bytes_per_sample_;
-		frames_capacity_in_buffer_ = (snd_pcm_sframes_t)(TRANSFER_BUFFER_SIZE / bytes_per_frame_);
-
-		logger_->info("finished reading audio file '{}'. "
-			"Frame rate: {} frames per seconds, "
-			"Number of channels: {}, "
-			"Wav format: major 0x{:x}, minor 0x{:x}, "
-			"Bytes per sample: {}, "
-			"Sample type: '{}', "
-			"Endian: '{}', "
-			"Total frames in file: {} which are: {} ms, and {}:{} minutes", 
-				full_file_name, frame_rate_, num_of_channels_, major_type, minor_type, bytes_per_sample_, 
-				SampleTypeToString(sample_type_), 
-				(is_endian_little_ ? "little" : "big"),
-				total_frame_in_file_, number_of_ms, number_of_minutes, seconds_modulo
-			);
+		if(play_requested_) {
+			throw std::runtime_error("this instance of alsa playback service has already played in the past. it cannot be reused. create a new instance to play again");
+		}
+		play_requested_ = true;
+
+		logger_->info("start playing file {} from position {} mili-seconds ({} seconds) at {} micro-seconds since epoch", 
+			file_id_, offset_in_ms, (double)offset_in_ms / 1000.0, start_at_epoch_us);
+
+		is_playing_ = true;
+		AudioWorkerCommand command;
+		command.type = AudioWorkerCommand::PlayAt;
+		command.handler = this;
+		command.offset_in_ms = offset_in_ms;
+		command.start_at_epoch_us = start_at_epoch_us;
+		audio_worker_->SendCommand(command);
+	}
 
-    }
+	/*
+	Like play, but the pcm is only filled with the frames starting at offset_in_ms, and is not started.
+	Playing starts on Go, which only needs to start the pcm, so the time from go command to 
+	first sample is short and deterministic.
+	 */
+	void AlsaPlaybackService::Prepare(int64_t offset_in_ms) {
 
-	const char *AlsaPlaybackService::SampleTypeToString(SampleType sample_type) {
-		switch(sample_type) {
-	    	case SampleTypeSigned: return "signed integer";
-	    	case SampleTypeUnsigned: return "unsigned integer";
-	    	case SampleTypeFloat: return "float";
+		if(!initialized_) {
+			throw std::runtime_error("tried to prepare wav file on an uninitialzed alsa service");
 		}
-		std::stringstream err_desc;
-		err_desc << "sample type not supported. value is " << (int)sample_type;
-		throw std::runtime_error(err_desc.str());
+
+		if(play_requested_) {
+			throw std::runtime_error("this instance of alsa playback service has already played in the past. it cannot be reused. create a new instance to play again");
+		}
+		play_requested_ = true;
+
+		logger_->info("prepare file {} for playing from position {} mili-seconds ({} seconds)", file_id_, offset_in_ms, (double)offset_in_ms / 1000.0);
+
+		is_playing_ = true;
+		waiting_for_go_ = true;
+		AudioWorkerCommand command;
+		command.type = AudioWorkerCommand::Prepare;
+		command.handler = this;
+		command.offset_in_ms = offset_in_ms;
+		audio_worker_->SendCommand(command);
+	}
+
+	bool AlsaPlaybackService::Go() {
+
+		if(!waiting_for_go_.exchange(false)) {
+			return false;
+		}
+
+		AudioWorkerCommand command;
+		command.type = AudioWorkerCommand::Go;
+		command.handler = this;
+		audio_worker_->SendCommand(command);
+		return true;
 	}
 
 	/*
-	Init the alsa driver according to the params of the current wav file.
-	throw std::runtime_error in case of error
+	Change the position of the file which is currently playing, without reloading
+	the file or reconfiguring the device.
+	The request is handled asynchronously by the worker thread, which drops the frames
+	pending in the pcm and refills it from the new position, so the new position is
+	audible after at most one buffer refill.
+	A file which waits for a scheduled start is not waiting anymore: it plays once the pcm is refilled.
+	Returns false if the service is no longer playing (stopped, or reached end of file),
+	in which case the seek is not performed, and a new service should be created.
 	 */
-	void AlsaPlaybackService::InitAlsa(const std::string &audio_device) {
+	bool AlsaPlaybackService::Seek(int64_t offset_in_ms, uint32_t play_seq_id) {
 
-		int err;
-		std::stringstream err_desc;
+		if(!is_playing_) {
+			return false;
+		}
 
-		if( (err = snd_pcm_open(&alsa_playback_handle_, audio_device.c_str(), SND_PCM_STREAM_PLAYBACK, 0)) < 0) {
-			err_desc << "cannot open audio device " << audio_device << " (" << snd_strerror(err) << ")";
-			throw std::runtime_error(err_desc.str());
+		AudioWorkerCommand command;
+		command.type = AudioWorkerCommand::Seek;
+		command.handler = this;
+		command.offset_in_ms = offset_in_ms;
+		command.play_seq_id = play_seq_id;
+		audio_worker_->SendCommand(command);
+		return true;
+	}
+
+	/*
+	Open full_file_name to be played right after the current track, in the same pcm stream, so there is 
+	no gap between them. The file is opened on the calling thread, and the producer continues reading
+	from it when it reaches the end of the current track.
+	Returns false if the file cannot be played gapless: its stream params are different from the current 
+	stream, or the last frames of the stream were already read.
+	Will throw std::runtime_error if the file cannot be opened.
+	 */
+	bool AlsaPlaybackService::QueueNext(const std::string &full_file_name, const std::string &file_id, uint32_t play_seq_id) {
+
+		std::shared_ptr<PlaybackTrack> track = OpenTrack(full_file_name, file_id, play_seq_id);
+		if(!track) {
+			logger_->info("file {} cannot be played gapless after file {}, since its audio format is different", file_id, GetFileId());
+			return false;
 		}
 
-		// set hw parameters
+		std::lock_guard<std::mutex> guard(tracks_mutex_);
+		if(!is_playing_ || reading_ended_) {
+			logger_->info("file {} cannot be played gapless after file {}, since the stream is ending", file_id, GetFileId());
+			return false;
+		}
+		next_track_ = track;
+		logger_->info("file {} is queued to be played after file {}, with play_seq_id: {}", file_id, GetFileId(), play_seq_id);
+		return true;
+	}
 
-		snd_pcm_hw_params_t *hw_params;
+	/*
+	Remove the file which was queued with QueueNext.
+	Returns false if there is no queued file, or if the producer already started reading it,
+	in which case it is played.
+	 */
+	bool AlsaPlaybackService::ClearNext() {
+		std::lock_guard<std::mutex> guard(tracks_mutex_);
+		if(!next_track_) {
+			return false;
+		}
+		next_track_.reset();
+		return true;
+	}
 
-		if( (err = snd_pcm_hw_params_malloc(&hw_params)) < 0 ) {
-			err_desc << "cannot allocate hardware parameter structure (" << snd_strerror(err) << ")";
-			throw std::runtime_error(err_desc.str());
+	/*
+	Start playing full_file_name from offset_in_ms, fading it in while the current file fades out,
+	in the same pcm stream. The file is opened on the calling thread. The crossfade starts at the 
+	next frame written to the pcm, and the position is reported for the new file from that frame.
+	Returns false if crossfade is disabled, the stream cannot be mixed (format, or different stream params),
+	or the current file is not playing. In this case the caller should play the file in a new service.
+	Will throw std::runtime_error if the file cannot be opened.
+	 */
+	bool AlsaPlaybackService::CrossfadeTo(const std::string &full_file_name, const std::string &file_id, int64_t offset_in_ms, uint32_t play_seq_id) {
+
+		if(crossfade_ms_ <= 0 || !crossfade_supported_ || !is_playing_ || waiting_for_go_) {
+			return false;
 		}
 
-		if( (err = snd_pcm_hw_params_any(alsa_playback_handle_, hw_params)) < 0) {
-			err_desc << "cannot initialize hardware parameter structure (" << snd_strerror(err) << ")";
-			throw std::runtime_error(err_desc.str());
+		std::shared_ptr<PlaybackTrack> track = OpenTrack(full_file_name, file_id, play_seq_id);
+		if(!track) {
+			logger_->info("file {} cannot be crossfaded with file {}, since its audio format is different", file_id, GetFileId());
+			return false;
 		}
 
-		if( (err = snd_pcm_hw_params_set_access(alsa_playback_handle_, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0) {
-			err_desc << "cannot set access type (" << snd_strerror(err) << ")";
-			throw std::runtime_error(err_desc.str());
+		{
+			std::lock_guard<std::mutex> guard(tracks_mutex_);
+			crossfade_track_ = track;
 		}
 
-		snd_pcm_format_t alsaFormat;
-		if(GetFormatForAlsa(alsaFormat) != true) {
-			err_desc << "the wav format is not supported by this player of alsa";
-			throw std::runtime_error(err_desc.str());
+		logger_->info("crossfading from file {} to file {} at position {} mili-seconds, over {} mili-seconds", 
+			GetFileId(), file_id, offset_in_ms, crossfade_ms_);
+
+		AudioWorkerCommand command;
+		command.type = AudioWorkerCommand::Crossfade;
+		command.handler = this;
+		command.offset_in_ms = offset_in_ms;
+		command.play_seq_id = play_seq_id;
+		audio_worker_->SendCommand(command);
+		return true;
+	}
+
+	/*
+	Open a file to be played in the stream of this service.
+	Returns null if the stream params of the file are different from the current stream.
+	Will throw std::runtime_error if the file cannot be opened.
+	 */
+	std::shared_ptr<AlsaPlaybackService::PlaybackTrack> AlsaPlaybackService::OpenTrack(const std::string &full_file_name, const std::string &file_id, uint32_t play_seq_id) {
+
+		std::shared_ptr<PlaybackTrack> track = std::make_shared<PlaybackTrack>();
+		track->file_id = file_id;
+		track->play_seq_id = play_seq_id;
+		track->reader.Open(logger_, full_file_name, audio_cache_);
+
+		snd_pcm_format_t format;
+		if(!track->reader.GetFormatForAlsa(format) || format != file_params_.format || 
+			track->reader.GetFrameRate() != file_params_.frame_rate || track->reader.GetNumOfChannels() != file_params_.num_of_channels) 
+		{
+			return nullptr;
 		}
-		if( (err = snd_pcm_hw_params_set_format(alsa_playback_handle_, hw_params, alsaFormat)) < 0) {
-			err_desc << "cannot set sample format (" << snd_strerror(err) << ")";
-			throw std::runtime_error(err_desc.str());
+		return track;
+	}
+
+	const std::string AlsaPlaybackService::GetFileId() const {
+		std::lock_guard<std::mutex> guard(file_id_mutex_);
+		return file_id_;
+	}
+
+	/*
+	Stop playing and wait until the worker thread is done with this instance.
+	After it returns, the instance can be safely deleted.
+	Returns true if the file was playing when stopped.
+	 */
+	bool AlsaPlaybackService::Stop() {
+
+		if(!play_requested_) {
+			return false;
 		}
 
-		if( (err = snd_pcm_hw_params_set_rate(alsa_playback_handle_, hw_params, frame_rate_, 0)) < 0) {
-			err_desc << "cannot set sample rate (" << snd_strerror(err) << ")";
-			throw std::runtime_error(err_desc.str());
+		AudioWorkerCommand command;
+		command.type = AudioWorkerCommand::Stop;
+		command.handler = this;
+		return audio_worker_->SendCommandAndWait(command);
+	}
+
+	void AlsaPlaybackService::HandleAudioCommand(const AudioWorkerCommand &command) {
+		switch(command.type) {
+			case AudioWorkerCommand::Play:
+				StartStream(command.offset_in_ms, true);
+				break;
+			case AudioWorkerCommand::PlayAt:
+				StartStreamAt(command.offset_in_ms, command.start_at_epoch_us);
+				break;
+			case AudioWorkerCommand::Prepare:
+				StartStream(command.offset_in_ms, false);
+				break;
+			case AudioWorkerCommand::Go:
+				GoStream();
+				break;
+			case AudioWorkerCommand::Seek:
+				SeekStream(command.offset_in_ms, command.play_seq_id);
+				break;
+			case AudioWorkerCommand::Stop:
+				StopStream(command.done);
+				break;
+			case AudioWorkerCommand::Crossfade:
+				CrossfadeStream(command.offset_in_ms, command.play_seq_id);
+				break;
 		}
+	}
 
-		if( (err = snd_pcm_hw_params_set_channels(alsa_playback_handle_, hw_params, num_of_channels_)) < 0) {
-			err_desc << "cannot set channel count (" << snd_strerror(err) << ")";
-			throw std::runtime_error(err_desc.str());
+	void AlsaPlaybackService::StartStream(int64_t offset_in_ms, bool start_pcm) {
+		SetPosition(offset_in_ms);
+		start_pcm_ = start_pcm;
+		stream_state_ = StreamStateTransfer;
+		ScheduleLoop();
+	}
+
+	/*
+	A scheduled start is a prepared stream, which is started internally on a timer.
+	The requested wall clock time is converted to the monotonic clock, so the start is not 
+	affected by adjustments of the system time while waiting.
+	The pcm buffer is empty when the stream is prepared, so the first frame written to it is 
+	the first frame heard when the pcm is started.
+	 */
+	void AlsaPlaybackService::StartStreamAt(int64_t offset_in_ms, uint64_t start_at_epoch_us) {
+
+		struct timespec now_epoch;
+		clock_gettime(CLOCK_REALTIME, &now_epoch);
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		int64_t now_epoch_us = (int64_t)now_epoch.tv_sec * 1000000 + now_epoch.tv_nsec / 1000;
+		std::chrono::steady_clock::time_point requested_start_time = now + std::chrono::microseconds((int64_t)start_at_epoch_us - now_epoch_us);
+
+		// the pcm buffer should be filled before it is started. 
+		// if there is not enough time for it, start later, from the frame which should be audible at that time
+		scheduled_start_time_ = std::max(requested_start_time, now + std::chrono::microseconds(SCHEDULED_START_PREFILL_US));
+		int64_t late_us = std::chrono::duration_cast<std::chrono::microseconds>(scheduled_start_time_ - requested_start_time).count();
+		int64_t late_frames = (late_us * (int64_t)frame_rate_ + 500000) / 1000000;
+		int64_t offset_frames = (offset_in_ms * (int64_t)frame_rate_) / 1000;
+		if(late_us > 0) {
+			logger_->warn("play_seq_id: {}. requested start time is too close or already passed. starting {} us late, skipping {} frames", 
+				play_seq_id_, late_us, late_frames);
 		}
 
-		if( (err = snd_pcm_hw_params(alsa_playback_handle_, hw_params)) < 0) {
-			err_desc << "cannot set alsa hw parameters (" << snd_strerror(err) << ")";
-			throw std::runtime_error(err_desc.str());
+		SetPositionFrames(offset_frames + late_frames);
+		scheduled_start_position_frames_ = curr_position_frames_;
+		start_pcm_ = false;
+		stream_state_ = StreamStateTransfer;
+		ScheduleLoop();
+
+		start_wait_pending_ = true;
+		start_timer_.expires_at(scheduled_start_time_ - std::chrono::microseconds(SCHEDULED_START_SPIN_US));
+		start_timer_.async_wait(std::bind(&AlsaPlaybackService::OnScheduledStart, this, std::placeholders::_1));
+	}
+
+	void AlsaPlaybackService::OnScheduledStart(const boost::system::error_code &error_code) {
+
+		start_wait_pending_ = false;
+		if(CompletePendingStop() || error_code || stream_state_ == StreamStateIdle) {
+			return;
+		}
+		// started by a seek, while the handler was already queued
+		if(start_pcm_) {
+			return;
 		}
 
-		snd_pcm_hw_params_free(hw_params);
-		hw_params = nullptr;
+		// timer wakeup is not accurate enough. spin for the last few hundreds micro seconds.
+		// blocking the worker thread is fine here: it belongs to this zone only, the pcm is not started yet,
+		// and at least SCHEDULED_START_PREFILL_US of frames were already written to it, so nothing can underrun
+		while(std::chrono::steady_clock::now() < scheduled_start_time_) {
+		}
 
+		GoStream();
 
-		// set software parameters
+		// verify with the pcm delay which frame is actually being played now
+		snd_pcm_sframes_t delay = 0;
+		if(stream_state_ != StreamStateIdle && audio_sink_->GetDelay(&delay) == 0) {
+			int64_t since_start_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - scheduled_start_time_).count();
+			int64_t expected_position_frames = scheduled_start_position_frames_ + (since_start_us * (int64_t)frame_rate_) / 1000000;
+			int64_t actual_position_frames = curr_position_frames_ - delay;
+			logger_->info("play_seq_id: {}. scheduled start done. position error is {} frames", 
+				play_seq_id_, actual_position_frames - expected_position_frames);
+		}
+	}
 
-		snd_pcm_sw_params_t *sw_params;
+	void AlsaPlaybackService::GoStream() {
+		start_pcm_ = true;
+		if(stream_state_ == StreamStateIdle) {
+			return;
+		}
 
-		if( (err = snd_pcm_sw_params_malloc(&sw_params)) < 0) {
-			err_desc << "cannot allocate software parameters structure (" << snd_strerror(err) << ")";
-			throw std::runtime_error(err_desc.str());
+		try {
+			StartPcmIfNeeded();
+			logger_->info("play_seq_id: {}. prepared file {} started playing", play_seq_id_, file_id_);
 		}
+		catch(const std::runtime_error &e) {
+			logger_->error("play_seq_id: {}. starting prepared file failed. exception is: {}", play_seq_id_, e.what());
+			stream_state_ = StreamStateIdle;
+			FinishStream();
+			return;
+		}
+
+		// the loop is waiting for the pcm to consume frames, which only happens now that it is started.
+		// wake it up so it is registered for the started pcm
+		CancelLoopWait();
+		ScheduleLoop();
+	}
 
-		if( (err = snd_pcm_sw_params_current(alsa_playback_handle_, sw_params)) < 0) {
-			err_desc << "cannot initialize software parameters structure (" << snd_strerror(err) << ")";
+	/*
+	The pcm is configured to never start by itself when frames are written to it.
+	Start it when it has frames, unless the stream is prepared and waiting for go.
+	 */
+	void AlsaPlaybackService::StartPcmIfNeeded() {
+		if(!start_pcm_) {
+			return;
+		}
+		if(audio_sink_->GetState() != SND_PCM_STATE_PREPARED) {
+			return;
+		}
+		snd_pcm_sframes_t delay = 0;
+		if(audio_sink_->GetDelay(&delay) < 0 || delay <= 0) {
+			return;
+		}
+		int err;
+		if( (err = audio_sink_->Start()) < 0) {
+			std::stringstream err_desc;
+			err_desc << "snd_pcm_start failed (" << snd_strerror(err) << ")";
 			throw std::runtime_error(err_desc.str());
 		}
+		mirror_outputs_->Start();
+	}
 
-		// how many frames should be in the buffer before alsa start to play it.
-		// we set to 0 -> means start playing immediately
-		if( (err = snd_pcm_sw_params_set_start_threshold(alsa_playback_handle_, sw_params, 0U)) < 0) {
-			err_desc << "cannot set start mode (" << snd_strerror(err) << ")";
-			throw std::runtime_error(err_desc.str());
-		}	
+	void AlsaPlaybackService::SeekStream(int64_t offset_in_ms, uint32_t play_seq_id) {
 
-		if( (err = snd_pcm_sw_params(alsa_playback_handle_, sw_params)) < 0) {
-			err_desc << "cannot set software parameters (" << snd_strerror(err) << ")";
-			throw std::runtime_error(err_desc.str());
-		}	
+		// the stream might have ended after seek was requested.
+		// since file and pcm are still valid, it is just started again from the new position
+		try {
+			audio_sink_->DropAndPrepare();
+		}
+		catch(const std::runtime_error &e) {
+			logger_->error("play_seq_id: {}. seek failed. exception is: {}", play_seq_id, e.what());
+			play_seq_id_ = play_seq_id;
+			FinishStream();
+			return;
+		}
+		SetPosition(offset_in_ms);
+		// seek is a request to play now. a stream which waits for a scheduled start is started once it is refilled,
+		// like a stream which was started right away. a prepared stream still waits for go
+		if(start_wait_pending_) {
+			start_timer_.cancel();
+			start_pcm_ = true;
+		}
 
-		snd_pcm_sw_params_free(sw_params);
-		sw_params = nullptr;
+		logger_->info("play_seq_id: {}. file {} seeked to position {} mili-seconds. new play_seq_id: {}", 
+			play_seq_id_, file_id_, offset_in_ms, play_seq_id);
+		play_seq_id_ = play_seq_id;
+		is_playing_ = true;
+		stream_state_ = StreamStateTransfer;
 
-		if( (err = snd_pcm_prepare(alsa_playback_handle_)) < 0) {
-			err_desc << "cannot prepare audio interface for use (" << snd_strerror(err) << ")";
-			throw std::runtime_error(err_desc.str());
+		// if the loop is waiting, wake it up to start transfering from the new position
+		CancelLoopWait();
+		ScheduleLoop();
+	}
+
+	/*
+	Switch the stream to the incoming track at the next frame written to the pcm, and mix the
+	outgoing track into it from the same frame. The frames which were read ahead are discarded,
+	and read again with the mix. The frames already in the pcm are played as they are, so 
+	the crossfade is heard after them, like a seek.
+	*/
+	void AlsaPlaybackService::CrossfadeStream(int64_t offset_in_ms, uint32_t play_seq_id) {
+
+		std::shared_ptr<PlaybackTrack> incoming_track;
+		{
+			std::lock_guard<std::mutex> guard(tracks_mutex_);
+			incoming_track = std::move(crossfade_track_);
+		}
+		if(!incoming_track) {
+			return;
 		}
 
-		initialized_ = true;	
+		if(stream_state_ == StreamStateIdle) {
+			// the current file ended while the request was sent. there is nothing to fade out
+			writing_track_ = incoming_track;
+			{
+				std::lock_guard<std::mutex> guard(file_id_mutex_);
+				file_id_ = writing_track_->file_id;
+			}
+			SeekStream(offset_in_ms, play_seq_id);
+			return;
+		}
+
+		// the outgoing track continues from the first frame which was not written to the pcm
+		int64_t outgoing_position_frames = curr_position_frames_;
+		std::shared_ptr<PlaybackTrack> outgoing_track = writing_track_;
+		int64_t incoming_position_frames = (double)offset_in_ms / 1000.0 * (double)frame_rate_;
+		incoming_position_frames = std::min(incoming_position_frames, (int64_t)incoming_track->reader.GetTotalFrames());
+		incoming_track->play_seq_id = play_seq_id;
+		SwitchWritingTrack(incoming_track, incoming_position_frames);
+
+		// the producer now reads the incoming track. queued tracks are dropped, like on seek
+		StopProducerAt(incoming_position_frames, false);
+		fading_track_ = outgoing_track;
+		fading_position_frames_ = outgoing_position_frames;
+		if(fading_position_frames_ >= 0) {
+			fading_track_->reader.Seek(fading_position_frames_);
+		}
+		crossfader_.Start((uint64_t)crossfade_ms_ * frame_rate_ / 1000, crossfade_curve_);
+		audio_producer_->Start(this);
 	}
 
-	bool AlsaPlaybackService::GetFormatForAlsa(snd_pcm_format_t &out_format) const {
-		switch(sample_type_) {
+	void AlsaPlaybackService::StopStream(std::promise<bool> *done) {
 
-			case SampleTypeSigned: {
-				if(is_endian_little_) {
-					switch(bytes_per_sample_) {
-						case 1: out_format = SND_PCM_FORMAT_S8; return true;
-						case 2: out_format = SND_PCM_FORMAT_S16_LE; return true;
-						case 3: out_format = SND_PCM_FORMAT_S24_LE; return true;
-						case 4: out_format = SND_PCM_FORMAT_S32_LE; return true;
-					}
-				}
-				else {
-					switch(bytes_per_sample_) {
-						case 1: out_format = SND_PCM_FORMAT_S8; return true;
-						case 2: out_format = SND_PCM_FORMAT_S16_BE; return true;
-						case 3: out_format = SND_PCM_FORMAT_S24_BE; return true;
-						case 4: out_format = SND_PCM_FORMAT_S32_BE; return true;
-					}
-				}
+		bool was_playing = (stream_state_ != StreamStateIdle);
+		if(was_playing) {
+			stream_state_ = StreamStateIdle;
+			audio_producer_->Stop();
+			try {
+				PcmDrop();
 			}
-			break;
-
-			case SampleTypeUnsigned: {
-				if(is_endian_little_) {
-					switch(bytes_per_sample_) {
-						case 1: out_format = SND_PCM_FORMAT_U8; return true;
-						case 2: out_format = SND_PCM_FORMAT_U16_LE; return true;
-						case 3: out_format = SND_PCM_FORMAT_U24_LE; return true;
-						case 4: out_format = SND_PCM_FORMAT_U32_LE; return true;
-					}
-				}
-				else {
-					switch(bytes_per_sample_) {
-						case 1: out_format = SND_PCM_FORMAT_U8; return true;
-						case 2: out_format = SND_PCM_FORMAT_U16_BE; return true;
-						case 3: out_format = SND_PCM_FORMAT_U24_BE; return true;
-						case 4: out_format = SND_PCM_FORMAT_U32_BE; return true;
-					}
-				}
+			catch(const std::runtime_error &e) {
+				logger_->error("play_seq_id: {}. error while stopping current wav file. exception is: {}", play_seq_id_, e.what());
 			}
-			break;
+			FinishStream();
+		}
 
-			case SampleTypeFloat: {
-				if(is_endian_little_) {
-					switch(bytes_per_sample_) {
-						case 4: out_format = SND_PCM_FORMAT_FLOAT_LE; return true;
-						case 8: out_format = SND_PCM_FORMAT_FLOAT64_LE; return true;
-					}
-				}
-				else {
-					switch(bytes_per_sample_) {
-						case 4: out_format = SND_PCM_FORMAT_FLOAT_BE; return true;
-						case 8: out_format = SND_PCM_FORMAT_FLOAT64_BE; return true;
-					}
-				}			
+		// a pending loop handler references this instance. 
+		// wait for it to exit before reporting that stop is done
+		if(loop_pending_ || start_wait_pending_) {
+			CancelLoopWait();
+			start_timer_.cancel();
+			pending_stop_ = done;
+			pending_stop_result_ = was_playing;
+			return;
+		}
+
+		// after this call the instance might be deleted by the thread which requested the stop
+		done->set_value(was_playing);
+	}
+
+	void AlsaPlaybackService::SetPosition(int64_t offset_in_ms) {
+		double position_in_seconds = (double)offset_in_ms / 1000.0;
+		SetPositionFrames(position_in_seconds * (double)frame_rate_);
+	}
+
+	/*
+	The next track is dropped when the position is set by a request. 
+	The controller queues it again once the new position is reported.
+	*/
+	void AlsaPlaybackService::SetPositionFrames(int64_t position_frames) {
+		RestartProducerAt(position_frames, false);
+		ResetPositionTracking();
+	}
+
+	/*
+	Discard the frames which were read ahead, and start reading from position_frames of the current track.
+	The producer is stopped while the file position changes, as it is the one reading the file.
+	If the producer already started reading the next track, it is queued again (or dropped if keep_next_track is false).
+	*/
+	void AlsaPlaybackService::RestartProducerAt(int64_t position_frames, bool keep_next_track) {
+		StopProducerAt(position_frames, keep_next_track);
+		audio_producer_->Start(this);
+	}
 
+	/*
+	Same as RestartProducerAt, but leaves the producer stopped, so the caller can set up more of its state.
+	A crossfade in progress is cancelled, since the outgoing track would no longer be aligned.
+	*/
+	void AlsaPlaybackService::StopProducerAt(int64_t position_frames, bool keep_next_track) {
+		audio_producer_->Stop();
+		crossfader_.Cancel();
+		fading_track_.reset();
+		{
+			std::lock_guard<std::mutex> guard(tracks_mutex_);
+			if(track_boundary_pending_.load(std::memory_order_acquire)) {
+				next_track_ = std::move(track_boundary_next_);
+				track_boundary_pending_.store(false, std::memory_order_relaxed);
+			}
+			if(!keep_next_track) {
+				next_track_.reset();
 			}
-			break;
+			reading_ended_ = false;
+		}
+		reading_track_ = writing_track_;
+		curr_position_frames_ = std::min(position_frames, (int64_t)writing_track_->reader.GetTotalFrames());
+		read_position_frames_ = curr_position_frames_;
+		if(curr_position_frames_ >= 0) {
+			reading_track_->reader.Seek(curr_position_frames_);
+		}
+		ring_.Reset();
+		audio_producer_->ResetMetrics(ring_.GetCapacityBytes() / bytes_per_frame_);
+	}
 
+	/*
+	The position is set on a prepared (empty) pcm. 
+	Measurements and reports of the previous position are no longer relevant.
+	*/
+	void AlsaPlaybackService::ResetPositionTracking() {
+		frames_written_to_pcm_ = 0;
+		position_estimator_.Reset();
+		card_clock_estimator_.Reset();
+		has_reported_start_time_ = false;
+		if(drift_compensation_) {
+			resampler_.Reset();
 		}
-		return false;
 	}
 
-	void AlsaPlaybackService::Play(int64_t offset_in_ms) {
+	/*
+	Recover the pcm after an xrun (or suspend), and continue the stream.
+	While the pcm was stopped, the audio clock did not advance, so just continuing to write
+	would play the rest of the file late, and the reported start time would no longer be valid.
+	Instead, the frames which should have been played during the xrun are skipped, and the
+	stream continues from the position the estimation expects to be played now.
+	The sound card clock did advance during the xrun, so its measurement continues as if the 
+	lost frames were played.
+	Returns false if err is not an xrun, in which case the caller should handle the error.
+	*/
+	bool AlsaPlaybackService::RecoverFromXrun(int err) {
+
+		if(err != -EPIPE && err != -ESTRPIPE) {
+			return false;
+		}
 
-		if(!initialized_) {
-			throw std::runtime_error("tried to play wav file on an uninitialzed alsa service");
+		uint64_t xrun_duration_us = audio_sink_->RecoverXrun(err);
+
+		// the pcm is empty after recovery. everything written to it was either played or lost
+		int64_t lost_card_frames = (int64_t)std::llround((double)xrun_duration_us * frame_rate_ * card_clock_estimator_.GetSpeed() / 1000000.0);
+		frames_written_to_pcm_ += lost_card_frames;
+
+		int64_t prev_position_frames = curr_position_frames_;
+		if(has_reported_start_time_ && position_estimator_.HasEstimation() && has_tstamp_to_epoch_offset_) {
+			int64_t now_us = audio_sink_->GetTimestampNowUs() + tstamp_to_epoch_offset_us_;
+			int64_t expected_position_frames = (int64_t)std::llround(position_estimator_.GetPositionUs(now_us) * frame_rate_ / 1000000.0);
+			int64_t skip_frames = std::min(expected_position_frames, (int64_t)writing_track_->reader.GetTotalFrames()) - curr_position_frames_;
+			if(skip_frames > 0) {
+				// usually the skipped frames are already in the ring, and are just discarded
+				if((uint64_t)skip_frames * bytes_per_frame_ <= ring_.GetFillBytes()) {
+					ring_.CommitRead(skip_frames * bytes_per_frame_);
+					curr_position_frames_ += skip_frames;
+					audio_producer_->Wakeup();
+				}
+				else {
+					RestartProducerAt(curr_position_frames_ + skip_frames, true);
+				}
+			}
+		}
+		if(drift_compensation_) {
+			resampler_.Reset();
 		}
 
-		if(ios_.stopped()) {
-			throw std::runtime_error("this instance of alsa playback service has already played in the past. it cannot be reused. create a new instance to play again");
+		// the volume ramps and the cues continue from the frame which is heard after the skip,
+		// so a ramp scheduled at a position in the track still starts at that position
+		int64_t skipped_frames = curr_position_frames_ - prev_position_frames;
+		if(skipped_frames > 0) {
+			volume_control_->Advance(skipped_frames);
+			cue_mixer_->Advance(skipped_frames);
 		}
 
-		double position_in_seconds = (double)offset_in_ms / 1000.0;
-		curr_position_frames_ = position_in_seconds * (double)frame_rate_;
-		curr_position_frames_ = std::min(curr_position_frames_, (int64_t)total_frame_in_file_);
-		if(curr_position_frames_ >= 0) {
-			sf_count_t seek_res = snd_file_.seek(curr_position_frames_, SEEK_SET);
+		logger_->warn("play_seq_id: {}. recovered from xrun which lasted {} us. skipped {} frames to keep the stream in time", 
+			play_seq_id_, xrun_duration_us, skipped_frames);
+		return true;
+	}
+
+	void AlsaPlaybackService::ScheduleLoop() {
+		if(loop_pending_) {
+			return;
 		}
+		loop_pending_ = true;
+		audio_worker_->GetIoService().post(std::bind(&AlsaPlaybackService::OnLoopWakeup, this, boost::system::error_code()));
+	}
 
-		logger_->info("start playing file {} from position {} mili-seconds ({} seconds)", file_id_, offset_in_ms, position_in_seconds);
-		playing_thread_ = std::thread(&AlsaPlaybackService::PlayingThreadMain, this);
+	/*
+	Wake up the loop when the pcm is ready to receive more frames (at least one period
+	is free in the buffer), or when an error occurred on it.
+	*/
+	void AlsaPlaybackService::ScheduleLoopOnPcmReady() {
+		loop_pending_ = true;
+		poll_fired_ = false;
+		pending_poll_waits_ = poll_descriptors_.size();
+		for(size_t i = 0; i < poll_descriptors_.size(); i++) {
+			poll_fds_[i].revents = 0;
+			auto handler = std::bind(&AlsaPlaybackService::OnPcmDescriptorReady, this, i, std::placeholders::_1);
+			if(poll_fds_[i].events & POLLIN) {
+				poll_descriptors_[i]->async_read_some(boost::asio::null_buffers(), handler);
+			}
+			else {
+				poll_descriptors_[i]->async_write_some(boost::asio::null_buffers(), handler);
+			}
+		}
 	}
 
-	bool AlsaPlaybackService::Stop() {
+	/*
+	While draining, the pcm is always ready for writing, so the descriptors cannot be used.
+	Sleep until the frames currently in the buffer are expected to be played.
+	*/
+	void AlsaPlaybackService::ScheduleLoopAfterDrainWait(snd_pcm_sframes_t delay) {
+		int64_t wait_us = (int64_t)delay * 1000000 / frame_rate_;
+		ScheduleLoopAfterWait(std::max(wait_us, (int64_t)1000));
+	}
 
-		bool was_playing = playing_thread_.joinable() && !ios_.stopped();
+	void AlsaPlaybackService::ScheduleLoopAfterWait(int64_t wait_us) {
+		loop_pending_ = true;
+		alsa_wait_timer_.expires_from_now(boost::posix_time::microseconds(wait_us));
+		alsa_wait_timer_.async_wait(std::bind(&AlsaPlaybackService::OnLoopWakeup, this, std::placeholders::_1));
+	}
 
+	void AlsaPlaybackService::CancelLoopWait() {
 		alsa_wait_timer_.cancel();
-		ios_.stop();
-		if(playing_thread_.joinable()) {
-			playing_thread_.join();
+		for(auto &poll_descriptor : poll_descriptors_) {
+			poll_descriptor->cancel();
 		}
-		return was_playing;
 	}
 
-	void AlsaPlaybackService::PlayingThreadMain() {
+	void AlsaPlaybackService::OnPcmDescriptorReady(size_t fd_index, boost::system::error_code error_code) {
+
+		pending_poll_waits_--;
+		if(!error_code) {
+			poll_fds_[fd_index].revents = poll_fds_[fd_index].events;
+			if(!poll_fired_) {
+				poll_fired_ = true;
+				// one descriptor is enough to wake up the loop. 
+				// the others are canceled, and the loop runs once all of them returned
+				for(size_t i = 0; i < poll_descriptors_.size(); i++) {
+					if(i != fd_index) {
+						poll_descriptors_[i]->cancel();
+					}
+				}
+			}
+		}
+
+		if(pending_poll_waits_ > 0) {
+			return;
+		}
+
+		if(poll_fired_ && stream_state_ != StreamStateIdle && pending_stop_ == nullptr) {
+			try {
+				// the result is not needed (avail_update tells if frames can be written, or if there was an xrun),
+				// but some plugins (dmix for example) must process the event
+				audio_sink_->GetPollRevents(poll_fds_);
+			}
+			catch(const std::runtime_error &e) {
+				logger_->warn("play_seq_id: {}. {}", play_seq_id_, e.what());
+			}
+		}
+		OnLoopWakeup(error_code);
+	}
+
+	void AlsaPlaybackService::OnLoopWakeup(boost::system::error_code /*error_code*/) {
+
+		// the wait might be canceled by a seek or stop. 
+		// in both cases the stream state tells what should be done next, so the error is not checked.
+		loop_pending_ = false;
+
+		if(CompletePendingStop()) {
+			return;
+		}
 
 		try {
-			ios_.post(std::bind(&AlsaPlaybackService::FramesToPcmTransferLoop, this, boost::system::error_code()));
-			ios_.run();
-			PcmDrop();
+			switch(stream_state_) {
+				case StreamStateIdle:
+					return;
+				case StreamStateTransfer:
+					FramesToPcmTransferLoop();
+					break;
+				case StreamStateDrain:
+					PcmDrainLoop();
+					break;
+			}
 		}
 		catch(const std::runtime_error &e) {
 			logger_->error("play_seq_id: {}. error while playing current wav file. stopped transfering frames to alsa. exception is: {}", play_seq_id_, e.what());
+			stream_state_ = StreamStateIdle;
+			try {
+				PcmDrop();
+			}
+			catch(const std::runtime_error &) {
+				// already reporting the error which stopped the stream
+			}
+			FinishStream();
+		}
+	}
+
+	/*
+	Called when a pending handler exits. If stop is waiting for the handlers of this instance,
+	fulfill it once no handler is pending. 
+	Returns true if stop was requested, in which case the caller should return without touching the instance.
+	*/
+	bool AlsaPlaybackService::CompletePendingStop() {
+		if(pending_stop_ == nullptr) {
+			return false;
+		}
+		if(loop_pending_ || start_wait_pending_) {
+			return true;
 		}
+		std::promise<bool> *done = pending_stop_;
+		pending_stop_ = nullptr;
+		// after this call the instance might be deleted by the thread which requested the stop
+		done->set_value(pending_stop_result_);
+		return true;
+	}
+
+	void AlsaPlaybackService::FinishStream() {
 		logger_->info("play_seq_id: {}. handling done", play_seq_id_);
+		audio_producer_->Stop();
+		cue_mixer_->StopVoices();
+		is_playing_ = false;
 		player_events_callback_->NoSongPlayingStatus(file_id_, play_seq_id_);
-		ios_.stop();
 	}
 
-	void AlsaPlaybackService::FramesToPcmTransferLoop(boost::system::error_code error_code) {
-
-		// the function might be called from timer, in which case error_code might
-		// indicate the timer canceled and we should not invoke the function.
-		if(error_code)
-			return;
+	void AlsaPlaybackService::FramesToPcmTransferLoop() {
 
 		std::stringstream err_desc;
-		int err;
 
 		// calculate how many frames to write
 		snd_pcm_sframes_t frames_to_deliver;
-		if( (frames_to_deliver = snd_pcm_avail_update(alsa_playback_handle_)) < 0) {
-			if(frames_to_deliver == -EPIPE) {
-				throw std::runtime_error("an xrun occured");
+		if( (frames_to_deliver = audio_sink_->AvailUpdate()) < 0) {
+			if(RecoverFromXrun(frames_to_deliver)) {
+				ScheduleLoop();
+				return;
 			}
-			else {
-				err_desc << "unknown ALSA avail update return value (" << frames_to_deliver << ")";
-				throw std::runtime_error(err_desc.str());
+			err_desc << "unknown ALSA avail update return value (" << frames_to_deliver << ")";
+			throw std::runtime_error(err_desc.str());
+		}
+		else if(frames_to_deliver < (snd_pcm_sframes_t)audio_sink_->GetPeriodSize()) {
+			// not worth a write. sleep until a period of frames is free in the buffer
+			ScheduleLoopOnPcmReady();
+			return;
+		}
+		pcm_free_frames_ = frames_to_deliver;
+
+		// all the frames of the current track were written. the frames in the ring are of the next track
+		if(FramesBeforeTrackBoundary() == 0) {
+			StartWritingNextTrack();
+		}
+
+		if(ring_.IsDrained()) {
+			logger_->info("play_seq_id: {}. done writing all frames to pcm. waiting for audio device to play remaining frames in the buffer", play_seq_id_);
+			// a short file might end before the pcm was started
+			StartPcmIfNeeded();
+			stream_state_ = StreamStateDrain;
+			ScheduleLoop();
+			return;
+		}
+
+		if(ring_.GetFillBytes() == 0) {
+			// the producer did not keep up (slow read), or just started. check again soon
+			if(!in_ring_underrun_ && IsAlsaStatePlaying()) {
+				in_ring_underrun_ = true;
+				audio_producer_->ReportRingUnderrun();
+				logger_->warn("play_seq_id: {}. no frames were read ahead from the file in time", play_seq_id_);
 			}
+			ScheduleLoopAfterWait(RING_EMPTY_WAIT_US);
+			return;
 		}
-		else if(frames_to_deliver == 0) {
-			alsa_wait_timer_.expires_from_now(boost::posix_time::millisec(5));
-			alsa_wait_timer_.async_wait(std::bind(&AlsaPlaybackService::FramesToPcmTransferLoop, this, std::placeholders::_1));
+		in_ring_underrun_ = false;
+
+		snd_pcm_sframes_t frames_read;
+		if(audio_sink_->IsMmapAccess()) {
+			frames_read = TransferFramesMmap(frames_to_deliver);
+		}
+		else {
+			frames_read = TransferFramesRw(frames_to_deliver);
+		}
+		audio_producer_->ReportRingFill(ring_.GetFillBytes() / bytes_per_frame_, IsAlsaStatePlaying());
+
+		if(frames_read < 0) {
+			// xrun while transferring. the pcm was recovered, and the frames will be written on the next iteration
+			ScheduleLoop();
 			return;
 		}
 
+		StartPcmIfNeeded();
+		CheckSongStartTime();
+
+		ScheduleLoop();
+	}
+
+	/*
+	Copy frames from the ring into a transfer buffer, and from it to alsa with snd_pcm_writei.
+	Returns the number of frames taken from the ring, and a negative value if an xrun was recovered.
+	*/
+	snd_pcm_sframes_t AlsaPlaybackService::TransferFramesRw(snd_pcm_sframes_t frames_to_deliver) {
+
 		// we want to deliver as many frames as possible.
 		// we can put frames_to_deliver number of frames, but the buffer can only hold frames_capacity_in_buffer_ frames
 		frames_to_deliver = std::min(frames_to_deliver, frames_capacity_in_buffer_);
 
-		// read the frames from the file. TODO: what if readRaw fails?
-		char buffer_for_transfer[TRANSFER_BUFFER_SIZE];
-		
-		bool start_in_future = (curr_position_frames_ < 0);
-		if(!start_in_future) {
-			unsigned int bytes_to_deliver = frames_to_deliver * bytes_per_frame_;
-			bytes_to_deliver = snd_file_.readRaw(buffer_for_transfer, bytes_to_deliver);
-			if(bytes_to_deliver < 0) {
-				err_desc << "Failed reading raw frames from snd file. returned: " << sf_error_number(bytes_to_deliver);
-				throw std::runtime_error(err_desc.str());				
+		char *buffer_for_transfer = transfer_buffer_.data();
+		snd_pcm_sframes_t frames_read;
+		snd_pcm_sframes_t frames_produced = ProduceFrames(buffer_for_transfer, frames_to_deliver, &frames_read);
+
+		snd_pcm_sframes_t frames_written = audio_sink_->Write(buffer_for_transfer, frames_produced);
+		if(frames_written < 0 && RecoverFromXrun(frames_written)) {
+			return -1;
+		}
+		if( frames_written < 0) {
+			std::stringstream err_desc;
+			err_desc << "snd_pcm_writei failed (" << snd_strerror(frames_written) << ")";
+			throw std::runtime_error(err_desc.str());				
+		}
+
+		mirror_outputs_->Write(frames_written_to_pcm_, buffer_for_transfer, frames_written);
+		AdvancePosition(frames_produced, frames_written);
+		return frames_read;
+	}
+
+	/*
+	Copy frames from the ring directly into the device ring buffer, without an intermediate copy.
+	Returns the number of frames taken from the ring, and a negative value if an xrun was recovered.
+	*/
+	snd_pcm_sframes_t AlsaPlaybackService::TransferFramesMmap(snd_pcm_sframes_t frames_to_deliver) {
+
+		int err;
+		std::stringstream err_desc;
+
+		const snd_pcm_channel_area_t *areas;
+		snd_pcm_uframes_t offset;
+		snd_pcm_uframes_t frames = frames_to_deliver;
+		if( (err = audio_sink_->MmapBegin(&areas, &offset, &frames)) < 0) {
+			if(RecoverFromXrun(err)) {
+				return -1;
 			}
-			if(bytes_to_deliver == 0) {
-				logger_->info("play_seq_id: {}. done writing all frames to pcm. waiting for audio device to play remaining frames in the buffer", play_seq_id_);
-				ios_.post(std::bind(&AlsaPlaybackService::PcmDrainLoop, this, boost::system::error_code()));
-				return;
+			err_desc << "snd_pcm_mmap_begin failed (" << snd_strerror(err) << ")";
+			throw std::runtime_error(err_desc.str());
+		}
+
+		// interleaved access - all channels share the same area, and a frame is 'step' bits
+		char *dest = (char *)areas[0].addr + (areas[0].first / 8) + offset * (areas[0].step / 8);
+		snd_pcm_sframes_t frames_read;
+		snd_pcm_sframes_t frames_produced = ProduceFrames(dest, frames, &frames_read);
+
+		snd_pcm_sframes_t frames_committed = audio_sink_->MmapCommit(offset, frames_produced);
+		if(frames_committed < 0 && RecoverFromXrun(frames_committed)) {
+			return -1;
+		}
+		if(frames_committed < 0) {
+			err_desc << "snd_pcm_mmap_commit failed (" << snd_strerror(frames_committed) << ")";
+			throw std::runtime_error(err_desc.str());
+		}
+
+		// the committed frames stay in the device buffer until the hardware plays them, so they can still be copied
+		mirror_outputs_->Write(frames_written_to_pcm_, dest, frames_committed);
+		AdvancePosition(frames_produced, frames_committed);
+		return frames_read;
+	}
+
+	/*
+	Fill dest with up to max_frames frames for the pcm, from the frames which were read ahead into the ring. 
+	The frames are not removed from the ring until they are written to the pcm (AdvancePosition).
+	frames_read is set to the number of frames taken from the ring for them, which is 
+	different from the returned number of frames when resampling for drift compensation.
+	*/
+	snd_pcm_sframes_t AlsaPlaybackService::ProduceFrames(char *dest, snd_pcm_sframes_t max_frames, snd_pcm_sframes_t *frames_read) {
+
+		// frames of the next track are taken only after the position moved to it
+		snd_pcm_sframes_t frames_before_boundary = FramesBeforeTrackBoundary();
+
+		if(!drift_compensation_) {
+			if(frames_before_boundary >= 0) {
+				max_frames = std::min(max_frames, frames_before_boundary);
 			}
+			*frames_read = ring_.Peek(dest, max_frames * bytes_per_frame_) / bytes_per_frame_;
+			MixCues(dest, *frames_read);
+			ApplyVolume(dest, *frames_read);
+			return *frames_read;
+		}
+
+		snd_pcm_sframes_t max_input_frames = std::min((snd_pcm_sframes_t)resampler_.MaxInputFrames(max_frames), frames_capacity_in_buffer_);
+		// for a tiny dest (end of mmap area), the input which is not resampled stays in the ring
+		max_input_frames = std::max(max_input_frames, (snd_pcm_sframes_t)1);
+		if(frames_before_boundary >= 0) {
+			max_input_frames = std::min(max_input_frames, frames_before_boundary);
+		}
+		*frames_read = ring_.Peek(resampler_input_.data(), max_input_frames * bytes_per_frame_) / bytes_per_frame_;
+		snd_pcm_sframes_t frames_produced = resampler_.Process(resampler_input_.data(), *frames_read, dest, max_frames);
+		MixCues(dest, frames_produced);
+		ApplyVolume(dest, frames_produced);
+		return frames_produced;
+	}
+
+	/*
+	Mix the active cues into frames which are about to be written to the pcm.
+	Cues advance only when frames are written (AdvancePosition), so frames which are produced again 
+	after a partial write mix the same part of the cues.
+	*/
+	void AlsaPlaybackService::MixCues(char *dest, snd_pcm_sframes_t frames) {
+		if(!cues_supported_ || frames <= 0 || !cue_mixer_->Update(frame_rate_, num_of_channels_, pcm_free_frames_, frames)) {
+			return;
+		}
+		size_t num_of_samples = frames * num_of_channels_;
+		cue_mix_buffer_.resize(num_of_samples);
+		cue_converter_.ToFloat(dest, num_of_samples, cue_mix_buffer_.data());
+		cue_mixer_->Mix(cue_mix_buffer_.data(), frames);
+		// clips the sum, so loud cues saturate instead of wrapping around
+		cue_converter_.FromFloat(cue_mix_buffer_.data(), num_of_samples, dest);
+	}
+
+	/*
+	Scale frames which are about to be written to the pcm by the volume of the zone.
+	The gains are of the frames from the next one written to the pcm, and only advance when frames are written
+	(AdvancePosition), so frames which are produced again after a partial write get the same gains.
+	At unity gain the frames are not touched.
+	*/
+	void AlsaPlaybackService::ApplyVolume(char *dest, snd_pcm_sframes_t frames) {
+		if(!volume_supported_ || frames <= 0 ||
+			!volume_control_->Update(writing_track_->play_seq_id, curr_position_frames_, frame_rate_, frames))
+		{
+			return;
+		}
+		if(volume_control_->IsGainConstant()) {
+			gain_scaler_.Scale(dest, frames, volume_control_->GetConstantGain());
 		}
 		else {
-			frames_to_deliver = std::min(frames_to_deliver, (snd_pcm_sframes_t)-curr_position_frames_);
-			unsigned int bytes_to_deliver = frames_to_deliver * bytes_per_frame_;
-			bzero(buffer_for_transfer, bytes_to_deliver);
+			gain_scaler_.Scale(dest, frames, volume_control_->GetFrameGains());
 		}
+	}
 
-		int frames_written = snd_pcm_writei(alsa_playback_handle_, buffer_for_transfer, frames_to_deliver);
-		if( frames_written < 0) {
-			err_desc << "snd_pcm_writei failed (" << snd_strerror(frames_written) << ")";
-			throw std::runtime_error(err_desc.str());				
+	/*
+	Read frames ahead into the ring, until it is full, or the file ended.
+	Frames are read into the free region of the ring directly, in chunks, so a stop request
+	does not wait for a long read.
+	*/
+	bool AlsaPlaybackService::ProduceAudio(const std::atomic<bool> &stop_requested) {
+
+		try {
+			while(!stop_requested.load(std::memory_order_relaxed)) {
+				char *region;
+				size_t region_bytes = std::min(ring_.GetWriteRegion(&region), (size_t)PRODUCER_CHUNK_SIZE);
+				snd_pcm_sframes_t max_frames = region_bytes / bytes_per_frame_;
+				if(max_frames == 0) {
+					return true;
+				}
+				snd_pcm_sframes_t frames = ReadFrames(*reading_track_, &read_position_frames_, region, max_frames);
+				if(frames == 0) {
+					if(StartReadingNextTrack()) {
+						continue;
+					}
+					ring_.SetEndOfStream();
+					return false;
+				}
+				if(crossfader_.IsActive()) {
+					MixFadingTrack(region, frames);
+				}
+				ring_.CommitWrite(frames * bytes_per_frame_);
+			}
+		}
+		catch(const std::runtime_error &e) {
+			// the frames which were already read are played, and the stream ends after them
+			logger_->error("play_seq_id: {}. error while reading audio file. exception is: {}", play_seq_id_, e.what());
+			{
+				std::lock_guard<std::mutex> guard(tracks_mutex_);
+				reading_ended_ = true;
+			}
+			ring_.SetEndOfStream();
+			return false;
 		}
+		return true;
+	}
 
-		curr_position_frames_ += frames_written;
-		if( (curr_position_frames_ >= 0) && (start_in_future || (frames_written != frames_to_deliver))) {
-			logger_->warn("play_seq_id: {}. transfered to alsa less frame then requested. frames_to_deliver: {}, frames_written: {}", play_seq_id_, frames_to_deliver, frames_written);
-			snd_file_.seek(curr_position_frames_, SEEK_SET);
+	/*
+	Called by the producer at the end of the track it reads. If a next track is queued, continue reading 
+	from its first frame, right after the last frame of the current track, and mark where it starts in the ring.
+	Returns false if there is no next track, in which case the stream ends.
+	*/
+	bool AlsaPlaybackService::StartReadingNextTrack() {
+		std::lock_guard<std::mutex> guard(tracks_mutex_);
+		if(!next_track_ || track_boundary_pending_.load(std::memory_order_acquire)) {
+			reading_ended_ = true;
+			return false;
 		}
+		reading_track_ = std::move(next_track_);
+		reading_track_->reader.Seek(0);
+		read_position_frames_ = 0;
+		track_boundary_ring_index_ = ring_.GetBytesWritten();
+		track_boundary_next_ = reading_track_;
+		track_boundary_pending_.store(true, std::memory_order_release);
+		return true;
+	}
 
-		CheckSongStartTime();
+	/*
+	Frames of the current track which are still in the ring, if the producer already started 
+	reading the next track. -1 if it did not.
+	*/
+	snd_pcm_sframes_t AlsaPlaybackService::FramesBeforeTrackBoundary() const {
+		if(!track_boundary_pending_.load(std::memory_order_acquire)) {
+			return -1;
+		}
+		return (track_boundary_ring_index_ - ring_.GetBytesRead()) / bytes_per_frame_;
+	}
+
+	/*
+	Continue the stream with the next track. Its first frame follows the last frame of the current 
+	track in the pcm, so the position estimation continues, shifted to positions in the new file,
+	and the start time of the new file is reported right away.
+	*/
+	void AlsaPlaybackService::StartWritingNextTrack() {
+		std::shared_ptr<PlaybackTrack> next_track = std::move(track_boundary_next_);
+		track_boundary_pending_.store(false, std::memory_order_release);
+
+		logger_->info("play_seq_id: {}. done writing file {} to pcm. continuing with file {} and play_seq_id: {}", 
+			play_seq_id_, GetFileId(), next_track->file_id, next_track->play_seq_id);
+		SwitchWritingTrack(std::move(next_track), 0);
+	}
+
+	/*
+	The next frame written to the pcm is position_frames of track. 
+	The frames before it in the pcm are not affected, so the position estimation continues, 
+	shifted to positions in the new file, and its start time is reported right away.
+	*/
+	void AlsaPlaybackService::SwitchWritingTrack(std::shared_ptr<PlaybackTrack> track, int64_t position_frames) {
+		double shift_us = (double)(position_frames - curr_position_frames_) * 1000000.0 / (double)frame_rate_;
+		position_estimator_.ShiftPosition(shift_us);
+		reported_start_time_us_ -= shift_us / reported_speed_;
+		report_new_track_ = true;
+
+		curr_position_frames_ = position_frames;
+		play_seq_id_ = track->play_seq_id;
+		writing_track_ = std::move(track);
+		std::lock_guard<std::mutex> guard(file_id_mutex_);
+		file_id_ = writing_track_->file_id;
+	}
+
+	/*
+	Mix the outgoing track into frames which were just read from the incoming track, 
+	and end the crossfade when it is done. After the end of the outgoing file, 
+	it is mixed as silence, so the incoming track still fades in over the whole duration.
+	*/
+	void AlsaPlaybackService::MixFadingTrack(char *dest, snd_pcm_sframes_t frames) {
+		snd_pcm_sframes_t fading_frames = 0;
+		while(fading_track_ && fading_frames < frames) {
+			snd_pcm_sframes_t read_frames;
+			try {
+				read_frames = ReadFrames(*fading_track_, &fading_position_frames_, 
+					&fading_buffer_[fading_frames * bytes_per_frame_], frames - fading_frames);
+			}
+			catch(const std::runtime_error &e) {
+				logger_->error("play_seq_id: {}. error while reading the faded out file. exception is: {}", play_seq_id_, e.what());
+				read_frames = 0;
+			}
+			if(read_frames == 0) {
+				fading_track_.reset();
+				break;
+			}
+			fading_frames += read_frames;
+		}
+		if(fading_frames < frames) {
+			snd_pcm_format_set_silence(alsa_format_, &fading_buffer_[fading_frames * bytes_per_frame_], (frames - fading_frames) * num_of_channels_);
+		}
 
-		ios_.post(std::bind(&AlsaPlaybackService::FramesToPcmTransferLoop, this, boost::system::error_code()));
+		crossfader_.Process(dest, fading_buffer_.data(), frames);
+		if(!crossfader_.IsActive()) {
+			logger_->info("play_seq_id: {}. crossfade done", play_seq_id_);
+			fading_track_.reset();
+		}
 	}
 
-	void AlsaPlaybackService::PcmDrainLoop(boost::system::error_code error_code) {
+	/*
+	Fill dest with up to max_frames frames of track from *position_frames, and advance it: silence while the
+	position is before the start of the file, and frames from the file after it, converted to the format of the pcm.
+	Returns the number of frames placed in dest. 0 means end of file.
+	*/
+	snd_pcm_sframes_t AlsaPlaybackService::ReadFrames(PlaybackTrack &track, int64_t *position_frames, char *dest, snd_pcm_sframes_t max_frames) {
+
+		if(*position_frames < 0) {
+			snd_pcm_sframes_t frames = std::min(max_frames, (snd_pcm_sframes_t)-*position_frames);
+			snd_pcm_format_set_silence(alsa_format_, dest, frames * num_of_channels_);
+			*position_frames += frames;
+			if(*position_frames == 0) {
+				track.reader.Seek(0);
+			}
+			return frames;
+		}
 
-		if(error_code)
+		if(!converting_) {
+			snd_pcm_sframes_t frames = track.reader.Read(dest, max_frames);
+			*position_frames += frames;
+			return frames;
+		}
+
+		max_frames = std::min(max_frames, (snd_pcm_sframes_t)(conversion_buffer_.size() / format_converter_.GetInBytesPerFrame()));
+		snd_pcm_sframes_t frames = track.reader.Read(conversion_buffer_.data(), max_frames);
+		format_converter_.Convert(conversion_buffer_.data(), frames, dest);
+		*position_frames += frames;
+		return frames;
+	}
+
+	/*
+	Update the position after frames_produced frames were produced for the pcm, and frames_written of them 
+	were accepted by alsa. The frames they were produced from are removed from the ring.
+	*/
+	void AlsaPlaybackService::AdvancePosition(snd_pcm_sframes_t frames_produced, snd_pcm_sframes_t frames_written) {
+
+		bool partial_write = (frames_written != frames_produced);
+		frames_written_to_pcm_ += frames_written;
+		pcm_free_frames_ -= frames_written;
+		volume_control_->Advance(frames_written);
+		cue_mixer_->Advance(frames_written);
+		// frames which were not written stay in the ring for the next transfer.
+		// when resampling, so does the input of the output which was not written, and it is resampled again
+		snd_pcm_sframes_t frames_consumed = drift_compensation_ ? (snd_pcm_sframes_t)resampler_.Advance(frames_written) : frames_written;
+		ring_.CommitRead(frames_consumed * bytes_per_frame_);
+		audio_producer_->Wakeup();
+		curr_position_frames_ += frames_consumed;
+		if(partial_write) {
+			logger_->warn("play_seq_id: {}. transfered to alsa less frame then requested. frames_to_deliver: {}, frames_written: {}", play_seq_id_, frames_produced, frames_written);
+		}
+	}
+
+	void AlsaPlaybackService::PcmDrainLoop() {
+
+		// all the frames of a prepared stream are in the buffer. 
+		// nothing to do until go, which will resume the loop
+		if(!start_pcm_) {
 			return;
+		}
 
 		bool is_currently_playing = IsAlsaStatePlaying();
+		snd_pcm_sframes_t delay = 0;
+		if(is_currently_playing && audio_sink_->GetDelay(&delay) < 0) {
+			delay = 0;
+		}
 
 		if(!is_currently_playing) {
 			logger_->info("play_seq_id: {}. playing audio file ended successfully (transfered all frames to pcm and it is empty).", play_seq_id_);
+			stream_state_ = StreamStateIdle;
+			PcmDrop();
+			FinishStream();
 			return;
 		}
 
+		// the mirrors may have frames which did not fit in their buffers yet
+		mirror_outputs_->Pump();
 		CheckSongStartTime();
 
-		alsa_wait_timer_.expires_from_now(boost::posix_time::millisec(5));
-		alsa_wait_timer_.async_wait(std::bind(&AlsaPlaybackService::PcmDrainLoop, this, std::placeholders::_1));
+		if(audio_sink_->SetDrainWakeup()) {
+			ScheduleLoopOnPcmReady();
+			return;
+		}
+		ScheduleLoopAfterDrainWait(delay);
 	}
 
 	void AlsaPlaybackService::PcmDrop() 
 	{
-		int err;
-		if( (err = snd_pcm_drop(alsa_playback_handle_)) < 0 ) {
-			std::stringstream err_desc;
-			err_desc << "snd_pcm_drop failed (" << snd_strerror(err) << ")";
-			throw std::runtime_error(err_desc.str());
-		}
+		mirror_outputs_->Drop();
+		audio_sink_->Drop();
 	}
 
+	/*
+	Calculate the wall clock time at which position 0 of the file was played, and report it
+	when it changes.
+	The pcm status holds the delay together with the time at which the hw pointer was sampled, 
+	so the calculation is not affected by the time it takes to query it. 
+	The timestamps are on the (monotonic) clock configured for the pcm, and are translated 
+	to wall clock with a single offset, so adjustments of the system time while playing 
+	(NTP steps for example) do not move the reported start time.
+	*/
 	void AlsaPlaybackService::CheckSongStartTime() {
-		int err;
-		snd_pcm_sframes_t delay = 0;
 
-		if( (err = snd_pcm_delay(alsa_playback_handle_, &delay)) < 0) {
-			std::stringstream err_desc;
-			err_desc << "cannot query current offset in buffer (" << snd_strerror(err) << ")";
-			throw std::runtime_error(err_desc.str());
-		}	 
+		AlsaPcmPositionSnapshot snapshot = audio_sink_->GetPositionSnapshot();
 
-		// this is a magic number test to remove end of file wrong reporting
-		if(delay < 4096) {
+		// a prepared stream has frames in the buffer, but the audio does not advance
+		if(snapshot.state != SND_PCM_STATE_RUNNING || snapshot.delay <= 0 || snapshot.tstamp_us == 0) {
 			return;
 		}
-		int64_t pos_in_frames = curr_position_frames_ - delay;
-		int64_t ms_since_audio_file_start = ((pos_in_frames * (int64_t)1000) / (int64_t)frame_rate_);
 
-		struct timeval tv;
-		gettimeofday(&tv, NULL);
-		// convert sec to ms and usec to ms
-		uint64_t curr_time_ms_since_epoch = (uint64_t)(tv.tv_sec) * 1000 + (uint64_t)(tv.tv_usec) / 1000;
-		uint64_t audio_file_start_time_ms_since_epoch = (int64_t)curr_time_ms_since_epoch - ms_since_audio_file_start;
+		if(!has_tstamp_to_epoch_offset_) {
+			tstamp_to_epoch_offset_us_ = audio_sink_->GetTimestampToEpochOffsetUs();
+			has_tstamp_to_epoch_offset_ = true;
+		}
+
+		int64_t time_us = snapshot.tstamp_us + tstamp_to_epoch_offset_us_;
+		// the speed of the sound card clock is measured on the frames it played, which is independent of the resampling
+		card_clock_estimator_.AddMeasurement(time_us, frames_written_to_pcm_ - snapshot.delay);
+		mirror_outputs_->Align(snapshot.tstamp_us, frames_written_to_pcm_ - snapshot.delay, card_clock_estimator_.GetSpeed());
+
+		int64_t pos_in_frames = curr_position_frames_ - snapshot.delay;
+		if(drift_compensation_) {
+			// delay is in resampled frames, and some file frames are still in the resampler
+			double delay_in_file_frames = (double)snapshot.delay / resampler_.GetRatio() + resampler_.GetPendingInputFrames();
+			pos_in_frames = curr_position_frames_ - (int64_t)std::llround(delay_in_file_frames);
+			UpdateDriftCompensation(time_us);
+		}
+		position_estimator_.AddMeasurement(time_us, pos_in_frames);
 
-		int64_t diff_from_prev = audio_file_start_time_ms_since_epoch - audio_start_time_ms_since_epoch_;
-		// there might be small jittering, we don't want to update the value often.
-		if(diff_from_prev <= 1 && diff_from_prev >= -1)
+		// clients extrapolate the position from the last report. 
+		// report again only when that extrapolation is too far from the estimation
+		double prediction_error_us = position_estimator_.PredictionErrorUs(reported_start_time_us_, reported_speed_, time_us);
+		if(has_reported_start_time_ && !report_new_track_ && prediction_error_us < position_report_error_us_) {
 			return;
+		}
 
-		player_events_callback_->NewSongStatus(file_id_, play_seq_id_, audio_file_start_time_ms_since_epoch, 1.0);
+		double start_time_us = position_estimator_.GetStartTimeUs();
+		double speed = position_estimator_.GetSpeed();
+		uint64_t audio_file_start_time_us_since_epoch = (uint64_t)std::llround(start_time_us);
+		player_events_callback_->NewSongStatus(file_id_, play_seq_id_, audio_file_start_time_us_since_epoch, speed);
 
 		std::stringstream msg_stream;
 		msg_stream << "play_seq_id: " << play_seq_id_ << ". ";
-		msg_stream << "calculated a new audio file start time: " << audio_file_start_time_ms_since_epoch << " (ms since epoch). ";
-		if(audio_start_time_ms_since_epoch_ > 0) {
-			msg_stream << "this is a change since last calculation of " << diff_from_prev << " ms. ";
+		msg_stream << "calculated a new audio file start time: " << audio_file_start_time_us_since_epoch << " (us since epoch), ";
+		msg_stream << "speed: " << speed << " (sound card drift " << 
+			(drift_compensation_ ? card_clock_estimator_.GetDriftPpm() : position_estimator_.GetDriftPpm()) << " ppm";
+		if(drift_compensation_) {
+			msg_stream << ", compensated with resampling ratio " << resampler_.GetRatio();
+		}
+		msg_stream << "). ";
+		if(has_reported_start_time_) {
+			msg_stream << "previous report was off by " << (int64_t)prediction_error_us << " us. ";
 		}
-		msg_stream << "pcm delay in frames as reported by alsa: " << delay << " and position in file is " << 
-			ms_since_audio_file_start << " ms. ";
+		msg_stream << "pcm delay in frames as reported by alsa: " << snapshot.delay << " and position in file is " << 
+			(pos_in_frames * 1000) / (int64_t)frame_rate_ << " ms. ";
 		logger_->info(msg_stream.str());
 
-		audio_start_time_ms_since_epoch_ = audio_file_start_time_ms_since_epoch;
+		has_reported_start_time_ = true;
+		report_new_track_ = false;
+		reported_start_time_us_ = start_time_us;
+		reported_speed_ = speed;
+	}
+
+	/*
+	Set the resampling ratio, so the file is played at exactly the wall clock rate, and the
+	start time which was reported first does not change for the whole stream.
+	The speed of the sound card clock is measured on the frames it played (CheckSongStartTime).
+	Resampling by this ratio cancels the drift. 
+	The remaining error in position (from the time it took to measure the drift), is corrected
+	slowly, so the rate change is not audible.
+	*/
+	void AlsaPlaybackService::UpdateDriftCompensation(int64_t time_us) {
+
+		double correction = 0.0;
+		if(has_reported_start_time_ && position_estimator_.HasEstimation()) {
+			// positive if the file is played ahead of the reported start time, and should be slowed down
+			double position_error_us = position_estimator_.GetPositionUs(time_us) - ((double)time_us - reported_start_time_us_);
+			const double max_correction = MAX_DRIFT_CORRECTION_PPM / 1000000.0;
+			correction = std::min(std::max(position_error_us / DRIFT_CORRECTION_TIME_US, -max_correction), max_correction);
+		}
+
+		resampler_.SetRatio(card_clock_estimator_.GetSpeed() * (1.0 + correction));
 	}
 
 	bool AlsaPlaybackService::IsAlsaStatePlaying() 
 	{
-		int status = snd_pcm_state(alsa_playback_handle_);
+		int status = audio_sink_->GetState();
 		// the code had SND_PCM_STATE_PREPARED as well.
 		// it is removed, to resolve issue of song start playing after end of file.
 		// the drain function would not finish since the status is 'SND_PCM_STATE_PREPARED'
@@ -598,12 +1773,40 @@ namespace wavplayeralsa
     void AlsaPlaybackServiceFactory::Initialize(
             std::shared_ptr<spdlog::logger> logger,
 			PlayerEventsIfc *player_events_callback,
-            const std::string &audio_device
+            AudioCache *audio_cache,
+            CueMixer *cue_mixer,
+            VolumeControl *volume_control,
+            const std::string &audio_device,
+            const std::vector<MirrorDeviceConfig> &mirror_devices,
+            RenderClock *render_clock,
+            bool use_mmap_access,
+            const std::string &alsa_tstamp_type,
+            const AlsaPcmBufferConfig &alsa_buffer_config,
+            int audio_ring_ms,
+            int position_report_error_us,
+            bool drift_compensation,
+            int crossfade_ms,
+            const std::string &crossfade_curve,
+            int audio_thread_rt_priority,
+            int audio_thread_cpu
         )
     {
         logger_ = logger;
 		player_events_callback_ = player_events_callback;
+		audio_cache_ = audio_cache;
+		cue_mixer_ = cue_mixer;
+		volume_control_ = volume_control;
         audio_device_ = audio_device;
+		audio_ring_ms_ = audio_ring_ms;
+		position_report_error_us_ = position_report_error_us;
+		drift_compensation_ = drift_compensation;
+		crossfade_ms_ = crossfade_ms;
+		crossfade_curve_ = (crossfade_curve == "linear") ? Crossfader::CurveLinear : Crossfader::CurveEqualPower;
+
+		audio_sink_ = CreateAudioSink(logger_, audio_device_, use_mmap_access, alsa_tstamp_type, alsa_buffer_config, render_clock);
+		mirror_outputs_.Initialize(logger_, mirror_devices, alsa_tstamp_type);
+		audio_worker_.Initialize(logger_->clone("audio_worker"), audio_thread_rt_priority, audio_thread_cpu);
+		audio_producer_.Initialize(logger_->clone("audio_producer"));
     }
 
     IAlsaPlaybackService* AlsaPlaybackServiceFactory::CreateAlsaPlaybackService(
@@ -617,9 +1820,37 @@ namespace wavplayeralsa
 			player_events_callback_,
             full_file_name,
             file_id,
-			audio_device_,
+			audio_sink_.get(),
+			&audio_worker_,
+			&audio_producer_,
+			audio_cache_,
+			cue_mixer_,
+			volume_control_,
+			&mirror_outputs_,
+			audio_ring_ms_,
+			position_report_error_us_,
+			drift_compensation_,
+			crossfade_ms_,
+			crossfade_curve_,
 			play_seq_id
         );
     }
 
+    XrunStats AlsaPlaybackServiceFactory::QueryXrunStats()
+    {
+        return audio_sink_->QueryXrunStats();
+    }
+
+    AudioDeviceStatus AlsaPlaybackServiceFactory::QueryAudioDeviceStatus()
+    {
+        AudioDeviceStatus status = audio_sink_->QueryStatus();
+        AudioRingMetrics ring_metrics = audio_producer_.QueryMetrics();
+        status.ring_capacity_frames = ring_metrics.capacity_frames;
+        status.ring_fill_frames = ring_metrics.fill_frames;
+        status.ring_min_fill_frames = ring_metrics.min_fill_frames;
+        status.ring_underruns = ring_metrics.underruns;
+        status.mirrors = mirror_outputs_.QueryStatus();
+        return status;
+    }
+
 }
\ No newline at end of file
@@ -4,6 +4,15 @@
 #include "spdlog/spdlog.h"
 
 #include "player_events_ifc.h"
+#include "player_actions_ifc.h"
+#include "services/audio_sink.h"
+#include "services/audio_worker.h"
+#include "services/audio_producer.h"
+#include "services/audio_cache.h"
+#include "services/crossfader.h"
+#include "services/cue_mixer.h"
+#include "services/volume_control.h"
+#include "services/mirror_outputs.h"
 
 namespace wavplayeralsa
 {
@@ -17,18 +26,55 @@ namespace wavplayeralsa
     public:
         virtual const std::string GetFileId() const = 0;
         virtual void Play(int64_t offset_in_ms) = 0;
+        // play such that position offset_in_ms is audible at start_at_epoch_us (wall clock, micro-seconds since epoch)
+        virtual void PlayAt(int64_t offset_in_ms, uint64_t start_at_epoch_us) = 0;
+        // fill the pcm buffer from offset_in_ms, but do not start playing until Go is called
+        virtual void Prepare(int64_t offset_in_ms) = 0;
+        // start playing a prepared file. returns false if the service is not waiting for go
+        virtual bool Go() = 0;
+        // change position in the file which is currently playing, and report it with the new play_seq_id.
+        // a file which waits for a scheduled start plays right away from the new position. a prepared file still waits for go.
+        // returns false if the file is no longer playing, and the seek was not performed.
+        virtual bool Seek(int64_t offset_in_ms, uint32_t play_seq_id) = 0;
         virtual bool Stop() = 0;
+        // open a file to be played right after the current one, in the same pcm stream with no gap.
+        // its start is reported with play_seq_id. returns false if it cannot be played gapless
+        // (different audio format, or the current file already ended). throws if the file cannot be opened.
+        virtual bool QueueNext(const std::string &full_file_name, const std::string &file_id, uint32_t play_seq_id) = 0;
+        // remove the queued file. returns false if there is none, or it is already being read
+        virtual bool ClearNext() = 0;
+        // fade the current file out, and full_file_name in from offset_in_ms, reported with play_seq_id.
+        // returns false if crossfade is disabled or not possible (different audio format, or the current file 
+        // is not playing), in which case the file should be played by a new service. throws if the file cannot be opened.
+        virtual bool CrossfadeTo(const std::string &full_file_name, const std::string &file_id, int64_t offset_in_ms, uint32_t play_seq_id) = 0;
 
     };
 
-    class AlsaPlaybackServiceFactory
+    class AlsaPlaybackServiceFactory :
+        public XrunStatsActionsIfc,
+        public AudioDeviceActionsIfc
     {
 
     public:
         void Initialize(
             std::shared_ptr<spdlog::logger> logger,
             PlayerEventsIfc *player_events_callback,
-            const std::string &audio_device
+            AudioCache *audio_cache,
+            CueMixer *cue_mixer,
+            VolumeControl *volume_control,
+            const std::string &audio_device,
+            const std::vector<MirrorDeviceConfig> &mirror_devices,
+            RenderClock *render_clock,
+            bool use_mmap_access,
+            const std::string &alsa_tstamp_type,
+            const AlsaPcmBufferConfig &alsa_buffer_config,
+            int audio_ring_ms,
+            int position_report_error_us,
+            bool drift_compensation,
+            int crossfade_ms,
+            const std::string &crossfade_curve,
+            int audio_thread_rt_priority,
+            int audio_thread_cpu
         );
 
     public:
@@ -39,13 +85,41 @@ namespace wavplayeralsa
             uint32_t play_seq_id
         );
 
+    public:
+        // XrunStatsActionsIfc
+        XrunStats QueryXrunStats();
+
+        // AudioDeviceActionsIfc
+        AudioDeviceStatus QueryAudioDeviceStatus();
+
 
 	private:
 		std::shared_ptr<spdlog::logger> logger_;
 
     private:
         PlayerEventsIfc *player_events_callback_;
+        AudioCache *audio_cache_;
+        CueMixer *cue_mixer_;
+        VolumeControl *volume_control_;
         std::string audio_device_;
+        int audio_ring_ms_ = 500;
+        int position_report_error_us_ = 500;
+        bool drift_compensation_ = false;
+        int crossfade_ms_ = 0;
+        Crossfader::Curve crossfade_curve_ = Crossfader::CurveEqualPower;
+
+        // single sink for the device (alsa pcm, or simulated), shared by all the playback services
+        // which are created by this factory (one at a time).
+        std::unique_ptr<AudioSink> audio_sink_;
+
+        // extra devices which play the same audio as the main device, in sync with it
+        MirrorOutputs mirror_outputs_;
+
+        // thread on which all playback services created by this factory transfer audio
+        AudioWorker audio_worker_;
+
+        // thread on which all playback services created by this factory read audio ahead
+        AudioProducer audio_producer_;
 
     };
 
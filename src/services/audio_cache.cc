@@ -0,0 +1,163 @@
+#include "services/audio_cache.h"
+
+#include <sstream>
+#include <algorithm>
+
+#include "sndfile.hh"
+
+namespace wavplayeralsa
+{
+
+	AudioCache::~AudioCache()
+	{
+		{
+			std::lock_guard<std::mutex> guard(mutex_);
+			stop_loader_ = true;
+		}
+		load_cv_.notify_all();
+		if(loader_thread_.joinable()) {
+			loader_thread_.join();
+		}
+	}
+
+	void AudioCache::Initialize(std::shared_ptr<spdlog::logger> logger, uint64_t budget_bytes)
+	{
+		logger_ = logger;
+		budget_bytes_ = budget_bytes;
+
+		if(IsEnabled()) {
+			loader_thread_ = std::thread(&AudioCache::LoaderThreadMain, this);
+		}
+	}
+
+	std::shared_ptr<const AudioCacheBuffer> AudioCache::Get(const std::string &canonical_path, std::time_t mtime, uint64_t data_size_bytes)
+	{
+		if(!IsEnabled()) {
+			return nullptr;
+		}
+
+		std::lock_guard<std::mutex> guard(mutex_);
+
+		auto it = entries_.find(canonical_path);
+		if(it != entries_.end()) {
+			if(it->second.mtime == mtime) {
+				hits_++;
+				lru_.splice(lru_.begin(), lru_, it->second.lru_it);
+				return it->second.buffer;
+			}
+			// file changed on disk since it was loaded
+			EvictLocked(canonical_path);
+		}
+
+		misses_++;
+
+		if(data_size_bytes > budget_bytes_) {
+			return nullptr;
+		}
+		for(const LoadRequest &request : load_queue_) {
+			if(request.canonical_path == canonical_path) {
+				return nullptr;
+			}
+		}
+		load_queue_.push_back(LoadRequest{canonical_path, mtime, data_size_bytes});
+		load_cv_.notify_one();
+		return nullptr;
+	}
+
+	AudioCacheStats AudioCache::QueryAudioCacheStats()
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+
+		AudioCacheStats stats;
+		stats.hits = hits_;
+		stats.misses = misses_;
+		stats.resident_bytes = resident_bytes_;
+		stats.budget_bytes = budget_bytes_;
+		stats.entries = entries_.size();
+		return stats;
+	}
+
+	void AudioCache::LoaderThreadMain()
+	{
+		while(true) {
+
+			LoadRequest request;
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				load_cv_.wait(lock, [this]{ return stop_loader_ || !load_queue_.empty(); });
+				if(stop_loader_) {
+					return;
+				}
+				request = load_queue_.front();
+				load_queue_.pop_front();
+			}
+
+			try {
+				std::shared_ptr<AudioCacheBuffer> buffer = LoadFile(request);
+				Put(request, buffer);
+				logger_->info("loaded audio file '{}' to cache ({} bytes)", request.canonical_path, buffer->size());
+			}
+			catch(const std::runtime_error &e) {
+				logger_->warn("cannot load audio file '{}' to cache: {}", request.canonical_path, e.what());
+			}
+		}
+	}
+
+	std::shared_ptr<AudioCacheBuffer> AudioCache::LoadFile(const LoadRequest &request)
+	{
+		SndfileHandle snd_file(request.canonical_path);
+		if(snd_file.error() != 0) {
+			std::stringstream err_desc;
+			err_desc << "file cannot be opened. error msg: '" << snd_file.strError() << "'";
+			throw std::runtime_error(err_desc.str());
+		}
+
+		std::shared_ptr<AudioCacheBuffer> buffer = std::make_shared<AudioCacheBuffer>(request.data_size_bytes);
+		uint64_t total_read = 0;
+		while(total_read < buffer->size()) {
+			sf_count_t bytes_read = snd_file.readRaw(buffer->data() + total_read, buffer->size() - total_read);
+			if(bytes_read <= 0) {
+				break;
+			}
+			total_read += bytes_read;
+		}
+		if(total_read != buffer->size()) {
+			std::stringstream err_desc;
+			err_desc << "read " << total_read << " bytes, expected " << buffer->size();
+			throw std::runtime_error(err_desc.str());
+		}
+		return buffer;
+	}
+
+	void AudioCache::Put(const LoadRequest &request, std::shared_ptr<const AudioCacheBuffer> buffer)
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+
+		EvictLocked(request.canonical_path);
+
+		while(resident_bytes_ + buffer->size() > budget_bytes_ && !lru_.empty()) {
+			const std::string least_recently_used = lru_.back();
+			logger_->info("evicting audio file '{}' from cache", least_recently_used);
+			EvictLocked(least_recently_used);
+		}
+
+		lru_.push_front(request.canonical_path);
+		Entry &entry = entries_[request.canonical_path];
+		entry.mtime = request.mtime;
+		entry.buffer = buffer;
+		entry.lru_it = lru_.begin();
+		resident_bytes_ += buffer->size();
+	}
+
+	void AudioCache::EvictLocked(const std::string &canonical_path)
+	{
+		auto it = entries_.find(canonical_path);
+		if(it == entries_.end()) {
+			return;
+		}
+		resident_bytes_ -= it->second.buffer->size();
+		lru_.erase(it->second.lru_it);
+		entries_.erase(it);
+	}
+
+}
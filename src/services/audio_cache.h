@@ -0,0 +1,98 @@
+#ifndef WAVPLAYERALSA_AUDIO_CACHE_H__
+#define WAVPLAYERALSA_AUDIO_CACHE_H__
+
+#include <string>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <vector>
+#include <list>
+#include <deque>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include "spdlog/spdlog.h"
+
+#include "player_actions_ifc.h"
+
+namespace wavplayeralsa
+{
+
+    // raw frames of a whole audio file, exactly as read with SndfileHandle::readRaw
+    typedef std::vector<char> AudioCacheBuffer;
+
+    /*
+    LRU cache of ready-to-play audio files in RAM, limited by a memory budget.
+    Entries are keyed by canonical path, and are valid only for the modification time
+    of the file when it was loaded.
+    On a miss, the file is loaded in the background by a dedicated loader thread,
+    so the current play is not delayed, and the next play of the file starts from RAM.
+    Buffers are shared, so an entry which is evicted while playing stays valid
+    until the playback service releases it.
+    */
+    class AudioCache :
+        public AudioCacheActionsIfc
+    {
+
+    public:
+        ~AudioCache();
+
+        // budget_bytes of 0 disables the cache
+        void Initialize(std::shared_ptr<spdlog::logger> logger, uint64_t budget_bytes);
+
+    public:
+        bool IsEnabled() const { return budget_bytes_ > 0; }
+
+        // returns nullptr on miss, in which case the file is scheduled for loading
+        // (if it fits the budget).
+        // data_size_bytes is the expected size of the audio data of the file.
+        std::shared_ptr<const AudioCacheBuffer> Get(const std::string &canonical_path, std::time_t mtime, uint64_t data_size_bytes);
+
+    public:
+        // AudioCacheActionsIfc
+        AudioCacheStats QueryAudioCacheStats();
+
+    private:
+        struct LoadRequest {
+            std::string canonical_path;
+            std::time_t mtime;
+            uint64_t data_size_bytes;
+        };
+
+        void LoaderThreadMain();
+        std::shared_ptr<AudioCacheBuffer> LoadFile(const LoadRequest &request);
+        void Put(const LoadRequest &request, std::shared_ptr<const AudioCacheBuffer> buffer);
+        void EvictLocked(const std::string &canonical_path);
+
+    private:
+        std::shared_ptr<spdlog::logger> logger_;
+        uint64_t budget_bytes_ = 0;
+
+    private:
+        struct Entry {
+            std::time_t mtime;
+            std::shared_ptr<const AudioCacheBuffer> buffer;
+            std::list<std::string>::iterator lru_it;
+        };
+
+        std::mutex mutex_; // guards all the members below
+        std::unordered_map<std::string, Entry> entries_;
+        std::list<std::string> lru_; // most recently used first
+        uint64_t resident_bytes_ = 0;
+        uint64_t hits_ = 0;
+        uint64_t misses_ = 0;
+
+    private:
+        // background loading
+        std::deque<LoadRequest> load_queue_;
+        std::condition_variable load_cv_;
+        bool stop_loader_ = false;
+        std::thread loader_thread_;
+
+    };
+
+}
+
+#endif // WAVPLAYERALSA_AUDIO_CACHE_H__
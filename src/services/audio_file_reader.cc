@@ -0,0 +1,233 @@
+#include "services/audio_file_reader.h"
+
+#include <sstream>
+#include <cstring>
+#include <algorithm>
+
+#include <boost/filesystem.hpp>
+
+namespace wavplayeralsa
+{
+
+	/*
+	Read the file content from disk, extract relevant metadata from the
+	wav header, and save it to the relevant members of the class.
+	The function will also initialize the source from which frames are read
+	(cache, memory mapped file, or the snd_file member).
+	Will throw std::runtime_error in case of error.
+	 */
+	void AudioFileReader::Open(std::shared_ptr<spdlog::logger> logger, const std::string &full_file_name, AudioCache *audio_cache)
+	{
+		logger_ = logger;
+
+		snd_file_ = SndfileHandle(full_file_name);
+		if(snd_file_.error() != 0) {
+			std::stringstream errorDesc;
+			errorDesc << "The file '" << full_file_name << "' cannot be opened. error msg: '" << snd_file_.strError() << "'";
+			throw std::runtime_error(errorDesc.str());
+		}
+
+		// set the parameters from read from the SndFile and produce log messages
+
+		frame_rate_ = snd_file_.samplerate();
+		num_of_channels_ = snd_file_.channels();
+
+		int major_type = snd_file_.format() & SF_FORMAT_TYPEMASK;
+		int minor_type = snd_file_.format() & SF_FORMAT_SUBMASK;
+
+		switch(minor_type) {
+			case SF_FORMAT_PCM_S8: 
+				bytes_per_sample_ = 1;
+				sample_type_ = SampleTypeSigned;
+				break;
+			case SF_FORMAT_PCM_16: 
+				bytes_per_sample_ = 2;
+				sample_type_ = SampleTypeSigned;
+				break;
+			case SF_FORMAT_PCM_24: 
+				bytes_per_sample_ = 3;
+				sample_type_ = SampleTypeSigned;
+				break;
+			case SF_FORMAT_PCM_32: 
+				bytes_per_sample_ = 4;
+				sample_type_ = SampleTypeSigned;
+				break;
+			case SF_FORMAT_FLOAT:
+				bytes_per_sample_ = 4;
+				sample_type_ = SampleTypeFloat;
+				break;
+			case SF_FORMAT_DOUBLE:
+				bytes_per_sample_ = 8;
+				sample_type_ = SampleTypeFloat;
+				break;
+			default:
+				std::stringstream err_desc;
+				err_desc << "wav file is in unsupported format. minor format as read from sndFile is: " << std::hex << minor_type;
+				throw std::runtime_error(err_desc.str());
+		}
+
+		switch(major_type) {
+			case SF_FORMAT_WAV:
+				is_endian_little_ = true;
+				break;
+			case SF_FORMAT_AIFF:
+				is_endian_little_ = false;
+				break;
+			default:
+				std::stringstream err_desc;
+				err_desc << "wav file is in unsupported format. major format as read from sndFile is: " << std::hex << major_type;
+				throw std::runtime_error(err_desc.str());
+		}
+
+		total_frame_in_file_ = snd_file_.frames();
+		uint64_t number_of_ms = total_frame_in_file_ * 1000 / frame_rate_;
+		int number_of_minutes = number_of_ms / (1000 * 60);
+		int seconds_modulo = (number_of_ms / 1000) % 60;	
+
+		bytes_per_frame_ = num_of_channels_ * bytes_per_sample_;
+
+		logger_->info("finished reading audio file '{}'. "
+			"Frame rate: {} frames per seconds, "
+			"Number of channels: {}, "
+			"Wav format: major 0x{:x}, minor 0x{:x}, "
+			"Bytes per sample: {}, "
+			"Sample type: '{}', "
+			"Endian: '{}', "
+			"Total frames in file: {} which are: {} ms, and {}:{} minutes", 
+				full_file_name, frame_rate_, num_of_channels_, major_type, minor_type, bytes_per_sample_, 
+				SampleTypeToString(sample_type_), 
+				(is_endian_little_ ? "little" : "big"),
+				total_frame_in_file_, number_of_ms, number_of_minutes, seconds_modulo
+			);
+
+		uint64_t data_size_bytes = total_frame_in_file_ * bytes_per_frame_;
+
+		boost::system::error_code mtime_error;
+		std::time_t mtime = boost::filesystem::last_write_time(full_file_name, mtime_error);
+		if(audio_cache != nullptr && !mtime_error) {
+			cached_data_ = audio_cache->Get(full_file_name, mtime, data_size_bytes);
+		}
+		if(cached_data_) {
+			logger_->info("audio file '{}' is played from cache", full_file_name);
+			return;
+		}
+
+		try {
+			mapped_file_.Open(full_file_name, (major_type == SF_FORMAT_AIFF), data_size_bytes);
+		}
+		catch(const std::runtime_error &e) {
+			logger_->info("audio file '{}' cannot be memory mapped, frames will be read with libsndfile. reason: {}", full_file_name, e.what());
+		}
+
+	}
+
+	const char *AudioFileReader::SampleTypeToString(SampleType sample_type) {
+		switch(sample_type) {
+	    	case SampleTypeSigned: return "signed integer";
+	    	case SampleTypeUnsigned: return "unsigned integer";
+	    	case SampleTypeFloat: return "float";
+		}
+		std::stringstream err_desc;
+		err_desc << "sample type not supported. value is " << (int)sample_type;
+		throw std::runtime_error(err_desc.str());
+	}
+
+	bool AudioFileReader::GetFormatForAlsa(snd_pcm_format_t &out_format) const {
+		switch(sample_type_) {
+
+			case SampleTypeSigned: {
+				if(is_endian_little_) {
+					switch(bytes_per_sample_) {
+						case 1: out_format = SND_PCM_FORMAT_S8; return true;
+						case 2: out_format = SND_PCM_FORMAT_S16_LE; return true;
+						case 3: out_format = SND_PCM_FORMAT_S24_3LE; return true;
+						case 4: out_format = SND_PCM_FORMAT_S32_LE; return true;
+					}
+				}
+				else {
+					switch(bytes_per_sample_) {
+						case 1: out_format = SND_PCM_FORMAT_S8; return true;
+						case 2: out_format = SND_PCM_FORMAT_S16_BE; return true;
+						case 3: out_format = SND_PCM_FORMAT_S24_3BE; return true;
+						case 4: out_format = SND_PCM_FORMAT_S32_BE; return true;
+					}
+				}
+			}
+			break;
+
+			case SampleTypeUnsigned: {
+				if(is_endian_little_) {
+					switch(bytes_per_sample_) {
+						case 1: out_format = SND_PCM_FORMAT_U8; return true;
+						case 2: out_format = SND_PCM_FORMAT_U16_LE; return true;
+						case 3: out_format = SND_PCM_FORMAT_U24_3LE; return true;
+						case 4: out_format = SND_PCM_FORMAT_U32_LE; return true;
+					}
+				}
+				else {
+					switch(bytes_per_sample_) {
+						case 1: out_format = SND_PCM_FORMAT_U8; return true;
+						case 2: out_format = SND_PCM_FORMAT_U16_BE; return true;
+						case 3: out_format = SND_PCM_FORMAT_U24_3BE; return true;
+						case 4: out_format = SND_PCM_FORMAT_U32_BE; return true;
+					}
+				}
+			}
+			break;
+
+			case SampleTypeFloat: {
+				if(is_endian_little_) {
+					switch(bytes_per_sample_) {
+						case 4: out_format = SND_PCM_FORMAT_FLOAT_LE; return true;
+						case 8: out_format = SND_PCM_FORMAT_FLOAT64_LE; return true;
+					}
+				}
+				else {
+					switch(bytes_per_sample_) {
+						case 4: out_format = SND_PCM_FORMAT_FLOAT_BE; return true;
+						case 8: out_format = SND_PCM_FORMAT_FLOAT64_BE; return true;
+					}
+				}			
+
+			}
+			break;
+
+		}
+		return false;
+	}
+
+	void AudioFileReader::Seek(int64_t position_frames) {
+		if(cached_data_) {
+			cached_data_position_ = std::min((uint64_t)position_frames * bytes_per_frame_, (uint64_t)cached_data_->size());
+		}
+		else if(mapped_file_.IsOpen()) {
+			mapped_file_.Seek(position_frames * bytes_per_frame_);
+		}
+		else {
+			snd_file_.seek(position_frames, SEEK_SET);
+		}
+	}
+
+	int64_t AudioFileReader::Read(char *dest, int64_t max_frames) {
+
+		if(cached_data_) {
+			uint64_t bytes = std::min((uint64_t)max_frames * bytes_per_frame_, cached_data_->size() - cached_data_position_);
+			memcpy(dest, cached_data_->data() + cached_data_position_, bytes);
+			cached_data_position_ += bytes;
+			return bytes / bytes_per_frame_;
+		}
+
+		if(mapped_file_.IsOpen()) {
+			return mapped_file_.Read(dest, max_frames * bytes_per_frame_) / bytes_per_frame_;
+		}
+
+		sf_count_t bytes_read = snd_file_.readRaw(dest, max_frames * bytes_per_frame_);
+		if(bytes_read < 0) {
+			std::stringstream err_desc;
+			err_desc << "Failed reading raw frames from snd file. returned: " << sf_error_number(bytes_read);
+			throw std::runtime_error(err_desc.str());				
+		}
+		return bytes_read / bytes_per_frame_;
+	}
+
+}
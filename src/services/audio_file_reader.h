@@ -0,0 +1,83 @@
+#ifndef WAVPLAYERALSA_AUDIO_FILE_READER_H__
+#define WAVPLAYERALSA_AUDIO_FILE_READER_H__
+
+#include <string>
+#include <memory>
+#include <cstdint>
+
+#include "alsa/asoundlib.h"
+#include "sndfile.hh"
+#include "spdlog/spdlog.h"
+
+#include "services/mapped_audio_file.h"
+#include "services/audio_cache.h"
+
+namespace wavplayeralsa
+{
+
+    /*
+    Reads the raw frames of an audio file, in the sample format of the file.
+    Frames are read from the audio cache if the file is cached, directly from a memory 
+    mapped file if it needs no decoding, and with libsndfile otherwise.
+    Not thread safe. The owner should make sure it is used by one thread at a time.
+    */
+    class AudioFileReader
+    {
+
+    public:
+        // open the file and read its header. audio_cache can be null, to read the file directly.
+        // will throw std::runtime_error in case of error.
+        void Open(std::shared_ptr<spdlog::logger> logger, const std::string &full_file_name, AudioCache *audio_cache);
+
+    public:
+        // the alsa format of the samples in the file (24 bit samples are packed, 3 bytes each).
+        // false if the sample format of the file cannot be played by alsa
+        bool GetFormatForAlsa(snd_pcm_format_t &out_format) const;
+
+        unsigned int GetFrameRate() const { return frame_rate_; }
+        unsigned int GetNumOfChannels() const { return num_of_channels_; }
+        unsigned int GetBytesPerFrame() const { return bytes_per_frame_; }
+        uint64_t GetTotalFrames() const { return total_frame_in_file_; }
+
+        // set the position of the next frame to read
+        void Seek(int64_t position_frames);
+
+        // read up to max_frames frames to dest. returns the number of frames read, 0 at end of file.
+        // will throw std::runtime_error in case of error.
+        int64_t Read(char *dest, int64_t max_frames);
+
+    private:
+        enum SampleType {
+            SampleTypeSigned = 0,
+            SampleTypeUnsigned = 1,
+            SampleTypeFloat = 2
+        };
+        static const char *SampleTypeToString(SampleType sample_type);
+
+    private:
+        std::shared_ptr<spdlog::logger> logger_;
+
+        SndfileHandle snd_file_;
+        // for files which need no decoding, frames are read directly from memory mapped file.
+        // if not open, frames are read with snd_file_
+        MappedAudioFile mapped_file_;
+        // if the file is in the audio cache, frames are read from RAM.
+        std::shared_ptr<const AudioCacheBuffer> cached_data_;
+        uint64_t cached_data_position_ = 0; // in bytes
+
+        // from file
+        unsigned int frame_rate_ = 44100;
+        unsigned int num_of_channels_ = 2;
+        bool is_endian_little_ = true; // if false the endian is big :)
+        SampleType sample_type_ = SampleTypeSigned;
+        unsigned int bytes_per_sample_ = 2;
+        uint64_t total_frame_in_file_ = 0;
+
+        // calculated
+        unsigned int bytes_per_frame_ = 1;
+
+    };
+
+}
+
+#endif // WAVPLAYERALSA_AUDIO_FILE_READER_H__
@@ -0,0 +1,97 @@
+#include "services/audio_frames_ring.h"
+
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+namespace wavplayeralsa
+{
+
+	AudioFramesRing::AudioFramesRing() :
+		write_index_(0),
+		end_of_stream_(false),
+		read_index_(0)
+	{
+
+	}
+
+	void AudioFramesRing::Initialize(size_t capacity_bytes)
+	{
+		void *buffer = nullptr;
+		if(posix_memalign(&buffer, CACHE_LINE_SIZE, std::max(capacity_bytes, (size_t)1)) != 0) {
+			throw std::runtime_error("cannot allocate audio frames ring");
+		}
+		buffer_.reset((char *)buffer);
+		capacity_ = capacity_bytes;
+		Reset();
+	}
+
+	void AudioFramesRing::Reset()
+	{
+		write_index_.store(0, std::memory_order_relaxed);
+		read_index_.store(0, std::memory_order_relaxed);
+		cached_read_index_ = 0;
+		cached_write_index_ = 0;
+		// publish the reset to the producer thread, which is started after it
+		end_of_stream_.store(false, std::memory_order_release);
+	}
+
+	size_t AudioFramesRing::GetFillBytes() const
+	{
+		size_t read_index = read_index_.load(std::memory_order_acquire);
+		return write_index_.load(std::memory_order_acquire) - read_index;
+	}
+
+	size_t AudioFramesRing::GetWriteRegion(char **region)
+	{
+		size_t write_index = write_index_.load(std::memory_order_relaxed);
+		if(write_index - cached_read_index_ == capacity_) {
+			cached_read_index_ = read_index_.load(std::memory_order_acquire);
+		}
+		size_t free_bytes = capacity_ - (write_index - cached_read_index_);
+		size_t offset = write_index % capacity_;
+		*region = buffer_.get() + offset;
+		return std::min(free_bytes, capacity_ - offset);
+	}
+
+	void AudioFramesRing::CommitWrite(size_t bytes)
+	{
+		write_index_.store(write_index_.load(std::memory_order_relaxed) + bytes, std::memory_order_release);
+	}
+
+	void AudioFramesRing::SetEndOfStream()
+	{
+		end_of_stream_.store(true, std::memory_order_release);
+	}
+
+	size_t AudioFramesRing::Peek(char *dest, size_t max_bytes)
+	{
+		size_t read_index = read_index_.load(std::memory_order_relaxed);
+		if(cached_write_index_ - read_index < max_bytes) {
+			cached_write_index_ = write_index_.load(std::memory_order_acquire);
+		}
+		size_t bytes = std::min(max_bytes, cached_write_index_ - read_index);
+
+		// the filled region might wrap around the end of the buffer
+		size_t offset = read_index % capacity_;
+		size_t first_part = std::min(bytes, capacity_ - offset);
+		memcpy(dest, buffer_.get() + offset, first_part);
+		memcpy(dest + first_part, buffer_.get(), bytes - first_part);
+		return bytes;
+	}
+
+	void AudioFramesRing::CommitRead(size_t bytes)
+	{
+		read_index_.store(read_index_.load(std::memory_order_relaxed) + bytes, std::memory_order_release);
+	}
+
+	bool AudioFramesRing::IsDrained()
+	{
+		// end of stream is set after the last write, so once it is seen, the write index is final
+		if(!end_of_stream_.load(std::memory_order_acquire)) {
+			return false;
+		}
+		return GetFillBytes() == 0;
+	}
+
+}
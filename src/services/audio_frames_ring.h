@@ -0,0 +1,90 @@
+#ifndef WAVPLAYERALSA_AUDIO_FRAMES_RING_H__
+#define WAVPLAYERALSA_AUDIO_FRAMES_RING_H__
+
+#include <cstddef>
+#include <cstdlib>
+#include <atomic>
+#include <memory>
+
+namespace wavplayeralsa
+{
+
+    /*
+    Lock free single-producer single-consumer ring of audio bytes.
+    The producer (file reading thread) writes directly into the free region of the ring,
+    and the consumer (audio thread) copies from the filled region, so neither side
+    ever blocks on the other.
+    The write and read indices only increase (they are taken modulo the capacity when
+    accessing the buffer), so a full ring is distinguished from an empty one.
+    Each side keeps its index, and a cached copy of the other side's index, on its own
+    cache line. The other side's index is only loaded again when the cached copy shows
+    no room, which keeps the cache lines from bouncing between the cores on every call.
+    The capacity should be a multiple of the frame size, so regions always hold whole frames.
+    */
+    class AudioFramesRing
+    {
+
+    public:
+        AudioFramesRing();
+
+        // not thread safe. should be called before the producer and consumer start
+        void Initialize(size_t capacity_bytes);
+
+        // discard all the content. should only be called when the producer is not running
+        void Reset();
+
+        size_t GetCapacityBytes() const { return capacity_; }
+
+        // bytes available for the consumer. can be called from any thread
+        size_t GetFillBytes() const;
+
+    // producer
+    public:
+        // contiguous free region, starting at *region. returns its size in bytes
+        size_t GetWriteRegion(char **region);
+        void CommitWrite(size_t bytes);
+
+        // no more bytes will be written (until Reset)
+        void SetEndOfStream();
+
+        // total bytes written since Reset. marks a position in the stream
+        size_t GetBytesWritten() const { return write_index_.load(std::memory_order_relaxed); }
+
+    // consumer
+    public:
+        // copy up to max_bytes bytes to dest, without consuming them. returns the number of bytes copied
+        size_t Peek(char *dest, size_t max_bytes);
+        void CommitRead(size_t bytes);
+
+        // true if the producer ended the stream, and all of it was consumed
+        bool IsDrained();
+
+        // total bytes consumed since Reset
+        size_t GetBytesRead() const { return read_index_.load(std::memory_order_relaxed); }
+
+    private:
+        static const size_t CACHE_LINE_SIZE = 64;
+
+        struct FreeDeleter {
+            void operator()(char *p) const { free(p); }
+        };
+        std::unique_ptr<char, FreeDeleter> buffer_;
+        size_t capacity_ = 0;
+
+        // written by the producer
+        char producer_line_pad_[CACHE_LINE_SIZE];
+        std::atomic<size_t> write_index_;
+        size_t cached_read_index_ = 0;
+        std::atomic<bool> end_of_stream_;
+
+        // written by the consumer
+        char consumer_line_pad_[CACHE_LINE_SIZE];
+        std::atomic<size_t> read_index_;
+        size_t cached_write_index_ = 0;
+        char end_pad_[CACHE_LINE_SIZE];
+
+    };
+
+}
+
+#endif // WAVPLAYERALSA_AUDIO_FRAMES_RING_H__
@@ -0,0 +1,102 @@
+#include "services/audio_position_estimator.h"
+
+#include <cmath>
+
+namespace wavplayeralsa
+{
+
+	void AudioPositionEstimator::Initialize(unsigned int frame_rate)
+	{
+		frame_rate_ = frame_rate;
+		Reset();
+	}
+
+	void AudioPositionEstimator::Reset()
+	{
+		measurements_.clear();
+		start_time_us_ = 0.0;
+		speed_ = 1.0;
+	}
+
+	void AudioPositionEstimator::AddMeasurement(int64_t time_us, int64_t position_frames)
+	{
+		double position_us = (double)position_frames * 1000000.0 / (double)frame_rate_;
+
+		if(HasEstimation()) {
+			if(std::abs(position_us - GetPositionUs(time_us)) > STEP_THRESHOLD_US) {
+				Reset();
+			}
+			else if(time_us - measurements_.back().time_us < MIN_MEASUREMENT_INTERVAL_US) {
+				return;
+			}
+		}
+
+		measurements_.push_back(Measurement{time_us, position_us});
+		while(measurements_.front().time_us < time_us - WINDOW_US) {
+			measurements_.pop_front();
+		}
+
+		Fit();
+	}
+
+	void AudioPositionEstimator::ShiftPosition(double delta_us)
+	{
+		for(Measurement &m : measurements_) {
+			m.position_us += delta_us;
+		}
+		start_time_us_ -= delta_us / speed_;
+	}
+
+	double AudioPositionEstimator::PredictionErrorUs(double start_time_us, double speed, int64_t time_us) const
+	{
+		double predicted_position_us = ((double)time_us - start_time_us) * speed;
+		return std::abs(predicted_position_us - GetPositionUs(time_us));
+	}
+
+	/*
+	Least squares fit of position = (time - start_time) * speed over the measurements in the window.
+	Times are taken relative to the first measurement, so the sums keep their precision.
+	Until the window is long enough for the slope to be meaningful, only the start time is fitted,
+	with the nominal speed.
+	*/
+	void AudioPositionEstimator::Fit()
+	{
+		const int64_t time_ref_us = measurements_.front().time_us;
+		const double n = (double)measurements_.size();
+
+		double sum_x = 0.0, sum_y = 0.0;
+		for(const Measurement &m : measurements_) {
+			sum_x += (double)(m.time_us - time_ref_us);
+			sum_y += m.position_us;
+		}
+		double mean_x = sum_x / n;
+		double mean_y = sum_y / n;
+
+		double speed = 1.0;
+		int64_t span_us = measurements_.back().time_us - time_ref_us;
+		if(span_us >= MIN_SPAN_FOR_SPEED_US) {
+			double sxx = 0.0, sxy = 0.0;
+			for(const Measurement &m : measurements_) {
+				double dx = (double)(m.time_us - time_ref_us) - mean_x;
+				sxx += dx * dx;
+				sxy += dx * (m.position_us - mean_y);
+			}
+			double fitted_speed = sxy / sxx;
+			// anything further than this from nominal is not a clock drift, but bad measurements
+			static const double MAX_DRIFT = 0.001;
+			if(std::abs(fitted_speed - 1.0) <= MAX_DRIFT) {
+				speed = fitted_speed;
+			}
+		}
+
+		// the fitted line goes through (mean_x, mean_y)
+		speed_ = speed;
+		start_time_us_ = (double)time_ref_us + mean_x - mean_y / speed;
+	}
+
+	double AudioPositionEstimator::GetPositionUs(int64_t time_us) const
+	{
+		return ((double)time_us - start_time_us_) * speed_;
+	}
+
+}
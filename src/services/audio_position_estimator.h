@@ -0,0 +1,85 @@
+#ifndef WAVPLAYERALSA_AUDIO_POSITION_ESTIMATOR_H__
+#define WAVPLAYERALSA_AUDIO_POSITION_ESTIMATOR_H__
+
+#include <cstdint>
+#include <deque>
+
+namespace wavplayeralsa
+{
+
+    /*
+    Estimates the audio position of a playing stream as a linear function of wall clock time.
+    Measurements (a frame, and the time it was played) are fitted with least squares over
+    a sliding window, so the jitter of single measurements is averaged out, and the slope
+    tracks the drift of the sound card clock relative to the system clock.
+    The estimation is expressed like the status reported to clients: the time at which
+    position 0 was played, and the speed of the audio relative to wall clock
+    (1.0 if the sound card clock is exact).
+    */
+    class AudioPositionEstimator
+    {
+
+    public:
+        void Initialize(unsigned int frame_rate);
+
+        // forget all measurements. called when the position changes (seek, new stream)
+        void Reset();
+
+        // the frame at position_frames was played at time_us (wall clock, micro seconds since epoch).
+        // a measurement which does not match the current estimation (after an xrun for example)
+        // restarts the estimation.
+        void AddMeasurement(int64_t time_us, int64_t position_frames);
+
+        // continue the estimation with positions moved by delta_us (stream continues with another file).
+        // the measurements are kept, so the speed is not measured again
+        void ShiftPosition(double delta_us);
+
+    public:
+        bool HasEstimation() const { return !measurements_.empty(); }
+
+        // wall clock time (micro seconds since epoch) at which position 0 was played
+        double GetStartTimeUs() const { return start_time_us_; }
+
+        // audio clock / wall clock
+        double GetSpeed() const { return speed_; }
+
+        // sound card clock drift in parts per million. positive if audio plays faster than wall clock
+        double GetDriftPpm() const { return (speed_ - 1.0) * 1000000.0; }
+
+        // how far (in micro seconds of audio) a position calculated with start_time_us and speed
+        // is from the estimation, at time_us
+        double PredictionErrorUs(double start_time_us, double speed, int64_t time_us) const;
+
+        // estimated audio position at time_us, in micro seconds of audio (at the nominal frame rate)
+        double GetPositionUs(int64_t time_us) const;
+
+    private:
+        void Fit();
+
+    private:
+        // measurements older than this are removed from the window
+        static const int64_t WINDOW_US = 20 * 1000000LL;
+        // measurements closer than this to the previous one are ignored, so the window is not dominated by bursts
+        static const int64_t MIN_MEASUREMENT_INTERVAL_US = 20000;
+        // the slope is only fitted once the measurements span this much time. before that, speed is 1.0
+        static const int64_t MIN_SPAN_FOR_SPEED_US = 2 * 1000000LL;
+        // a measurement this far from the estimation means the audio really jumped
+        static const int64_t STEP_THRESHOLD_US = 5000;
+
+        struct Measurement {
+            int64_t time_us;
+            double position_us; // position in the file, converted to micro seconds with the nominal frame rate
+        };
+
+        unsigned int frame_rate_ = 44100;
+        std::deque<Measurement> measurements_;
+
+        // estimation: position_us = (time_us - start_time_us_) * speed_
+        double start_time_us_ = 0.0;
+        double speed_ = 1.0;
+
+    };
+
+}
+
+#endif // WAVPLAYERALSA_AUDIO_POSITION_ESTIMATOR_H__
@@ -0,0 +1,134 @@
+#include "services/audio_producer.h"
+
+#include <chrono>
+
+namespace wavplayeralsa
+{
+
+	const int AudioProducer::IDLE_WAIT_MS;
+
+	AudioProducer::AudioProducer() :
+		stop_requested_(false),
+		wakeup_pending_(false),
+		ring_capacity_frames_(0),
+		ring_fill_frames_(0),
+		ring_min_fill_frames_(0),
+		ring_underruns_(0)
+	{
+
+	}
+
+	AudioProducer::~AudioProducer()
+	{
+		{
+			std::lock_guard<std::mutex> guard(mutex_);
+			exit_ = true;
+			stop_requested_ = true;
+		}
+		job_cv_.notify_all();
+		if(producer_thread_.joinable()) {
+			producer_thread_.join();
+		}
+	}
+
+	void AudioProducer::Initialize(std::shared_ptr<spdlog::logger> logger)
+	{
+		logger_ = logger;
+		producer_thread_ = std::thread(&AudioProducer::ProducerThreadMain, this);
+	}
+
+	void AudioProducer::Start(AudioProducerJobIfc *job)
+	{
+		Stop();
+		{
+			std::lock_guard<std::mutex> guard(mutex_);
+			job_ = job;
+			job_generation_++;
+			job_done_ = false;
+			stop_requested_ = false;
+		}
+		job_cv_.notify_all();
+	}
+
+	void AudioProducer::Stop()
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		job_ = nullptr;
+		stop_requested_ = true;
+		job_cv_.notify_all();
+		idle_cv_.wait(lock, [this] { return !job_running_; });
+	}
+
+	void AudioProducer::Wakeup()
+	{
+		// notify without the lock. if the producer misses it, it wakes up on IDLE_WAIT_MS
+		wakeup_pending_.store(true, std::memory_order_release);
+		job_cv_.notify_one();
+	}
+
+	void AudioProducer::ResetMetrics(uint64_t capacity_frames)
+	{
+		ring_capacity_frames_ = capacity_frames;
+		ring_fill_frames_ = 0;
+		ring_min_fill_frames_ = capacity_frames;
+	}
+
+	void AudioProducer::ReportRingFill(uint64_t fill_frames, bool device_playing)
+	{
+		ring_fill_frames_.store(fill_frames, std::memory_order_relaxed);
+		// the ring starts empty. the low water mark is only meaningful once the device plays from it
+		if(device_playing && fill_frames < ring_min_fill_frames_.load(std::memory_order_relaxed)) {
+			ring_min_fill_frames_.store(fill_frames, std::memory_order_relaxed);
+		}
+	}
+
+	AudioRingMetrics AudioProducer::QueryMetrics() const
+	{
+		AudioRingMetrics metrics;
+		metrics.capacity_frames = ring_capacity_frames_;
+		metrics.fill_frames = ring_fill_frames_;
+		metrics.min_fill_frames = ring_min_fill_frames_;
+		metrics.underruns = ring_underruns_;
+		return metrics;
+	}
+
+	void AudioProducer::ProducerThreadMain()
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		while(!exit_) {
+
+			if(job_ == nullptr || job_done_) {
+				job_cv_.wait(lock);
+				continue;
+			}
+
+			AudioProducerJobIfc *job = job_;
+			uint64_t job_generation = job_generation_;
+			job_running_ = true;
+			wakeup_pending_ = false;
+			lock.unlock();
+
+			bool more_to_produce = false;
+			try {
+				more_to_produce = job->ProduceAudio(stop_requested_);
+			}
+			catch(const std::exception &e) {
+				// the job is expected to handle its errors. it is not run again
+				logger_->error("unhandled exception in audio producer thread: {}", e.what());
+			}
+
+			lock.lock();
+			job_running_ = false;
+			if(!more_to_produce && job_generation_ == job_generation) {
+				job_done_ = true;
+			}
+			idle_cv_.notify_all();
+
+			// the ring is full. wait until the audio thread consumes some of it
+			job_cv_.wait_for(lock, std::chrono::milliseconds(IDLE_WAIT_MS), [this, job_generation] { 
+				return exit_ || job_generation_ != job_generation || wakeup_pending_.load(std::memory_order_acquire); 
+			});
+		}
+	}
+
+}
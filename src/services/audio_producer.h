@@ -0,0 +1,107 @@
+#ifndef WAVPLAYERALSA_AUDIO_PRODUCER_H__
+#define WAVPLAYERALSA_AUDIO_PRODUCER_H__
+
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include "spdlog/spdlog.h"
+
+namespace wavplayeralsa
+{
+
+    class AudioProducerJobIfc
+    {
+
+    public:
+        // invoked on the producer thread. read frames ahead into the ring, until it is full.
+        // should return early if stop_requested is set.
+        // returns false when there is nothing more to produce (end of stream).
+        virtual bool ProduceAudio(const std::atomic<bool> &stop_requested) = 0;
+
+    };
+
+    // fill level of the ring which feeds the audio thread, in frames
+    struct AudioRingMetrics
+    {
+        uint64_t capacity_frames = 0;
+        uint64_t fill_frames = 0;
+        // lowest fill level seen while the audio device was playing, since the stream started.
+        // close to 0 means the file reads barely kept up with playback
+        uint64_t min_fill_frames = 0;
+        // times the audio thread found the ring empty while the audio device was playing
+        uint64_t underruns = 0;
+    };
+
+    /*
+    A long lived thread which reads (and decodes) audio ahead of playback, into a ring
+    which the audio worker thread consumes. 
+    File reads can stall (slow SD card, page faults on a mapped file, cold cache), and
+    doing them on the audio thread would delay the writes to the audio device. With the 
+    reads on this thread, a stall only lowers the fill level of the ring.
+    A single job (the playback service which is playing) is run at a time. The job is 
+    started and stopped by the audio worker thread. The audio thread wakes the producer
+    when it consumed frames, and the producer also wakes up periodically in case a wakeup
+    was missed, so the audio thread never waits on a lock.
+    */
+    class AudioProducer
+    {
+
+    public:
+        AudioProducer();
+        ~AudioProducer();
+
+        void Initialize(std::shared_ptr<spdlog::logger> logger);
+
+    public:
+        // start running job on the producer thread. any previous job is stopped first
+        void Start(AudioProducerJobIfc *job);
+
+        // stop running the current job. blocks until the job is no longer running on the producer thread
+        void Stop();
+
+        // there is free room in the ring. lock free, can be called from the audio thread
+        void Wakeup();
+
+    public:
+        // updated by the audio thread, read by any thread
+        void ResetMetrics(uint64_t capacity_frames);
+        void ReportRingFill(uint64_t fill_frames, bool device_playing);
+        void ReportRingUnderrun() { ring_underruns_++; }
+        AudioRingMetrics QueryMetrics() const;
+
+    private:
+        void ProducerThreadMain();
+
+    private:
+        std::shared_ptr<spdlog::logger> logger_;
+
+        // producer wakes up at least this often while it has a job, in case a wakeup was missed
+        static const int IDLE_WAIT_MS = 5;
+
+        std::thread producer_thread_;
+        std::mutex mutex_;
+        std::condition_variable job_cv_; // new job, wakeup or exit
+        std::condition_variable idle_cv_; // job returned
+        AudioProducerJobIfc *job_ = nullptr;
+        uint64_t job_generation_ = 0; // changes on every start, even if the job is the same
+        bool job_done_ = false;
+        bool job_running_ = false;
+        bool exit_ = false;
+        std::atomic<bool> stop_requested_;
+        std::atomic<bool> wakeup_pending_;
+
+    private:
+        std::atomic<uint64_t> ring_capacity_frames_;
+        std::atomic<uint64_t> ring_fill_frames_;
+        std::atomic<uint64_t> ring_min_fill_frames_;
+        std::atomic<uint64_t> ring_underruns_;
+
+    };
+
+}
+
+#endif // WAVPLAYERALSA_AUDIO_PRODUCER_H__
@@ -0,0 +1,194 @@
+#include "services/audio_sink.h"
+
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+
+#include "services/alsa_pcm_session.h"
+#include "services/simulated_audio_sink.h"
+#include "services/capture_audio_sink.h"
+
+namespace wavplayeralsa
+{
+
+	void XrunStatsRecorder::Record(const XrunEvent &xrun)
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		stats_.count++;
+		stats_.total_duration_us += xrun.duration_us;
+		stats_.max_duration_us = std::max(stats_.max_duration_us, xrun.duration_us);
+		if(stats_.recent.size() >= MAX_RECENT_XRUNS) {
+			stats_.recent.erase(stats_.recent.begin());
+		}
+		stats_.recent.push_back(xrun);
+	}
+
+	XrunStats XrunStatsRecorder::Query()
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		return stats_;
+	}
+
+	int64_t AudioSink::GetTimestampNowUs() const
+	{
+		struct timespec tstamp_now;
+		clock_gettime(GetTimestampClockId(), &tstamp_now);
+		return (int64_t)tstamp_now.tv_sec * 1000000 + tstamp_now.tv_nsec / 1000;
+	}
+
+	/*
+	The timestamp clock is sampled before and after the wall clock, and the average is used, 
+	so the error is at most half the time between the samples.
+	*/
+	int64_t AudioSink::GetTimestampToEpochOffsetUs() const
+	{
+		clockid_t tstamp_clock_id = GetTimestampClockId();
+		if(tstamp_clock_id == CLOCK_REALTIME) {
+			return 0;
+		}
+
+		struct timespec tstamp_before, epoch_now, tstamp_after;
+		clock_gettime(tstamp_clock_id, &tstamp_before);
+		clock_gettime(CLOCK_REALTIME, &epoch_now);
+		clock_gettime(tstamp_clock_id, &tstamp_after);
+
+		int64_t tstamp_before_us = (int64_t)tstamp_before.tv_sec * 1000000 + tstamp_before.tv_nsec / 1000;
+		int64_t tstamp_after_us = (int64_t)tstamp_after.tv_sec * 1000000 + tstamp_after.tv_nsec / 1000;
+		int64_t epoch_now_us = (int64_t)epoch_now.tv_sec * 1000000 + epoch_now.tv_nsec / 1000;
+		return epoch_now_us - (tstamp_before_us + tstamp_after_us) / 2;
+	}
+
+	/*
+	Parse the 'key=value,...' options of a simulated device.
+	The capture file name is returned in capture_file_name, if it is allowed (not nullptr).
+	*/
+	static SimulatedAudioSinkConfig ParseSimulatedOptions(const std::string &audio_device, const std::string &options, std::string *capture_file_name)
+	{
+		SimulatedAudioSinkConfig config;
+		std::stringstream options_stream(options);
+		std::string option;
+		while(std::getline(options_stream, option, ',')) {
+			if(option.empty()) {
+				continue;
+			}
+			size_t eq_pos = option.find('=');
+			std::string key = option.substr(0, eq_pos);
+			std::string value = eq_pos == std::string::npos ? "" : option.substr(eq_pos + 1);
+			if(eq_pos == std::string::npos || value.empty()) {
+				std::stringstream err_desc;
+				err_desc << "audio device '" << audio_device << "': option '" << option << "' has no value";
+				throw std::runtime_error(err_desc.str());
+			}
+
+			try {
+				size_t parsed_chars = 0;
+				if(key == "delay_us") {
+					config.delay_us = std::stoll(value, &parsed_chars);
+				}
+				else if(key == "jitter_us") {
+					config.jitter_us = std::stoll(value, &parsed_chars);
+				}
+				else if(key == "drift_ppm") {
+					config.drift_ppm = std::stod(value, &parsed_chars);
+				}
+				else if(key == "formats" || key == "channels") {
+					// list separated by '/', since ',' separates the options
+					std::stringstream list_stream(value);
+					std::string item;
+					while(std::getline(list_stream, item, '/')) {
+						if(key == "formats") {
+							snd_pcm_format_t format = snd_pcm_format_value(item.c_str());
+							if(format == SND_PCM_FORMAT_UNKNOWN) {
+								throw std::invalid_argument(item);
+							}
+							config.formats.push_back(format);
+						}
+						else {
+							size_t item_parsed_chars = 0;
+							unsigned long num_of_channels = std::stoul(item, &item_parsed_chars);
+							if(item_parsed_chars != item.size() || num_of_channels == 0) {
+								throw std::invalid_argument(item);
+							}
+							config.channels.push_back((unsigned int)num_of_channels);
+						}
+					}
+					parsed_chars = value.size();
+				}
+				else if(key == "file" && capture_file_name != nullptr) {
+					*capture_file_name = value;
+					parsed_chars = value.size();
+				}
+				else {
+					std::stringstream err_desc;
+					err_desc << "audio device '" << audio_device << "': unknown option '" << key << "'";
+					throw std::runtime_error(err_desc.str());
+				}
+				if(parsed_chars != value.size()) {
+					throw std::invalid_argument(value);
+				}
+			}
+			catch(const std::logic_error &e) {
+				std::stringstream err_desc;
+				err_desc << "audio device '" << audio_device << "': invalid value '" << value << "' for option '" << key << "'";
+				throw std::runtime_error(err_desc.str());
+			}
+		}
+
+		if(config.delay_us < 0 || config.jitter_us < 0) {
+			std::stringstream err_desc;
+			err_desc << "audio device '" << audio_device << "': delay_us and jitter_us cannot be negative";
+			throw std::runtime_error(err_desc.str());
+		}
+		if(config.drift_ppm <= -1000000.0) {
+			std::stringstream err_desc;
+			err_desc << "audio device '" << audio_device << "': drift_ppm must be above -1000000";
+			throw std::runtime_error(err_desc.str());
+		}
+		return config;
+	}
+
+	std::unique_ptr<AudioSink> CreateAudioSink(
+			std::shared_ptr<spdlog::logger> logger,
+			const std::string &audio_device,
+			bool use_mmap_access,
+			const std::string &tstamp_type,
+			const AlsaPcmBufferConfig &buffer_config,
+			RenderClock *render_clock
+		)
+	{
+		const std::string sim_prefix = "sim";
+		const std::string capture_prefix = "capture:";
+
+		if(audio_device == sim_prefix || audio_device.compare(0, sim_prefix.size() + 1, sim_prefix + ":") == 0) {
+			std::string options = audio_device.size() > sim_prefix.size() ? audio_device.substr(sim_prefix.size() + 1) : "";
+			SimulatedAudioSinkConfig config = ParseSimulatedOptions(audio_device, options, nullptr);
+			std::unique_ptr<SimulatedAudioSink> sink(new SimulatedAudioSink());
+			sink->Initialize(logger->clone("simulated_audio_sink"), audio_device, config, buffer_config, render_clock);
+			return sink;
+		}
+
+		if(audio_device.compare(0, capture_prefix.size(), capture_prefix) == 0) {
+			std::string capture_file_name;
+			SimulatedAudioSinkConfig config = ParseSimulatedOptions(audio_device, audio_device.substr(capture_prefix.size()), &capture_file_name);
+			if(capture_file_name.empty()) {
+				std::stringstream err_desc;
+				err_desc << "audio device '" << audio_device << "': capture device requires a 'file' option";
+				throw std::runtime_error(err_desc.str());
+			}
+			std::unique_ptr<CaptureAudioSink> sink(new CaptureAudioSink());
+			sink->Initialize(logger->clone("capture_audio_sink"), audio_device, capture_file_name, config, buffer_config, render_clock);
+			return sink;
+		}
+
+		if(render_clock != nullptr) {
+			std::stringstream err_desc;
+			err_desc << "audio device '" << audio_device << "' cannot be used for rendering. only simulated devices can";
+			throw std::runtime_error(err_desc.str());
+		}
+
+		std::unique_ptr<AlsaPcmSession> sink(new AlsaPcmSession());
+		sink->Initialize(logger->clone("alsa_pcm_session"), audio_device, use_mmap_access, tstamp_type, buffer_config);
+		return sink;
+	}
+
+}
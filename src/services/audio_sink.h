@@ -0,0 +1,178 @@
+#ifndef WAVPLAYERALSA_AUDIO_SINK_H__
+#define WAVPLAYERALSA_AUDIO_SINK_H__
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <mutex>
+#include <time.h>
+#include <poll.h>
+
+#include "alsa/asoundlib.h"
+#include "spdlog/spdlog.h"
+
+#include "player_actions_ifc.h"
+
+namespace wavplayeralsa
+{
+
+    class RenderClock;
+
+    // the parameters of an audio stream which require hw params negotiation
+    // with the audio device when they change.
+    struct AlsaPcmStreamParams
+    {
+        snd_pcm_format_t format = SND_PCM_FORMAT_S16_LE;
+        unsigned int frame_rate = 44100;
+        unsigned int num_of_channels = 2;
+
+        bool operator==(const AlsaPcmStreamParams &other) const {
+            return format == other.format && frame_rate == other.frame_rate && num_of_channels == other.num_of_channels;
+        }
+        bool operator!=(const AlsaPcmStreamParams &other) const { return !(*this == other); }
+    };
+
+    // requested size of the pcm buffer. values are negotiated with the device
+    // to the nearest it supports. 0 leaves the choice to the device
+    struct AlsaPcmBufferConfig
+    {
+        unsigned int buffer_time_us = 0;
+        // period_time_us takes precedence over periods, if both are set
+        unsigned int period_time_us = 0;
+        unsigned int periods = 0;
+    };
+
+    // consistent snapshot of the playback position, taken from the pcm status
+    struct AlsaPcmPositionSnapshot
+    {
+        snd_pcm_state_t state = SND_PCM_STATE_OPEN;
+        // frames which were written to the pcm, and were not yet played
+        snd_pcm_sframes_t delay = 0;
+        // the time at which delay was sampled, in micro seconds on the session timestamp clock
+        int64_t tstamp_us = 0;
+    };
+
+    /*
+    Where the playback services write their frames. The main implementation is the alsa pcm
+    (AlsaPcmSession). The simulated sinks consume the frames on a virtual sample clock, so the
+    whole playback pipeline runs (and can be measured) on a machine with no audio device.
+    The interface follows the alsa pcm: the same states, and the frame transfer functions return
+    a negative error code like the snd_pcm_* functions (-EPIPE on xrun), so the transfer loop
+    handles all the sinks the same way. The functions which configure the stream throw
+    std::runtime_error in case of error.
+    All the functions are called on the audio worker thread, except for the Query functions.
+    */
+    class AudioSink
+    {
+
+    public:
+        virtual ~AudioSink() { }
+
+    public:
+        // true if the sink can play a stream with the given params, without converting them.
+        // will throw std::runtime_error if the device cannot be queried
+        virtual bool IsStreamParamsSupported(const AlsaPcmStreamParams &params) = 0;
+
+        // make the sink ready (in PREPARED state, empty buffer) for a new stream with the given params.
+        virtual void StartStream(const AlsaPcmStreamParams &params) = 0;
+
+        // discard all frames which are pending in the buffer, and prepare for receiving new frames.
+        virtual void DropAndPrepare() = 0;
+
+        // stop immediately, discarding pending frames.
+        virtual void Drop() = 0;
+
+        // like snd_pcm_start. the sink never starts by itself when frames are written to it
+        virtual int Start() = 0;
+
+        virtual snd_pcm_state_t GetState() = 0;
+
+        // like snd_pcm_avail_update, snd_pcm_delay and snd_pcm_writei
+        virtual snd_pcm_sframes_t AvailUpdate() = 0;
+        virtual int GetDelay(snd_pcm_sframes_t *delay) = 0;
+        virtual snd_pcm_sframes_t Write(const void *buffer, snd_pcm_uframes_t frames) = 0;
+
+        // true if frames should be transfered with MmapBegin / MmapCommit, and false if with Write.
+        virtual bool IsMmapAccess() const = 0;
+        virtual int MmapBegin(const snd_pcm_channel_area_t **areas, snd_pcm_uframes_t *offset, snd_pcm_uframes_t *frames) = 0;
+        virtual snd_pcm_sframes_t MmapCommit(snd_pcm_uframes_t offset, snd_pcm_uframes_t frames) = 0;
+
+        // number of frames in a period. the poll descriptors signal when at least
+        // that many frames can be written.
+        virtual snd_pcm_uframes_t GetPeriodSize() const = 0;
+
+        // the descriptors to wait on for the sink to be ready for writing.
+        // they are valid as long as the device is not reopened (only StartStream can reopen).
+        virtual std::vector<struct pollfd> GetPollDescriptors() const = 0;
+
+        // must be called after a wait on the descriptors returns
+        virtual unsigned short GetPollRevents(std::vector<struct pollfd> &poll_fds) = 0;
+
+        // recover after an xrun (err is -EPIPE) or suspend (err is -ESTRPIPE),
+        // and record it in the xrun statistics. the sink is then prepared and empty.
+        // returns the time (in micro seconds) from the xrun until it was recovered.
+        virtual uint64_t RecoverXrun(int err) = 0;
+
+        // delay and timestamp are sampled together
+        virtual AlsaPcmPositionSnapshot GetPositionSnapshot() = 0;
+
+        // the clock on which the timestamps are taken
+        virtual clockid_t GetTimestampClockId() const = 0;
+
+        // the current time on the timestamp clock, in micro seconds
+        virtual int64_t GetTimestampNowUs() const;
+
+        // offset to add to a timestamp to get wall clock time (micro seconds since epoch)
+        virtual int64_t GetTimestampToEpochOffsetUs() const;
+
+        // wake up the poll descriptors when all the frames in the buffer were played.
+        // returns false if the sink cannot (the alsa pcm descriptors are always ready while draining),
+        // in which case the caller should sleep for the delay instead
+        virtual bool SetDrainWakeup() { return false; }
+
+    public:
+        // can be called from any thread
+        virtual AudioDeviceStatus QueryStatus() = 0;
+        virtual XrunStats QueryXrunStats() = 0;
+
+    };
+
+    // xrun statistics of a sink. Record is called on the audio worker thread, and Query from any thread
+    class XrunStatsRecorder
+    {
+
+    public:
+        void Record(const XrunEvent &xrun);
+        XrunStats Query();
+
+    private:
+        static const size_t MAX_RECENT_XRUNS = 32;
+        std::mutex mutex_;
+        XrunStats stats_;
+
+    };
+
+    /*
+    Create the sink for audio_device:
+    'sim' or 'sim:<options>' - simulated sink, which consumes frames on a virtual sample clock.
+    'capture:file=<path>[,<options>]' - simulated sink, which also writes the frames it played to a wav file.
+    anything else - alsa pcm device name.
+    Options are 'key=value' separated by ',': delay_us, jitter_us, drift_ppm, and formats and channels
+    as lists separated by '/' (see SimulatedAudioSinkConfig).
+    If render_clock is not nullptr, the simulated sinks play on it instead of the system clock,
+    and alsa devices cannot be used.
+    will throw std::runtime_error if the options are invalid.
+    */
+    std::unique_ptr<AudioSink> CreateAudioSink(
+        std::shared_ptr<spdlog::logger> logger,
+        const std::string &audio_device,
+        bool use_mmap_access,
+        const std::string &tstamp_type,
+        const AlsaPcmBufferConfig &buffer_config,
+        RenderClock *render_clock
+    );
+
+}
+
+#endif // WAVPLAYERALSA_AUDIO_SINK_H__
@@ -0,0 +1,121 @@
+#include "services/audio_worker.h"
+
+#include <sstream>
+#include <cstring>
+#include <functional>
+
+#include <pthread.h>
+#include <sched.h>
+
+namespace wavplayeralsa
+{
+
+	AudioWorker::AudioWorker()
+	{
+
+	}
+
+	AudioWorker::~AudioWorker()
+	{
+		ios_work_.reset();
+		ios_.stop();
+		if(worker_thread_.joinable()) {
+			worker_thread_.join();
+		}
+	}
+
+	void AudioWorker::Initialize(
+			std::shared_ptr<spdlog::logger> logger,
+			int rt_priority,
+			int cpu_affinity
+		)
+	{
+		logger_ = logger;
+		rt_priority_ = rt_priority;
+		cpu_affinity_ = cpu_affinity;
+
+		ios_work_.reset(new boost::asio::io_service::work(ios_));
+		worker_thread_ = std::thread(&AudioWorker::WorkerThreadMain, this);
+	}
+
+	void AudioWorker::SendCommand(const AudioWorkerCommand &command)
+	{
+		// the queue is large enough for any reasonable burst of commands.
+		// if it is full, the worker is busy, and we wait for it to catch up
+		while(!commands_.push(command)) {
+			std::this_thread::yield();
+		}
+
+		// wake up the worker in case it is waiting for alsa
+		ios_.post(std::bind(&AudioWorker::ProcessCommands, this));
+	}
+
+	bool AudioWorker::SendCommandAndWait(AudioWorkerCommand command)
+	{
+		std::promise<bool> done;
+		std::future<bool> result = done.get_future();
+		command.done = &done;
+		SendCommand(command);
+		return result.get();
+	}
+
+	void AudioWorker::WorkerThreadMain()
+	{
+		SetThreadScheduling();
+
+		while(true) {
+			try {
+				ios_.run();
+				break;
+			}
+			catch(const std::exception &e) {
+				// handlers are expected to handle their errors.
+				// the worker must keep running for the next commands
+				logger_->error("unhandled exception in audio worker thread: {}", e.what());
+			}
+		}
+	}
+
+	/*
+	Set the scheduling policy and cpu affinity of the worker thread according to configuration.
+	Failure is not fatal (usually it is missing permissions for real time scheduling),
+	the player will work with default scheduling.
+	*/
+	void AudioWorker::SetThreadScheduling()
+	{
+		int err;
+
+		if(rt_priority_ > 0) {
+			struct sched_param param;
+			memset(&param, 0, sizeof(param));
+			param.sched_priority = rt_priority_;
+			if( (err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param)) != 0) {
+				logger_->warn("cannot set SCHED_FIFO priority {} for audio thread ({}). using default scheduling", rt_priority_, strerror(err));
+			}
+			else {
+				logger_->info("audio thread is running with SCHED_FIFO priority {}", rt_priority_);
+			}
+		}
+
+		if(cpu_affinity_ >= 0) {
+			cpu_set_t cpu_set;
+			CPU_ZERO(&cpu_set);
+			CPU_SET(cpu_affinity_, &cpu_set);
+			if( (err = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set)) != 0) {
+				logger_->warn("cannot pin audio thread to cpu {} ({})", cpu_affinity_, strerror(err));
+			}
+			else {
+				logger_->info("audio thread is pinned to cpu {}", cpu_affinity_);
+			}
+		}
+	}
+
+	void AudioWorker::ProcessCommands()
+	{
+		AudioWorkerCommand command;
+		while(commands_.pop(command)) {
+			command.handler->HandleAudioCommand(command);
+		}
+	}
+
+}
@@ -0,0 +1,106 @@
+#ifndef WAVPLAYERALSA_AUDIO_WORKER_H__
+#define WAVPLAYERALSA_AUDIO_WORKER_H__
+
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <future>
+
+#include <boost/asio.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
+
+#include "spdlog/spdlog.h"
+
+namespace wavplayeralsa
+{
+
+    class AudioWorkerCommandHandlerIfc;
+
+    struct AudioWorkerCommand
+    {
+        enum Type {
+            Play = 0,
+            PlayAt = 1,
+            Prepare = 2,
+            Go = 3,
+            Seek = 4,
+            Stop = 5,
+            Crossfade = 6
+        };
+
+        Type type = Play;
+        AudioWorkerCommandHandlerIfc *handler = nullptr;
+        int64_t offset_in_ms = 0;
+        uint64_t start_at_epoch_us = 0; // PlayAt only
+        uint32_t play_seq_id = 0;
+        // if not null, handler should set a value when the command is done.
+        // the thread that sent the command waits on it.
+        std::promise<bool> *done = nullptr;
+    };
+
+    class AudioWorkerCommandHandlerIfc
+    {
+
+    public:
+        // always invoked on the audio worker thread
+        virtual void HandleAudioCommand(const AudioWorkerCommand &command) = 0;
+
+    };
+
+    /*
+    A single long lived thread which runs all the audio transfer work (talking to alsa,
+    reading audio files), isolated from the networking io_service.
+    Commands (play / seek / stop) are sent to the worker over a lock free single-producer
+    single-consumer queue. The producer is the controller, which runs on the main io_service
+    thread, so commands should only be sent from that thread.
+    The thread can optionally run with real time (SCHED_FIFO) priority, and be pinned to a cpu.
+    */
+    class AudioWorker
+    {
+
+    public:
+        AudioWorker();
+        ~AudioWorker();
+
+        // start the worker thread.
+        // rt_priority - SCHED_FIFO priority for the thread (1-99). 0 keeps the default scheduling policy.
+        // cpu_affinity - index of cpu to pin the thread to. negative value means no pinning.
+        void Initialize(
+            std::shared_ptr<spdlog::logger> logger,
+            int rt_priority,
+            int cpu_affinity
+        );
+
+    public:
+        boost::asio::io_service &GetIoService() { return ios_; }
+
+        // enqueue a command for the worker. does not wait for the command to be handled.
+        void SendCommand(const AudioWorkerCommand &command);
+
+        // enqueue a command for the worker, and wait for the handler to complete it.
+        bool SendCommandAndWait(AudioWorkerCommand command);
+
+    private:
+        void WorkerThreadMain();
+        void SetThreadScheduling();
+        void ProcessCommands();
+
+    private:
+        std::shared_ptr<spdlog::logger> logger_;
+        int rt_priority_ = 0;
+        int cpu_affinity_ = -1;
+
+    private:
+        static const int COMMAND_QUEUE_CAPACITY = 64;
+        boost::lockfree::spsc_queue<AudioWorkerCommand, boost::lockfree::capacity<COMMAND_QUEUE_CAPACITY>> commands_;
+
+    private:
+        boost::asio::io_service ios_;
+        std::unique_ptr<boost::asio::io_service::work> ios_work_;
+        std::thread worker_thread_;
+
+    };
+
+}
+
+#endif // WAVPLAYERALSA_AUDIO_WORKER_H__
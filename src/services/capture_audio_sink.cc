@@ -0,0 +1,137 @@
+#include "services/capture_audio_sink.h"
+
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+namespace wavplayeralsa
+{
+
+	void CaptureAudioSink::Initialize(
+			std::shared_ptr<spdlog::logger> logger,
+			const std::string &audio_device,
+			const std::string &capture_file_name,
+			const SimulatedAudioSinkConfig &config,
+			const AlsaPcmBufferConfig &buffer_config,
+			RenderClock *render_clock
+		)
+	{
+		SimulatedAudioSink::Initialize(logger, audio_device, config, buffer_config, render_clock);
+		capture_file_name_ = capture_file_name;
+	}
+
+	/*
+	The wav subtype for the sample format. 0 if a wav file cannot hold it.
+	*/
+	int CaptureAudioSink::SndfileFormatOf(snd_pcm_format_t format)
+	{
+		switch(format) {
+			case SND_PCM_FORMAT_U8: return SF_FORMAT_PCM_U8;
+			case SND_PCM_FORMAT_S16_LE: return SF_FORMAT_PCM_16;
+			case SND_PCM_FORMAT_S24_3LE: return SF_FORMAT_PCM_24;
+			case SND_PCM_FORMAT_S32_LE: return SF_FORMAT_PCM_32;
+			case SND_PCM_FORMAT_FLOAT_LE: return SF_FORMAT_FLOAT;
+			case SND_PCM_FORMAT_FLOAT64_LE: return SF_FORMAT_DOUBLE;
+			default: return 0;
+		}
+	}
+
+	bool CaptureAudioSink::IsStreamParamsSupported(const AlsaPcmStreamParams &params)
+	{
+		return SndfileFormatOf(params.format) != 0 && SimulatedAudioSink::IsStreamParamsSupported(params);
+	}
+
+	void CaptureAudioSink::StartStream(const AlsaPcmStreamParams &params)
+	{
+		SimulatedAudioSink::StartStream(params);
+		if(!has_file_params_ || params != file_params_) {
+			OpenFile(params);
+		}
+	}
+
+	/*
+	The frames are written as they are in the pcm buffer, so the file has the sample format of the stream.
+	*/
+	void CaptureAudioSink::OpenFile(const AlsaPcmStreamParams &params)
+	{
+		int sndfile_format = SndfileFormatOf(params.format);
+		if(sndfile_format == 0) {
+			std::stringstream err_desc;
+			err_desc << "sample format " << snd_pcm_format_name(params.format) << " cannot be captured to a wav file";
+			throw std::runtime_error(err_desc.str());
+		}
+
+		std::string file_name = capture_file_name_;
+		if(file_index_ > 0) {
+			size_t extension_pos = file_name.rfind('.');
+			size_t dir_pos = file_name.rfind('/');
+			if(extension_pos == std::string::npos || (dir_pos != std::string::npos && extension_pos < dir_pos)) {
+				extension_pos = file_name.size();
+			}
+			file_name.insert(extension_pos, "." + std::to_string(file_index_));
+		}
+
+		capture_file_ = SndfileHandle(file_name, SFM_WRITE, SF_FORMAT_WAV | sndfile_format, params.num_of_channels, params.frame_rate);
+		if(capture_file_.error() != SF_ERR_NO_ERROR) {
+			std::stringstream err_desc;
+			err_desc << "cannot open capture file '" << file_name << "' (" << capture_file_.strError() << ")";
+			capture_file_ = SndfileHandle();
+			throw std::runtime_error(err_desc.str());
+		}
+		capture_file_.command(SFC_SET_UPDATE_HEADER_AUTO, nullptr, SF_TRUE);
+
+		file_params_ = params;
+		has_file_params_ = true;
+		file_start_ns_ = (file_index_ == 0 && GetRenderClock() != nullptr) ? GetRenderClock()->GetStartNs() : NowNs();
+		file_frames_ = 0;
+		file_index_++;
+		bytes_per_frame_ = (snd_pcm_format_physical_width(params.format) / 8) * params.num_of_channels;
+		logger_->info("capturing played audio to file '{}'", file_name);
+	}
+
+	/*
+	On a render clock, the silence from the end of the previous stream is written when the next one starts.
+	*/
+	int CaptureAudioSink::Start()
+	{
+		int err = SimulatedAudioSink::Start();
+		if(err == 0 && GetRenderClock() != nullptr && capture_file_) {
+			const AlsaPcmStreamParams &params = GetStreamParams();
+			int64_t frames_until_now = (NowNs() - file_start_ns_) * params.frame_rate / 1000000000;
+			PadSilence(frames_until_now - file_frames_);
+		}
+		return err;
+	}
+
+	void CaptureAudioSink::PadSilence(int64_t frames)
+	{
+		if(frames <= 0) {
+			return;
+		}
+		const AlsaPcmStreamParams &params = GetStreamParams();
+		const int64_t CHUNK_FRAMES = 4096;
+		std::vector<char> silence(CHUNK_FRAMES * bytes_per_frame_);
+		snd_pcm_format_set_silence(params.format, silence.data(), CHUNK_FRAMES * params.num_of_channels);
+		while(frames > 0 && capture_file_) {
+			int64_t chunk_frames = std::min(frames, CHUNK_FRAMES);
+			OnFramesPlayed(silence.data(), chunk_frames);
+			frames -= chunk_frames;
+		}
+	}
+
+	void CaptureAudioSink::OnFramesPlayed(const char *frames, snd_pcm_uframes_t num_of_frames)
+	{
+		if(!capture_file_) {
+			return;
+		}
+		sf_count_t bytes = (sf_count_t)num_of_frames * bytes_per_frame_;
+		if(capture_file_.writeRaw(frames, bytes) != bytes) {
+			logger_->error("writing to capture file failed ({}). capture is stopped", capture_file_.strError());
+			capture_file_ = SndfileHandle();
+			return;
+		}
+		file_frames_ += num_of_frames;
+	}
+
+}
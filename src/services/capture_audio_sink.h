@@ -0,0 +1,67 @@
+#ifndef WAVPLAYERALSA_CAPTURE_AUDIO_SINK_H__
+#define WAVPLAYERALSA_CAPTURE_AUDIO_SINK_H__
+
+#include <string>
+#include <memory>
+
+#include "sndfile.hh"
+#include "spdlog/spdlog.h"
+
+#include "services/simulated_audio_sink.h"
+
+namespace wavplayeralsa
+{
+
+    /*
+    A simulated audio device, which also writes the frames it played to a wav file, in play order.
+    Time in which nothing was played (stopped, xrun) is not in the file.
+    The file is written on the audio worker thread, when the virtual clock advances. 
+    Its header is updated on every write, so it is valid while the player is still running.
+    Streams with the same format continue the same file. When the format changes, the next file is
+    started, named with a running number before the extension (show.wav, show.1.wav, ...).
+    On a render clock, the time between streams is filled with silence, so a frame in the file is
+    at the time it was played (the first file starts at the start of the clock).
+    */
+    class CaptureAudioSink :
+        public SimulatedAudioSink
+    {
+
+    public:
+        void Initialize(
+            std::shared_ptr<spdlog::logger> logger,
+            const std::string &audio_device,
+            const std::string &capture_file_name,
+            const SimulatedAudioSinkConfig &config,
+            const AlsaPcmBufferConfig &buffer_config,
+            RenderClock *render_clock
+        );
+
+    public:
+        bool IsStreamParamsSupported(const AlsaPcmStreamParams &params);
+        void StartStream(const AlsaPcmStreamParams &params);
+        int Start();
+
+    protected:
+        void OnFramesPlayed(const char *frames, snd_pcm_uframes_t num_of_frames);
+
+    private:
+        static int SndfileFormatOf(snd_pcm_format_t format);
+        void OpenFile(const AlsaPcmStreamParams &params);
+        void PadSilence(int64_t frames);
+
+    private:
+        std::string capture_file_name_;
+        SndfileHandle capture_file_;
+        bool has_file_params_ = false;
+        AlsaPcmStreamParams file_params_;
+        unsigned int file_index_ = 0;
+        unsigned int bytes_per_frame_ = 4;
+        // render clock only. time of the first frame in the file, and the number of frames in it
+        int64_t file_start_ns_ = 0;
+        int64_t file_frames_ = 0;
+
+    };
+
+}
+
+#endif // WAVPLAYERALSA_CAPTURE_AUDIO_SINK_H__
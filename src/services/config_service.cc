@@ -1,5 +1,7 @@
 #include "services/config_service.h"
 
+#include <cctype>
+
 #include <boost/filesystem.hpp>
 #include <boost/lexical_cast.hpp>
 #include "cxxopts/cxxopts.hpp"
@@ -11,6 +13,7 @@ ConfigService::ConfigService()
 {
 	const std::string current_working_directory = boost::filesystem::current_path().string();
 	wav_dir_ = current_working_directory; // default value
+	render_dir_ = current_working_directory;
 }
 
 bool ConfigService::InitFromCmdArguments(int argc, char *argv[])
@@ -26,7 +29,25 @@ bool ConfigService::InitFromCmdArguments(int argc, char *argv[])
 		("mqtt_host", "host for the mqtt message broker", cxxopts::value<std::string>())
 		("mqtt_port", "port on which mqtt message broker listen for client connections", cxxopts::value<uint16_t>()->default_value(std::to_string(mqtt_port_)))
 		("log_dir", "directory for log file (directory must exist, will not be created)", cxxopts::value<std::string>())
-		("audio_device", "audio device for playback. can be string like 'plughw:0,0'. use 'aplay -l' to list available devices", cxxopts::value<std::string>()->default_value(audio_device_))
+		("audio_device", "audio device for playback. can be string like 'plughw:0,0'. use 'aplay -l' to list available devices. devices joined with '+' (like 'hw:0,0+hw:1,0') play the same audio in sync with the first one. a device can have its own buffer size, like 'hw:1,0@buffer_time_us=60000,periods=3'. 'sim' or 'capture:file=<path>' is a simulated device, with no audio hardware (see README)", cxxopts::value<std::string>()->default_value(audio_device_))
+		("zones", "independent players in this process, each on its own audio device (or devices joined with '+'), as 'name=device' separated by ';'. for example 'stage=hw:0,0;lobby=hw:1,0'. requests choose a zone by name, and go to the first zone if none is given. if not set, there is a single zone on audio_device", cxxopts::value<std::string>())
+		("alsa_access", "how frames are transfered to the audio device. 'rw' copies them with snd_pcm_writei, 'mmap' reads them directly into the device buffer (falls back to 'rw' if the device does not support it)", cxxopts::value<std::string>()->default_value(alsa_access_))
+		("alsa_tstamp_type", "clock for the audio device timestamps, which are used to track the audio position. 'monotonic_raw', 'monotonic' or 'gettimeofday' (falls back to the next one if the device does not support it)", cxxopts::value<std::string>()->default_value(alsa_tstamp_type_))
+		("alsa_target_latency_ms", "size of the audio device buffer in milliseconds, split into 4 periods unless alsa_period_time_us or alsa_periods are set. controls how long it takes for play / seek / stop to be heard. 0 to use the device default", cxxopts::value<uint32_t>()->default_value(std::to_string(alsa_target_latency_ms_)))
+		("alsa_buffer_time_us", "size of the audio device buffer in micro seconds. overrides alsa_target_latency_ms. 0 to use the device default", cxxopts::value<uint32_t>()->default_value(std::to_string(alsa_buffer_time_us_)))
+		("alsa_period_time_us", "size of an audio device period in micro seconds. the audio thread wakes up once per period, and writes a period of frames at a time. 0 to use the device default", cxxopts::value<uint32_t>()->default_value(std::to_string(alsa_period_time_us_)))
+		("alsa_periods", "number of periods in the audio device buffer. ignored if alsa_period_time_us is set. 0 to use the device default", cxxopts::value<uint32_t>()->default_value(std::to_string(alsa_periods_)))
+		("audio_ring_ms", "how much audio (milliseconds) is read ahead from the file, so slow reads do not delay writes to the audio device", cxxopts::value<int>()->default_value(std::to_string(audio_ring_ms_)))
+		("position_report_error_us", "audio position status is sent to clients again only when the position they calculate from the last status is off by more than this (micro seconds)", cxxopts::value<int>()->default_value(std::to_string(position_report_error_us_)))
+		("drift_compensation", "resample the audio, so it is played at the rate of the system clock instead of the sound card clock. keeps the audio start time constant on long files", cxxopts::value<bool>()->default_value(drift_compensation_ ? "true" : "false"))
+		("crossfade_ms", "when a song is played while another song is playing, fade the playing song out and the new song in over this many milliseconds. 0 to switch songs without crossfade", cxxopts::value<int>()->default_value(std::to_string(crossfade_ms_)))
+		("crossfade_curve", "gain curve of the crossfade. 'equal_power' keeps the loudness constant for uncorrelated songs, 'linear' keeps the amplitude constant", cxxopts::value<std::string>()->default_value(crossfade_curve_))
+		("audio_cache_mb", "memory budget in MB for keeping recently played audio files in RAM. 0 to disable", cxxopts::value<uint32_t>()->default_value(std::to_string(audio_cache_mb_)))
+		("cue_dir", "directory of short audio files (cues) which can be played on top of the current song. the files are loaded to RAM when the player starts", cxxopts::value<std::string>())
+		("audio_thread_rt_priority", "SCHED_FIFO priority (1-99) for the audio thread. 0 to use default scheduling", cxxopts::value<int>()->default_value(std::to_string(audio_thread_rt_priority_)))
+		("audio_thread_cpu", "index of cpu on which the audio thread should run. -1 to let the os decide", cxxopts::value<int>()->default_value(std::to_string(audio_thread_cpu_)))
+		("render_script", "render the show in this script file faster than real time, instead of playing on the audio devices, and exit when it ends (see README)", cxxopts::value<std::string>())
+		("render_dir", "directory for the render output: a wav file for each zone, and the log of status messages (events.jsonl)", cxxopts::value<std::string>()->default_value(render_dir_))
 		("h, help", "print help");
 
 	try
@@ -79,6 +100,78 @@ bool ConfigService::InitFromCmdArguments(int argc, char *argv[])
 		{
 			audio_device_ = cmd_line_parameters["audio_device"].as<std::string>();
 		}
+		if (cmd_line_parameters.count("zones") > 0)
+		{
+			SetZones(cmd_line_parameters["zones"].as<std::string>());
+		}
+		if (cmd_line_parameters.count("alsa_access") > 0)
+		{
+			SetAlsaAccess(cmd_line_parameters["alsa_access"].as<std::string>());
+		}
+		if (cmd_line_parameters.count("alsa_tstamp_type") > 0)
+		{
+			SetAlsaTstampType(cmd_line_parameters["alsa_tstamp_type"].as<std::string>());
+		}
+		if (cmd_line_parameters.count("alsa_target_latency_ms") > 0)
+		{
+			alsa_target_latency_ms_ = cmd_line_parameters["alsa_target_latency_ms"].as<uint32_t>();
+		}
+		if (cmd_line_parameters.count("alsa_buffer_time_us") > 0)
+		{
+			alsa_buffer_time_us_ = cmd_line_parameters["alsa_buffer_time_us"].as<uint32_t>();
+		}
+		if (cmd_line_parameters.count("alsa_period_time_us") > 0)
+		{
+			alsa_period_time_us_ = cmd_line_parameters["alsa_period_time_us"].as<uint32_t>();
+		}
+		if (cmd_line_parameters.count("alsa_periods") > 0)
+		{
+			alsa_periods_ = cmd_line_parameters["alsa_periods"].as<uint32_t>();
+		}
+		if (cmd_line_parameters.count("audio_ring_ms") > 0)
+		{
+			audio_ring_ms_ = cmd_line_parameters["audio_ring_ms"].as<int>();
+		}
+		if (cmd_line_parameters.count("position_report_error_us") > 0)
+		{
+			position_report_error_us_ = cmd_line_parameters["position_report_error_us"].as<int>();
+		}
+		if (cmd_line_parameters.count("drift_compensation") > 0)
+		{
+			drift_compensation_ = cmd_line_parameters["drift_compensation"].as<bool>();
+		}
+		if (cmd_line_parameters.count("crossfade_ms") > 0)
+		{
+			crossfade_ms_ = cmd_line_parameters["crossfade_ms"].as<int>();
+		}
+		if (cmd_line_parameters.count("crossfade_curve") > 0)
+		{
+			SetCrossfadeCurve(cmd_line_parameters["crossfade_curve"].as<std::string>());
+		}
+		if (cmd_line_parameters.count("audio_cache_mb") > 0)
+		{
+			audio_cache_mb_ = cmd_line_parameters["audio_cache_mb"].as<uint32_t>();
+		}
+		if (cmd_line_parameters.count("cue_dir") > 0)
+		{
+			cue_dir_ = cmd_line_parameters["cue_dir"].as<std::string>();
+		}
+		if (cmd_line_parameters.count("audio_thread_rt_priority") > 0)
+		{
+			audio_thread_rt_priority_ = cmd_line_parameters["audio_thread_rt_priority"].as<int>();
+		}
+		if (cmd_line_parameters.count("audio_thread_cpu") > 0)
+		{
+			audio_thread_cpu_ = cmd_line_parameters["audio_thread_cpu"].as<int>();
+		}
+		if (cmd_line_parameters.count("render_script") > 0)
+		{
+			render_script_ = cmd_line_parameters["render_script"].as<std::string>();
+		}
+		if (cmd_line_parameters.count("render_dir") > 0)
+		{
+			render_dir_ = cmd_line_parameters["render_dir"].as<std::string>();
+		}
 	}
 	catch (const cxxopts::OptionException &e)
 	{
@@ -126,7 +219,72 @@ void ConfigService::LogConfig(std::shared_ptr<spdlog::logger> logger) const
 		config_stream << "log file: not saving log to file, as none is configured" << std::endl;
 	}
 
-	config_stream << "audio device: '" << audio_device_ << "'";
+	if(!zones_.empty()) {
+		config_stream << "zones:";
+		for(const ZoneConfig &zone : zones_) {
+			config_stream << " " << zone.name << "='" << zone.audio_device << "'";
+		}
+		config_stream << std::endl;
+	}
+
+	config_stream << "audio device: '" << audio_device_ << "', access='" << alsa_access_ << "', tstamp_type='" << alsa_tstamp_type_ << "'" << std::endl;
+
+	config_stream << "audio device buffer: ";
+	if(GetAlsaBufferTimeUs() > 0) {
+		config_stream << "buffer_time_us='" << GetAlsaBufferTimeUs() << "'";
+	}
+	else {
+		config_stream << "device default size";
+	}
+	if(GetAlsaPeriodTimeUs() > 0) {
+		config_stream << ", period_time_us='" << GetAlsaPeriodTimeUs() << "'";
+	}
+	else if(GetAlsaPeriods() > 0) {
+		config_stream << ", periods='" << GetAlsaPeriods() << "'";
+	}
+	config_stream << ", read ahead ring_ms='" << audio_ring_ms_ << "'" << std::endl;
+
+	config_stream << "position report: error_us='" << position_report_error_us_ << "', drift_compensation='" << (drift_compensation_ ? "on" : "off") << "'" << std::endl;
+
+	if(crossfade_ms_ > 0) {
+		config_stream << "crossfade: duration_ms='" << crossfade_ms_ << "', curve='" << crossfade_curve_ << "'" << std::endl;
+	}
+	else {
+		config_stream << "crossfade: disabled" << std::endl;
+	}
+
+	if(audio_cache_mb_ > 0) {
+		config_stream << "audio cache: budget_mb='" << audio_cache_mb_ << "'" << std::endl;
+	}
+	else {
+		config_stream << "audio cache: disabled" << std::endl;
+	}
+
+	if(!cue_dir_.empty()) {
+		config_stream << "cues: dir='" << cue_dir_ << "'" << std::endl;
+	}
+	else {
+		config_stream << "cues: disabled" << std::endl;
+	}
+
+	config_stream << "audio thread: ";
+	if(audio_thread_rt_priority_ > 0) {
+		config_stream << "rt_priority='" << audio_thread_rt_priority_ << "'";
+	}
+	else {
+		config_stream << "default scheduling";
+	}
+	if(audio_thread_cpu_ >= 0) {
+		config_stream << ", cpu='" << audio_thread_cpu_ << "'";
+	}
+	config_stream << std::endl;
+
+	if(IsRenderMode()) {
+		config_stream << "render: script='" << render_script_ << "', dir='" << render_dir_ << "'";
+	}
+	else {
+		config_stream << "render: disabled";
+	}
 	logger->info(config_stream.str());
 }
 
@@ -164,6 +322,78 @@ void ConfigService::SetParamFromFile(const std::string &param_name, const std::s
 	{
 		audio_device_ = param_value;
 	}
+	else if (param_name == "zones")
+	{
+		SetZones(param_value);
+	}
+	else if (param_name == "alsa_access")
+	{
+		SetAlsaAccess(param_value);
+	}
+	else if (param_name == "alsa_tstamp_type")
+	{
+		SetAlsaTstampType(param_value);
+	}
+	else if (param_name == "alsa_target_latency_ms")
+	{
+		alsa_target_latency_ms_ = boost::lexical_cast<uint32_t>(param_value);
+	}
+	else if (param_name == "alsa_buffer_time_us")
+	{
+		alsa_buffer_time_us_ = boost::lexical_cast<uint32_t>(param_value);
+	}
+	else if (param_name == "alsa_period_time_us")
+	{
+		alsa_period_time_us_ = boost::lexical_cast<uint32_t>(param_value);
+	}
+	else if (param_name == "alsa_periods")
+	{
+		alsa_periods_ = boost::lexical_cast<uint32_t>(param_value);
+	}
+	else if (param_name == "audio_ring_ms")
+	{
+		audio_ring_ms_ = boost::lexical_cast<int>(param_value);
+	}
+	else if (param_name == "position_report_error_us")
+	{
+		position_report_error_us_ = boost::lexical_cast<int>(param_value);
+	}
+	else if (param_name == "drift_compensation")
+	{
+		SetDriftCompensation(param_value);
+	}
+	else if (param_name == "crossfade_ms")
+	{
+		crossfade_ms_ = boost::lexical_cast<int>(param_value);
+	}
+	else if (param_name == "crossfade_curve")
+	{
+		SetCrossfadeCurve(param_value);
+	}
+	else if (param_name == "audio_cache_mb")
+	{
+		audio_cache_mb_ = boost::lexical_cast<uint32_t>(param_value);
+	}
+	else if (param_name == "cue_dir")
+	{
+		cue_dir_ = param_value;
+	}
+	else if (param_name == "audio_thread_rt_priority")
+	{
+		audio_thread_rt_priority_ = boost::lexical_cast<int>(param_value);
+	}
+	else if (param_name == "audio_thread_cpu")
+	{
+		audio_thread_cpu_ = boost::lexical_cast<int>(param_value);
+	}
+	else if (param_name == "render_script")
+	{
+		render_script_ = param_value;
+	}
+	else if (param_name == "render_dir")
+	{
+		render_dir_ = param_value;
+	}
 	else
 	{
 		std::stringstream err;
@@ -172,6 +402,206 @@ void ConfigService::SetParamFromFile(const std::string &param_name, const std::s
 	}
 }
 
+uint32_t ConfigService::GetAlsaBufferTimeUs() const
+{
+	if (alsa_buffer_time_us_ > 0)
+	{
+		return alsa_buffer_time_us_;
+	}
+	return alsa_target_latency_ms_ * 1000;
+}
+
+uint32_t ConfigService::GetAlsaPeriods() const
+{
+	// a buffer sized by target latency is split into periods, so the audio thread
+	// refills it before it runs low
+	if (alsa_periods_ == 0 && alsa_period_time_us_ == 0 && alsa_buffer_time_us_ == 0 && alsa_target_latency_ms_ > 0)
+	{
+		return DEFAULT_PERIODS_FOR_TARGET_LATENCY;
+	}
+	return alsa_periods_;
+}
+
+void ConfigService::SetAlsaAccess(const std::string &alsa_access)
+{
+	if (alsa_access != "rw" && alsa_access != "mmap")
+	{
+		std::stringstream err;
+		err << "invalid alsa_access '" << alsa_access << "'. should be 'rw' or 'mmap'";
+		throw std::runtime_error(err.str());
+	}
+	alsa_access_ = alsa_access;
+}
+
+void ConfigService::SetDriftCompensation(const std::string &drift_compensation)
+{
+	if (drift_compensation == "true" || drift_compensation == "1")
+	{
+		drift_compensation_ = true;
+	}
+	else if (drift_compensation == "false" || drift_compensation == "0")
+	{
+		drift_compensation_ = false;
+	}
+	else
+	{
+		std::stringstream err;
+		err << "invalid drift_compensation '" << drift_compensation << "'. should be 'true', 'false', '1' or '0'";
+		throw std::runtime_error(err.str());
+	}
+}
+
+void ConfigService::SetCrossfadeCurve(const std::string &crossfade_curve)
+{
+	if (crossfade_curve != "equal_power" && crossfade_curve != "linear")
+	{
+		std::stringstream err;
+		err << "invalid crossfade_curve '" << crossfade_curve << "'. should be 'equal_power' or 'linear'";
+		throw std::runtime_error(err.str());
+	}
+	crossfade_curve_ = crossfade_curve;
+}
+
+void ConfigService::SetZones(const std::string &zones)
+{
+	std::vector<ZoneConfig> parsed_zones;
+	std::stringstream zones_stream(zones);
+	std::string zone_str;
+	while (std::getline(zones_stream, zone_str, ';'))
+	{
+		if (zone_str.empty())
+		{
+			continue;
+		}
+
+		std::stringstream err;
+		size_t separator_pos = zone_str.find('=');
+		if (separator_pos == std::string::npos || separator_pos == 0 || separator_pos == zone_str.size() - 1)
+		{
+			err << "invalid zone '" << zone_str << "'. should be 'name=device'";
+			throw std::runtime_error(err.str());
+		}
+
+		ZoneConfig zone;
+		zone.name = zone_str.substr(0, separator_pos);
+		zone.audio_device = zone_str.substr(separator_pos + 1);
+		// the name is used in mqtt topics and urls
+		for (char c : zone.name)
+		{
+			if (!std::isalnum((unsigned char)c) && c != '_' && c != '-')
+			{
+				err << "invalid zone name '" << zone.name << "'. should only contain letters, digits, '_' and '-'";
+				throw std::runtime_error(err.str());
+			}
+		}
+		for (const ZoneConfig &other_zone : parsed_zones)
+		{
+			if (other_zone.name == zone.name)
+			{
+				err << "zone name '" << zone.name << "' is used more than once";
+				throw std::runtime_error(err.str());
+			}
+		}
+		GetAudioDevices(zone.audio_device);
+		parsed_zones.push_back(zone);
+	}
+	zones_ = parsed_zones;
+}
+
+std::vector<AudioDeviceConfig> ConfigService::GetAudioDevices(const std::string &audio_device_list) const
+{
+	std::vector<AudioDeviceConfig> devices;
+	std::stringstream devices_stream(audio_device_list);
+	std::string device_str;
+	while (std::getline(devices_stream, device_str, '+'))
+	{
+		std::stringstream err;
+		AudioDeviceConfig device;
+		device.buffer_time_us = GetAlsaBufferTimeUs();
+		device.period_time_us = GetAlsaPeriodTimeUs();
+		device.periods = GetAlsaPeriods();
+
+		size_t options_pos = device_str.rfind('@');
+		device.audio_device = device_str.substr(0, options_pos);
+		if (options_pos != std::string::npos)
+		{
+			std::stringstream options_stream(device_str.substr(options_pos + 1));
+			std::string option;
+			while (std::getline(options_stream, option, ','))
+			{
+				size_t eq_pos = option.find('=');
+				std::string key = option.substr(0, eq_pos);
+				std::string value = eq_pos == std::string::npos ? "" : option.substr(eq_pos + 1);
+				uint32_t parsed_value = 0;
+				try
+				{
+					if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos)
+					{
+						throw boost::bad_lexical_cast();
+					}
+					parsed_value = boost::lexical_cast<uint32_t>(value);
+				}
+				catch (const boost::bad_lexical_cast &)
+				{
+					err << "invalid value '" << value << "' for option '" << key << "' of audio device '" << device.audio_device << "'";
+					throw std::runtime_error(err.str());
+				}
+
+				if (key == "buffer_time_us")
+				{
+					device.buffer_time_us = parsed_value;
+				}
+				else if (key == "period_time_us")
+				{
+					device.period_time_us = parsed_value;
+				}
+				else if (key == "periods")
+				{
+					// the period time of the alsa buffer options would take precedence
+					device.periods = parsed_value;
+					device.period_time_us = 0;
+				}
+				else
+				{
+					err << "unknown option '" << key << "' of audio device '" << device.audio_device << "'. should be 'buffer_time_us', 'period_time_us' or 'periods'";
+					throw std::runtime_error(err.str());
+				}
+			}
+		}
+
+		bool is_duplicate = false;
+		for (const AudioDeviceConfig &other_device : devices)
+		{
+			is_duplicate = is_duplicate || other_device.audio_device == device.audio_device;
+		}
+		if (device.audio_device.empty() || is_duplicate)
+		{
+			err << "invalid audio device list '" << audio_device_list << "'. expected 'device+mirror_device', with different devices";
+			throw std::runtime_error(err.str());
+		}
+		devices.push_back(device);
+	}
+
+	if (devices.empty())
+	{
+		std::stringstream err;
+		err << "invalid audio device list '" << audio_device_list << "'. expected at least one device";
+		throw std::runtime_error(err.str());
+	}
+	return devices;
+}
+
+void ConfigService::SetAlsaTstampType(const std::string &alsa_tstamp_type)
+{
+	if (alsa_tstamp_type != "gettimeofday" && alsa_tstamp_type != "monotonic" && alsa_tstamp_type != "monotonic_raw")
+	{
+		std::stringstream err;
+		err << "invalid alsa_tstamp_type '" << alsa_tstamp_type << "'. should be 'gettimeofday', 'monotonic' or 'monotonic_raw'";
+		throw std::runtime_error(err.str());
+	}
+	alsa_tstamp_type_ = alsa_tstamp_type;
+}
+
 void ConfigService::LoadConfigFile(const std::string &path)
 {
 	std::ifstream infile(path);
@@ -4,11 +4,26 @@
 #include <string>
 #include <cstdint>
 #include <memory>
+#include <vector>
 #include "spdlog/spdlog.h"
 
 namespace wavplayeralsa
 {
 
+    // an audio device, and the size of its buffer. 0 means device default
+    struct AudioDeviceConfig {
+        std::string audio_device;
+        uint32_t buffer_time_us = 0;
+        uint32_t period_time_us = 0; // takes precedence over periods, if both are set
+        uint32_t periods = 0;
+    };
+
+    // a player with its own audio device, in the same process as the other zones
+    struct ZoneConfig {
+        std::string name;
+        std::string audio_device;
+    };
+
     class ConfigService
     {
 
@@ -20,6 +35,11 @@ namespace wavplayeralsa
     private:
         void LoadConfigFile(const std::string &path); 
         void SetParamFromFile(const std::string &param_name, const std::string &param_value);
+        void SetAlsaAccess(const std::string &alsa_access);
+        void SetAlsaTstampType(const std::string &alsa_tstamp_type);
+        void SetDriftCompensation(const std::string &drift_compensation);
+        void SetCrossfadeCurve(const std::string &crossfade_curve);
+        void SetZones(const std::string &zones);
 
     public:
         bool SaveLogsToFile() const { return !log_dir_.empty(); }
@@ -35,6 +55,33 @@ namespace wavplayeralsa
         uint16_t GetMqttPort() const { return mqtt_port_; }
         std::string GetWavDir() const { return wav_dir_; }
         std::string GetAudioDevice() const { return audio_device_; }
+        // empty if no zones are configured, in which case the player has a single zone on audio_device
+        const std::vector<ZoneConfig> &GetZones() const { return zones_; }
+        bool UseMmapAccess() const { return alsa_access_ == "mmap"; }
+        std::string GetAlsaTstampType() const { return alsa_tstamp_type_; }
+        // 0 means device default
+        uint32_t GetAlsaBufferTimeUs() const;
+        uint32_t GetAlsaPeriodTimeUs() const { return alsa_period_time_us_; }
+        uint32_t GetAlsaPeriods() const;
+        // the devices of a zone, 'main+mirror1+mirror2', each with optional buffer options after '@'
+        // (like 'hw:1,0@buffer_time_us=60000,periods=3'). devices with no options use the alsa buffer options.
+        // will throw std::runtime_error if the list is invalid
+        std::vector<AudioDeviceConfig> GetAudioDevices(const std::string &audio_device_list) const;
+        int GetAudioRingMs() const { return audio_ring_ms_; }
+        int GetPositionReportErrorUs() const { return position_report_error_us_; }
+        bool UseDriftCompensation() const { return drift_compensation_; }
+        // 0 means crossfade is disabled
+        int GetCrossfadeMs() const { return crossfade_ms_; }
+        std::string GetCrossfadeCurve() const { return crossfade_curve_; }
+        int GetAudioThreadRtPriority() const { return audio_thread_rt_priority_; }
+        int GetAudioThreadCpu() const { return audio_thread_cpu_; }
+        // empty means cues are disabled
+        std::string GetCueDir() const { return cue_dir_; }
+        uint64_t GetAudioCacheBytes() const { return (uint64_t)audio_cache_mb_ * 1024 * 1024; }
+        // render mode plays the show script on a virtual clock, and exits when it ends
+        bool IsRenderMode() const { return !render_script_.empty(); }
+        std::string GetRenderScript() const { return render_script_; }
+        std::string GetRenderDir() const { return render_dir_; }
 
     private:
         std::string config_file_;
@@ -48,6 +95,25 @@ namespace wavplayeralsa
         uint16_t mqtt_port_ = 1883;
         std::string wav_dir_;
         std::string audio_device_ = "default";
+        std::vector<ZoneConfig> zones_; // the first zone is the default one for requests with no zone
+        std::string alsa_access_ = "rw"; // 'rw' or 'mmap'
+        std::string alsa_tstamp_type_ = "monotonic_raw"; // 'gettimeofday', 'monotonic' or 'monotonic_raw'
+        uint32_t alsa_target_latency_ms_ = 0; // 0 means device default
+        uint32_t alsa_buffer_time_us_ = 0; // overrides alsa_target_latency_ms_ if set
+        uint32_t alsa_period_time_us_ = 0;
+        uint32_t alsa_periods_ = 0; // ignored if alsa_period_time_us_ is set
+        static const uint32_t DEFAULT_PERIODS_FOR_TARGET_LATENCY = 4;
+        int audio_ring_ms_ = 500; // audio read ahead of the audio device
+        int position_report_error_us_ = 500; // position status is reported again when the last report is off by more than this
+        bool drift_compensation_ = false; // resample the audio to follow the system clock instead of the sound card clock
+        int crossfade_ms_ = 0; // 0 means songs are switched without crossfade
+        std::string crossfade_curve_ = "equal_power"; // 'equal_power' or 'linear'
+        int audio_thread_rt_priority_ = 0; // 0 means default scheduling (not real time)
+        int audio_thread_cpu_ = -1; // negative means thread is not pinned to a cpu
+        uint32_t audio_cache_mb_ = 0; // 0 means cache is disabled
+        std::string cue_dir_; // directory of short sounds played on top of the current song
+        std::string render_script_; // empty means the player plays on the audio devices
+        std::string render_dir_;
 
     };
 }
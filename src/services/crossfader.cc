@@ -0,0 +1,71 @@
+#include "services/crossfader.h"
+
+#include <cmath>
+#include <algorithm>
+
+namespace wavplayeralsa
+{
+
+	bool Crossfader::Initialize(snd_pcm_format_t format, unsigned int num_of_channels)
+	{
+		if(!converter_.Initialize(format)) {
+			return false;
+		}
+		num_of_channels_ = num_of_channels;
+		duration_frames_ = 0;
+		done_frames_ = 0;
+		return true;
+	}
+
+	void Crossfader::Start(uint64_t duration_frames, Curve curve)
+	{
+		duration_frames_ = duration_frames;
+		done_frames_ = 0;
+		curve_ = curve;
+	}
+
+	void Crossfader::Process(char *incoming, const char *outgoing, size_t frames)
+	{
+		if(!IsActive()) {
+			return;
+		}
+
+		const size_t ch = num_of_channels_;
+		const size_t n = (size_t)std::min((uint64_t)frames, duration_frames_ - done_frames_);
+
+		// gains are taken at the middle of each frame, so the fade is symmetric
+		incoming_gain_.resize(n);
+		outgoing_gain_.resize(n);
+		const double step = 1.0 / (double)duration_frames_;
+		double t = ((double)done_frames_ + 0.5) * step;
+		for(size_t i = 0; i < n; i++, t += step) {
+			if(curve_ == CurveLinear) {
+				incoming_gain_[i] = (float)t;
+				outgoing_gain_[i] = (float)(1.0 - t);
+			}
+			else {
+				incoming_gain_[i] = (float)std::sin(t * M_PI_2);
+				outgoing_gain_[i] = (float)std::cos(t * M_PI_2);
+			}
+		}
+
+		incoming_float_.resize(n * ch);
+		outgoing_float_.resize(n * ch);
+		converter_.ToFloat(incoming, n * ch, incoming_float_.data());
+		converter_.ToFloat(outgoing, n * ch, outgoing_float_.data());
+
+		float *in = incoming_float_.data();
+		const float *out = outgoing_float_.data();
+		for(size_t i = 0; i < n; i++) {
+			const float gi = incoming_gain_[i];
+			const float go = outgoing_gain_[i];
+			for(size_t c = 0; c < ch; c++) {
+				in[i * ch + c] = in[i * ch + c] * gi + out[i * ch + c] * go;
+			}
+		}
+
+		converter_.FromFloat(incoming_float_.data(), n * ch, incoming);
+		done_frames_ += n;
+	}
+
+}
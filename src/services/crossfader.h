@@ -0,0 +1,59 @@
+#ifndef WAVPLAYERALSA_CROSSFADER_H__
+#define WAVPLAYERALSA_CROSSFADER_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "alsa/asoundlib.h"
+
+#include "services/sample_converter.h"
+
+namespace wavplayeralsa
+{
+
+    /*
+    Mixes the end of the outgoing track into the start of the incoming one, with gains which
+    follow the fade curve frame by frame.
+    Both are converted to float, mixed, and converted back to the pcm format. The gains of 
+    a chunk are calculated first, so the mixing loop is plain multiply-add over the samples.
+    The fade state is kept between calls, so consecutive chunks are faded as one stream.
+    */
+    class Crossfader
+    {
+
+    public:
+        enum Curve {
+            CurveLinear = 0, // gains sum to 1. for correlated audio (the same song)
+            CurveEqualPower = 1 // powers sum to 1. keeps the loudness constant for different songs
+        };
+
+    public:
+        // returns false if the format is not supported (see SampleConverter)
+        bool Initialize(snd_pcm_format_t format, unsigned int num_of_channels);
+
+        void Start(uint64_t duration_frames, Curve curve);
+        void Cancel() { done_frames_ = duration_frames_; }
+        bool IsActive() const { return done_frames_ < duration_frames_; }
+
+        // mix frames frames of outgoing into incoming (in place), and advance the fade.
+        // once the fade is done, incoming is not changed.
+        void Process(char *incoming, const char *outgoing, size_t frames);
+
+    private:
+        SampleConverter converter_;
+        unsigned int num_of_channels_ = 2;
+        Curve curve_ = CurveEqualPower;
+        uint64_t duration_frames_ = 0;
+        uint64_t done_frames_ = 0;
+
+        std::vector<float> incoming_float_;
+        std::vector<float> outgoing_float_;
+        std::vector<float> incoming_gain_;
+        std::vector<float> outgoing_gain_;
+
+    };
+
+}
+
+#endif // WAVPLAYERALSA_CROSSFADER_H__
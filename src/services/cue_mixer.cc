@@ -0,0 +1,224 @@
+#include "services/cue_mixer.h"
+
+#include <sstream>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+#include <boost/filesystem.hpp>
+
+#include "services/audio_file_reader.h"
+#include "services/sample_converter.h"
+
+namespace wavplayeralsa
+{
+
+	void CueSoundBank::Initialize(std::shared_ptr<spdlog::logger> logger, const std::string &cue_dir)
+	{
+		logger_ = logger;
+
+		if(cue_dir.empty()) {
+			logger_->info("no cue directory is configured. cues are disabled");
+			return;
+		}
+
+		boost::filesystem::path cue_dir_path(cue_dir);
+		if(!boost::filesystem::is_directory(cue_dir_path)) {
+			std::stringstream err_desc;
+			err_desc << "cue directory '" << cue_dir << "' is not a directory";
+			throw std::runtime_error(err_desc.str());
+		}
+
+		std::size_t trailing_path_len = cue_dir_path.string().length();
+		for ( boost::filesystem::recursive_directory_iterator end, dir(cue_dir_path); dir != end; ++dir ) {
+			if(!boost::filesystem::is_regular_file(dir->status())) {
+				continue;
+			}
+			std::string cue_id = dir->path().string().substr(trailing_path_len);
+			if(!cue_id.empty() && cue_id[0] == '/') {
+				cue_id = cue_id.substr(1);
+			}
+			try {
+				LoadCue(cue_id, boost::filesystem::canonical(dir->path()).string());
+			}
+			catch(const std::runtime_error &e) {
+				// a file which is not audio should not prevent the other cues from loading
+				logger_->warn("cue file '{}' is not loaded. reason: {}", cue_id, e.what());
+			}
+		}
+		logger_->info("loaded {} cues from directory '{}'", sounds_.size(), cue_dir);
+	}
+
+	/*
+	Read the whole file, and convert it to float samples for mixing.
+	*/
+	void CueSoundBank::LoadCue(const std::string &cue_id, const std::string &full_file_name)
+	{
+		AudioFileReader reader;
+		reader.Open(logger_, full_file_name, nullptr);
+
+		snd_pcm_format_t format;
+		SampleConverter converter;
+		if(!reader.GetFormatForAlsa(format) || !converter.Initialize(format)) {
+			std::stringstream err_desc;
+			err_desc << "sample format is not supported for cues. use 16 bit, 32 bit or float files";
+			throw std::runtime_error(err_desc.str());
+		}
+
+		CueSound &sound = sounds_[cue_id];
+		sound.frame_rate = reader.GetFrameRate();
+		sound.num_of_channels = reader.GetNumOfChannels();
+		sound.total_frames = reader.GetTotalFrames();
+
+		std::vector<char> raw(sound.total_frames * reader.GetBytesPerFrame());
+		int64_t frames_read = 0;
+		while(frames_read < (int64_t)sound.total_frames) {
+			int64_t frames = reader.Read(&raw[frames_read * reader.GetBytesPerFrame()], sound.total_frames - frames_read);
+			if(frames == 0) {
+				break;
+			}
+			frames_read += frames;
+		}
+		sound.total_frames = frames_read;
+		sound.samples.resize(sound.total_frames * sound.num_of_channels);
+		converter.ToFloat(raw.data(), sound.samples.size(), sound.samples.data());
+
+		logger_->info("loaded cue '{}': {} frames, frame rate {}, {} channels", cue_id, sound.total_frames, sound.frame_rate, sound.num_of_channels);
+	}
+
+	const CueSound *CueSoundBank::Find(const std::string &cue_id) const
+	{
+		std::map<std::string, CueSound>::const_iterator it = sounds_.find(cue_id);
+		if(it == sounds_.end()) {
+			return nullptr;
+		}
+		return &it->second;
+	}
+
+	std::list<std::string> CueSoundBank::QueryCues() const
+	{
+		std::list<std::string> cue_ids;
+		for(const auto &sound : sounds_) {
+			cue_ids.push_back(sound.first);
+		}
+		return cue_ids;
+	}
+
+	const int64_t CueMixer::TRIGGER_TIMEOUT_MS;
+
+	void CueMixer::Initialize(std::shared_ptr<spdlog::logger> logger, const CueSoundBank *cue_sound_bank)
+	{
+		logger_ = logger;
+		cue_sound_bank_ = cue_sound_bank;
+		voices_.reserve(MAX_VOICES);
+	}
+
+	bool CueMixer::TriggerCueRequest(const std::string &cue_id, double gain_db, std::stringstream &out_msg)
+	{
+		const CueSound *sound = cue_sound_bank_->Find(cue_id);
+		if(sound == nullptr) {
+			out_msg << "cue '" << cue_id << "' is not loaded. cues are loaded from the cue directory when the player starts";
+			return false;
+		}
+
+		CueTrigger trigger;
+		trigger.sound = sound;
+		trigger.gain = (float)std::pow(10.0, gain_db / 20.0);
+		trigger.trigger_time = std::chrono::steady_clock::now();
+		if(!triggers_.push(trigger)) {
+			out_msg << "cue '" << cue_id << "' is not triggered. too many cues are waiting for the audio thread";
+			return false;
+		}
+
+		out_msg << "triggered cue '" << cue_id << "' with gain " << gain_db << " db";
+		return true;
+	}
+
+	std::list<std::string> CueMixer::QueryCues()
+	{
+		return cue_sound_bank_->QueryCues();
+	}
+
+	bool CueMixer::Update(unsigned int frame_rate, unsigned int num_of_channels, int64_t lead_frames, size_t frames)
+	{
+		stream_num_of_channels_ = num_of_channels;
+
+		CueTrigger trigger;
+		while(triggers_.pop(trigger)) {
+			const int64_t waited_us = std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::steady_clock::now() - trigger.trigger_time).count();
+			if(waited_us > TRIGGER_TIMEOUT_MS * 1000) {
+				logger_->warn("cue is not played, since no stream was playing for {} ms after it was triggered", waited_us / 1000);
+				continue;
+			}
+			// mono cues are played on all the channels. other cues should match the stream
+			if(trigger.sound->frame_rate != frame_rate ||
+				(trigger.sound->num_of_channels != num_of_channels && trigger.sound->num_of_channels != 1))
+			{
+				logger_->warn("cue is not played, since its frame rate or number of channels is different from the playing stream");
+				continue;
+			}
+			if(voices_.size() == MAX_VOICES) {
+				voices_.erase(voices_.begin());
+			}
+			// a trigger which waited longer than the lead (the stream just started) is played right away
+			const int64_t start_frame = std::max(lead_frames - waited_us * (int64_t)frame_rate / 1000000, (int64_t)0);
+			voices_.push_back(Voice{trigger.sound, trigger.gain, -start_frame});
+		}
+
+		for(const Voice &voice : voices_) {
+			if(-voice.position_frames < (int64_t)frames) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void CueMixer::Mix(float *samples, size_t frames) const
+	{
+		for(const Voice &voice : voices_) {
+			const CueSound &sound = *voice.sound;
+			const size_t skip = (size_t)std::max(-voice.position_frames, (int64_t)0);
+			if(skip >= frames) {
+				continue;
+			}
+			const uint64_t position_frames = (uint64_t)std::max(voice.position_frames, (int64_t)0);
+			const size_t n = (size_t)std::min((uint64_t)(frames - skip), sound.total_frames - position_frames);
+			const float gain = voice.gain;
+			const float *src = sound.samples.data() + position_frames * sound.num_of_channels;
+			const size_t ch = stream_num_of_channels_;
+			float *dest = samples + skip * ch;
+
+			if(sound.num_of_channels == 1 && ch != 1) {
+				for(size_t i = 0; i < n; i++) {
+					const float s = src[i] * gain;
+					for(size_t c = 0; c < ch; c++) {
+						dest[i * ch + c] += s;
+					}
+				}
+			}
+			else {
+				const size_t num_of_samples = n * ch;
+				for(size_t i = 0; i < num_of_samples; i++) {
+					dest[i] += src[i] * gain;
+				}
+			}
+		}
+	}
+
+	void CueMixer::Advance(size_t num_of_frames)
+	{
+		for(Voice &voice : voices_) {
+			voice.position_frames += (int64_t)num_of_frames;
+		}
+		voices_.erase(std::remove_if(voices_.begin(), voices_.end(),
+			[](const Voice &voice) { return voice.position_frames >= (int64_t)voice.sound->total_frames; }),
+			voices_.end());
+	}
+
+	void CueMixer::StopVoices()
+	{
+		voices_.clear();
+	}
+
+}
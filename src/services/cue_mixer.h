@@ -0,0 +1,133 @@
+#ifndef WAVPLAYERALSA_CUE_MIXER_H__
+#define WAVPLAYERALSA_CUE_MIXER_H__
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <map>
+#include <list>
+#include <chrono>
+
+#include <boost/lockfree/spsc_queue.hpp>
+
+#include "spdlog/spdlog.h"
+
+#include "player_actions_ifc.h"
+
+namespace wavplayeralsa
+{
+
+    // a cue file, decoded to float
+    struct CueSound {
+        unsigned int frame_rate;
+        unsigned int num_of_channels;
+        uint64_t total_frames;
+        std::vector<float> samples; // interleaved
+    };
+
+    /*
+    All the files in the cue directory, decoded to float in RAM when the player starts, so triggering
+    a cue does no file access.
+    Not changed after Initialize, so it is shared by the cue mixers of all the zones, and read 
+    by their threads without locking.
+    */
+    class CueSoundBank
+    {
+
+    public:
+        // load all the files in cue_dir. empty cue_dir disables cues.
+        // will throw std::runtime_error if the directory cannot be read.
+        void Initialize(std::shared_ptr<spdlog::logger> logger, const std::string &cue_dir);
+
+        // nullptr if there is no such cue
+        const CueSound *Find(const std::string &cue_id) const;
+        std::list<std::string> QueryCues() const;
+
+    private:
+        void LoadCue(const std::string &cue_id, const std::string &full_file_name);
+
+    private:
+        std::shared_ptr<spdlog::logger> logger_;
+        std::map<std::string, CueSound> sounds_;
+
+    };
+
+    /*
+    Short sounds (stingers, clicks) from the cue sound bank, which are played on top of the current 
+    song of a zone, without interrupting it.
+    Triggers are sent to the audio worker thread over a lock free single-producer single-consumer queue.
+    The producer is the main io_service thread (http handlers), and the consumer is the playback service
+    which is transferring audio, which mixes the active voices into the frames right before they are
+    written to the pcm. A cue is heard one audio device buffer after it was triggered: it starts at the
+    frame in the mixed period which is heard at that time, so the latency does not depend on when the
+    trigger arrived within the period.
+    Voices advance only on frames which were written to the pcm, so frames which are produced again
+    after a partial write mix the same part of the cue.
+    Cues are only played while a song is playing. A trigger which is not taken by the audio worker
+    in time (no song is playing) is dropped.
+    */
+    class CueMixer :
+        public CueActionsIfc
+    {
+
+    public:
+        void Initialize(std::shared_ptr<spdlog::logger> logger, const CueSoundBank *cue_sound_bank);
+
+    public:
+        // CueActionsIfc. called on the main io_service thread only
+        bool TriggerCueRequest(const std::string &cue_id, double gain_db, std::stringstream &out_msg);
+        std::list<std::string> QueryCues();
+
+    // audio worker thread
+    public:
+        // take new triggers for the next frames frames of a stream with frame_rate and num_of_channels.
+        // the first of these frames is heard lead_frames frames before a cue triggered now should be heard,
+        // which is the number of free frames in the audio device buffer before they are written.
+        // returns true if there are voices to mix into these frames
+        bool Update(unsigned int frame_rate, unsigned int num_of_channels, int64_t lead_frames, size_t frames);
+
+        // add the active voices to frames frames of interleaved float samples.
+        // the sum is not clipped here. it is clipped when converted back to the pcm format
+        void Mix(float *samples, size_t frames) const;
+
+        // num_of_frames frames were written to the pcm (or skipped after an xrun)
+        void Advance(size_t num_of_frames);
+
+        // stop all the active voices. called when the stream ends
+        void StopVoices();
+
+    private:
+        struct CueTrigger {
+            const CueSound *sound;
+            float gain;
+            std::chrono::steady_clock::time_point trigger_time;
+        };
+
+        struct Voice {
+            const CueSound *sound;
+            float gain;
+            int64_t position_frames; // negative until the voice starts
+        };
+
+    private:
+        std::shared_ptr<spdlog::logger> logger_;
+        const CueSoundBank *cue_sound_bank_ = nullptr;
+
+        static const size_t TRIGGER_QUEUE_CAPACITY = 64;
+        boost::lockfree::spsc_queue<CueTrigger, boost::lockfree::capacity<TRIGGER_QUEUE_CAPACITY>> triggers_;
+        // a trigger waiting longer than this in the queue is dropped, as no stream is playing
+        static const int64_t TRIGGER_TIMEOUT_MS = 100;
+
+        // audio worker thread only.
+        // when a cue is triggered with all the voices playing, the oldest voice is stopped
+        static const size_t MAX_VOICES = 16;
+        std::vector<Voice> voices_;
+        unsigned int stream_num_of_channels_ = 2;
+
+    };
+
+}
+
+#endif // WAVPLAYERALSA_CUE_MIXER_H__
@@ -0,0 +1,133 @@
+#include "services/drift_resampler.h"
+
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+namespace wavplayeralsa
+{
+
+	/*
+	The interpolation loop, instantiated for mono and stereo, so the loop over the channels of a frame
+	has a constant count and is unrolled. CHANNELS = 0 is for any other count, given in ch.
+	*/
+	template <unsigned int CHANNELS>
+	static size_t InterpolateFrames(const float *work, size_t len, size_t ch, double *position, double step, float *out, size_t max_out_frames)
+	{
+		if(CHANNELS != 0) {
+			ch = CHANNELS;
+		}
+		double t = *position;
+		size_t out_frames = 0;
+		while(out_frames < max_out_frames) {
+			size_t i = (size_t)t;
+			if(i + 2 >= len) {
+				break;
+			}
+			const float mu = (float)(t - (double)i);
+			const float *x = &work[(i - 1) * ch];
+			float *y = &out[out_frames * ch];
+			for(size_t c = 0; c < ch; c++) {
+				const float x0 = x[c];
+				const float x1 = x[ch + c];
+				const float x2 = x[2 * ch + c];
+				const float x3 = x[3 * ch + c];
+				const float c1 = 0.5f * (x2 - x0);
+				const float c2 = x0 - 2.5f * x1 + 2.0f * x2 - 0.5f * x3;
+				const float c3 = 0.5f * (x3 - x0) + 1.5f * (x1 - x2);
+				y[c] = ((c3 * mu + c2) * mu + c1) * mu + x1;
+			}
+			out_frames++;
+			t += step;
+		}
+		*position = t;
+		return out_frames;
+	}
+
+	bool DriftResampler::Initialize(snd_pcm_format_t format, unsigned int num_of_channels)
+	{
+		if(!converter_.Initialize(format)) {
+			return false;
+		}
+		num_of_channels_ = num_of_channels;
+		switch(num_of_channels) {
+			case 1: interpolate_ = &InterpolateFrames<1>; break;
+			case 2: interpolate_ = &InterpolateFrames<2>; break;
+			default: interpolate_ = &InterpolateFrames<0>; break;
+		}
+		ratio_ = 1.0;
+		Reset();
+		return true;
+	}
+
+	void DriftResampler::Reset()
+	{
+		phase_ = 1.0;
+		primed_ = false;
+		history_.assign(HISTORY_FRAMES * num_of_channels_, 0.0f);
+		work_in_frames_ = 0;
+		work_out_frames_ = 0;
+	}
+
+	size_t DriftResampler::MaxInputFrames(size_t max_out_frames) const
+	{
+		// the output of n input frames is at most ceil(n * ratio) + 1 frames
+		if(max_out_frames <= 2) {
+			return 0;
+		}
+		return (size_t)((double)(max_out_frames - 2) / ratio_);
+	}
+
+	size_t DriftResampler::Process(const char *in, size_t in_frames, char *out, size_t max_out_frames)
+	{
+		const size_t ch = num_of_channels_;
+		const size_t len = HISTORY_FRAMES + in_frames;
+
+		work_.resize(len * ch);
+		std::copy(history_.begin(), history_.end(), work_.begin());
+		converter_.ToFloat(in, in_frames * ch, work_.data() + HISTORY_FRAMES * ch);
+		if(!primed_ && in_frames > 0) {
+			// start from the first frame, instead of interpolating from silence
+			for(size_t h = 0; h < HISTORY_FRAMES; h++) {
+				std::copy(work_.begin() + HISTORY_FRAMES * ch, work_.begin() + (HISTORY_FRAMES + 1) * ch, work_.begin() + h * ch);
+			}
+		}
+
+		out_float_.resize(max_out_frames * ch);
+		double t = phase_;
+		size_t out_frames = interpolate_(work_.data(), len, ch, &t, 1.0 / ratio_, out_float_.data(), max_out_frames);
+		work_in_frames_ = in_frames;
+		work_out_frames_ = out_frames;
+
+		// interpolation can overshoot full scale. the converter clips it
+		converter_.FromFloat(out_float_.data(), out_frames * ch, out);
+		return out_frames;
+	}
+
+	/*
+	The position after out_frames frames is found by the same additions as in the interpolation loop.
+	The input frames before the one preceding it are consumed, and the frames from it are the history.
+	*/
+	size_t DriftResampler::Advance(size_t out_frames)
+	{
+		out_frames = std::min(out_frames, work_out_frames_);
+		if(out_frames == 0) {
+			return 0;
+		}
+
+		const size_t ch = num_of_channels_;
+		const double step = 1.0 / ratio_;
+		double t = phase_;
+		for(size_t i = 0; i < out_frames; i++) {
+			t += step;
+		}
+		const size_t consumed = std::min((size_t)t - 1, work_in_frames_);
+
+		std::copy(work_.begin() + consumed * ch, work_.begin() + (consumed + HISTORY_FRAMES) * ch, history_.begin());
+		phase_ = t - (double)consumed;
+		primed_ = true;
+		work_out_frames_ = 0;
+		return consumed;
+	}
+
+}
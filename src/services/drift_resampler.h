@@ -0,0 +1,86 @@
+#ifndef WAVPLAYERALSA_DRIFT_RESAMPLER_H__
+#define WAVPLAYERALSA_DRIFT_RESAMPLER_H__
+
+#include <cstddef>
+#include <vector>
+
+#include "alsa/asoundlib.h"
+
+#include "services/sample_converter.h"
+
+namespace wavplayeralsa
+{
+
+    /*
+    Fractional resampler for compensating the drift of the sound card clock.
+    The ratio (output frames per input frame) is expected to be very close to 1.0, and to
+    change slowly, so a 4 point cubic (hermite) interpolation is accurate enough, and keeps
+    the cost per sample low. The inner loop is plain float arithmetic over the channels of
+    a frame, with a constant channel count for mono and stereo.
+    State (the last input frames and the fractional position) is kept between calls,
+    so consecutive buffers are resampled as one continuous stream.
+    Process does not change the state. Advance moves it past the output frames which were written,
+    and tells how much of the input they consumed. The rest of the input is given to Process again,
+    which produces the same output for it, so a partial write loses no frames.
+    */
+    class DriftResampler
+    {
+
+    public:
+        // returns false if the format is not supported.
+        // supported formats are native endian signed 16 bit, signed 32 bit and float.
+        bool Initialize(snd_pcm_format_t format, unsigned int num_of_channels);
+
+        // forget the stream history. called when the input position changes
+        void Reset();
+
+        // output frames per input frame
+        void SetRatio(double ratio) { ratio_ = ratio; }
+        double GetRatio() const { return ratio_; }
+
+        // how many input frames can be processed in one call, without producing more than max_out_frames
+        size_t MaxInputFrames(size_t max_out_frames) const;
+
+        // input frames which were consumed, but their output was not produced yet
+        double GetPendingInputFrames() const { return HISTORY_FRAMES - phase_; }
+
+        // resample up to in_frames frames from in to out, producing at most max_out_frames frames.
+        // returns the number of frames written to out.
+        size_t Process(const char *in, size_t in_frames, char *out, size_t max_out_frames);
+
+        // out_frames of the frames from the last Process were written.
+        // returns the number of input frames they consumed. the next Process should start after them
+        size_t Advance(size_t out_frames);
+
+    private:
+        typedef size_t (*InterpolateFunc)(const float *work, size_t len, size_t ch, double *position, double step, float *out, size_t max_out_frames);
+
+    private:
+        // interpolation needs one frame before, and two frames after the output position.
+        // these are kept from the previous call
+        static const size_t HISTORY_FRAMES = 3;
+
+        SampleConverter converter_;
+        unsigned int num_of_channels_ = 2;
+        // selected for num_of_channels_ in Initialize
+        InterpolateFunc interpolate_ = nullptr;
+        double ratio_ = 1.0;
+
+        // position of the next output frame in the history frames, followed by the next input (in frames). about [1, 2)
+        double phase_ = 1.0;
+        bool primed_ = false;
+
+        // the last input frames which were consumed, as interleaved float samples
+        std::vector<float> history_;
+
+        // the last Process: history frames, followed by its input, as interleaved float samples
+        std::vector<float> work_;
+        size_t work_in_frames_ = 0;
+        size_t work_out_frames_ = 0;
+        std::vector<float> out_float_;
+
+    };
+
+}
+
+#endif // WAVPLAYERALSA_DRIFT_RESAMPLER_H__
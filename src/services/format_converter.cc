@@ -0,0 +1,289 @@
+#include "services/format_converter.h"
+
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <type_traits>
+
+#include "services/sample_formats.h"
+
+namespace wavplayeralsa
+{
+
+	static const snd_pcm_format_t NATIVE_S24_3 = SampleFormatNativeS24Packed::Format();
+
+	// uniform random value in [0, 1), from a hash of a counter. unlike a sequential generator,
+	// each sample has its own value, so the dither loop has no dependency between samples
+	static inline float RandomUniform(uint32_t counter)
+	{
+		counter ^= counter >> 16;
+		counter *= 0x7feb352du;
+		counter ^= counter >> 15;
+		counter *= 0x846ca68bu;
+		counter ^= counter >> 16;
+		return (float)(counter >> 8) * (1.0f / 16777216.0f);
+	}
+
+	/*
+	How a single sample is converted from In to Out, decided at compile time:
+	the same format is copied as is, integer formats are widened exactly,
+	float formats of the same size (which differ in byte order only) have their bytes swapped,
+	and anything else goes through float.
+	Reducing to 16 bit adds TPDF dither: the difference of two uniform random values of up to 1 LSB,
+	which decorrelates the quantization error from the signal, so it is heard as a constant low noise
+	instead of distortion on quiet passages.
+	*/
+	template <typename In, typename Out, bool SAME_FORMAT = std::is_same<In, Out>::value,
+		bool BYTE_SWAP = !SAME_FORMAT && In::IS_FLOAT && Out::IS_FLOAT && In::BYTES == Out::BYTES>
+	struct SampleConversion
+	{
+		static const bool EXACT = !In::IS_FLOAT && !Out::IS_FLOAT && Out::BITS >= In::BITS;
+		static const bool DITHER = !Out::IS_FLOAT && Out::BITS == 16 && !EXACT;
+
+		static inline void Convert(const char *in, char *out, float dither) {
+			if(EXACT) {
+				Out::WriteInt(In::ReadInt(in), out);
+			}
+			else {
+				Out::WriteFloat(In::ReadFloat(in) + dither, out);
+			}
+		}
+	};
+
+	template <typename In, typename Out>
+	struct SampleConversion<In, Out, true, false>
+	{
+		static const bool DITHER = false;
+
+		static inline void Convert(const char *in, char *out, float) {
+			memcpy(out, in, In::BYTES);
+		}
+	};
+
+	template <unsigned int BYTES> struct SampleBits;
+	template <> struct SampleBits<4> { typedef uint32_t Type; };
+	template <> struct SampleBits<8> { typedef uint64_t Type; };
+
+	template <typename In, typename Out>
+	struct SampleConversion<In, Out, false, true>
+	{
+		static const bool DITHER = false;
+
+		static inline void Convert(const char *in, char *out, float) {
+			typedef typename SampleBits<In::BYTES>::Type Bits;
+			sample_formats_detail::Store<Bits, false>(sample_formats_detail::Load<Bits, true>(in), out);
+		}
+	};
+
+	/*
+	The whole conversion of a block of samples in a single pass, instantiated for each pair of formats
+	and for upmix (OUT_PER_IN = 2, each mono sample written to both channels), so the loop has no branches
+	on the format and the samples are read and written once, with no intermediate buffers.
+	*/
+	template <typename In, typename Out, unsigned int OUT_PER_IN>
+	static void ConvertSamples(const char *in, size_t num_of_samples, char *out, uint32_t *random_state)
+	{
+		typedef SampleConversion<In, Out> Conversion;
+		uint32_t counter = *random_state;
+		for(size_t i = 0; i < num_of_samples; i++) {
+			float dither = 0.0f;
+			if(Conversion::DITHER) {
+				uint32_t sample_counter = counter + (uint32_t)i * 2;
+				dither = (RandomUniform(sample_counter) - RandomUniform(sample_counter + 1)) * (1.0f / 32768.0f);
+			}
+			for(unsigned int k = 0; k < OUT_PER_IN; k++) {
+				Conversion::Convert(in + i * In::BYTES, out + (i * OUT_PER_IN + k) * Out::BYTES, dither);
+			}
+		}
+		if(Conversion::DITHER) {
+			*random_state = counter + (uint32_t)num_of_samples * 2;
+		}
+	}
+
+	struct ConversionKernel {
+		snd_pcm_format_t in_format;
+		snd_pcm_format_t out_format;
+		unsigned int out_samples_per_in_sample;
+		FormatConverter::KernelFunc func;
+	};
+
+	template <typename In, typename Out>
+	static void AddKernels(std::vector<ConversionKernel> &table)
+	{
+		table.push_back({ In::Format(), Out::Format(), 1, &ConvertSamples<In, Out, 1> });
+		table.push_back({ In::Format(), Out::Format(), 2, &ConvertSamples<In, Out, 2> });
+	}
+
+	// the formats which the device is configured with when it cannot play the file format
+	template <typename In>
+	static void AddKernelsFrom(std::vector<ConversionKernel> &table)
+	{
+		AddKernels<In, In>(table);
+		AddKernels<In, SampleFormatNativeS16>(table);
+		AddKernels<In, SampleFormatNativeS32>(table);
+		AddKernels<In, SampleFormatNativeFloat>(table);
+	}
+
+	static std::vector<ConversionKernel> BuildKernelTable()
+	{
+		std::vector<ConversionKernel> table;
+		AddKernelsFrom<SampleFormatS16<false>>(table);
+		AddKernelsFrom<SampleFormatS16<true>>(table);
+		AddKernelsFrom<SampleFormatS24Packed<false>>(table);
+		AddKernelsFrom<SampleFormatS24Packed<true>>(table);
+		AddKernelsFrom<SampleFormatS32<false>>(table);
+		AddKernelsFrom<SampleFormatS32<true>>(table);
+		AddKernelsFrom<SampleFormatFloat<false>>(table);
+		AddKernelsFrom<SampleFormatFloat<true>>(table);
+		AddKernelsFrom<SampleFormatFloat64<false>>(table);
+		AddKernelsFrom<SampleFormatFloat64<true>>(table);
+		// the device is also tried with the cpu endian format of the file, which is not a format of its own above
+		AddKernels<SampleFormatS24Packed<true>, SampleFormatS24Packed<false>>(table);
+		AddKernels<SampleFormatFloat64<true>, SampleFormatFloat64<false>>(table);
+		return table;
+	}
+
+	// formats which are only played as is can still be upmixed, as they are only copied
+	static FormatConverter::KernelFunc RawUpmixKernel(int width)
+	{
+		switch(width) {
+			case 8: return &ConvertSamples<SampleFormatRaw<1>, SampleFormatRaw<1>, 2>;
+			case 16: return &ConvertSamples<SampleFormatRaw<2>, SampleFormatRaw<2>, 2>;
+			case 24: return &ConvertSamples<SampleFormatRaw<3>, SampleFormatRaw<3>, 2>;
+			case 32: return &ConvertSamples<SampleFormatRaw<4>, SampleFormatRaw<4>, 2>;
+			case 64: return &ConvertSamples<SampleFormatRaw<8>, SampleFormatRaw<8>, 2>;
+			default: return nullptr;
+		}
+	}
+
+	/*
+	The format with the same samples in cpu endian.
+	SND_PCM_FORMAT_UNKNOWN for formats which are only played as is.
+	*/
+	snd_pcm_format_t FormatConverter::CpuEndianFormat(snd_pcm_format_t format)
+	{
+		switch(format) {
+			case SND_PCM_FORMAT_S16_LE:
+			case SND_PCM_FORMAT_S16_BE:
+				return SND_PCM_FORMAT_S16;
+			case SND_PCM_FORMAT_S24_3LE:
+			case SND_PCM_FORMAT_S24_3BE:
+				return NATIVE_S24_3;
+			case SND_PCM_FORMAT_S32_LE:
+			case SND_PCM_FORMAT_S32_BE:
+				return SND_PCM_FORMAT_S32;
+			case SND_PCM_FORMAT_FLOAT_LE:
+			case SND_PCM_FORMAT_FLOAT_BE:
+				return SND_PCM_FORMAT_FLOAT;
+			case SND_PCM_FORMAT_FLOAT64_LE:
+			case SND_PCM_FORMAT_FLOAT64_BE:
+				return SND_PCM_FORMAT_FLOAT64;
+			default:
+				return SND_PCM_FORMAT_UNKNOWN;
+		}
+	}
+
+	std::vector<AlsaPcmStreamParams> FormatConverter::GetDeviceParamsCandidates(const AlsaPcmStreamParams &file_params)
+	{
+		std::vector<snd_pcm_format_t> formats;
+		formats.push_back(file_params.format);
+		snd_pcm_format_t native_format = CpuEndianFormat(file_params.format);
+		if(native_format != SND_PCM_FORMAT_UNKNOWN && native_format != file_params.format) {
+			formats.push_back(native_format);
+		}
+		switch(native_format) {
+			case SND_PCM_FORMAT_S16:
+				formats.push_back(SND_PCM_FORMAT_S32);
+				break;
+			case SND_PCM_FORMAT_S32:
+				formats.push_back(SND_PCM_FORMAT_S16);
+				break;
+			case SND_PCM_FORMAT_FLOAT:
+				formats.push_back(SND_PCM_FORMAT_S32);
+				formats.push_back(SND_PCM_FORMAT_S16);
+				break;
+			case SND_PCM_FORMAT_FLOAT64:
+				formats.push_back(SND_PCM_FORMAT_FLOAT);
+				formats.push_back(SND_PCM_FORMAT_S32);
+				formats.push_back(SND_PCM_FORMAT_S16);
+				break;
+			default:
+				if(native_format == NATIVE_S24_3) {
+					formats.push_back(SND_PCM_FORMAT_S32);
+					formats.push_back(SND_PCM_FORMAT_S16);
+				}
+				break;
+		}
+
+		// upmix is lossless, so it is preferred over a lower resolution format
+		std::vector<unsigned int> channels;
+		channels.push_back(file_params.num_of_channels);
+		if(file_params.num_of_channels == 1) {
+			channels.push_back(2);
+		}
+
+		std::vector<AlsaPcmStreamParams> candidates;
+		for(snd_pcm_format_t format : formats) {
+			for(unsigned int num_of_channels : channels) {
+				AlsaPcmStreamParams params = file_params;
+				params.format = format;
+				params.num_of_channels = num_of_channels;
+				candidates.push_back(params);
+			}
+		}
+		return candidates;
+	}
+
+	bool FormatConverter::Initialize(const AlsaPcmStreamParams &in_params, const AlsaPcmStreamParams &out_params)
+	{
+		kernel_ = nullptr;
+
+		if(in_params.frame_rate != out_params.frame_rate) {
+			return false;
+		}
+		bool upmix = (in_params.num_of_channels != out_params.num_of_channels);
+		if(upmix && (in_params.num_of_channels != 1 || out_params.num_of_channels != 2)) {
+			return false;
+		}
+		int in_width = snd_pcm_format_physical_width(in_params.format);
+		int out_width = snd_pcm_format_physical_width(out_params.format);
+		if(in_width <= 0 || in_width % 8 != 0 || out_width <= 0 || out_width % 8 != 0) {
+			return false;
+		}
+
+		if(in_params.format != out_params.format || upmix) {
+			// the table is built once, on the first stream
+			static const std::vector<ConversionKernel> kernels = BuildKernelTable();
+			unsigned int out_samples_per_in_sample = upmix ? 2 : 1;
+			for(const ConversionKernel &kernel : kernels) {
+				if(kernel.in_format == in_params.format && kernel.out_format == out_params.format &&
+					kernel.out_samples_per_in_sample == out_samples_per_in_sample) {
+					kernel_ = kernel.func;
+					break;
+				}
+			}
+			if(kernel_ == nullptr && in_params.format == out_params.format) {
+				kernel_ = RawUpmixKernel(in_width);
+			}
+			if(kernel_ == nullptr) {
+				return false;
+			}
+		}
+
+		in_channels_ = in_params.num_of_channels;
+		in_bytes_per_frame_ = (in_width / 8) * in_params.num_of_channels;
+		out_bytes_per_frame_ = (out_width / 8) * out_params.num_of_channels;
+		random_state_ = 1;
+		return true;
+	}
+
+	void FormatConverter::Convert(const char *in, size_t num_of_frames, char *out)
+	{
+		if(kernel_ == nullptr) {
+			memcpy(out, in, num_of_frames * in_bytes_per_frame_);
+			return;
+		}
+		kernel_(in, num_of_frames * in_channels_, out, &random_state_);
+	}
+
+}
@@ -0,0 +1,60 @@
+#ifndef WAVPLAYERALSA_FORMAT_CONVERTER_H__
+#define WAVPLAYERALSA_FORMAT_CONVERTER_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "alsa/asoundlib.h"
+
+#include "services/audio_sink.h"
+
+namespace wavplayeralsa
+{
+
+    /*
+    Converts interleaved frames from the format of an audio file to a format which the audio device
+    can play, when it cannot play the file format as is (which would otherwise need the plug plugin,
+    with its own buffering and unknown delay).
+    Supported conversions: non native endian samples to native endian, packed 24 bit samples to 32 bit,
+    16 bit to 32 bit, float (and double) samples to 32 bit, or to 16 bit with TPDF dither, and mono to stereo.
+    Each conversion is a single loop, instantiated at compile time for the pair of formats (see sample_formats.h),
+    and selected from a table when the stream starts.
+    The frame rate is not converted.
+    */
+    class FormatConverter
+    {
+
+    public:
+        // the params to try to configure the device with for a stream of a file, in order of preference:
+        // the params of the file first, then lossless conversions, and 16 bit (dithered) last.
+        static std::vector<AlsaPcmStreamParams> GetDeviceParamsCandidates(const AlsaPcmStreamParams &file_params);
+
+        // returns false if there is no conversion from in_params to out_params
+        bool Initialize(const AlsaPcmStreamParams &in_params, const AlsaPcmStreamParams &out_params);
+
+        unsigned int GetInBytesPerFrame() const { return in_bytes_per_frame_; }
+        unsigned int GetOutBytesPerFrame() const { return out_bytes_per_frame_; }
+
+        // convert num_of_frames frames from in to out. in and out must not overlap
+        void Convert(const char *in, size_t num_of_frames, char *out);
+
+        // converts num_of_samples samples from in to out. random_state is the state of the dither noise generator
+        typedef void (*KernelFunc)(const char *in, size_t num_of_samples, char *out, uint32_t *random_state);
+
+    private:
+        static snd_pcm_format_t CpuEndianFormat(snd_pcm_format_t format);
+
+    private:
+        unsigned int in_channels_ = 2;
+        unsigned int in_bytes_per_frame_ = 4;
+        unsigned int out_bytes_per_frame_ = 4;
+        // nullptr when the frames are copied as is
+        KernelFunc kernel_ = nullptr;
+        uint32_t random_state_ = 1;
+
+    };
+
+}
+
+#endif // WAVPLAYERALSA_FORMAT_CONVERTER_H__
@@ -0,0 +1,173 @@
+#include "services/mapped_audio_file.h"
+
+#include <sstream>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace wavplayeralsa
+{
+
+	namespace
+	{
+		uint32_t ReadUint32Le(const char *p) {
+			const unsigned char *u = (const unsigned char *)p;
+			return (uint32_t)u[0] | ((uint32_t)u[1] << 8) | ((uint32_t)u[2] << 16) | ((uint32_t)u[3] << 24);
+		}
+
+		uint32_t ReadUint32Be(const char *p) {
+			const unsigned char *u = (const unsigned char *)p;
+			return ((uint32_t)u[0] << 24) | ((uint32_t)u[1] << 16) | ((uint32_t)u[2] << 8) | (uint32_t)u[3];
+		}
+	}
+
+	MappedAudioFile::~MappedAudioFile()
+	{
+		Close();
+	}
+
+	void MappedAudioFile::Open(const std::string &full_file_name, bool is_aiff, uint64_t data_size_bytes)
+	{
+		Close();
+
+		std::stringstream err_desc;
+
+		int fd = open(full_file_name.c_str(), O_RDONLY);
+		if(fd < 0) {
+			err_desc << "cannot open file for mapping (" << strerror(errno) << ")";
+			throw std::runtime_error(err_desc.str());
+		}
+
+		struct stat file_stat;
+		if(fstat(fd, &file_stat) != 0) {
+			err_desc << "cannot stat file (" << strerror(errno) << ")";
+			close(fd);
+			throw std::runtime_error(err_desc.str());
+		}
+
+		mapping_size_ = file_stat.st_size;
+		void *mapping = mmap(nullptr, mapping_size_, PROT_READ, MAP_PRIVATE, fd, 0);
+		// the mapping holds its own reference to the file
+		close(fd);
+		if(mapping == MAP_FAILED) {
+			mapping_size_ = 0;
+			err_desc << "cannot mmap file (" << strerror(errno) << ")";
+			throw std::runtime_error(err_desc.str());
+		}
+		mapping_ = (char *)mapping;
+
+		try {
+			uint64_t data_offset = is_aiff ? FindAiffDataOffset() : FindWavDataOffset();
+
+			// chunk size field might be bogus for files which were written as stream.
+			// trust the metadata, as long as the data is actually in the file
+			if(data_offset + data_size_bytes > mapping_size_) {
+				err_desc << "audio data is expected to be " << data_size_bytes << " bytes at offset " << data_offset <<
+					", but file size is " << mapping_size_;
+				throw std::runtime_error(err_desc.str());
+			}
+
+			data_ = mapping_ + data_offset;
+			data_size_ = data_size_bytes;
+		}
+		catch(const std::runtime_error &) {
+			Close();
+			throw;
+		}
+
+		madvise(mapping_, mapping_size_, MADV_SEQUENTIAL);
+		Seek(0);
+	}
+
+	void MappedAudioFile::Close()
+	{
+		if(mapping_ != nullptr) {
+			munmap(mapping_, mapping_size_);
+		}
+		mapping_ = nullptr;
+		mapping_size_ = 0;
+		data_ = nullptr;
+		data_size_ = 0;
+		position_ = 0;
+	}
+
+	void MappedAudioFile::Seek(uint64_t byte_offset)
+	{
+		position_ = std::min(byte_offset, data_size_);
+
+		// madvise requires page aligned address
+		static const uint64_t page_size = sysconf(_SC_PAGESIZE);
+		uint64_t file_offset = (data_ - mapping_) + position_;
+		uint64_t aligned_offset = file_offset - (file_offset % page_size);
+		uint64_t length = std::min((uint64_t)READ_AHEAD_BYTES, (uint64_t)mapping_size_ - aligned_offset);
+		if(length > 0) {
+			madvise(mapping_ + aligned_offset, length, MADV_WILLNEED);
+		}
+	}
+
+	size_t MappedAudioFile::Read(char *dest, size_t max_bytes)
+	{
+		size_t bytes = std::min((uint64_t)max_bytes, data_size_ - position_);
+		memcpy(dest, data_ + position_, bytes);
+		position_ += bytes;
+		return bytes;
+	}
+
+	/*
+	RIFF wave file is a 12 bytes header ("RIFF", size, "WAVE"), followed by chunks.
+	each chunk is 4 bytes id, 4 bytes little endian size, and data padded to even size.
+	the audio is in the "data" chunk.
+	*/
+	uint64_t MappedAudioFile::FindWavDataOffset() const
+	{
+		if(mapping_size_ < 12 || memcmp(mapping_, "RIFF", 4) != 0 || memcmp(mapping_ + 8, "WAVE", 4) != 0) {
+			throw std::runtime_error("file is not a RIFF WAVE file");
+		}
+
+		uint64_t offset = 12;
+		while(offset + 8 <= mapping_size_) {
+			const char *chunk = mapping_ + offset;
+			uint64_t chunk_size = ReadUint32Le(chunk + 4);
+			if(memcmp(chunk, "data", 4) == 0) {
+				return offset + 8;
+			}
+			offset += 8 + chunk_size + (chunk_size & 1);
+		}
+		throw std::runtime_error("cannot find 'data' chunk in wav file");
+	}
+
+	/*
+	AIFF file is a 12 bytes header ("FORM", size, "AIFF" or "AIFC"), followed by chunks.
+	each chunk is 4 bytes id, 4 bytes big endian size, and data padded to even size.
+	the audio is in the "SSND" chunk, after 4 bytes offset and 4 bytes block size fields.
+	*/
+	uint64_t MappedAudioFile::FindAiffDataOffset() const
+	{
+		if(mapping_size_ < 12 || memcmp(mapping_, "FORM", 4) != 0 ||
+			(memcmp(mapping_ + 8, "AIFF", 4) != 0 && memcmp(mapping_ + 8, "AIFC", 4) != 0)) {
+			throw std::runtime_error("file is not an AIFF file");
+		}
+
+		uint64_t offset = 12;
+		while(offset + 8 <= mapping_size_) {
+			const char *chunk = mapping_ + offset;
+			uint64_t chunk_size = ReadUint32Be(chunk + 4);
+			if(memcmp(chunk, "SSND", 4) == 0) {
+				if(offset + 16 > mapping_size_) {
+					break;
+				}
+				uint64_t data_offset_in_chunk = ReadUint32Be(chunk + 8);
+				return offset + 16 + data_offset_in_chunk;
+			}
+			offset += 8 + chunk_size + (chunk_size & 1);
+		}
+		throw std::runtime_error("cannot find 'SSND' chunk in aiff file");
+	}
+
+}
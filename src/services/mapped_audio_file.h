@@ -0,0 +1,58 @@
+#ifndef WAVPLAYERALSA_MAPPED_AUDIO_FILE_H__
+#define WAVPLAYERALSA_MAPPED_AUDIO_FILE_H__
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+namespace wavplayeralsa
+{
+
+    /*
+    Memory mapped view of the raw audio data in an uncompressed wav / aiff file.
+    The file metadata (format, frames count) is read with libsndfile. This class only
+    locates the audio data chunk in the file, and maps it, so reading frames and
+    seeking are plain pointer arithmetic, without syscalls or copies into libsndfile buffers.
+    The bytes are exactly what SndfileHandle::readRaw would return.
+    */
+    class MappedAudioFile
+    {
+
+    public:
+        ~MappedAudioFile();
+
+        // map the file, and locate the audio data in it.
+        // data_size_bytes is the expected size of the audio data, as calculated from the file metadata.
+        // throw std::runtime_error if the file cannot be mapped, or its layout is not supported.
+        void Open(const std::string &full_file_name, bool is_aiff, uint64_t data_size_bytes);
+        void Close();
+        bool IsOpen() const { return data_ != nullptr; }
+
+    public:
+        // set the read position, in bytes from the start of the audio data
+        void Seek(uint64_t byte_offset);
+
+        // copy up to max_bytes from the current position to dest, and advance the position.
+        // returns the number of bytes copied, 0 at end of data.
+        size_t Read(char *dest, size_t max_bytes);
+
+    private:
+        uint64_t FindWavDataOffset() const;
+        uint64_t FindAiffDataOffset() const;
+
+    private:
+        // how much data to ask the kernel to read ahead of the position after a seek
+        static const size_t READ_AHEAD_BYTES = 1024 * 1024;
+
+        char *mapping_ = nullptr;
+        size_t mapping_size_ = 0;
+
+        const char *data_ = nullptr;
+        uint64_t data_size_ = 0;
+        uint64_t position_ = 0;
+
+    };
+
+}
+
+#endif // WAVPLAYERALSA_MAPPED_AUDIO_FILE_H__
@@ -0,0 +1,475 @@
+#include "services/mirror_outputs.h"
+
+#include <sstream>
+#include <cstring>
+#include <cmath>
+#include <cerrno>
+#include <algorithm>
+#include <stdexcept>
+
+namespace wavplayeralsa
+{
+
+	void MirrorOutput::Initialize(
+			std::shared_ptr<spdlog::logger> logger,
+			const std::string &audio_device,
+			const std::string &tstamp_type,
+			const AlsaPcmBufferConfig &buffer_config
+		)
+	{
+		logger_ = logger;
+		audio_device_ = audio_device;
+		// frames are written from the fifo (or the resampler output) with Write
+		audio_sink_ = CreateAudioSink(logger_, audio_device, false, tstamp_type, buffer_config, nullptr);
+		status_.device = audio_device;
+	}
+
+	void MirrorOutput::StartStream(const AlsaPcmStreamParams &params, clockid_t reference_clock_id)
+	{
+		active_ = false;
+		started_ = false;
+		try {
+			audio_sink_->StartStream(params);
+		}
+		catch(const std::runtime_error &e) {
+			Fail(e);
+			return;
+		}
+
+		format_ = params.format;
+		frame_rate_ = params.frame_rate;
+		num_of_channels_ = params.num_of_channels;
+		bytes_per_frame_ = (snd_pcm_format_physical_width(format_) / 8) * num_of_channels_;
+		period_size_ = std::max((snd_pcm_sframes_t)audio_sink_->GetPeriodSize(), (snd_pcm_sframes_t)1);
+
+		fifo_.resize(((uint64_t)FIFO_MS * frame_rate_ / 1000) * bytes_per_frame_);
+		clock_estimator_.Initialize(frame_rate_);
+		write_buffer_.resize(period_size_ * bytes_per_frame_);
+		resampling_ = resampler_.Initialize(format_, num_of_channels_);
+		if(!resampling_) {
+			logger_->warn("format {} cannot be resampled. device is aligned by padding and dropping frames only", snd_pcm_format_name(format_));
+		}
+		clock_offset_us_ = CalcClockOffset(reference_clock_id);
+
+		active_ = true;
+		Resync(0);
+		{
+			std::lock_guard<std::mutex> guard(status_mutex_);
+			status_.playing = false;
+			status_.offset_us = 0;
+			status_.drift_ppm = 0.0;
+			status_.resample_ratio = 1.0;
+			status_.error.clear();
+		}
+	}
+
+	/*
+	Forget all the frames of the device, and continue from stream_frame.
+	The device is started again by Pump, if the main device is playing, and aligned by the next measurements.
+	*/
+	void MirrorOutput::Resync(int64_t stream_frame)
+	{
+		try {
+			audio_sink_->DropAndPrepare();
+		}
+		catch(const std::runtime_error &e) {
+			Fail(e);
+			return;
+		}
+		fifo_begin_ = 0;
+		fifo_end_ = 0;
+		fifo_begin_frame_ = stream_frame;
+		silence_to_pad_ = 0;
+		frames_to_drop_ = 0;
+		pcm_frames_written_ = 0;
+		realign_measurements_ = 0;
+		clock_estimator_.Reset();
+		if(resampling_) {
+			resampler_.Reset();
+			resampler_.SetRatio(1.0);
+		}
+	}
+
+	void MirrorOutput::Write(int64_t stream_frame, const char *frames, snd_pcm_sframes_t num_of_frames)
+	{
+		if(!active_ || num_of_frames <= 0) {
+			return;
+		}
+
+		if(stream_frame != fifo_begin_frame_ + FifoFrames()) {
+			logger_->info("stream continues from frame {} instead of {}. restarting the device from it", stream_frame, fifo_begin_frame_ + FifoFrames());
+			Resync(stream_frame);
+			if(!active_) {
+				return;
+			}
+		}
+
+		// the device plays behind, and the frames which should already have been played are skipped
+		if(frames_to_drop_ > 0) {
+			snd_pcm_sframes_t dropped = (snd_pcm_sframes_t)std::min(frames_to_drop_, (int64_t)num_of_frames);
+			frames_to_drop_ -= dropped;
+			fifo_begin_frame_ += dropped;
+			stream_frame += dropped;
+			frames += dropped * bytes_per_frame_;
+			num_of_frames -= dropped;
+		}
+
+		size_t bytes = num_of_frames * bytes_per_frame_;
+		if(fifo_end_ + bytes > fifo_.size() && fifo_begin_ > 0) {
+			std::memmove(fifo_.data(), fifo_.data() + fifo_begin_, fifo_end_ - fifo_begin_);
+			fifo_end_ -= fifo_begin_;
+			fifo_begin_ = 0;
+		}
+		if(fifo_end_ + bytes > fifo_.size()) {
+			// the device does not take frames (it is stuck). start over from the new frames
+			logger_->warn("fifo is full. device does not play the frames written to it");
+			Resync(stream_frame);
+			if(!active_) {
+				return;
+			}
+			bytes = std::min(bytes, fifo_.size());
+		}
+		std::memcpy(fifo_.data() + fifo_end_, frames, bytes);
+		fifo_end_ += bytes;
+
+		Pump();
+	}
+
+	void MirrorOutput::Pump()
+	{
+		if(!active_) {
+			return;
+		}
+
+		try {
+			snd_pcm_sframes_t avail = audio_sink_->AvailUpdate();
+			if(avail < 0) {
+				if(!RecoverXrun(avail)) {
+					std::stringstream err_desc;
+					err_desc << "unknown ALSA avail update return value (" << avail << ")";
+					throw std::runtime_error(err_desc.str());
+				}
+				avail = audio_sink_->AvailUpdate();
+			}
+			if(avail > 0) {
+				WriteToPcm(avail);
+			}
+
+			snd_pcm_sframes_t delay = 0;
+			if(started_ && audio_sink_->GetState() == SND_PCM_STATE_PREPARED && audio_sink_->GetDelay(&delay) == 0 && delay > 0) {
+				int err;
+				if( (err = audio_sink_->Start()) < 0) {
+					std::stringstream err_desc;
+					err_desc << "snd_pcm_start failed (" << snd_strerror(err) << ")";
+					throw std::runtime_error(err_desc.str());
+				}
+			}
+		}
+		catch(const std::runtime_error &e) {
+			Fail(e);
+		}
+	}
+
+	/*
+	Write up to avail frames: first silence which was requested for alignment, then frames from the fifo,
+	resampled by the ratio which keeps the device in sync with the main device.
+	*/
+	void MirrorOutput::WriteToPcm(snd_pcm_sframes_t avail)
+	{
+		while(avail > 0) {
+			snd_pcm_sframes_t max_frames = std::min(avail, period_size_);
+			snd_pcm_sframes_t written;
+
+			if(silence_to_pad_ > 0) {
+				snd_pcm_sframes_t frames = std::min(max_frames, silence_to_pad_);
+				snd_pcm_format_set_silence(format_, write_buffer_.data(), frames * num_of_channels_);
+				written = audio_sink_->Write(write_buffer_.data(), frames);
+				if(written > 0) {
+					silence_to_pad_ -= written;
+				}
+			}
+			else if(FifoFrames() == 0) {
+				return;
+			}
+			else if(!resampling_) {
+				snd_pcm_sframes_t frames = std::min(max_frames, FifoFrames());
+				written = audio_sink_->Write(fifo_.data() + fifo_begin_, frames);
+				if(written > 0) {
+					ConsumeFifo(written);
+				}
+			}
+			else {
+				snd_pcm_sframes_t in_frames = std::min((snd_pcm_sframes_t)resampler_.MaxInputFrames(max_frames), FifoFrames());
+				in_frames = std::max(in_frames, (snd_pcm_sframes_t)1);
+				snd_pcm_sframes_t out_frames = resampler_.Process(fifo_.data() + fifo_begin_, in_frames, write_buffer_.data(), max_frames);
+				written = audio_sink_->Write(write_buffer_.data(), out_frames);
+				if(written >= 0) {
+					// the input of the output which was not written stays in the fifo, and is resampled again
+					ConsumeFifo(resampler_.Advance(written));
+				}
+			}
+
+			if(written < 0) {
+				if(!RecoverXrun(written)) {
+					std::stringstream err_desc;
+					err_desc << "snd_pcm_writei failed (" << snd_strerror(written) << ")";
+					throw std::runtime_error(err_desc.str());
+				}
+				avail = audio_sink_->AvailUpdate();
+				continue;
+			}
+			pcm_frames_written_ += written;
+			avail -= written;
+			if(written == 0) {
+				return;
+			}
+		}
+	}
+
+	void MirrorOutput::ConsumeFifo(snd_pcm_sframes_t frames)
+	{
+		fifo_begin_ += frames * bytes_per_frame_;
+		fifo_begin_frame_ += frames;
+		if(fifo_begin_ == fifo_end_) {
+			fifo_begin_ = 0;
+			fifo_end_ = 0;
+		}
+	}
+
+	/*
+	The pcm is empty after recovery. The frames in the fifo are played late,
+	which the next measurement finds, and realigns by dropping them.
+	*/
+	bool MirrorOutput::RecoverXrun(int err)
+	{
+		if(err != -EPIPE && err != -ESTRPIPE) {
+			return false;
+		}
+		audio_sink_->RecoverXrun(err);
+		silence_to_pad_ = 0;
+		realign_measurements_ = REALIGN_MEASUREMENTS;
+		if(resampling_) {
+			resampler_.Reset();
+		}
+		return true;
+	}
+
+	void MirrorOutput::Start()
+	{
+		started_ = true;
+		Pump();
+	}
+
+	/*
+	The stream ended. The device is prepared again by the next stream.
+	*/
+	void MirrorOutput::Drop()
+	{
+		started_ = false;
+		if(!active_) {
+			return;
+		}
+		active_ = false;
+		fifo_begin_ = 0;
+		fifo_end_ = 0;
+		try {
+			audio_sink_->Drop();
+		}
+		catch(const std::runtime_error &e) {
+			Fail(e);
+			return;
+		}
+		std::lock_guard<std::mutex> guard(status_mutex_);
+		status_.playing = false;
+	}
+
+	/*
+	Compare the time at which the main device and this device play the same stream frame.
+	For this device, the next frame in the fifo (after the frames which are about to be dropped) is
+	played after the frames in the pcm buffer (delay, in device frames), the silence which was not
+	padded yet, and the frames which are still in the resampler. The main device frame at the same time is extrapolated from its last
+	measurement with its speed.
+	*/
+	void MirrorOutput::Align(int64_t reference_tstamp_us, int64_t reference_frame, double reference_speed)
+	{
+		if(!active_ || !started_) {
+			return;
+		}
+
+		AlsaPcmPositionSnapshot snapshot;
+		try {
+			snapshot = audio_sink_->GetPositionSnapshot();
+		}
+		catch(const std::runtime_error &e) {
+			Fail(e);
+			return;
+		}
+		if(snapshot.state != SND_PCM_STATE_RUNNING || snapshot.tstamp_us == 0) {
+			return;
+		}
+
+		int64_t tstamp_us = snapshot.tstamp_us + clock_offset_us_;
+		clock_estimator_.AddMeasurement(tstamp_us, pcm_frames_written_ - snapshot.delay);
+
+		double ratio = resampling_ ? resampler_.GetRatio() : 1.0;
+		double pending_input_frames = resampling_ ? resampler_.GetPendingInputFrames() : 0.0;
+		double played_frame = (double)(fifo_begin_frame_ + frames_to_drop_) - pending_input_frames - (double)(snapshot.delay + silence_to_pad_) / ratio;
+		double reference_played_frame = (double)reference_frame +
+			(double)(tstamp_us - reference_tstamp_us) * frame_rate_ * reference_speed / 1000000.0;
+
+		// positive if this device plays behind the main device
+		double offset_frames = reference_played_frame - played_frame;
+		int64_t offset_us = (int64_t)std::llround(offset_frames * 1000000.0 / frame_rate_);
+		// relative to the main device clock
+		double speed = clock_estimator_.GetSpeed() / reference_speed;
+
+		if(std::abs(offset_us) > REALIGN_OFFSET_US) {
+			realign_measurements_++;
+		}
+		else {
+			realign_measurements_ = 0;
+		}
+
+		bool realigned = false;
+		if(realign_measurements_ >= REALIGN_MEASUREMENTS) {
+			int64_t frames = (int64_t)std::llround(offset_frames);
+			if(frames > 0) {
+				snd_pcm_sframes_t fifo_frames = std::min((int64_t)FifoFrames(), frames);
+				ConsumeFifo(fifo_frames);
+				frames_to_drop_ += frames - fifo_frames;
+			}
+			else {
+				silence_to_pad_ += -frames;
+			}
+			logger_->info("device is {} us {} the main device. {} {} frames", std::abs(offset_us),
+				offset_us > 0 ? "behind" : "ahead of", offset_us > 0 ? "dropping" : "padding", std::abs(frames));
+			realign_measurements_ = 0;
+			realigned = true;
+		}
+		else if(resampling_) {
+			// when behind, play the frames faster (less output frames for each input frame)
+			const double max_correction = MAX_OFFSET_CORRECTION_PPM / 1000000.0;
+			double correction = std::min(std::max(-(double)offset_us / OFFSET_CORRECTION_TIME_US, -max_correction), max_correction);
+			resampler_.SetRatio(speed * (1.0 + correction));
+		}
+
+		std::lock_guard<std::mutex> guard(status_mutex_);
+		status_.playing = true;
+		status_.offset_us = offset_us;
+		status_.drift_ppm = (speed - 1.0) * 1000000.0;
+		status_.resample_ratio = resampling_ ? resampler_.GetRatio() : 1.0;
+		if(realigned) {
+			status_.realigns++;
+		}
+	}
+
+	MirrorDeviceStatus MirrorOutput::QueryStatus()
+	{
+		MirrorDeviceStatus status;
+		{
+			std::lock_guard<std::mutex> guard(status_mutex_);
+			status = status_;
+		}
+		status.xruns = audio_sink_->QueryXrunStats().count;
+		return status;
+	}
+
+	/*
+	The device is stopped until the next stream. The main device and the other mirrors continue.
+	*/
+	void MirrorOutput::Fail(const std::runtime_error &e)
+	{
+		logger_->error("mirror device {} is stopped until the next file. exception is: {}", audio_device_, e.what());
+		active_ = false;
+		std::lock_guard<std::mutex> guard(status_mutex_);
+		status_.playing = false;
+		status_.error = e.what();
+	}
+
+	/*
+	Devices which do not support the configured timestamp type fall back to another clock.
+	Their timestamps are translated to the clock of the main device.
+	*/
+	int64_t MirrorOutput::CalcClockOffset(clockid_t reference_clock_id) const
+	{
+		clockid_t clock_id = audio_sink_->GetTimestampClockId();
+		if(clock_id == reference_clock_id) {
+			return 0;
+		}
+
+		struct timespec before, reference_now, after;
+		clock_gettime(clock_id, &before);
+		clock_gettime(reference_clock_id, &reference_now);
+		clock_gettime(clock_id, &after);
+
+		int64_t before_us = (int64_t)before.tv_sec * 1000000 + before.tv_nsec / 1000;
+		int64_t after_us = (int64_t)after.tv_sec * 1000000 + after.tv_nsec / 1000;
+		int64_t reference_now_us = (int64_t)reference_now.tv_sec * 1000000 + reference_now.tv_nsec / 1000;
+		return reference_now_us - (before_us + after_us) / 2;
+	}
+
+	void MirrorOutputs::Initialize(
+			std::shared_ptr<spdlog::logger> logger,
+			const std::vector<MirrorDeviceConfig> &devices,
+			const std::string &tstamp_type
+		)
+	{
+		for(size_t i = 0; i < devices.size(); i++) {
+			std::unique_ptr<MirrorOutput> output(new MirrorOutput());
+			output->Initialize(logger->clone("mirror_output." + std::to_string(i)), devices[i].audio_device, tstamp_type, devices[i].buffer_config);
+			outputs_.push_back(std::move(output));
+		}
+	}
+
+	void MirrorOutputs::StartStream(const AlsaPcmStreamParams &params, clockid_t reference_clock_id)
+	{
+		for(std::unique_ptr<MirrorOutput> &output : outputs_) {
+			output->StartStream(params, reference_clock_id);
+		}
+	}
+
+	void MirrorOutputs::Write(int64_t stream_frame, const char *frames, snd_pcm_sframes_t num_of_frames)
+	{
+		for(std::unique_ptr<MirrorOutput> &output : outputs_) {
+			output->Write(stream_frame, frames, num_of_frames);
+		}
+	}
+
+	void MirrorOutputs::Pump()
+	{
+		for(std::unique_ptr<MirrorOutput> &output : outputs_) {
+			output->Pump();
+		}
+	}
+
+	void MirrorOutputs::Start()
+	{
+		for(std::unique_ptr<MirrorOutput> &output : outputs_) {
+			output->Start();
+		}
+	}
+
+	void MirrorOutputs::Drop()
+	{
+		for(std::unique_ptr<MirrorOutput> &output : outputs_) {
+			output->Drop();
+		}
+	}
+
+	void MirrorOutputs::Align(int64_t reference_tstamp_us, int64_t reference_frame, double reference_speed)
+	{
+		for(std::unique_ptr<MirrorOutput> &output : outputs_) {
+			output->Align(reference_tstamp_us, reference_frame, reference_speed);
+		}
+	}
+
+	std::vector<MirrorDeviceStatus> MirrorOutputs::QueryStatus()
+	{
+		std::vector<MirrorDeviceStatus> statuses;
+		for(std::unique_ptr<MirrorOutput> &output : outputs_) {
+			statuses.push_back(output->QueryStatus());
+		}
+		return statuses;
+	}
+
+}
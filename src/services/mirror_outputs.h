@@ -0,0 +1,176 @@
+#ifndef WAVPLAYERALSA_MIRROR_OUTPUTS_H__
+#define WAVPLAYERALSA_MIRROR_OUTPUTS_H__
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <mutex>
+#include <time.h>
+
+#include "alsa/asoundlib.h"
+#include "spdlog/spdlog.h"
+
+#include "player_actions_ifc.h"
+#include "services/audio_sink.h"
+#include "services/audio_position_estimator.h"
+#include "services/drift_resampler.h"
+
+namespace wavplayeralsa
+{
+
+    struct MirrorDeviceConfig
+    {
+        std::string audio_device;
+        AlsaPcmBufferConfig buffer_config;
+    };
+
+    /*
+    An extra audio device which plays the same frames as the main device of the zone, in sync with it.
+    The frames are decoded once, and the frames written to the main pcm are copied to a fifo of the
+    mirror, from which they are written to its own pcm, whenever it has room for them.
+    The main device is the reference: each measurement compares the timestamped delay of the mirror with
+    the one of the main device, which gives the time difference (offset) at which both play the same frame.
+    Small offsets and the drift between the two clocks are corrected by resampling the mirror frames,
+    the same way drift compensation does for the main device. Large offsets (start, xrun) are corrected
+    at once, by padding silence or dropping frames.
+    A mirror device which fails is stopped, and does not affect the main device or the other mirrors.
+    All the functions run on the audio worker thread of the zone, except for QueryStatus.
+    */
+    class MirrorOutput
+    {
+
+    public:
+        void Initialize(
+            std::shared_ptr<spdlog::logger> logger,
+            const std::string &audio_device,
+            const std::string &tstamp_type,
+            const AlsaPcmBufferConfig &buffer_config
+        );
+
+    public:
+        // prepare the device for a new stream. the first frame of the stream is stream frame 0.
+        // reference_clock_id is the timestamp clock of the main device
+        void StartStream(const AlsaPcmStreamParams &params, clockid_t reference_clock_id);
+
+        // frames which were written to the main pcm, starting at stream_frame.
+        // a stream_frame which does not follow the previous frames (seek, xrun on the main device)
+        // restarts the mirror from it
+        void Write(int64_t stream_frame, const char *frames, snd_pcm_sframes_t num_of_frames);
+
+        // write frames from the fifo to the pcm, as much as it can take, and start it
+        // if the main device is playing
+        void Pump();
+
+        // the main device started playing
+        void Start();
+
+        // stop the device, and discard its frames
+        void Drop();
+
+        // measure the offset from the main device, which played reference_frame at reference_tstamp_us
+        // (on its timestamp clock), with its clock running at reference_speed.
+        void Align(int64_t reference_tstamp_us, int64_t reference_frame, double reference_speed);
+
+        // can be called from any thread
+        MirrorDeviceStatus QueryStatus();
+
+    private:
+        void Resync(int64_t stream_frame);
+        void WriteToPcm(snd_pcm_sframes_t avail);
+        void ConsumeFifo(snd_pcm_sframes_t frames);
+        bool RecoverXrun(int err);
+        void Fail(const std::runtime_error &e);
+        int64_t CalcClockOffset(clockid_t reference_clock_id) const;
+        snd_pcm_sframes_t FifoFrames() const { return (fifo_end_ - fifo_begin_) / bytes_per_frame_; }
+
+    private:
+        std::shared_ptr<spdlog::logger> logger_;
+        std::string audio_device_;
+        std::unique_ptr<AudioSink> audio_sink_;
+
+        // the stream is configured on the device, and it did not fail
+        bool active_ = false;
+        // the main device was started. the mirror is started (or restarted after xrun) as soon as it has frames
+        bool started_ = false;
+
+        snd_pcm_format_t format_ = SND_PCM_FORMAT_S16_LE;
+        unsigned int frame_rate_ = 44100;
+        unsigned int num_of_channels_ = 2;
+        unsigned int bytes_per_frame_ = 1;
+        snd_pcm_sframes_t period_size_ = 1;
+
+        // frames copied from the main device, which were not yet written to the pcm.
+        // the frames between fifo_begin_ and fifo_end_ (bytes) are valid. fifo_begin_frame_ is the stream frame at fifo_begin_
+        static const int FIFO_MS = 1000;
+        std::vector<char> fifo_;
+        size_t fifo_begin_ = 0;
+        size_t fifo_end_ = 0;
+        int64_t fifo_begin_frame_ = 0;
+
+        // pending alignment corrections
+        snd_pcm_sframes_t silence_to_pad_ = 0;
+        int64_t frames_to_drop_ = 0;
+
+        // frames written to the pcm since it was last prepared, including padding
+        int64_t pcm_frames_written_ = 0;
+        // add to the timestamps of this device to get the time on the main device timestamp clock
+        int64_t clock_offset_us_ = 0;
+        AudioPositionEstimator clock_estimator_;
+
+        bool resampling_ = false; // the format can be resampled
+        DriftResampler resampler_;
+        // one period of resampled frames (or padding silence), for snd_pcm_writei
+        std::vector<char> write_buffer_;
+
+        // offsets above this are corrected by padding or dropping frames. below it, by resampling
+        static const int64_t REALIGN_OFFSET_US = 1000;
+        // a single measurement can be off (coarse delay reporting on some devices).
+        // realign only if this many measurements in a row are above the threshold
+        static const int REALIGN_MEASUREMENTS = 3;
+        int realign_measurements_ = 0;
+        static const int64_t OFFSET_CORRECTION_TIME_US = 2 * 1000000LL;
+        static const int MAX_OFFSET_CORRECTION_PPM = 500;
+
+    private:
+        std::mutex status_mutex_;
+        MirrorDeviceStatus status_;
+
+    };
+
+    /*
+    The mirror devices of a zone. Forwards the stream events of the main device to all of them.
+    */
+    class MirrorOutputs
+    {
+
+    public:
+        void Initialize(
+            std::shared_ptr<spdlog::logger> logger,
+            const std::vector<MirrorDeviceConfig> &devices,
+            const std::string &tstamp_type
+        );
+
+        bool IsEmpty() const { return outputs_.empty(); }
+
+    // audio worker thread
+    public:
+        void StartStream(const AlsaPcmStreamParams &params, clockid_t reference_clock_id);
+        void Write(int64_t stream_frame, const char *frames, snd_pcm_sframes_t num_of_frames);
+        void Pump();
+        void Start();
+        void Drop();
+        void Align(int64_t reference_tstamp_us, int64_t reference_frame, double reference_speed);
+
+    public:
+        // can be called from any thread
+        std::vector<MirrorDeviceStatus> QueryStatus();
+
+    private:
+        std::vector<std::unique_ptr<MirrorOutput>> outputs_;
+
+    };
+
+}
+
+#endif // WAVPLAYERALSA_MIRROR_OUTPUTS_H__
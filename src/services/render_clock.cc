@@ -0,0 +1,131 @@
+#include "services/render_clock.h"
+
+#include <algorithm>
+#include <time.h>
+
+namespace wavplayeralsa
+{
+
+	const int RenderClock::SETTLE_MS;
+	const int RenderClock::STALL_WARNING_MS;
+
+	void RenderClock::Initialize(std::shared_ptr<spdlog::logger> logger)
+	{
+		logger_ = logger;
+
+		struct timespec monotonic_now, epoch_now;
+		clock_gettime(CLOCK_MONOTONIC, &monotonic_now);
+		clock_gettime(CLOCK_REALTIME, &epoch_now);
+		start_ns_ = (int64_t)monotonic_now.tv_sec * 1000000000 + monotonic_now.tv_nsec;
+		now_ns_ = start_ns_;
+		epoch_offset_us_ = ((int64_t)epoch_now.tv_sec * 1000000 + epoch_now.tv_nsec / 1000) - start_ns_ / 1000;
+		last_activity_ = std::chrono::steady_clock::now();
+	}
+
+	void RenderClock::AddClient(Client *client)
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		ClientState state;
+		state.client = client;
+		clients_.push_back(state);
+	}
+
+	void RenderClock::RemoveClient(Client *client)
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		clients_.erase(std::remove_if(clients_.begin(), clients_.end(), 
+			[client](const ClientState &state) { return state.client == client; }), clients_.end());
+		changed_.notify_all();
+	}
+
+	void RenderClock::UpdateClient(Client *client, bool running, int64_t wakeup_ns)
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		for(ClientState &state : clients_) {
+			if(state.client == client) {
+				state.running = running;
+				state.wakeup_ns = wakeup_ns;
+			}
+		}
+		if(!running) {
+			last_activity_ = std::chrono::steady_clock::now();
+		}
+		changed_.notify_all();
+	}
+
+	void RenderClock::Touch()
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		last_activity_ = std::chrono::steady_clock::now();
+	}
+
+	void RenderClock::AdvanceTo(int64_t time_ns)
+	{
+		Advance(time_ns, false);
+	}
+
+	bool RenderClock::AdvanceUntilIdle(int64_t max_time_ns)
+	{
+		return Advance(max_time_ns, true);
+	}
+
+	bool RenderClock::Advance(int64_t time_ns, bool until_idle)
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		std::chrono::steady_clock::time_point blocked_since = std::chrono::steady_clock::now();
+		bool stall_reported = false;
+
+		while(true) {
+			std::chrono::steady_clock::time_point real_now = std::chrono::steady_clock::now();
+			bool writer_busy = false;
+			bool any_running = false;
+			int64_t next_ns = time_ns;
+			for(const ClientState &state : clients_) {
+				if(!state.running) {
+					continue;
+				}
+				any_running = true;
+				if(state.wakeup_ns < 0) {
+					writer_busy = true;
+				}
+				else {
+					next_ns = std::min(next_ns, state.wakeup_ns);
+				}
+			}
+
+			std::chrono::steady_clock::duration quiet_time = real_now - last_activity_;
+			if(writer_busy || quiet_time < std::chrono::milliseconds(SETTLE_MS)) {
+				if(writer_busy && !stall_reported && real_now - blocked_since > std::chrono::milliseconds(STALL_WARNING_MS)) {
+					logger_->warn("audio pipeline did not respond for {} ms at render time {} ms", 
+						STALL_WARNING_MS, (now_ns_ - start_ns_) / 1000000);
+					stall_reported = true;
+				}
+				std::chrono::steady_clock::duration wait_time = std::chrono::milliseconds(SETTLE_MS);
+				if(!writer_busy) {
+					wait_time -= quiet_time;
+				}
+				changed_.wait_for(lock, wait_time);
+				continue;
+			}
+
+			if(until_idle && !any_running) {
+				return true;
+			}
+			if(now_ns_ >= time_ns) {
+				return !any_running;
+			}
+
+			now_ns_ = std::max((int64_t)now_ns_, next_ns);
+			for(ClientState &state : clients_) {
+				if(state.running && state.wakeup_ns >= 0 && state.wakeup_ns <= now_ns_) {
+					// the writer of the device is busy until it reports its next wakeup
+					state.wakeup_ns = -1;
+					state.client->OnClockWakeup();
+				}
+			}
+			blocked_since = std::chrono::steady_clock::now();
+			stall_reported = false;
+		}
+	}
+
+}
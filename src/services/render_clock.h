@@ -0,0 +1,105 @@
+#ifndef WAVPLAYERALSA_RENDER_CLOCK_H__
+#define WAVPLAYERALSA_RENDER_CLOCK_H__
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+
+#include "spdlog/spdlog.h"
+
+namespace wavplayeralsa
+{
+
+    /*
+    Virtual time for rendering a show faster than real time.
+    The simulated audio devices play on this clock instead of the system clock, and it is advanced
+    by the renderer, as fast as the playback pipeline can fill the devices.
+    The clock never passes a point at which a playing device would run empty: each playing device
+    tells the time at which its writer should be woken up (a period is free, or draining ended).
+    The clock advances to the earliest of these times, wakes up the device, and waits until its
+    writer wrote the frames and went to sleep again.
+    While there are no playing devices, the clock jumps forward, but only after the pipeline had
+    no activity for a short (real) time, so a file which is being loaded starts at the time it
+    was requested, and not after the jump.
+    */
+    class RenderClock
+    {
+
+    public:
+        // an audio device which plays on the clock
+        class Client
+        {
+        public:
+            virtual ~Client() { }
+            // the clock reached the wakeup time of the client. called on the thread which advances the clock
+            virtual void OnClockWakeup() = 0;
+        };
+
+    public:
+        void Initialize(std::shared_ptr<spdlog::logger> logger);
+
+    public:
+        // virtual monotonic time, in nano seconds
+        int64_t NowNs() const { return now_ns_; }
+        // the time at which the clock started (time 0 of the show)
+        int64_t GetStartNs() const { return start_ns_; }
+        // add to a time of the clock (in micro seconds) to get the virtual wall clock time.
+        // the virtual wall clock starts at the real wall clock time of Initialize
+        int64_t GetEpochOffsetUs() const { return epoch_offset_us_; }
+
+    // audio devices. called on the audio worker threads
+    public:
+        void AddClient(Client *client);
+        void RemoveClient(Client *client);
+        // running is true if the device is playing. wakeup_ns is the time at which the device
+        // writer waits to be woken up, or negative if it is not waiting (busy writing).
+        void UpdateClient(Client *client, bool running, int64_t wakeup_ns);
+
+    // renderer
+    public:
+        // the pipeline is about to change (a command was sent to it). the clock waits until it settles
+        void Touch();
+
+        // advance the clock to time_ns.
+        void AdvanceTo(int64_t time_ns);
+
+        // advance the clock until no device is playing, or up to max_time_ns.
+        // returns true if the devices are idle
+        bool AdvanceUntilIdle(int64_t max_time_ns);
+
+    private:
+        bool Advance(int64_t time_ns, bool until_idle);
+
+    private:
+        struct ClientState {
+            Client *client = nullptr;
+            bool running = false;
+            int64_t wakeup_ns = -1;
+        };
+
+    private:
+        std::shared_ptr<spdlog::logger> logger_;
+        std::atomic<int64_t> now_ns_{0};
+        int64_t start_ns_ = 0;
+        int64_t epoch_offset_us_ = 0;
+
+        std::mutex mutex_;
+        std::condition_variable changed_;
+        std::vector<ClientState> clients_;
+        // real time of the last change in a device which is not playing, or of the last command
+        std::chrono::steady_clock::time_point last_activity_;
+
+        // the pipeline is considered settled after this much real time with no activity
+        static const int SETTLE_MS = 100;
+        // warn if a device writer does not respond for this long
+        static const int STALL_WARNING_MS = 5000;
+
+    };
+
+}
+
+#endif // WAVPLAYERALSA_RENDER_CLOCK_H__
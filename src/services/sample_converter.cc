@@ -0,0 +1,46 @@
+#include "services/sample_converter.h"
+
+#include "services/sample_formats.h"
+
+namespace wavplayeralsa
+{
+
+	template <typename Format>
+	static void ToFloatSamples(const char *in, size_t num_of_samples, float *out)
+	{
+		for(size_t i = 0; i < num_of_samples; i++) {
+			out[i] = Format::ReadFloat(in + i * Format::BYTES);
+		}
+	}
+
+	template <typename Format>
+	static void FromFloatSamples(const float *in, size_t num_of_samples, char *out)
+	{
+		for(size_t i = 0; i < num_of_samples; i++) {
+			Format::WriteFloat(in[i], out + i * Format::BYTES);
+		}
+	}
+
+	bool SampleConverter::Initialize(snd_pcm_format_t format)
+	{
+		switch(format) {
+			case SND_PCM_FORMAT_S16:
+				to_float_ = &ToFloatSamples<SampleFormatNativeS16>;
+				from_float_ = &FromFloatSamples<SampleFormatNativeS16>;
+				break;
+			case SND_PCM_FORMAT_S32:
+				to_float_ = &ToFloatSamples<SampleFormatNativeS32>;
+				from_float_ = &FromFloatSamples<SampleFormatNativeS32>;
+				break;
+			case SND_PCM_FORMAT_FLOAT:
+				to_float_ = &ToFloatSamples<SampleFormatNativeFloat>;
+				from_float_ = &FromFloatSamples<SampleFormatNativeFloat>;
+				break;
+			default:
+				return false;
+		}
+		format_ = format;
+		return true;
+	}
+
+}
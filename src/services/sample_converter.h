@@ -0,0 +1,45 @@
+#ifndef WAVPLAYERALSA_SAMPLE_CONVERTER_H__
+#define WAVPLAYERALSA_SAMPLE_CONVERTER_H__
+
+#include <cstddef>
+
+#include "alsa/asoundlib.h"
+
+namespace wavplayeralsa
+{
+
+    /*
+    Converts interleaved samples between a pcm format and float, for processing the audio
+    (resampling, mixing) in float.
+    Float samples are in the range [-1.0, 1.0). Conversion back to integer formats clips
+    samples which are out of range, so processing can overshoot full scale without wrapping.
+    The loops are instantiated for each format (see sample_formats.h), and the one for the
+    format is selected in Initialize, so there is no branch on the format per call or per sample.
+    */
+    class SampleConverter
+    {
+
+    public:
+        // returns false if the format is not supported.
+        // supported formats are native endian signed 16 bit, signed 32 bit and float.
+        bool Initialize(snd_pcm_format_t format);
+
+        snd_pcm_format_t GetFormat() const { return format_; }
+
+        void ToFloat(const char *in, size_t num_of_samples, float *out) const { to_float_(in, num_of_samples, out); }
+        void FromFloat(const float *in, size_t num_of_samples, char *out) const { from_float_(in, num_of_samples, out); }
+
+    private:
+        typedef void (*ToFloatFunc)(const char *in, size_t num_of_samples, float *out);
+        typedef void (*FromFloatFunc)(const float *in, size_t num_of_samples, char *out);
+
+    private:
+        snd_pcm_format_t format_ = SND_PCM_FORMAT_UNKNOWN;
+        ToFloatFunc to_float_ = nullptr;
+        FromFloatFunc from_float_ = nullptr;
+
+    };
+
+}
+
+#endif // WAVPLAYERALSA_SAMPLE_CONVERTER_H__
@@ -0,0 +1,207 @@
+#ifndef WAVPLAYERALSA_SAMPLE_FORMATS_H__
+#define WAVPLAYERALSA_SAMPLE_FORMATS_H__
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#include "alsa/asoundlib.h"
+
+namespace wavplayeralsa
+{
+
+    /*
+    The sample formats which the player processes, as types. The loops over samples are templates
+    over them, instantiated for each format, so they have no format branches inside.
+    The instance for the stream is selected once, when it starts.
+    Each format reads and writes a single sample at a byte pointer, which does not have to be aligned:
+    as a float in [-1.0, 1.0), or as a signed integer in the most significant bits of an int32_t.
+    Writing a float to an integer format clips it to full scale.
+    SWAP formats are in the non native byte order.
+    */
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    static const bool CPU_LITTLE_ENDIAN = false;
+#else
+    static const bool CPU_LITTLE_ENDIAN = true;
+#endif
+
+    namespace sample_formats_detail
+    {
+        inline uint16_t ByteSwap(uint16_t v) { return __builtin_bswap16(v); }
+        inline uint32_t ByteSwap(uint32_t v) { return __builtin_bswap32(v); }
+        inline uint64_t ByteSwap(uint64_t v) { return __builtin_bswap64(v); }
+
+        template <typename T, bool SWAP>
+        inline T Load(const char *p)
+        {
+            T v;
+            memcpy(&v, p, sizeof(T));
+            return SWAP ? ByteSwap(v) : v;
+        }
+
+        template <typename T, bool SWAP>
+        inline void Store(T v, char *p)
+        {
+            v = SWAP ? ByteSwap(v) : v;
+            memcpy(p, &v, sizeof(T));
+        }
+
+        // rounds like lrint, but to an int32_t, which has a vector conversion (lrint returns a long)
+        inline int32_t RoundToInt32(float v) { return __builtin_irintf(v); }
+        inline int32_t RoundToInt32(double v) { return __builtin_irint(v); }
+    }
+
+    template <bool SWAP>
+    struct SampleFormatS16
+    {
+        static const unsigned int BYTES = 2;
+        static const unsigned int BITS = 16;
+        static const bool IS_FLOAT = false;
+        static snd_pcm_format_t Format() { return (CPU_LITTLE_ENDIAN != SWAP) ? SND_PCM_FORMAT_S16_LE : SND_PCM_FORMAT_S16_BE; }
+
+        static inline int32_t ReadInt(const char *p) {
+            return (int32_t)(int16_t)sample_formats_detail::Load<uint16_t, SWAP>(p) * 65536;
+        }
+        static inline float ReadFloat(const char *p) {
+            return (float)(int16_t)sample_formats_detail::Load<uint16_t, SWAP>(p) * (1.0f / 32768.0f);
+        }
+        static inline void WriteInt(int32_t v, char *p) {
+            sample_formats_detail::Store<uint16_t, SWAP>((uint16_t)(v >> 16), p);
+        }
+        static inline void WriteFloat(float v, char *p) {
+            v = std::min(std::max(v * 32768.0f, -32768.0f), 32767.0f);
+            sample_formats_detail::Store<uint16_t, SWAP>((uint16_t)(int16_t)sample_formats_detail::RoundToInt32(v), p);
+        }
+    };
+
+    // 3 bytes per sample
+    template <bool SWAP>
+    struct SampleFormatS24Packed
+    {
+        static const unsigned int BYTES = 3;
+        static const unsigned int BITS = 24;
+        static const bool IS_FLOAT = false;
+        static const bool LITTLE_ENDIAN_BYTES = (CPU_LITTLE_ENDIAN != SWAP);
+        static snd_pcm_format_t Format() { return LITTLE_ENDIAN_BYTES ? SND_PCM_FORMAT_S24_3LE : SND_PCM_FORMAT_S24_3BE; }
+
+        static inline int32_t ReadInt(const char *p) {
+            const unsigned char *b = (const unsigned char *)p;
+            uint32_t lo = LITTLE_ENDIAN_BYTES ? b[0] : b[2];
+            uint32_t hi = LITTLE_ENDIAN_BYTES ? b[2] : b[0];
+            return (int32_t)((hi << 24) | ((uint32_t)b[1] << 16) | (lo << 8));
+        }
+        static inline float ReadFloat(const char *p) {
+            return (float)ReadInt(p) * (1.0f / 2147483648.0f);
+        }
+        static inline void WriteInt(int32_t v, char *p) {
+            uint32_t u = (uint32_t)v;
+            p[LITTLE_ENDIAN_BYTES ? 0 : 2] = (char)(u >> 8);
+            p[1] = (char)(u >> 16);
+            p[LITTLE_ENDIAN_BYTES ? 2 : 0] = (char)(u >> 24);
+        }
+        static inline void WriteFloat(float v, char *p) {
+            v = std::min(std::max(v * 8388608.0f, -8388608.0f), 8388607.0f);
+            WriteInt(sample_formats_detail::RoundToInt32(v) * 256, p);
+        }
+    };
+
+    template <bool SWAP>
+    struct SampleFormatS32
+    {
+        static const unsigned int BYTES = 4;
+        static const unsigned int BITS = 32;
+        static const bool IS_FLOAT = false;
+        static snd_pcm_format_t Format() { return (CPU_LITTLE_ENDIAN != SWAP) ? SND_PCM_FORMAT_S32_LE : SND_PCM_FORMAT_S32_BE; }
+
+        static inline int32_t ReadInt(const char *p) {
+            return (int32_t)sample_formats_detail::Load<uint32_t, SWAP>(p);
+        }
+        static inline float ReadFloat(const char *p) {
+            return (float)ReadInt(p) * (1.0f / 2147483648.0f);
+        }
+        static inline void WriteInt(int32_t v, char *p) {
+            sample_formats_detail::Store<uint32_t, SWAP>((uint32_t)v, p);
+        }
+        static inline void WriteFloat(float v, char *p) {
+            double d = std::min(std::max((double)v * 2147483648.0, -2147483648.0), 2147483647.0);
+            WriteInt(sample_formats_detail::RoundToInt32(d), p);
+        }
+    };
+
+    // float samples are not clipped
+    template <bool SWAP>
+    struct SampleFormatFloat
+    {
+        static const unsigned int BYTES = 4;
+        static const unsigned int BITS = 32;
+        static const bool IS_FLOAT = true;
+        static snd_pcm_format_t Format() { return (CPU_LITTLE_ENDIAN != SWAP) ? SND_PCM_FORMAT_FLOAT_LE : SND_PCM_FORMAT_FLOAT_BE; }
+
+        static inline float ReadFloat(const char *p) {
+            uint32_t u = sample_formats_detail::Load<uint32_t, SWAP>(p);
+            float v;
+            memcpy(&v, &u, sizeof(v));
+            return v;
+        }
+        static inline int32_t ReadInt(const char *p) {
+            double d = std::min(std::max((double)ReadFloat(p) * 2147483648.0, -2147483648.0), 2147483647.0);
+            return sample_formats_detail::RoundToInt32(d);
+        }
+        static inline void WriteFloat(float v, char *p) {
+            uint32_t u;
+            memcpy(&u, &v, sizeof(u));
+            sample_formats_detail::Store<uint32_t, SWAP>(u, p);
+        }
+        static inline void WriteInt(int32_t v, char *p) {
+            WriteFloat((float)v * (1.0f / 2147483648.0f), p);
+        }
+    };
+
+    template <bool SWAP>
+    struct SampleFormatFloat64
+    {
+        static const unsigned int BYTES = 8;
+        static const unsigned int BITS = 64;
+        static const bool IS_FLOAT = true;
+        static snd_pcm_format_t Format() { return (CPU_LITTLE_ENDIAN != SWAP) ? SND_PCM_FORMAT_FLOAT64_LE : SND_PCM_FORMAT_FLOAT64_BE; }
+
+        static inline float ReadFloat(const char *p) {
+            uint64_t u = sample_formats_detail::Load<uint64_t, SWAP>(p);
+            double v;
+            memcpy(&v, &u, sizeof(v));
+            return (float)v;
+        }
+        static inline int32_t ReadInt(const char *p) {
+            double d = std::min(std::max((double)ReadFloat(p) * 2147483648.0, -2147483648.0), 2147483647.0);
+            return sample_formats_detail::RoundToInt32(d);
+        }
+        static inline void WriteFloat(float v, char *p) {
+            double d = v;
+            uint64_t u;
+            memcpy(&u, &d, sizeof(u));
+            sample_formats_detail::Store<uint64_t, SWAP>(u, p);
+        }
+        static inline void WriteInt(int32_t v, char *p) {
+            WriteFloat((float)v * (1.0f / 2147483648.0f), p);
+        }
+    };
+
+    // any format, for loops which only move samples around
+    template <unsigned int SAMPLE_BYTES>
+    struct SampleFormatRaw
+    {
+        static const unsigned int BYTES = SAMPLE_BYTES;
+        static const unsigned int BITS = SAMPLE_BYTES * 8;
+        static const bool IS_FLOAT = false;
+    };
+
+    typedef SampleFormatS16<false> SampleFormatNativeS16;
+    typedef SampleFormatS24Packed<false> SampleFormatNativeS24Packed;
+    typedef SampleFormatS32<false> SampleFormatNativeS32;
+    typedef SampleFormatFloat<false> SampleFormatNativeFloat;
+
+}
+
+#endif // WAVPLAYERALSA_SAMPLE_FORMATS_H__
@@ -0,0 +1,433 @@
+#include "services/simulated_audio_sink.h"
+
+#include <sstream>
+#include <cstring>
+#include <cmath>
+#include <cerrno>
+#include <algorithm>
+#include <stdexcept>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/timerfd.h>
+
+namespace wavplayeralsa
+{
+
+	SimulatedAudioSink::SimulatedAudioSink() :
+		jitter_random_(1)
+	{
+
+	}
+
+	SimulatedAudioSink::~SimulatedAudioSink()
+	{
+		if(render_clock_ != nullptr) {
+			render_clock_->RemoveClient(this);
+		}
+		if(timer_fd_ >= 0) {
+			close(timer_fd_);
+		}
+	}
+
+	void SimulatedAudioSink::Initialize(
+			std::shared_ptr<spdlog::logger> logger,
+			const std::string &audio_device,
+			const SimulatedAudioSinkConfig &config,
+			const AlsaPcmBufferConfig &buffer_config,
+			RenderClock *render_clock
+		)
+	{
+		logger_ = logger;
+		audio_device_ = audio_device;
+		config_ = config;
+		buffer_config_ = buffer_config;
+		clock_speed_ = 1.0 + config_.drift_ppm / 1000000.0;
+		status_.device = audio_device;
+
+		timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		if(timer_fd_ < 0) {
+			std::stringstream err_desc;
+			err_desc << "cannot create timer for simulated audio device (" << strerror(errno) << ")";
+			throw std::runtime_error(err_desc.str());
+		}
+
+		render_clock_ = render_clock;
+		if(render_clock_ != nullptr) {
+			render_clock_->AddClient(this);
+		}
+
+		logger_->info("simulated audio device '{}': delay {} us, timestamp jitter {} us, clock drift {} ppm{}",
+			audio_device_, config_.delay_us, config_.jitter_us, config_.drift_ppm, render_clock_ != nullptr ? ", on render clock" : "");
+	}
+
+	bool SimulatedAudioSink::IsStreamParamsSupported(const AlsaPcmStreamParams &params)
+	{
+		int sample_width = snd_pcm_format_physical_width(params.format);
+		if(sample_width <= 0 || sample_width % 8 != 0 || params.num_of_channels == 0) {
+			return false;
+		}
+		if(!config_.formats.empty() && std::find(config_.formats.begin(), config_.formats.end(), params.format) == config_.formats.end()) {
+			return false;
+		}
+		if(!config_.channels.empty() && std::find(config_.channels.begin(), config_.channels.end(), params.num_of_channels) == config_.channels.end()) {
+			return false;
+		}
+		return true;
+	}
+
+	/*
+	The buffer is sized like the alsa negotiation would, from the configured buffer and period times,
+	without rounding to what a device supports.
+	*/
+	void SimulatedAudioSink::StartStream(const AlsaPcmStreamParams &params)
+	{
+		if(!IsStreamParamsSupported(params)) {
+			std::stringstream err_desc;
+			err_desc << "cannot set stream params (" << snd_pcm_format_name(params.format) << ", " << params.num_of_channels << 
+				" channels is not supported by the simulated audio device)";
+			throw std::runtime_error(err_desc.str());
+		}
+		int sample_width = snd_pcm_format_physical_width(params.format);
+
+		if(has_params_) {
+			Drop();
+		}
+
+		params_ = params;
+		bytes_per_frame_ = (sample_width / 8) * params.num_of_channels;
+
+		unsigned int buffer_time_us = buffer_config_.buffer_time_us > 0 ? buffer_config_.buffer_time_us : DEFAULT_BUFFER_TIME_US;
+		buffer_size_ = std::max((snd_pcm_uframes_t)((uint64_t)buffer_time_us * params.frame_rate / 1000000), (snd_pcm_uframes_t)2);
+		if(buffer_config_.period_time_us > 0) {
+			period_size_ = (snd_pcm_uframes_t)((uint64_t)buffer_config_.period_time_us * params.frame_rate / 1000000);
+		}
+		else {
+			period_size_ = buffer_size_ / (buffer_config_.periods > 0 ? buffer_config_.periods : DEFAULT_PERIODS);
+		}
+		period_size_ = std::min(std::max(period_size_, (snd_pcm_uframes_t)1), buffer_size_);
+		buffer_.resize(buffer_size_ * bytes_per_frame_);
+		delay_frames_ = (snd_pcm_sframes_t)(config_.delay_us * params.frame_rate / 1000000);
+		has_params_ = true;
+
+		AudioDeviceStatus status;
+		status.device = audio_device_;
+		status.configured = true;
+		status.frame_rate = params.frame_rate;
+		status.num_of_channels = params.num_of_channels;
+		status.buffer_size_frames = buffer_size_;
+		status.period_size_frames = period_size_;
+		status.buffer_time_us = (unsigned int)((uint64_t)buffer_size_ * 1000000 / params.frame_rate);
+		status.period_time_us = (unsigned int)((uint64_t)period_size_ * 1000000 / params.frame_rate);
+		status.periods = (unsigned int)(buffer_size_ / period_size_);
+		logger_->info("simulated pcm buffer of {} frames ({} us) in {} periods of {} frames ({} us)",
+			status.buffer_size_frames, status.buffer_time_us, status.periods, status.period_size_frames, status.period_time_us);
+		{
+			std::lock_guard<std::mutex> guard(status_mutex_);
+			status_ = status;
+		}
+
+		Prepare();
+	}
+
+	void SimulatedAudioSink::DropAndPrepare()
+	{
+		Drop();
+		Prepare();
+	}
+
+	void SimulatedAudioSink::Drop()
+	{
+		// the frames which were played until now are still reported
+		Update();
+		state_ = SND_PCM_STATE_SETUP;
+		DisarmTimer();
+	}
+
+	void SimulatedAudioSink::Prepare()
+	{
+		state_ = SND_PCM_STATE_PREPARED;
+		appl_frames_ = 0;
+		hw_frames_ = 0;
+		DisarmTimer();
+	}
+
+	int SimulatedAudioSink::Start()
+	{
+		if(state_ != SND_PCM_STATE_PREPARED) {
+			return -EBADFD;
+		}
+		start_time_ns_ = NowNs();
+		state_ = SND_PCM_STATE_RUNNING;
+		ReportToClock();
+		return 0;
+	}
+
+	snd_pcm_state_t SimulatedAudioSink::GetState()
+	{
+		Update();
+		return state_;
+	}
+
+	snd_pcm_sframes_t SimulatedAudioSink::AvailUpdate()
+	{
+		Update();
+		if(state_ == SND_PCM_STATE_XRUN) {
+			return -EPIPE;
+		}
+		if(state_ != SND_PCM_STATE_PREPARED && state_ != SND_PCM_STATE_RUNNING) {
+			return -EBADFD;
+		}
+		snd_pcm_sframes_t avail = buffer_size_ - (appl_frames_ - hw_frames_);
+		if(state_ == SND_PCM_STATE_RUNNING && avail < (snd_pcm_sframes_t)period_size_) {
+			// the poll descriptor signals when a period is free
+			ArmTimer(appl_frames_ - buffer_size_ + period_size_);
+		}
+		return avail;
+	}
+
+	int SimulatedAudioSink::GetDelay(snd_pcm_sframes_t *delay)
+	{
+		Update();
+		if(state_ == SND_PCM_STATE_XRUN) {
+			return -EPIPE;
+		}
+		if(state_ != SND_PCM_STATE_PREPARED && state_ != SND_PCM_STATE_RUNNING) {
+			return -EBADFD;
+		}
+		*delay = appl_frames_ - hw_frames_ + (state_ == SND_PCM_STATE_RUNNING ? delay_frames_ : 0);
+		return 0;
+	}
+
+	snd_pcm_sframes_t SimulatedAudioSink::Write(const void *buffer, snd_pcm_uframes_t frames)
+	{
+		snd_pcm_sframes_t avail = AvailUpdate();
+		if(avail < 0) {
+			return avail;
+		}
+
+		snd_pcm_uframes_t frames_to_write = std::min(frames, (snd_pcm_uframes_t)avail);
+		const char *src = (const char *)buffer;
+		snd_pcm_uframes_t written = 0;
+		while(written < frames_to_write) {
+			snd_pcm_uframes_t index = (appl_frames_ + written) % buffer_size_;
+			snd_pcm_uframes_t n = std::min(frames_to_write - written, buffer_size_ - index);
+			std::memcpy(&buffer_[index * bytes_per_frame_], src + written * bytes_per_frame_, n * bytes_per_frame_);
+			written += n;
+		}
+		appl_frames_ += frames_to_write;
+		return frames_to_write;
+	}
+
+	int SimulatedAudioSink::MmapBegin(const snd_pcm_channel_area_t ** /*areas*/, snd_pcm_uframes_t * /*offset*/, snd_pcm_uframes_t * /*frames*/)
+	{
+		return -ENOSYS;
+	}
+
+	snd_pcm_sframes_t SimulatedAudioSink::MmapCommit(snd_pcm_uframes_t /*offset*/, snd_pcm_uframes_t /*frames*/)
+	{
+		return -ENOSYS;
+	}
+
+	std::vector<struct pollfd> SimulatedAudioSink::GetPollDescriptors() const
+	{
+		struct pollfd poll_fd;
+		poll_fd.fd = timer_fd_;
+		poll_fd.events = POLLIN;
+		poll_fd.revents = 0;
+		return std::vector<struct pollfd>(1, poll_fd);
+	}
+
+	unsigned short SimulatedAudioSink::GetPollRevents(std::vector<struct pollfd> & /*poll_fds*/)
+	{
+		uint64_t expirations;
+		while(read(timer_fd_, &expirations, sizeof(expirations)) > 0) {
+		}
+		return POLLOUT;
+	}
+
+	uint64_t SimulatedAudioSink::RecoverXrun(int err)
+	{
+		if((err != -EPIPE && err != -ESTRPIPE) || state_ != SND_PCM_STATE_XRUN) {
+			std::stringstream err_desc;
+			err_desc << "cannot recover simulated pcm from error (" << snd_strerror(err) << ")";
+			throw std::runtime_error(err_desc.str());
+		}
+
+		int64_t duration_us = std::max((NowNs() - xrun_time_ns_) / 1000, (int64_t)0);
+		int64_t epoch_now_us = GetTimestampNowUs() + GetTimestampToEpochOffsetUs();
+
+		XrunEvent xrun;
+		xrun.time_ms_since_epoch = (epoch_now_us - duration_us) / 1000;
+		xrun.duration_us = duration_us;
+		xrun_stats_.Record(xrun);
+
+		Prepare();
+		logger_->warn("recovered simulated pcm from xrun. duration {} us", duration_us);
+		return xrun.duration_us;
+	}
+
+	AlsaPcmPositionSnapshot SimulatedAudioSink::GetPositionSnapshot()
+	{
+		Update();
+		int64_t now_ns = NowNs();
+
+		AlsaPcmPositionSnapshot snapshot;
+		snapshot.state = state_;
+		if(state_ == SND_PCM_STATE_RUNNING) {
+			snapshot.delay = appl_frames_ - hw_frames_ + delay_frames_;
+		}
+		else if(state_ == SND_PCM_STATE_PREPARED) {
+			snapshot.delay = appl_frames_;
+		}
+		int64_t jitter_us = 0;
+		if(config_.jitter_us > 0) {
+			std::uniform_int_distribution<int64_t> jitter_distribution(-config_.jitter_us, config_.jitter_us);
+			jitter_us = jitter_distribution(jitter_random_);
+		}
+		snapshot.tstamp_us = now_ns / 1000 + jitter_us;
+		return snapshot;
+	}
+
+	int64_t SimulatedAudioSink::GetTimestampNowUs() const
+	{
+		return NowNs() / 1000;
+	}
+
+	int64_t SimulatedAudioSink::GetTimestampToEpochOffsetUs() const
+	{
+		if(render_clock_ != nullptr) {
+			return render_clock_->GetEpochOffsetUs();
+		}
+		return AudioSink::GetTimestampToEpochOffsetUs();
+	}
+
+	/*
+	The timer fires when the clock reaches the last frame written, which also ends the stream (xrun).
+	*/
+	bool SimulatedAudioSink::SetDrainWakeup()
+	{
+		Update();
+		if(state_ != SND_PCM_STATE_RUNNING) {
+			return false;
+		}
+		ArmTimer(appl_frames_);
+		return true;
+	}
+
+	AudioDeviceStatus SimulatedAudioSink::QueryStatus()
+	{
+		std::lock_guard<std::mutex> guard(status_mutex_);
+		return status_;
+	}
+
+	XrunStats SimulatedAudioSink::QueryXrunStats()
+	{
+		return xrun_stats_.Query();
+	}
+
+	/*
+	Advance the virtual clock to now. The frames it passed are played, and if it
+	reached the last frame written, the buffer ran empty (xrun).
+	*/
+	void SimulatedAudioSink::Update()
+	{
+		// the clock fired the timer (or is about to), and the writer is awake
+		if(wakeup_ns_ >= 0 && NowNs() >= wakeup_ns_) {
+			wakeup_ns_ = -1;
+		}
+
+		if(state_ != SND_PCM_STATE_RUNNING) {
+			ReportToClock();
+			return;
+		}
+
+		int64_t hw_frames = HwFramesAt(NowNs());
+		if(hw_frames >= appl_frames_) {
+			hw_frames = appl_frames_;
+			xrun_time_ns_ = TimeOfHwFrame(appl_frames_);
+			state_ = SND_PCM_STATE_XRUN;
+		}
+
+		while(hw_frames_ < hw_frames) {
+			snd_pcm_uframes_t index = hw_frames_ % buffer_size_;
+			snd_pcm_uframes_t n = std::min((snd_pcm_uframes_t)(hw_frames - hw_frames_), buffer_size_ - index);
+			OnFramesPlayed(&buffer_[index * bytes_per_frame_], n);
+			hw_frames_ += n;
+		}
+		ReportToClock();
+	}
+
+	void SimulatedAudioSink::ArmTimer(int64_t hw_frame)
+	{
+		DisarmTimer();
+		int64_t time_ns = TimeOfHwFrame(hw_frame);
+		if(render_clock_ != nullptr) {
+			wakeup_ns_ = time_ns;
+			ReportToClock();
+			return;
+		}
+
+		struct itimerspec timer_spec;
+		std::memset(&timer_spec, 0, sizeof(timer_spec));
+		timer_spec.it_value.tv_sec = time_ns / 1000000000;
+		timer_spec.it_value.tv_nsec = time_ns % 1000000000;
+		// a zero it_value disarms the timer. a time which passed fires right away
+		if(timer_spec.it_value.tv_sec == 0 && timer_spec.it_value.tv_nsec == 0) {
+			timer_spec.it_value.tv_nsec = 1;
+		}
+		timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &timer_spec, nullptr);
+	}
+
+	void SimulatedAudioSink::DisarmTimer()
+	{
+		struct itimerspec timer_spec;
+		std::memset(&timer_spec, 0, sizeof(timer_spec));
+		timerfd_settime(timer_fd_, 0, &timer_spec, nullptr);
+		uint64_t expirations;
+		while(read(timer_fd_, &expirations, sizeof(expirations)) > 0) {
+		}
+		if(render_clock_ != nullptr) {
+			wakeup_ns_ = -1;
+			ReportToClock();
+		}
+	}
+
+	void SimulatedAudioSink::ReportToClock()
+	{
+		if(render_clock_ != nullptr) {
+			render_clock_->UpdateClient(this, state_ == SND_PCM_STATE_RUNNING, wakeup_ns_);
+		}
+	}
+
+	/*
+	Fire the timer right away. It is read (and the sink is updated) on the audio worker thread.
+	*/
+	void SimulatedAudioSink::OnClockWakeup()
+	{
+		struct itimerspec timer_spec;
+		std::memset(&timer_spec, 0, sizeof(timer_spec));
+		timer_spec.it_value.tv_nsec = 1;
+		timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &timer_spec, nullptr);
+	}
+
+	int64_t SimulatedAudioSink::NowNs() const
+	{
+		if(render_clock_ != nullptr) {
+			return render_clock_->NowNs();
+		}
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+	}
+
+	int64_t SimulatedAudioSink::HwFramesAt(int64_t time_ns) const
+	{
+		return (int64_t)((double)(time_ns - start_time_ns_) * params_.frame_rate * clock_speed_ / 1000000000.0);
+	}
+
+	int64_t SimulatedAudioSink::TimeOfHwFrame(int64_t hw_frame) const
+	{
+		return start_time_ns_ + (int64_t)std::ceil((double)hw_frame * 1000000000.0 / (params_.frame_rate * clock_speed_));
+	}
+
+}
@@ -0,0 +1,157 @@
+#ifndef WAVPLAYERALSA_SIMULATED_AUDIO_SINK_H__
+#define WAVPLAYERALSA_SIMULATED_AUDIO_SINK_H__
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <time.h>
+
+#include "alsa/asoundlib.h"
+#include "spdlog/spdlog.h"
+
+#include "player_actions_ifc.h"
+#include "services/audio_sink.h"
+#include "services/render_clock.h"
+
+namespace wavplayeralsa
+{
+
+    struct SimulatedAudioSinkConfig
+    {
+        // latency from the buffer to the 'speaker', like the delay of a codec or an external dac.
+        // reported in the delay, and does not affect when the buffer runs empty
+        int64_t delay_us = 0;
+        // the timestamps of the position snapshots are off by a random error, uniform in [-jitter_us, jitter_us]
+        int64_t jitter_us = 0;
+        // the virtual sample clock runs faster (positive) or slower than the system monotonic clock
+        double drift_ppm = 0.0;
+        // the sample formats and channel counts the device supports, like a dac which only plays some of them.
+        // empty means all
+        std::vector<snd_pcm_format_t> formats;
+        std::vector<unsigned int> channels;
+    };
+
+    /*
+    An audio device with no hardware: a ring buffer, emptied by a virtual sample clock which
+    runs at the stream frame rate (with the configured drift) on the system monotonic clock.
+    It behaves like an alsa pcm with start threshold on the boundary: it starts only on Start,
+    and goes to XRUN when the clock reaches the last frame written.
+    The poll descriptor is a timer, armed when the buffer has less than a period of free space,
+    to fire when a period is free.
+    With a render clock, the sink plays on the virtual time of the clock instead of the system
+    clock, and the clock fires the timer when it reaches the wakeup time.
+    Only read-write access is supported.
+    */
+    class SimulatedAudioSink :
+        public AudioSink,
+        public RenderClock::Client
+    {
+
+    public:
+        SimulatedAudioSink();
+        ~SimulatedAudioSink();
+
+        void Initialize(
+            std::shared_ptr<spdlog::logger> logger,
+            const std::string &audio_device,
+            const SimulatedAudioSinkConfig &config,
+            const AlsaPcmBufferConfig &buffer_config,
+            RenderClock *render_clock
+        );
+
+    public:
+        // AudioSink
+        bool IsStreamParamsSupported(const AlsaPcmStreamParams &params);
+        void StartStream(const AlsaPcmStreamParams &params);
+        void DropAndPrepare();
+        void Drop();
+        int Start();
+        snd_pcm_state_t GetState();
+        snd_pcm_sframes_t AvailUpdate();
+        int GetDelay(snd_pcm_sframes_t *delay);
+        snd_pcm_sframes_t Write(const void *buffer, snd_pcm_uframes_t frames);
+        bool IsMmapAccess() const { return false; }
+        int MmapBegin(const snd_pcm_channel_area_t **areas, snd_pcm_uframes_t *offset, snd_pcm_uframes_t *frames);
+        snd_pcm_sframes_t MmapCommit(snd_pcm_uframes_t offset, snd_pcm_uframes_t frames);
+        snd_pcm_uframes_t GetPeriodSize() const { return period_size_; }
+        std::vector<struct pollfd> GetPollDescriptors() const;
+        unsigned short GetPollRevents(std::vector<struct pollfd> &poll_fds);
+        uint64_t RecoverXrun(int err);
+        AlsaPcmPositionSnapshot GetPositionSnapshot();
+        clockid_t GetTimestampClockId() const { return CLOCK_MONOTONIC; }
+        int64_t GetTimestampNowUs() const;
+        int64_t GetTimestampToEpochOffsetUs() const;
+        bool SetDrainWakeup();
+        AudioDeviceStatus QueryStatus();
+        XrunStats QueryXrunStats();
+
+    public:
+        // RenderClock::Client
+        void OnClockWakeup();
+
+    protected:
+        // frames which the virtual clock played, in play order.
+        // called on the audio worker thread, whenever the position is updated
+        virtual void OnFramesPlayed(const char * /*frames*/, snd_pcm_uframes_t /*num_of_frames*/) { }
+
+        const AlsaPcmStreamParams &GetStreamParams() const { return params_; }
+        RenderClock *GetRenderClock() const { return render_clock_; }
+        // time on the clock the sink plays on
+        int64_t NowNs() const;
+
+    protected:
+        std::shared_ptr<spdlog::logger> logger_;
+
+    private:
+        void Update();
+        void Prepare();
+        void ArmTimer(int64_t hw_frame);
+        void DisarmTimer();
+        void ReportToClock();
+        int64_t HwFramesAt(int64_t time_ns) const;
+        int64_t TimeOfHwFrame(int64_t hw_frame) const;
+
+    private:
+        std::string audio_device_;
+        SimulatedAudioSinkConfig config_;
+        AlsaPcmBufferConfig buffer_config_;
+        int timer_fd_ = -1;
+        RenderClock *render_clock_ = nullptr; // nullptr if the sink plays on the system clock
+        // when playing on a render clock, the time at which the timer should fire. negative if it is not armed
+        int64_t wakeup_ns_ = -1;
+
+        // used when no buffer size is configured
+        static const unsigned int DEFAULT_BUFFER_TIME_US = 100000;
+        static const unsigned int DEFAULT_PERIODS = 4;
+
+        AlsaPcmStreamParams params_;
+        bool has_params_ = false;
+        unsigned int bytes_per_frame_ = 4;
+        snd_pcm_uframes_t buffer_size_ = 0;
+        snd_pcm_uframes_t period_size_ = 1;
+        snd_pcm_sframes_t delay_frames_ = 0;
+        double clock_speed_ = 1.0;
+
+        // the simulated device state. the position is updated lazily, when the state is queried
+        snd_pcm_state_t state_ = SND_PCM_STATE_OPEN;
+        int64_t start_time_ns_ = 0; // when the clock started, on the monotonic clock
+        int64_t appl_frames_ = 0; // frames written since prepare
+        int64_t hw_frames_ = 0; // frames played since prepare
+        int64_t xrun_time_ns_ = 0;
+        // the frames in the buffer, kept for OnFramesPlayed
+        std::vector<char> buffer_;
+        std::mt19937 jitter_random_;
+
+    private:
+        std::mutex status_mutex_;
+        AudioDeviceStatus status_;
+        XrunStatsRecorder xrun_stats_;
+
+    };
+
+}
+
+#endif // WAVPLAYERALSA_SIMULATED_AUDIO_SINK_H__
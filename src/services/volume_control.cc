@@ -0,0 +1,296 @@
+#include "services/volume_control.h"
+
+#include <cmath>
+#include <algorithm>
+
+#include "services/sample_formats.h"
+
+namespace wavplayeralsa
+{
+
+	// gain of a single sample of each format, at index of samples
+	struct GainS16 {
+		static inline void Apply(char *samples, size_t index, float gain) {
+			int16_t *s = (int16_t *)samples;
+			float v = std::min(std::max((float)s[index] * gain, -32768.0f), 32767.0f);
+			s[index] = (int16_t)sample_formats_detail::RoundToInt32(v);
+		}
+	};
+
+	struct GainS32 {
+		static inline void Apply(char *samples, size_t index, float gain) {
+			int32_t *s = (int32_t *)samples;
+			// the largest float below 2^31
+			float v = std::min(std::max((float)s[index] * gain, -2147483648.0f), 2147483520.0f);
+			s[index] = sample_formats_detail::RoundToInt32(v);
+		}
+	};
+
+	struct GainFloat {
+		static inline void Apply(char *samples, size_t index, float gain) {
+			float *s = (float *)samples;
+			s[index] = s[index] * gain;
+		}
+	};
+
+	struct GainS24Packed {
+		static inline void Apply(char *samples, size_t index, float gain) {
+			char *p = samples + index * 3;
+			float v = (float)(SampleFormatNativeS24Packed::ReadInt(p) / 256) * gain;
+			v = std::min(std::max(v, -8388608.0f), 8388607.0f);
+			SampleFormatNativeS24Packed::WriteInt(sample_formats_detail::RoundToInt32(v) * 256, p);
+		}
+	};
+
+	template <typename Gain>
+	static void ScaleSamples(char *samples, size_t num_of_samples, float gain)
+	{
+		for(size_t i = 0; i < num_of_samples; i++) {
+			Gain::Apply(samples, i, gain);
+		}
+	}
+
+	// CHANNELS = 0 is for any number of channels, given in num_of_channels
+	template <typename Gain, unsigned int CHANNELS>
+	static void ScaleFrames(char *samples, size_t num_of_frames, unsigned int num_of_channels, const float *frame_gains)
+	{
+		const size_t ch = (CHANNELS != 0) ? CHANNELS : num_of_channels;
+		for(size_t i = 0; i < num_of_frames; i++) {
+			const float gain = frame_gains[i];
+			for(size_t c = 0; c < ch; c++) {
+				Gain::Apply(samples, i * ch + c, gain);
+			}
+		}
+	}
+
+	template <typename Gain>
+	static void SelectScaleFuncs(unsigned int num_of_channels,
+		void (**scale)(char *, size_t, float),
+		void (**scale_frames)(char *, size_t, unsigned int, const float *))
+	{
+		*scale = &ScaleSamples<Gain>;
+		switch(num_of_channels) {
+			case 1: *scale_frames = &ScaleFrames<Gain, 1>; break;
+			case 2: *scale_frames = &ScaleFrames<Gain, 2>; break;
+			default: *scale_frames = &ScaleFrames<Gain, 0>; break;
+		}
+	}
+
+	bool GainScaler::Initialize(snd_pcm_format_t format, unsigned int num_of_channels)
+	{
+		if(format == SND_PCM_FORMAT_S16) {
+			SelectScaleFuncs<GainS16>(num_of_channels, &scale_, &scale_frames_);
+		}
+		else if(format == SND_PCM_FORMAT_S32) {
+			SelectScaleFuncs<GainS32>(num_of_channels, &scale_, &scale_frames_);
+		}
+		else if(format == SND_PCM_FORMAT_FLOAT) {
+			SelectScaleFuncs<GainFloat>(num_of_channels, &scale_, &scale_frames_);
+		}
+		else if(format == SampleFormatNativeS24Packed::Format()) {
+			SelectScaleFuncs<GainS24Packed>(num_of_channels, &scale_, &scale_frames_);
+		}
+		else {
+			return false;
+		}
+		num_of_channels_ = num_of_channels;
+		return true;
+	}
+
+	constexpr double VolumeControl::MAX_GAIN_DB;
+	const int64_t VolumeControl::MIN_RAMP_MS;
+
+	float VolumeControl::GainRamp::GainAt(int64_t frame) const
+	{
+		if(frame <= start_frame) {
+			return from;
+		}
+		if(frame >= start_frame + length_frames) {
+			return to;
+		}
+		return from + (to - from) * (float)((double)(frame - start_frame) / (double)length_frames);
+	}
+
+	float VolumeControl::GainStage::GainAt(int64_t frame) const
+	{
+		if(has_scheduled && frame >= scheduled.start_frame) {
+			return scheduled.GainAt(frame);
+		}
+		return current.GainAt(frame);
+	}
+
+	bool VolumeControl::GainStage::IsConstant(int64_t frame, size_t num_of_frames) const
+	{
+		const int64_t last_frame = frame + (int64_t)num_of_frames - 1;
+		if(has_scheduled && last_frame > scheduled.start_frame) {
+			return false;
+		}
+		return current.from == current.to || frame >= current.start_frame + current.length_frames || last_frame <= current.start_frame;
+	}
+
+	// each ramp starts from the gain at its start frame, so the gain never jumps
+	void VolumeControl::GainStage::RampTo(float gain, int64_t start_frame, int64_t length_frames)
+	{
+		GainRamp ramp;
+		ramp.from = GainAt(start_frame);
+		ramp.to = gain;
+		ramp.start_frame = start_frame;
+		ramp.length_frames = length_frames;
+		current = ramp;
+		if(has_scheduled) {
+			scheduled.from = current.GainAt(scheduled.start_frame);
+		}
+	}
+
+	// the current ramp continues until the scheduled one starts. a later request replaces it
+	void VolumeControl::GainStage::ScheduleRampTo(float gain, int64_t start_frame, int64_t length_frames)
+	{
+		scheduled.from = current.GainAt(start_frame);
+		scheduled.to = gain;
+		scheduled.start_frame = start_frame;
+		scheduled.length_frames = length_frames;
+		has_scheduled = true;
+	}
+
+	void VolumeControl::Initialize(std::shared_ptr<spdlog::logger> logger)
+	{
+		logger_ = logger;
+	}
+
+	bool VolumeControl::PushRequest(const GainRequest &request, std::stringstream &out_msg)
+	{
+		if(!requests_.push(request)) {
+			out_msg << "too many volume changes are waiting for the audio thread";
+			return false;
+		}
+		return true;
+	}
+
+	bool VolumeControl::SetZoneGainRequest(double gain_db, int64_t ramp_ms, std::stringstream &out_msg)
+	{
+		if(!std::isfinite(gain_db)) {
+			out_msg << "gain " << gain_db << " db is not a finite number";
+			return false;
+		}
+		if(gain_db > MAX_GAIN_DB) {
+			out_msg << "gain " << gain_db << " db is above the maximum of " << MAX_GAIN_DB << " db";
+			return false;
+		}
+		GainRequest request{GainTargetZone, (float)std::pow(10.0, gain_db / 20.0), ramp_ms, -1};
+		if(!PushRequest(request, out_msg)) {
+			return false;
+		}
+		zone_gain_db_ = gain_db;
+		out_msg << "zone gain set to " << gain_db << " db over " << std::max(ramp_ms, MIN_RAMP_MS) << " ms";
+		return true;
+	}
+
+	bool VolumeControl::SetTrackGainRequest(double gain_db, int64_t ramp_ms, int64_t at_position_ms, std::stringstream &out_msg)
+	{
+		if(!std::isfinite(gain_db)) {
+			out_msg << "gain " << gain_db << " db is not a finite number";
+			return false;
+		}
+		if(gain_db > MAX_GAIN_DB) {
+			out_msg << "gain " << gain_db << " db is above the maximum of " << MAX_GAIN_DB << " db";
+			return false;
+		}
+		GainRequest request{GainTargetTrack, (float)std::pow(10.0, gain_db / 20.0), ramp_ms, at_position_ms};
+		if(!PushRequest(request, out_msg)) {
+			return false;
+		}
+		out_msg << "track gain set to " << gain_db << " db over " << std::max(ramp_ms, MIN_RAMP_MS) << " ms";
+		if(at_position_ms >= 0) {
+			out_msg << " from position " << at_position_ms << " ms";
+		}
+		return true;
+	}
+
+	bool VolumeControl::SetMuteRequest(bool muted, int64_t ramp_ms, std::stringstream &out_msg)
+	{
+		GainRequest request{GainTargetMute, muted ? 0.0f : 1.0f, ramp_ms, -1};
+		if(!PushRequest(request, out_msg)) {
+			return false;
+		}
+		muted_ = muted;
+		out_msg << (muted ? "muted" : "unmuted") << " over " << std::max(ramp_ms, MIN_RAMP_MS) << " ms";
+		return true;
+	}
+
+	VolumeStatus VolumeControl::QueryVolume()
+	{
+		VolumeStatus status;
+		status.zone_gain_db = zone_gain_db_;
+		status.track_gain_db = track_gain_db_.load();
+		status.muted = muted_;
+		return status;
+	}
+
+	void VolumeControl::TakeRequest(const GainRequest &request, int64_t track_position_frames, unsigned int frame_rate)
+	{
+		int64_t ramp_frames = std::max(request.ramp_ms, MIN_RAMP_MS) * frame_rate / 1000;
+		int64_t start_frame = stream_frames_;
+		switch(request.target) {
+			case GainTargetZone:
+				zone_stage_.RampTo(request.gain, start_frame, ramp_frames);
+				break;
+			case GainTargetMute:
+				mute_stage_.RampTo(request.gain, start_frame, ramp_frames);
+				break;
+			case GainTargetTrack:
+				// a position which was already played starts right away
+				if(request.at_position_ms >= 0 && request.at_position_ms * frame_rate / 1000 > track_position_frames) {
+					start_frame += request.at_position_ms * frame_rate / 1000 - track_position_frames;
+					track_stage_.ScheduleRampTo(request.gain, start_frame, ramp_frames);
+				}
+				else {
+					track_stage_.RampTo(request.gain, start_frame, ramp_frames);
+				}
+				track_gain_db_.store(20.0 * std::log10(std::max(request.gain, 1e-10f)));
+				break;
+		}
+	}
+
+	bool VolumeControl::Update(uint32_t track_id, int64_t track_position_frames, unsigned int frame_rate, size_t num_of_frames)
+	{
+		if(track_id != track_id_) {
+			// the gain of the previous track does not continue into the new one
+			track_id_ = track_id;
+			track_stage_.has_scheduled = false;
+			track_stage_.RampTo(1.0f, stream_frames_, MIN_RAMP_MS * frame_rate / 1000);
+			track_gain_db_.store(0.0);
+		}
+
+		GainRequest request;
+		while(requests_.pop(request)) {
+			TakeRequest(request, track_position_frames, frame_rate);
+		}
+
+		gain_constant_ = zone_stage_.IsConstant(stream_frames_, num_of_frames) &&
+			track_stage_.IsConstant(stream_frames_, num_of_frames) &&
+			mute_stage_.IsConstant(stream_frames_, num_of_frames);
+		if(gain_constant_) {
+			constant_gain_ = zone_stage_.GainAt(stream_frames_) * track_stage_.GainAt(stream_frames_) * mute_stage_.GainAt(stream_frames_);
+			return constant_gain_ != 1.0f;
+		}
+
+		frame_gains_.resize(num_of_frames);
+		for(size_t i = 0; i < num_of_frames; i++) {
+			const int64_t frame = stream_frames_ + (int64_t)i;
+			frame_gains_[i] = zone_stage_.GainAt(frame) * track_stage_.GainAt(frame) * mute_stage_.GainAt(frame);
+		}
+		return true;
+	}
+
+	void VolumeControl::Advance(size_t num_of_frames)
+	{
+		stream_frames_ += num_of_frames;
+		for(GainStage *stage : { &zone_stage_, &track_stage_, &mute_stage_ }) {
+			if(stage->has_scheduled && stream_frames_ >= stage->scheduled.start_frame) {
+				stage->current = stage->scheduled;
+				stage->has_scheduled = false;
+			}
+		}
+	}
+
+}
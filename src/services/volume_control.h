@@ -0,0 +1,165 @@
+#ifndef WAVPLAYERALSA_VOLUME_CONTROL_H__
+#define WAVPLAYERALSA_VOLUME_CONTROL_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <atomic>
+
+#include <boost/lockfree/spsc_queue.hpp>
+
+#include "alsa/asoundlib.h"
+#include "spdlog/spdlog.h"
+
+#include "player_actions_ifc.h"
+
+namespace wavplayeralsa
+{
+
+    /*
+    Multiplies interleaved pcm samples by a gain, in place.
+    The loop for the format (and for mono and stereo) is selected in Initialize.
+    Integer samples are clipped to full scale. Float samples are not clipped.
+    */
+    class GainScaler
+    {
+
+    public:
+        // returns false if the format is not supported.
+        // supported formats are native endian signed 16 bit, packed 24 bit, signed 32 bit and float.
+        bool Initialize(snd_pcm_format_t format, unsigned int num_of_channels);
+
+        // the same gain for all the frames
+        void Scale(char *samples, size_t num_of_frames, float gain) const {
+            scale_(samples, num_of_frames * num_of_channels_, gain);
+        }
+
+        // a gain for each frame
+        void Scale(char *samples, size_t num_of_frames, const float *frame_gains) const {
+            scale_frames_(samples, num_of_frames, num_of_channels_, frame_gains);
+        }
+
+    private:
+        typedef void (*ScaleFunc)(char *samples, size_t num_of_samples, float gain);
+        typedef void (*ScaleFramesFunc)(char *samples, size_t num_of_frames, unsigned int num_of_channels, const float *frame_gains);
+
+    private:
+        unsigned int num_of_channels_ = 2;
+        ScaleFunc scale_ = nullptr;
+        ScaleFramesFunc scale_frames_ = nullptr;
+
+    };
+
+    /*
+    Software volume of a zone: the gain of the zone, the gain of the track which is playing, and mute.
+    Requests are sent to the audio worker thread over a lock free single-producer single-consumer queue
+    (like cue triggers), and are applied to the frames right before they are written to the pcm, so a change
+    is heard after the audio which is already in the device buffer.
+    Each gain changes linearly over a ramp, which is timed in frames written to the pcm, so it starts on an exact
+    frame, and frames which were not accepted by the pcm are produced again with the same gains.
+    A track gain request can start at a position in the track, which is the position the player reports,
+    so the change is heard exactly when clients expect it.
+    Requests which are sent while nothing is playing are applied when the next stream starts.
+    */
+    class VolumeControl :
+        public VolumeActionsIfc
+    {
+
+    public:
+        void Initialize(std::shared_ptr<spdlog::logger> logger);
+
+    public:
+        // VolumeActionsIfc. called on the main io_service thread only
+        bool SetZoneGainRequest(double gain_db, int64_t ramp_ms, std::stringstream &out_msg);
+        bool SetTrackGainRequest(double gain_db, int64_t ramp_ms, int64_t at_position_ms, std::stringstream &out_msg);
+        bool SetMuteRequest(bool muted, int64_t ramp_ms, std::stringstream &out_msg);
+        VolumeStatus QueryVolume();
+
+    // audio worker thread
+    public:
+        // take new requests, and compute the gains of the next num_of_frames frames, which are written to the pcm
+        // from track_position_frames of the track track_id. a new track_id resets the track gain.
+        // returns false if all the frames are played at unity gain, so they can be written as they are
+        bool Update(uint32_t track_id, int64_t track_position_frames, unsigned int frame_rate, size_t num_of_frames);
+
+        // the gain of the frames of the last Update. when it is not constant, the gain of each frame is in GetFrameGains
+        bool IsGainConstant() const { return gain_constant_; }
+        float GetConstantGain() const { return constant_gain_; }
+        const float *GetFrameGains() const { return frame_gains_.data(); }
+
+        // num_of_frames frames were written to the pcm (or skipped after an xrun)
+        void Advance(size_t num_of_frames);
+
+    private:
+        // a linear change of gain, from start_frame, over length_frames
+        struct GainRamp {
+            float from = 1.0f;
+            float to = 1.0f;
+            int64_t start_frame = 0;
+            int64_t length_frames = 0;
+
+            float GainAt(int64_t frame) const;
+        };
+
+        // the current ramp, and one which is scheduled to start later
+        struct GainStage {
+            GainRamp current;
+            GainRamp scheduled;
+            bool has_scheduled = false;
+
+            float GainAt(int64_t frame) const;
+            bool IsConstant(int64_t frame, size_t num_of_frames) const;
+            void RampTo(float gain, int64_t start_frame, int64_t length_frames);
+            void ScheduleRampTo(float gain, int64_t start_frame, int64_t length_frames);
+        };
+
+        enum GainTarget {
+            GainTargetZone,
+            GainTargetTrack,
+            GainTargetMute
+        };
+
+        struct GainRequest {
+            GainTarget target;
+            float gain;
+            int64_t ramp_ms;
+            int64_t at_position_ms; // track gain only. negative for right away
+        };
+
+    private:
+        bool PushRequest(const GainRequest &request, std::stringstream &out_msg);
+        void TakeRequest(const GainRequest &request, int64_t track_position_frames, unsigned int frame_rate);
+
+    private:
+        std::shared_ptr<spdlog::logger> logger_;
+
+        // the gain above which samples are likely to clip
+        static constexpr double MAX_GAIN_DB = 12.0;
+        // shorter ramps are heard as clicks
+        static const int64_t MIN_RAMP_MS = 5;
+
+        static const size_t REQUEST_QUEUE_CAPACITY = 64;
+        boost::lockfree::spsc_queue<GainRequest, boost::lockfree::capacity<REQUEST_QUEUE_CAPACITY>> requests_;
+
+        // main io_service thread only. as requested
+        double zone_gain_db_ = 0.0;
+        bool muted_ = false;
+        // set by the audio worker thread, which knows when the track changes
+        std::atomic<double> track_gain_db_{0.0};
+
+        // audio worker thread only
+        int64_t stream_frames_ = 0; // frames written to the pcm
+        uint32_t track_id_ = 0;
+        GainStage zone_stage_;
+        GainStage track_stage_;
+        GainStage mute_stage_;
+        bool gain_constant_ = true;
+        float constant_gain_ = 1.0f;
+        std::vector<float> frame_gains_;
+
+    };
+
+}
+
+#endif // WAVPLAYERALSA_VOLUME_CONTROL_H__
@@ -0,0 +1,340 @@
+#include "show_renderer.h"
+
+#include <sstream>
+#include <iomanip>
+#include <future>
+#include <limits>
+#include <cmath>
+#include <stdexcept>
+
+#include <boost/filesystem.hpp>
+#include "nlohmann/json.hpp"
+
+
+using json = nlohmann::json;
+
+
+namespace wavplayeralsa {
+
+	ShowRenderer::ShowRenderer(boost::asio::io_service &io_service) :
+		io_service_(io_service)
+	{
+
+	}
+
+	ShowRenderer::~ShowRenderer()
+	{
+		if(render_thread_.joinable()) {
+			render_thread_.join();
+		}
+	}
+
+	void ShowRenderer::Initialize(
+		std::shared_ptr<spdlog::logger> logger,
+		const std::string &script_file,
+		const std::string &output_dir)
+	{
+		logger_ = logger;
+		output_dir_ = output_dir;
+
+		LoadScript(script_file);
+
+		boost::filesystem::create_directories(output_dir_);
+		std::string events_file_name = (boost::filesystem::path(output_dir_) / "events.jsonl").string();
+		events_file_.open(events_file_name, std::ios::out | std::ios::trunc);
+		if(!events_file_.is_open()) {
+			std::stringstream err_desc;
+			err_desc << "cannot open render events file '" << events_file_name << "'";
+			throw std::runtime_error(err_desc.str());
+		}
+
+		clock_.Initialize(logger_->clone("render_clock"));
+
+		json event;
+		event["show_time_ms"] = 0.0;
+		event["event"] = "render_started";
+		event["script"] = script_file;
+		event["start_time_millis_since_epoch"] = (clock_.GetStartNs() / 1000 + clock_.GetEpochOffsetUs()) / 1000;
+		WriteEvent(event);
+
+		logger_->info("loaded {} commands from show script '{}'. render output is written to '{}'", commands_.size(), script_file, output_dir_);
+	}
+
+	std::string ShowRenderer::GetZoneAudioDevice(const std::string &zone_name) const
+	{
+		return "capture:file=" + (boost::filesystem::path(output_dir_) / (zone_name + ".wav")).string();
+	}
+
+	void ShowRenderer::Start(ZonesActionsIfc *zones)
+	{
+		zones_ = zones;
+		render_thread_ = std::thread(&ShowRenderer::RenderThread, this);
+	}
+
+	/*
+	Arguments are checked when the script is loaded, so a typo is found before rendering the show.
+	*/
+	void ShowRenderer::LoadScript(const std::string &script_file)
+	{
+		std::ifstream script(script_file);
+		if(!script.is_open()) {
+			std::stringstream err_desc;
+			err_desc << "cannot open show script '" << script_file << "'";
+			throw std::runtime_error(err_desc.str());
+		}
+
+		std::string line;
+		int line_number = 0;
+		int64_t prev_time_us = 0;
+		while(std::getline(script, line)) {
+			line_number++;
+			size_t first_char = line.find_first_not_of(" \t\r");
+			if(first_char == std::string::npos || line[first_char] == '#') {
+				continue;
+			}
+
+			ShowCommand command;
+			command.line = line_number;
+			command.text = line.substr(first_char);
+			while(!command.text.empty() && (command.text.back() == '\r' || command.text.back() == ' ' || command.text.back() == '\t')) {
+				command.text.pop_back();
+			}
+
+			try {
+				std::stringstream line_stream(command.text);
+				std::string time_str;
+				line_stream >> time_str;
+				command.time_us = ParseShowTime(time_str);
+				if(command.time_us < prev_time_us) {
+					throw std::runtime_error("time is before the time of the previous command");
+				}
+				prev_time_us = command.time_us;
+
+				line_stream >> command.name;
+				if(!command.name.empty() && command.name[0] == '@') {
+					command.zone = command.name.substr(1);
+					command.name.clear();
+					line_stream >> command.name;
+				}
+				std::string arg;
+				while(line_stream >> std::quoted(arg)) {
+					command.args.push_back(arg);
+				}
+
+				size_t min_args = 0;
+				size_t max_args = 0;
+				bool volume_command = false;
+				if(command.name == "play" || command.name == "prepare" || command.name == "queue" || command.name == "cue") {
+					min_args = 1;
+					max_args = 2;
+				}
+				else if(command.name == "gain" || command.name == "track_gain") {
+					volume_command = true;
+					min_args = 1;
+					max_args = (command.name == "gain") ? 2 : 3;
+				}
+				else if(command.name == "mute" || command.name == "unmute") {
+					volume_command = true;
+					max_args = 1;
+				}
+				else if(command.name != "go" && command.name != "stop" && command.name != "clear_queue" && command.name != "end") {
+					throw std::runtime_error("unknown command '" + command.name + "'");
+				}
+				if(command.args.size() < min_args || command.args.size() > max_args) {
+					throw std::runtime_error("wrong number of arguments for '" + command.name + "'");
+				}
+				// offset_ms, index, gain_db, ramp_ms or at_position_ms. all the arguments of volume commands are numbers
+				for(size_t i = volume_command ? 0 : 1; i < command.args.size(); i++) {
+					size_t parsed_chars = 0;
+					bool is_gain = (command.name == "cue" && i == 1) || ((command.name == "gain" || command.name == "track_gain") && i == 0);
+					if(is_gain) {
+						std::stod(command.args[i], &parsed_chars);
+					}
+					else {
+						std::stoll(command.args[i], &parsed_chars);
+					}
+					if(parsed_chars != command.args[i].size()) {
+						throw std::invalid_argument(command.args[i]);
+					}
+				}
+			}
+			catch(const std::logic_error &e) {
+				std::stringstream err_desc;
+				err_desc << "show script '" << script_file << "' line " << line_number << ": invalid number '" << e.what() << "'";
+				throw std::runtime_error(err_desc.str());
+			}
+			catch(const std::runtime_error &e) {
+				std::stringstream err_desc;
+				err_desc << "show script '" << script_file << "' line " << line_number << ": " << e.what();
+				throw std::runtime_error(err_desc.str());
+			}
+
+			commands_.push_back(command);
+		}
+	}
+
+	/*
+	'95.5', '1:35.5' or '0:01:35.5' seconds from the start of the show.
+	*/
+	int64_t ShowRenderer::ParseShowTime(const std::string &time_str)
+	{
+		std::vector<std::string> parts;
+		std::stringstream time_stream(time_str);
+		std::string part;
+		while(std::getline(time_stream, part, ':')) {
+			parts.push_back(part);
+		}
+		if(parts.empty() || parts.size() > 3) {
+			throw std::runtime_error("invalid time '" + time_str + "'");
+		}
+
+		double seconds = 0.0;
+		for(size_t i = 0; i < parts.size(); i++) {
+			size_t parsed_chars = 0;
+			double value = (i + 1 == parts.size()) ? std::stod(parts[i], &parsed_chars) : (double)std::stoul(parts[i], &parsed_chars);
+			if(parts[i].empty() || parsed_chars != parts[i].size() || value < 0.0) {
+				throw std::runtime_error("invalid time '" + time_str + "'");
+			}
+			seconds = seconds * 60.0 + value;
+		}
+		return (int64_t)std::llround(seconds * 1000000.0);
+	}
+
+	void ShowRenderer::RenderThread()
+	{
+		int failed_commands = 0;
+		bool ended_by_command = false;
+
+		for(const ShowCommand &command : commands_) {
+			clock_.AdvanceTo(clock_.GetStartNs() + command.time_us * 1000);
+			if(command.name == "end") {
+				ended_by_command = true;
+				break;
+			}
+
+			// the controllers run on the io_service thread, like requests from the network apis
+			std::stringstream out_msg;
+			std::promise<bool> done;
+			io_service_.post([this, &command, &out_msg, &done]() {
+				done.set_value(RunCommand(command, out_msg));
+			});
+			bool success = done.get_future().get();
+			clock_.Touch();
+
+			if(success) {
+				logger_->info("show time {} ms, line {}: '{}'. {}", ShowTimeMs(), command.line, command.text, out_msg.str());
+			}
+			else {
+				failed_commands++;
+				logger_->error("show time {} ms, line {}: '{}' failed. {}", ShowTimeMs(), command.line, command.text, out_msg.str());
+			}
+
+			json event;
+			event["show_time_ms"] = ShowTimeMs();
+			event["event"] = "command";
+			event["line"] = command.line;
+			event["command"] = command.text;
+			event["success"] = success;
+			event["message"] = out_msg.str();
+			WriteEvent(event);
+		}
+
+		if(!ended_by_command) {
+			clock_.AdvanceUntilIdle(std::numeric_limits<int64_t>::max());
+		}
+
+		json event;
+		event["show_time_ms"] = ShowTimeMs();
+		event["event"] = "render_ended";
+		event["failed_commands"] = failed_commands;
+		WriteEvent(event);
+		{
+			std::lock_guard<std::mutex> guard(events_mutex_);
+			events_file_.close();
+		}
+
+		logger_->info("rendering ended at show time {} ms. {} commands failed", ShowTimeMs(), failed_commands);
+		succeeded_ = (failed_commands == 0);
+		io_service_.post([this]() { io_service_.stop(); });
+	}
+
+	bool ShowRenderer::RunCommand(const ShowCommand &command, std::stringstream &out_msg)
+	{
+		ZoneActions zone;
+		if(!zones_->FindZone(command.zone, &zone)) {
+			out_msg << "zone '" << command.zone << "' does not exist";
+			return false;
+		}
+
+		uint32_t play_seq_id = 0;
+		int64_t number_arg = command.args.size() > 1 && command.name != "cue" ? std::stoll(command.args[1]) : 0;
+		if(command.name == "play") {
+			return zone.current_song->NewSongRequest(command.args[0], number_arg, 0, out_msg, &play_seq_id);
+		}
+		if(command.name == "prepare") {
+			return zone.current_song->PrepareSongRequest(command.args[0], number_arg, out_msg, &play_seq_id);
+		}
+		if(command.name == "go") {
+			return zone.current_song->GoRequest(out_msg, &play_seq_id);
+		}
+		if(command.name == "stop") {
+			return zone.current_song->StopPlayRequest(out_msg, &play_seq_id);
+		}
+		if(command.name == "queue") {
+			return zone.play_queue->QueueInsertRequest(command.args[0], command.args.size() > 1 ? number_arg : -1, out_msg);
+		}
+		if(command.name == "clear_queue") {
+			return zone.play_queue->QueueClearRequest(out_msg);
+		}
+		if(command.name == "cue") {
+			double gain_db = command.args.size() > 1 ? std::stod(command.args[1]) : 0.0;
+			return zone.cues->TriggerCueRequest(command.args[0], gain_db, out_msg);
+		}
+		if(command.name == "gain") {
+			return zone.volume->SetZoneGainRequest(std::stod(command.args[0]), number_arg, out_msg);
+		}
+		if(command.name == "track_gain") {
+			int64_t at_position_ms = command.args.size() > 2 ? std::stoll(command.args[2]) : -1;
+			return zone.volume->SetTrackGainRequest(std::stod(command.args[0]), number_arg, at_position_ms, out_msg);
+		}
+		if(command.name == "mute" || command.name == "unmute") {
+			int64_t ramp_ms = command.args.size() > 0 ? std::stoll(command.args[0]) : 0;
+			return zone.volume->SetMuteRequest(command.name == "mute", ramp_ms, out_msg);
+		}
+		out_msg << "unknown command '" << command.name << "'";
+		return false;
+	}
+
+	/*
+	Status messages are logged as they are published, with the show time at which the controller published them.
+	Start times are also written as show time, which is what a show is usually validated against.
+	*/
+	void ShowRenderer::OnStatusMessage(const std::string &zone_name, const std::string &json_str)
+	{
+		json event;
+		event["show_time_ms"] = ShowTimeMs();
+		event["event"] = "status";
+		event["zone"] = zone_name;
+		event["status"] = json::parse(json_str);
+		if(event["status"].find("start_time_micros_since_epoch") != event["status"].end()) {
+			int64_t start_time_us = event["status"]["start_time_micros_since_epoch"].get<int64_t>();
+			int64_t show_start_us = clock_.GetStartNs() / 1000 + clock_.GetEpochOffsetUs();
+			event["start_show_time_ms"] = (double)(start_time_us - show_start_us) / 1000.0;
+		}
+		WriteEvent(event);
+	}
+
+	double ShowRenderer::ShowTimeMs() const
+	{
+		return (double)((clock_.NowNs() - clock_.GetStartNs()) / 1000) / 1000.0;
+	}
+
+	void ShowRenderer::WriteEvent(const json &event)
+	{
+		std::lock_guard<std::mutex> guard(events_mutex_);
+		if(events_file_.is_open()) {
+			events_file_ << event.dump() << "\n";
+		}
+	}
+
+}
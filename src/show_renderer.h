@@ -0,0 +1,103 @@
+#ifndef WAVPLAYERALSA_SHOW_RENDERER_H_
+#define WAVPLAYERALSA_SHOW_RENDERER_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <atomic>
+
+#include <boost/asio.hpp>
+
+#include "spdlog/spdlog.h"
+#include "nlohmann/json_fwd.hpp"
+
+#include "player_events_ifc.h"
+#include "player_actions_ifc.h"
+#include "services/render_clock.h"
+
+namespace wavplayeralsa {
+
+	/*
+	Plays a show script on the zones, on a virtual clock which runs as fast as the audio can be produced,
+	to validate a whole show (song order, offsets, timing) in a fraction of its length.
+	The commands are sent to the zones at their show time, the same way the network apis send them, 
+	so the controllers and the playback pipeline run as they would on a real show.
+	The audio devices of the zones should be simulated devices on the render clock, which capture what they play.
+	Every command (with its result) and every status message the clients would get is written, with the 
+	show time, to a log file of json lines.
+	The script has a command in each line: '<time> [@zone] <command> [args]', where time is in seconds 
+	('95.5', '1:35.5' or '0:01:35.5') from the start of the show. Lines starting with '#' are comments.
+	Commands: play <file_id> [offset_ms], prepare <file_id> [offset_ms], go, stop, queue <file_id> [index],
+	clear_queue, cue <cue_id> [gain_db], end. Arguments with spaces can be quoted.
+	Rendering ends at an 'end' command, or when no zone is playing after the last command.
+	*/
+	class ShowRenderer :
+		public StatusMessagesListenerIfc
+	{
+
+	public:
+		ShowRenderer(boost::asio::io_service &io_service);
+		~ShowRenderer();
+
+		// loads the script, and opens the output directory.
+		// will throw std::runtime_error in case of error
+		void Initialize(
+			std::shared_ptr<spdlog::logger> logger,
+			const std::string &script_file,
+			const std::string &output_dir);
+
+	public:
+		RenderClock *GetClock() { return &clock_; }
+
+		// the device for a zone: a simulated device which captures to a wav file in the output directory
+		std::string GetZoneAudioDevice(const std::string &zone_name) const;
+
+		// render on a separate thread. the io_service is stopped when rendering ends
+		void Start(ZonesActionsIfc *zones);
+
+		bool Succeeded() const { return succeeded_; }
+
+	public:
+		// StatusMessagesListenerIfc
+		void OnStatusMessage(const std::string &zone_name, const std::string &json_str);
+
+	private:
+		struct ShowCommand {
+			int line = 0;
+			int64_t time_us = 0; // from the start of the show
+			std::string zone; // empty for the default zone
+			std::string name;
+			std::vector<std::string> args;
+			std::string text; // as written in the script
+		};
+
+	private:
+		void LoadScript(const std::string &script_file);
+		static int64_t ParseShowTime(const std::string &time_str);
+		void RenderThread();
+		bool RunCommand(const ShowCommand &command, std::stringstream &out_msg);
+		double ShowTimeMs() const;
+		void WriteEvent(const nlohmann::json &event);
+
+	private:
+		boost::asio::io_service &io_service_;
+		std::shared_ptr<spdlog::logger> logger_;
+		ZonesActionsIfc *zones_ = nullptr;
+		RenderClock clock_;
+		std::vector<ShowCommand> commands_;
+		std::string output_dir_;
+
+		std::thread render_thread_;
+		std::atomic<bool> succeeded_{false};
+
+		std::mutex events_mutex_;
+		std::ofstream events_file_;
+
+	};
+
+}
+
+#endif // WAVPLAYERALSA_SHOW_RENDERER_H_
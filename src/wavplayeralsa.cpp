@@ -22,9 +22,11 @@
 #include "http_api.h"
 #include "mqtt_api.h"
 #include "audio_files_manager.h"
-#include "current_song_controller.h"
-#include "services/alsa_service.h"
+#include "player_zones.h"
+#include "show_renderer.h"
 #include "services/config_service.h"
+#include "services/audio_cache.h"
+#include "services/cue_mixer.h"
 
 
 /*
@@ -38,11 +40,7 @@ public:
 		web_sockets_api_(),
 		io_service_work_(io_service_),
 		mqtt_api_(io_service_),
-		current_song_controller_(
-			io_service_, 
-			&mqtt_api_, 
-			&web_sockets_api_, 
-			&alsa_playback_service_factory_)
+		show_renderer_(io_service_)
 	{
 
 	}
@@ -86,7 +84,10 @@ public:
 			http_api_logger_ = root_logger_->clone("http_api");
 			ws_api_logger_ = root_logger_->clone("ws_api");
 			mqtt_api_logger_ = root_logger_->clone("mqtt_api");
-			alsa_playback_service_factory_logger = root_logger_->clone("alsa_playback_service_factory");
+			zones_logger_ = root_logger_->clone("zones");
+			audio_cache_logger_ = root_logger_->clone("audio_cache");
+			cue_sound_bank_logger_ = root_logger_->clone("cue_sound_bank");
+			render_logger_ = root_logger_->clone("render");
 		}
 		catch(const std::exception &e) {
 			std::cerr << "Unable to create loggers. error is: " << e.what() << std::endl;
@@ -107,21 +108,27 @@ public:
 	void InitializeComponents() {
 		try {
 			audio_files_manager.Initialize(config_service_.GetWavDir());
-			web_sockets_api_.Initialize(ws_api_logger_, &io_service_, config_service_.GetWsListenPort());
-			http_api_.Initialize(http_api_logger_, uuid_, &io_service_, &current_song_controller_, &audio_files_manager, config_service_.GetHttpListenPort());
+			audio_cache_.Initialize(audio_cache_logger_, config_service_.GetAudioCacheBytes());
+			cue_sound_bank_.Initialize(cue_sound_bank_logger_, config_service_.GetCueDir());
 
-			// controllers
-			current_song_controller_.Initialize(uuid_, config_service_.GetWavDir());
-
-			// services
+			// render mode plays the script offline, so the network apis are not started
+			if(config_service_.IsRenderMode()) {
+				show_renderer_.Initialize(render_logger_, config_service_.GetRenderScript(), config_service_.GetRenderDir());
+			}
+			else {
+				web_sockets_api_.Initialize(ws_api_logger_, &io_service_, &player_zones_, config_service_.GetWsListenPort());
+				http_api_.Initialize(http_api_logger_, uuid_, &io_service_, &player_zones_, &audio_files_manager, &audio_cache_, config_service_.GetHttpListenPort());
+			}
 
-			alsa_playback_service_factory_.Initialize(
-				alsa_playback_service_factory_logger,
-				&current_song_controller_,
-				config_service_.GetAudioDevice()
-			);
+			// zones. without zones config, a single zone plays on audio_device, and publishes status as before
+			if(config_service_.GetZones().empty()) {
+				AddZone(DEFAULT_ZONE_NAME, config_service_.GetAudioDevice(), wavplayeralsa::MqttApi::CurrentSongTopic(""));
+			}
+			for(const wavplayeralsa::ZoneConfig &zone_config : config_service_.GetZones()) {
+				AddZone(zone_config.name, zone_config.audio_device, wavplayeralsa::MqttApi::CurrentSongTopic(zone_config.name));
+			}
 
-			if(config_service_.UseMqtt()) {
+			if(config_service_.UseMqtt() && !config_service_.IsRenderMode()) {
 				mqtt_api_.Initialize(mqtt_api_logger_, config_service_.GetMqttHost(), config_service_.GetMqttPort());
 			}
 		}
@@ -135,18 +142,36 @@ public:
 
 		if(!config_service_.GetInitialFile().empty()) {	
 		 	std::stringstream initial_file_play_status;
-			bool success = current_song_controller_.NewSongRequest(config_service_.GetInitialFile(), 0, initial_file_play_status, nullptr);
+			bool success = player_zones_.GetDefaultZone()->GetCurrentSongController().NewSongRequest(config_service_.GetInitialFile(), 0, 0, initial_file_play_status, nullptr);
 			if(!success) {
 				root_logger_->error("unable to play initial file. {}", initial_file_play_status.str());
 				exit(EXIT_FAILURE);
 			}
 		}	
 
+		if(config_service_.IsRenderMode()) {
+			show_renderer_.Start(&player_zones_);
+			io_service_.run();
+			exit(show_renderer_.Succeeded() ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+
 		io_service_.run();
 	}
 
 private:
 
+	void AddZone(const std::string &zone_name, const std::string &audio_device, const std::string &status_topic) {
+		std::unique_ptr<wavplayeralsa::PlayerZone> zone(new wavplayeralsa::PlayerZone(io_service_, &mqtt_api_, &web_sockets_api_));
+		if(config_service_.IsRenderMode()) {
+			// the zone plays to a capture file on the render clock, instead of its configured devices (mirrors included)
+			zone->Initialize(zones_logger_, config_service_, zone_name, show_renderer_.GetZoneAudioDevice(zone_name), status_topic, uuid_, &audio_cache_, &cue_sound_bank_, show_renderer_.GetClock(), &show_renderer_);
+		}
+		else {
+			zone->Initialize(zones_logger_, config_service_, zone_name, audio_device, status_topic, uuid_, &audio_cache_, &cue_sound_bank_, nullptr, nullptr);
+		}
+		player_zones_.Add(std::move(zone));
+	}
+
 	// create a file sink for logging.
 	// each invokation of the program will create a new file, with a name that contains the
 	// current date and time.
@@ -200,7 +225,10 @@ private:
 	std::shared_ptr<spdlog::logger> http_api_logger_;
 	std::shared_ptr<spdlog::logger> mqtt_api_logger_;
 	std::shared_ptr<spdlog::logger> ws_api_logger_;
-	std::shared_ptr<spdlog::logger> alsa_playback_service_factory_logger;
+	std::shared_ptr<spdlog::logger> zones_logger_;
+	std::shared_ptr<spdlog::logger> audio_cache_logger_;
+	std::shared_ptr<spdlog::logger> cue_sound_bank_logger_;
+	std::shared_ptr<spdlog::logger> render_logger_;
 
 private:
 	std::string uuid_;
@@ -211,10 +239,13 @@ private:
 	wavplayeralsa::HttpApi http_api_;
 	wavplayeralsa::MqttApi mqtt_api_;
 	wavplayeralsa::AudioFilesManager audio_files_manager;
-	wavplayeralsa::AlsaPlaybackServiceFactory alsa_playback_service_factory_;
+	wavplayeralsa::AudioCache audio_cache_;
+	wavplayeralsa::CueSoundBank cue_sound_bank_;
 	wavplayeralsa::ConfigService config_service_;
+	wavplayeralsa::ShowRenderer show_renderer_;
 
-	wavplayeralsa::CurrentSongController current_song_controller_;
+	wavplayeralsa::PlayerZones player_zones_;
+	const char *DEFAULT_ZONE_NAME = "default";
 
 };
 
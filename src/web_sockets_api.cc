@@ -2,6 +2,9 @@
 
 #include <boost/foreach.hpp>
 #include <boost/bind.hpp>
+#include "nlohmann/json.hpp"
+
+using json = nlohmann::json;
 
 using websocketpp::connection_hdl;
 
@@ -12,9 +15,15 @@ namespace wavplayeralsa {
 		
 	}
 
-	void WebSocketsApi::Initialize(std::shared_ptr<spdlog::logger> logger, boost::asio::io_service *io_service, uint16_t ws_listen_port) {
+	void WebSocketsApi::Initialize(
+		std::shared_ptr<spdlog::logger> logger, 
+		boost::asio::io_service *io_service, 
+		ZonesActionsIfc *zones_action_callback, 
+		uint16_t ws_listen_port) 
+	{
 
 		logger_ = logger;
+		zones_action_callback_ = zones_action_callback;
 
 	    server_.clear_error_channels(websocketpp::log::alevel::all);
 	    server_.clear_access_channels(websocketpp::log::alevel::all);
@@ -22,6 +31,7 @@ namespace wavplayeralsa {
 		server_.set_reuse_addr(true);
 	    server_.set_open_handler(websocketpp::lib::bind(&WebSocketsApi::OnOpen,this, websocketpp::lib::placeholders::_1));
     	server_.set_close_handler(websocketpp::lib::bind(&WebSocketsApi::OnClose,this, websocketpp::lib::placeholders::_1));
+    	server_.set_message_handler(websocketpp::lib::bind(&WebSocketsApi::OnMessage,this, websocketpp::lib::placeholders::_1, websocketpp::lib::placeholders::_2));
     	try {
 	    	server_.listen(ws_listen_port);
 	    }
@@ -37,16 +47,16 @@ namespace wavplayeralsa {
 		initialized = true;
 	}
 
-	void WebSocketsApi::ReportCurrentSong(const std::string &json_str) 
+	void WebSocketsApi::ReportCurrentSong(const std::string &zone_name, const std::string &json_str) 
 	{
-		last_status_msg_ = json_str;
+		last_status_msgs_[zone_name] = json_str;
 
 		if(!initialized)
 			return;
 
-		logger_->info("new status message: {}. will send to all {} connected clients", last_status_msg_, connections_.size());
+		logger_->info("new status message: {}. will send to all {} connected clients", json_str, connections_.size());
 		BOOST_FOREACH(const connection_hdl &hdl, connections_) {
-	        server_.send(hdl, last_status_msg_, websocketpp::frame::opcode::text);
+	        server_.send(hdl, json_str, websocketpp::frame::opcode::text);
 		}
 	}
 
@@ -57,7 +67,9 @@ namespace wavplayeralsa {
 		const auto con = server_.get_con_from_hdl(hdl);
 		const boost::asio::ip::address socket_address = con->get_raw_socket().remote_endpoint().address();
 		logger_->info("new web socket connection from ip {}, ptr for close reference: {}", socket_address.to_string(), hdl.lock().get());
-        server_.send(hdl, last_status_msg_, websocketpp::frame::opcode::text);
+        for(const auto &zone_msg : last_status_msgs_) {
+	        server_.send(hdl, zone_msg.second, websocketpp::frame::opcode::text);
+        }
     }
     
     void WebSocketsApi::OnClose(connection_hdl hdl) {
@@ -65,7 +77,53 @@ namespace wavplayeralsa {
         connections_.erase(hdl);
     }
 
-}
+	/*
+	Inbound messages are commands, for clients which need lower latency than an http request.
+	Currently the only supported command is {"command": "go"}, which starts playing a prepared file.
+	An optional "zone" selects the zone (default zone if not set).
+	The result is sent back to the client that sent the command.
+	 */
+	void WebSocketsApi::OnMessage(connection_hdl hdl, websocketpp::server<websocketpp::config::asio>::message_ptr msg) {
+
+		std::string command;
+		std::string zone_name;
+		try {
+			json command_json = json::parse(msg->get_payload());
+			command = command_json["command"].get<std::string>();
+			if(command_json.find("zone") != command_json.end()) {
+				zone_name = command_json["zone"].get<std::string>();
+			}
+		}
+		catch(json::exception &e) {
+			logger_->error("web socket message is not a valid command json. error msg: '{}'", e.what());
+			return;
+		}
 
+		std::stringstream handler_msg;
+		uint32_t play_seq_id = 0;
+		bool success;
+		ZoneActions zone;
+		if(!zones_action_callback_->FindZone(zone_name, &zone)) {
+			success = false;
+			handler_msg << "unknown zone '" << zone_name << "'";
+		}
+		else if(command == "go") {
+			success = zone.current_song->GoRequest(handler_msg, &play_seq_id);
+		}
+		else {
+			success = false;
+			handler_msg << "unknown web socket command '" << command << "'";
+		}
 
+		json response_json;
+		response_json["command"] = command;
+		response_json["zone"] = zone.zone_name;
+		response_json["success"] = success;
+		response_json["operation_desc"] = handler_msg.str();
+		response_json["play_seq_id"] = play_seq_id;
+		logger_->info("web socket command '{}' handled. result: {}", command, handler_msg.str());
+		server_.send(hdl, response_json.dump(), websocketpp::frame::opcode::text);
+	}
+
+}
 
@@ -3,6 +3,8 @@
 
 #include <cstdint>
 #include <set>
+#include <map>
+#include <string>
 
 #include <boost/asio.hpp>
 #include "websocketpp/config/asio_no_tls.hpp"
@@ -10,6 +12,7 @@
 #include "spdlog/spdlog.h"
 
 #include "player_events_ifc.h"
+#include "player_actions_ifc.h"
 
 namespace wavplayeralsa {
 
@@ -19,28 +22,36 @@ namespace wavplayeralsa {
 		WebSocketsApi();
 
 	public:
-		void Initialize(std::shared_ptr<spdlog::logger> logger, boost::asio::io_service *io_service, uint16_t ws_listen_port);
+		void Initialize(
+			std::shared_ptr<spdlog::logger> logger, 
+			boost::asio::io_service *io_service, 
+			ZonesActionsIfc *zones_action_callback, 
+			uint16_t ws_listen_port);
 
 	public:
-		void ReportCurrentSong(const std::string &json_str);
+		// status of the current song in zone_name. sent to all the clients
+		void ReportCurrentSong(const std::string &zone_name, const std::string &json_str);
 
 	private:
 		// web sockets callbacks
 		void OnOpen(websocketpp::connection_hdl hdl);
 		void OnClose(websocketpp::connection_hdl hdl);
+		void OnMessage(websocketpp::connection_hdl hdl, websocketpp::server<websocketpp::config::asio>::message_ptr msg);
 
 	private:
 
 		websocketpp::server<websocketpp::config::asio> server_;
 		std::shared_ptr<spdlog::logger> logger_;
 		boost::asio::io_service *io_service_;
+		ZonesActionsIfc *zones_action_callback_ = nullptr;
 
 		typedef std::set<websocketpp::connection_hdl, std::owner_less<websocketpp::connection_hdl>> ConList;
 		ConList connections_;
 
 		bool initialized = false;
 
-		std::string last_status_msg_;
+		// last status message of each zone, sent to new clients
+		std::map<std::string, std::string> last_status_msgs_;
 	};
 
 }
@@ -0,0 +1,139 @@
+/*
+Streams numbered frames through the producer thread and the ring, while the producer stalls
+at random like a slow file read, and the consumer reads faster than real time like the audio
+thread catching up. Checks that every frame arrives once, in order, and that the stream ends.
+Timing is only reported, not checked, so a slow machine does not fail the test.
+*/
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+#include "spdlog/spdlog.h"
+#include "spdlog/sinks/stdout_sinks.h"
+
+#include "services/audio_frames_ring.h"
+#include "services/audio_producer.h"
+
+using namespace wavplayeralsa;
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	do { \
+		if(!(condition)) { \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #condition << std::endl; \
+			failures++; \
+		} \
+	} while(0)
+
+static const unsigned int FRAME_RATE = 48000;
+static const size_t BYTES_PER_FRAME = 4;
+static const uint32_t TOTAL_FRAMES = FRAME_RATE * 10;
+static const int MAX_STALL_MS = 80;
+
+// writes the frame number as each frame, and stalls once in a while before a write
+class StallingJob :
+	public AudioProducerJobIfc
+{
+
+public:
+	StallingJob(AudioFramesRing *ring) : ring_(ring), rng_(1) { }
+
+	bool ProduceAudio(const std::atomic<bool> &stop_requested) {
+		while(!stop_requested) {
+			char *region = nullptr;
+			size_t region_frames = std::min(ring_->GetWriteRegion(&region), (size_t)4096) / BYTES_PER_FRAME;
+			if(region_frames == 0) {
+				return true;
+			}
+			if(rng_() % 200 == 0) {
+				stalls++;
+				std::this_thread::sleep_for(std::chrono::milliseconds(rng_() % MAX_STALL_MS));
+			}
+			size_t frames = 0;
+			for(; frames < region_frames && next_frame_ < TOTAL_FRAMES; frames++) {
+				uint32_t value = next_frame_++;
+				memcpy(region + frames * BYTES_PER_FRAME, &value, BYTES_PER_FRAME);
+			}
+			if(frames == 0) {
+				ring_->SetEndOfStream();
+				return false;
+			}
+			ring_->CommitWrite(frames * BYTES_PER_FRAME);
+		}
+		return true;
+	}
+
+public:
+	int stalls = 0;
+
+private:
+	AudioFramesRing *ring_;
+	std::mt19937 rng_;
+	uint32_t next_frame_ = 0;
+
+};
+
+int main()
+{
+	std::shared_ptr<spdlog::logger> logger = std::make_shared<spdlog::logger>("test", std::make_shared<spdlog::sinks::stdout_sink_mt>());
+
+	// 500 ms, like the default audio_ring_ms
+	AudioFramesRing ring;
+	ring.Initialize(FRAME_RATE / 2 * BYTES_PER_FRAME);
+
+	AudioProducer producer;
+	producer.Initialize(logger);
+	StallingJob job(&ring);
+	producer.Start(&job);
+
+	// consume a 10 ms period at a time, 10 times faster than real time
+	const size_t period_frames = FRAME_RATE / 100;
+	std::vector<char> period(period_frames * BYTES_PER_FRAME);
+	uint32_t expected_frame = 0;
+	uint32_t out_of_order = 0;
+	int empty_reads = 0;
+	std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+	while(!ring.IsDrained()) {
+		size_t bytes = ring.Peek(period.data(), period.size());
+		CHECK(bytes % BYTES_PER_FRAME == 0);
+		if(bytes == 0) {
+			empty_reads++;
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+			continue;
+		}
+		for(size_t i = 0; i < bytes / BYTES_PER_FRAME; i++) {
+			uint32_t value = 0;
+			memcpy(&value, period.data() + i * BYTES_PER_FRAME, BYTES_PER_FRAME);
+			if(value != expected_frame) {
+				out_of_order++;
+			}
+			expected_frame = value + 1;
+		}
+		ring.CommitRead(bytes);
+		producer.Wakeup();
+		std::this_thread::sleep_for(std::chrono::microseconds(1000 * bytes / period.size()));
+	}
+	double elapsed_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+	producer.Stop();
+
+	CHECK(out_of_order == 0);
+	CHECK(expected_frame == TOTAL_FRAMES);
+	CHECK(ring.GetBytesRead() == (size_t)TOTAL_FRAMES * BYTES_PER_FRAME);
+
+	std::cout << TOTAL_FRAMES << " frames in " << elapsed_sec << " sec. producer stalls: " << job.stalls
+		<< ", empty ring reads: " << empty_reads << std::endl;
+
+	if(failures > 0) {
+		std::cerr << failures << " checks failed" << std::endl;
+		return 1;
+	}
+	std::cout << "audio producer stall test passed" << std::endl;
+	return 0;
+}
@@ -0,0 +1,139 @@
+/*
+Resamples a sine with a ratio close to 1.0, like drift compensation does, while the pcm
+accepts only part of the frames of each write. Checks that the output is the same as when
+every write is accepted, that it continues smoothly across the writes, and that no input is lost.
+Also prints the cost of resampling per frame, for each channel count.
+*/
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+#include "services/drift_resampler.h"
+
+using namespace wavplayeralsa;
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	do { \
+		if(!(condition)) { \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #condition << std::endl; \
+			failures++; \
+		} \
+	} while(0)
+
+static const unsigned int FRAME_RATE = 48000;
+static const double SINE_HZ = 1000.0;
+static const float AMPLITUDE = 0.5f;
+static const double RATIO = 1.0001;
+static const size_t IN_FRAMES = FRAME_RATE * 2;
+static const size_t PERIOD_FRAMES = 1024;
+
+static std::vector<float> MakeSine(size_t num_of_frames, unsigned int num_of_channels)
+{
+	std::vector<float> samples(num_of_frames * num_of_channels);
+	for(size_t i = 0; i < num_of_frames; i++) {
+		for(unsigned int c = 0; c < num_of_channels; c++) {
+			samples[i * num_of_channels + c] = AMPLITUDE * (float)std::sin(2.0 * M_PI * SINE_HZ * (double)i / FRAME_RATE);
+		}
+	}
+	return samples;
+}
+
+/*
+Resample all of in, a period at a time, like the transfer loop. If partial_writes is set,
+the pcm accepts a random part of each period (sometimes none of it).
+Returns the frames which were written, and the input frames which were consumed in *consumed_frames.
+*/
+static std::vector<float> Resample(const std::vector<float> &in, unsigned int num_of_channels, bool partial_writes, size_t *consumed_frames)
+{
+	DriftResampler resampler;
+	CHECK(resampler.Initialize(SND_PCM_FORMAT_FLOAT, num_of_channels));
+	resampler.SetRatio(RATIO);
+
+	std::mt19937 rng(7);
+	std::vector<float> out;
+	std::vector<float> period(PERIOD_FRAMES * num_of_channels);
+	const size_t in_frames = in.size() / num_of_channels;
+	size_t position = 0;
+	while(position + resampler.MaxInputFrames(PERIOD_FRAMES) < in_frames) {
+		size_t max_in = resampler.MaxInputFrames(PERIOD_FRAMES);
+		size_t produced = resampler.Process((const char *)&in[position * num_of_channels], max_in, (char *)period.data(), PERIOD_FRAMES);
+		size_t written = produced;
+		if(partial_writes) {
+			written = rng() % (produced + 1);
+		}
+		out.insert(out.end(), period.begin(), period.begin() + written * num_of_channels);
+		position += resampler.Advance(written);
+	}
+	*consumed_frames = position;
+	return out;
+}
+
+static void CheckPartialWrites(unsigned int num_of_channels)
+{
+	std::vector<float> in = MakeSine(IN_FRAMES, num_of_channels);
+
+	size_t full_consumed = 0;
+	size_t partial_consumed = 0;
+	std::vector<float> full = Resample(in, num_of_channels, false, &full_consumed);
+	std::vector<float> partial = Resample(in, num_of_channels, true, &partial_consumed);
+
+	// the partial writes produce the same frames, up to where they stopped.
+	// the position is added up from a different phase in each write, so the last bits of a sample can differ
+	size_t common = std::min(full.size(), partial.size());
+	CHECK(common > (IN_FRAMES - 2 * PERIOD_FRAMES) * num_of_channels);
+	float max_diff = 0.0f;
+	for(size_t i = 0; i < common; i++) {
+		max_diff = std::max(max_diff, std::fabs(partial[i] - full[i]));
+	}
+	CHECK(max_diff <= 1e-6f);
+
+	// consecutive frames change by at most the slope of the sine, so a lost or repeated chunk is seen as a jump
+	const float max_step = AMPLITUDE * (float)(2.0 * M_PI * SINE_HZ / FRAME_RATE / RATIO) * 1.05f;
+	size_t jumps = 0;
+	for(size_t i = num_of_channels; i < partial.size(); i++) {
+		if(std::fabs(partial[i] - partial[i - num_of_channels]) > max_step) {
+			jumps++;
+		}
+	}
+	CHECK(jumps == 0);
+
+	// every consumed input frame was played, stretched by the ratio, besides the frames kept for interpolation
+	for(const std::pair<size_t, size_t> &run : { std::make_pair(full.size(), full_consumed), std::make_pair(partial.size(), partial_consumed) }) {
+		double expected_out_frames = (double)run.second * RATIO;
+		double out_frames = (double)(run.first / num_of_channels);
+		CHECK(std::fabs(out_frames - expected_out_frames) <= 4.0);
+	}
+}
+
+static void PrintCost(unsigned int num_of_channels)
+{
+	std::vector<float> in = MakeSine(IN_FRAMES, num_of_channels);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	size_t consumed = 0;
+	std::vector<float> out = Resample(in, num_of_channels, false, &consumed);
+	double elapsed_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+	std::cout << num_of_channels << " channels: " << elapsed_ns / (double)(out.size() / num_of_channels) << " ns per frame" << std::endl;
+}
+
+int main()
+{
+	for(unsigned int num_of_channels : { 1, 2, 6 }) {
+		CheckPartialWrites(num_of_channels);
+	}
+	for(unsigned int num_of_channels : { 1, 2, 6 }) {
+		PrintCost(num_of_channels);
+	}
+
+	if(failures > 0) {
+		std::cerr << failures << " checks failed" << std::endl;
+		return 1;
+	}
+	std::cout << "drift resampler test passed" << std::endl;
+	return 0;
+}
@@ -0,0 +1,94 @@
+/*
+Prints the time each sample conversion takes, for a stereo stream of each supported file format
+to each device format, and for the conversions to and from float used for processing.
+Not run as a test. Build it in the configuration to measure, and run it on the target device.
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+
+#include "services/format_converter.h"
+#include "services/sample_converter.h"
+
+using namespace wavplayeralsa;
+
+struct FormatName {
+	snd_pcm_format_t format;
+	const char *name;
+};
+
+static const FormatName FILE_FORMATS[] = {
+	{ SND_PCM_FORMAT_S16_LE, "S16_LE" },
+	{ SND_PCM_FORMAT_S16_BE, "S16_BE" },
+	{ SND_PCM_FORMAT_S24_3LE, "S24_3LE" },
+	{ SND_PCM_FORMAT_S24_3BE, "S24_3BE" },
+	{ SND_PCM_FORMAT_S32_LE, "S32_LE" },
+	{ SND_PCM_FORMAT_S32_BE, "S32_BE" },
+	{ SND_PCM_FORMAT_FLOAT_LE, "FLOAT_LE" },
+	{ SND_PCM_FORMAT_FLOAT_BE, "FLOAT_BE" },
+	{ SND_PCM_FORMAT_FLOAT64_LE, "FLOAT64_LE" },
+	{ SND_PCM_FORMAT_FLOAT64_BE, "FLOAT64_BE" },
+};
+
+static const FormatName DEVICE_FORMATS[] = {
+	{ SND_PCM_FORMAT_S16, "S16" },
+	{ SND_PCM_FORMAT_S32, "S32" },
+	{ SND_PCM_FORMAT_FLOAT, "FLOAT" },
+};
+
+// a period of a few ms, converted over and over, so it stays in the cache like in the transfer loop
+static const size_t PERIOD_FRAMES = 1024;
+static const unsigned int NUM_OF_CHANNELS = 2;
+static const int REPEATS = 2000;
+
+template <typename Func>
+static double NsPerSample(Func func)
+{
+	func();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for(int r = 0; r < REPEATS; r++) {
+		func();
+	}
+	double elapsed_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+	return elapsed_ns / ((double)REPEATS * PERIOD_FRAMES * NUM_OF_CHANNELS);
+}
+
+int main()
+{
+	// zeros are valid samples in every format. the time of the conversions does not depend on the values
+	std::vector<char> in(PERIOD_FRAMES * NUM_OF_CHANNELS * 8, 0);
+	std::vector<char> out(PERIOD_FRAMES * NUM_OF_CHANNELS * 8, 0);
+	std::vector<float> floats(PERIOD_FRAMES * NUM_OF_CHANNELS, 0.0f);
+
+	std::cout << std::fixed << std::setprecision(2);
+	std::cout << "ns per sample, " << NUM_OF_CHANNELS << " channels, " << PERIOD_FRAMES << " frames per call" << std::endl;
+	for(const FormatName &file_format : FILE_FORMATS) {
+		for(const FormatName &device_format : DEVICE_FORMATS) {
+			AlsaPcmStreamParams in_params;
+			in_params.format = file_format.format;
+			in_params.num_of_channels = NUM_OF_CHANNELS;
+			AlsaPcmStreamParams out_params = in_params;
+			out_params.format = device_format.format;
+			FormatConverter converter;
+			if(!converter.Initialize(in_params, out_params)) {
+				continue;
+			}
+			double ns = NsPerSample([&] { converter.Convert(in.data(), PERIOD_FRAMES, out.data()); });
+			std::cout << std::setw(12) << file_format.name << " -> " << std::setw(6) << device_format.name << ": " << ns << std::endl;
+		}
+	}
+
+	for(const FormatName &format : DEVICE_FORMATS) {
+		SampleConverter converter;
+		if(!converter.Initialize(format.format)) {
+			continue;
+		}
+		double to_float_ns = NsPerSample([&] { converter.ToFloat(in.data(), PERIOD_FRAMES * NUM_OF_CHANNELS, floats.data()); });
+		double from_float_ns = NsPerSample([&] { converter.FromFloat(floats.data(), PERIOD_FRAMES * NUM_OF_CHANNELS, out.data()); });
+		std::cout << std::setw(12) << format.name << " <-> float: " << to_float_ns << " / " << from_float_ns << std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,378 @@
+/*
+Checks every sample format conversion against a plain scalar reference, which reads and writes
+the bytes of each sample one by one: all the supported file formats in both byte orders, to
+themselves and to the formats the device is configured with, with and without upmix.
+Conversions to 16 bit are checked to stay within the dither bound, and the dither to be centered.
+The conversions to and from float, used for processing, are checked the same way.
+*/
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+#include "services/format_converter.h"
+#include "services/sample_converter.h"
+
+using namespace wavplayeralsa;
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	do { \
+		if(!(condition)) { \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #condition << std::endl; \
+			failures++; \
+		} \
+	} while(0)
+
+// the conversion which failed, for the check messages
+static std::string current_conversion;
+
+#define CHECK_CONVERSION(condition) \
+	do { \
+		if(!(condition)) { \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": " << current_conversion << ": check failed: " #condition << std::endl; \
+			failures++; \
+			return; \
+		} \
+	} while(0)
+
+struct FormatDesc {
+	snd_pcm_format_t format;
+	const char *name;
+	unsigned int bytes;
+	bool is_float;
+	bool big_endian;
+};
+
+static const FormatDesc FORMATS[] = {
+	{ SND_PCM_FORMAT_S16_LE, "S16_LE", 2, false, false },
+	{ SND_PCM_FORMAT_S16_BE, "S16_BE", 2, false, true },
+	{ SND_PCM_FORMAT_S24_3LE, "S24_3LE", 3, false, false },
+	{ SND_PCM_FORMAT_S24_3BE, "S24_3BE", 3, false, true },
+	{ SND_PCM_FORMAT_S32_LE, "S32_LE", 4, false, false },
+	{ SND_PCM_FORMAT_S32_BE, "S32_BE", 4, false, true },
+	{ SND_PCM_FORMAT_FLOAT_LE, "FLOAT_LE", 4, true, false },
+	{ SND_PCM_FORMAT_FLOAT_BE, "FLOAT_BE", 4, true, true },
+	{ SND_PCM_FORMAT_FLOAT64_LE, "FLOAT64_LE", 8, true, false },
+	{ SND_PCM_FORMAT_FLOAT64_BE, "FLOAT64_BE", 8, true, true },
+};
+
+static const FormatDesc &Desc(snd_pcm_format_t format)
+{
+	for(const FormatDesc &desc : FORMATS) {
+		if(desc.format == format) {
+			return desc;
+		}
+	}
+	throw std::runtime_error("no such format in the test");
+}
+
+// the scalar reference. a sample is an integer for integer formats, or a double for float formats
+struct Sample {
+	int64_t int_value = 0;
+	double float_value = 0.0;
+};
+
+static uint64_t ReadBytes(const FormatDesc &desc, const unsigned char *p)
+{
+	uint64_t u = 0;
+	for(unsigned int b = 0; b < desc.bytes; b++) {
+		unsigned int shift = desc.big_endian ? (desc.bytes - 1 - b) * 8 : b * 8;
+		u |= (uint64_t)p[b] << shift;
+	}
+	return u;
+}
+
+static void WriteBytes(const FormatDesc &desc, uint64_t u, unsigned char *p)
+{
+	for(unsigned int b = 0; b < desc.bytes; b++) {
+		unsigned int shift = desc.big_endian ? (desc.bytes - 1 - b) * 8 : b * 8;
+		p[b] = (unsigned char)(u >> shift);
+	}
+}
+
+static Sample ReadSample(const FormatDesc &desc, const unsigned char *p)
+{
+	Sample sample;
+	uint64_t u = ReadBytes(desc, p);
+	if(desc.is_float && desc.bytes == 4) {
+		uint32_t u32 = (uint32_t)u;
+		float f;
+		memcpy(&f, &u32, sizeof(f));
+		sample.float_value = f;
+	}
+	else if(desc.is_float) {
+		memcpy(&sample.float_value, &u, sizeof(sample.float_value));
+	}
+	else {
+		// sign extend from the sample width
+		unsigned int bits = desc.bytes * 8;
+		sample.int_value = (int64_t)(u << (64 - bits)) >> (64 - bits);
+	}
+	return sample;
+}
+
+static void WriteSample(const FormatDesc &desc, const Sample &sample, unsigned char *p)
+{
+	if(desc.is_float && desc.bytes == 4) {
+		float f = (float)sample.float_value;
+		uint32_t u32;
+		memcpy(&u32, &f, sizeof(u32));
+		WriteBytes(desc, u32, p);
+	}
+	else if(desc.is_float) {
+		uint64_t u;
+		memcpy(&u, &sample.float_value, sizeof(u));
+		WriteBytes(desc, u, p);
+	}
+	else {
+		WriteBytes(desc, (uint64_t)sample.int_value, p);
+	}
+}
+
+// full scale is [-1.0, 1.0)
+static double ToDouble(const FormatDesc &desc, const Sample &sample)
+{
+	if(desc.is_float) {
+		return sample.float_value;
+	}
+	return (double)sample.int_value / std::ldexp(1.0, desc.bytes * 8 - 1);
+}
+
+// random samples over the whole range, with full scale and zero first. float samples also go over full scale
+static std::vector<unsigned char> MakeSamples(const FormatDesc &desc, size_t num_of_samples, std::mt19937 &rng)
+{
+	std::vector<unsigned char> bytes(num_of_samples * desc.bytes);
+	const int64_t full_scale = (int64_t)1 << (desc.bytes * 8 - 1);
+	std::uniform_int_distribution<int64_t> int_dist(-full_scale, full_scale - 1);
+	std::uniform_real_distribution<double> float_dist(-1.2, 1.2);
+	for(size_t i = 0; i < num_of_samples; i++) {
+		Sample sample;
+		if(desc.is_float) {
+			const double edges[] = { -1.0, 1.0, 0.0, -1.5, 1.5 };
+			sample.float_value = (i < 5) ? edges[i] : float_dist(rng);
+			if(desc.bytes == 4) {
+				sample.float_value = (float)sample.float_value;
+			}
+		}
+		else {
+			const int64_t edges[] = { -full_scale, full_scale - 1, 0, -1, 1 };
+			sample.int_value = (i < 5) ? edges[i] : int_dist(rng);
+		}
+		WriteSample(desc, sample, &bytes[i * desc.bytes]);
+	}
+	return bytes;
+}
+
+/*
+Checks a single output sample against the reference conversion of the input sample.
+Returns the error in LSB for conversions to 16 bit, which are dithered, and 0 for the others.
+*/
+static bool CheckSample(const FormatDesc &in_desc, const unsigned char *in, const FormatDesc &out_desc, const unsigned char *out, double *error_lsb)
+{
+	*error_lsb = 0.0;
+	if(in_desc.format == out_desc.format) {
+		return memcmp(in, out, in_desc.bytes) == 0;
+	}
+
+	Sample in_sample = ReadSample(in_desc, in);
+	Sample out_sample = ReadSample(out_desc, out);
+
+	// integer to a wider (or the same) integer format is exact
+	if(!in_desc.is_float && !out_desc.is_float && out_desc.bytes >= in_desc.bytes) {
+		return out_sample.int_value == in_sample.int_value * ((int64_t)1 << ((out_desc.bytes - in_desc.bytes) * 8));
+	}
+
+	// anything else goes through a float sample
+	const float value = (float)ToDouble(in_desc, in_sample);
+	if(out_desc.is_float) {
+		return out_sample.float_value == (double)value;
+	}
+	if(out_desc.bytes == 4) {
+		double expected = std::min(std::max((double)value * 2147483648.0, -2147483648.0), 2147483647.0);
+		return out_sample.int_value == (int64_t)std::nearbyint(expected);
+	}
+
+	// 16 bit, with dither of up to 1 LSB, and rounding of up to half an LSB
+	double expected = (double)value * 32768.0;
+	*error_lsb = (double)out_sample.int_value - std::min(std::max(expected, -32768.0), 32767.0);
+	return std::fabs(*error_lsb) <= 1.5;
+}
+
+static void CheckConversion(const FormatDesc &in_desc, unsigned int in_channels, const FormatDesc &out_desc, unsigned int out_channels)
+{
+	current_conversion = std::string(in_desc.name) + "x" + std::to_string(in_channels) + " -> " + out_desc.name + "x" + std::to_string(out_channels);
+
+	AlsaPcmStreamParams in_params;
+	in_params.format = in_desc.format;
+	in_params.frame_rate = 48000;
+	in_params.num_of_channels = in_channels;
+	AlsaPcmStreamParams out_params = in_params;
+	out_params.format = out_desc.format;
+	out_params.num_of_channels = out_channels;
+
+	FormatConverter converter;
+	CHECK_CONVERSION(converter.Initialize(in_params, out_params));
+	CHECK_CONVERSION(converter.GetInBytesPerFrame() == in_desc.bytes * in_channels);
+	CHECK_CONVERSION(converter.GetOutBytesPerFrame() == out_desc.bytes * out_channels);
+
+	// an odd count, so no conversion only works on whole vectors
+	const size_t num_of_frames = 4099;
+	std::mt19937 rng(in_desc.format * 100 + out_desc.format);
+	std::vector<unsigned char> in = MakeSamples(in_desc, num_of_frames * in_channels, rng);
+	std::vector<unsigned char> out(num_of_frames * out_channels * out_desc.bytes + 1, 0xa5);
+	converter.Convert((const char *)in.data(), num_of_frames, (char *)out.data());
+	CHECK_CONVERSION(out.back() == 0xa5);
+
+	const unsigned int out_per_in = out_channels / in_channels;
+	double error_sum = 0.0;
+	for(size_t i = 0; i < num_of_frames * in_channels; i++) {
+		const unsigned char *in_sample = &in[i * in_desc.bytes];
+		for(unsigned int k = 0; k < out_per_in; k++) {
+			const unsigned char *out_sample = &out[(i * out_per_in + k) * out_desc.bytes];
+			double error_lsb = 0.0;
+			CHECK_CONVERSION(CheckSample(in_desc, in_sample, out_desc, out_sample, &error_lsb));
+			// both channels of an upmixed sample are the same, dither included
+			CHECK_CONVERSION(memcmp(out_sample, &out[i * out_per_in * out_desc.bytes], out_desc.bytes) == 0);
+			error_sum += error_lsb;
+		}
+	}
+	// the dither is centered, so it does not add a dc offset
+	CHECK_CONVERSION(std::fabs(error_sum / (double)(num_of_frames * out_channels)) < 0.05);
+}
+
+/*
+A constant signal of a quarter of a 16 bit LSB is lost without dither. With it, the average
+of the output is the signal, and the error of each sample is within the TPDF bound.
+*/
+static void CheckDitherBound()
+{
+	current_conversion = "dither of S32 -> S16";
+
+	AlsaPcmStreamParams in_params;
+	in_params.format = SND_PCM_FORMAT_S32;
+	in_params.num_of_channels = 1;
+	AlsaPcmStreamParams out_params = in_params;
+	out_params.format = SND_PCM_FORMAT_S16;
+
+	FormatConverter converter;
+	CHECK_CONVERSION(converter.Initialize(in_params, out_params));
+
+	const size_t num_of_samples = 100000;
+	std::vector<int32_t> in(num_of_samples, 65536 / 4);
+	std::vector<int16_t> out(num_of_samples);
+	// in chunks, so the dither continues between calls
+	for(size_t offset = 0; offset < num_of_samples; offset += 1000) {
+		converter.Convert((const char *)&in[offset], 1000, (char *)&out[offset]);
+	}
+
+	double sum = 0.0;
+	int16_t min_value = out[0];
+	int16_t max_value = out[0];
+	for(int16_t v : out) {
+		CHECK_CONVERSION(std::fabs((double)v - 0.25) <= 1.5);
+		sum += v;
+		min_value = std::min(min_value, v);
+		max_value = std::max(max_value, v);
+	}
+	CHECK_CONVERSION(std::fabs(sum / num_of_samples - 0.25) < 0.02);
+	CHECK_CONVERSION(min_value == -1 && max_value == 1);
+}
+
+static void CheckSampleConverter(snd_pcm_format_t format)
+{
+	const FormatDesc &desc = Desc(format);
+	current_conversion = std::string("sample converter ") + desc.name;
+
+	SampleConverter converter;
+	CHECK_CONVERSION(converter.Initialize(format));
+
+	const size_t num_of_samples = 4099;
+	std::mt19937 rng(format);
+	std::vector<unsigned char> in = MakeSamples(desc, num_of_samples, rng);
+	std::vector<float> floats(num_of_samples);
+	converter.ToFloat((const char *)in.data(), num_of_samples, floats.data());
+	for(size_t i = 0; i < num_of_samples; i++) {
+		CHECK_CONVERSION(floats[i] == (float)ToDouble(desc, ReadSample(desc, &in[i * desc.bytes])));
+	}
+
+	// back from float, clipped to full scale. the processing can overshoot it
+	std::uniform_real_distribution<float> float_dist(-1.5f, 1.5f);
+	for(float &f : floats) {
+		f = float_dist(rng);
+	}
+	std::vector<unsigned char> out(num_of_samples * desc.bytes);
+	converter.FromFloat(floats.data(), num_of_samples, (char *)out.data());
+	const double full_scale = std::ldexp(1.0, desc.bytes * 8 - 1);
+	for(size_t i = 0; i < num_of_samples; i++) {
+		Sample sample = ReadSample(desc, &out[i * desc.bytes]);
+		if(desc.is_float) {
+			CHECK_CONVERSION(sample.float_value == (double)floats[i]);
+		}
+		else {
+			double expected = std::min(std::max((double)floats[i] * full_scale, -full_scale), full_scale - 1.0);
+			CHECK_CONVERSION(sample.int_value == (int64_t)std::nearbyint(expected));
+		}
+	}
+}
+
+int main()
+{
+	const snd_pcm_format_t device_formats[] = { SND_PCM_FORMAT_S16, SND_PCM_FORMAT_S32, SND_PCM_FORMAT_FLOAT };
+
+	for(const FormatDesc &in_desc : FORMATS) {
+		std::vector<snd_pcm_format_t> out_formats(std::begin(device_formats), std::end(device_formats));
+		out_formats.push_back(in_desc.format);
+		for(snd_pcm_format_t out_format : out_formats) {
+			const FormatDesc &out_desc = Desc(out_format);
+			CheckConversion(in_desc, 1, out_desc, 1);
+			CheckConversion(in_desc, 2, out_desc, 2);
+			CheckConversion(in_desc, 1, out_desc, 2);
+		}
+
+		// every device format which is tried for a file can be converted to
+		AlsaPcmStreamParams file_params;
+		file_params.format = in_desc.format;
+		file_params.num_of_channels = 1;
+		for(const AlsaPcmStreamParams &device_params : FormatConverter::GetDeviceParamsCandidates(file_params)) {
+			FormatConverter converter;
+			if(!converter.Initialize(file_params, device_params)) {
+				std::cerr << "no conversion from " << in_desc.name << " to device candidate " << Desc(device_params.format).name << "x" << device_params.num_of_channels << std::endl;
+				failures++;
+			}
+		}
+	}
+
+	// formats which are only played as is are copied when upmixed
+	{
+		AlsaPcmStreamParams in_params;
+		in_params.format = SND_PCM_FORMAT_U8;
+		in_params.num_of_channels = 1;
+		AlsaPcmStreamParams out_params = in_params;
+		out_params.num_of_channels = 2;
+		FormatConverter converter;
+		CHECK(converter.Initialize(in_params, out_params));
+		const unsigned char in[3] = { 1, 2, 255 };
+		unsigned char out[6] = { 0 };
+		converter.Convert((const char *)in, 3, (char *)out);
+		CHECK(out[0] == 1 && out[1] == 1 && out[2] == 2 && out[3] == 2 && out[4] == 255 && out[5] == 255);
+	}
+
+	CheckDitherBound();
+
+	for(snd_pcm_format_t format : device_formats) {
+		CheckSampleConverter(format);
+	}
+
+	if(failures > 0) {
+		std::cerr << failures << " checks failed" << std::endl;
+		return 1;
+	}
+	std::cout << "format converter test passed" << std::endl;
+	return 0;
+}
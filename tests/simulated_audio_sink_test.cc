@@ -0,0 +1,132 @@
+/*
+Plays a stream on a simulated audio device on the system clock: fills the buffer, checks the
+position reported while it plays, lets it run empty, and checks the xrun is reported and recovered.
+Timing checks only have lower bounds on the frames played, so a slow machine does not fail them.
+*/
+
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cerrno>
+#include <cstdint>
+
+#include "spdlog/spdlog.h"
+#include "spdlog/sinks/stdout_sinks.h"
+
+#include "services/simulated_audio_sink.h"
+
+using namespace wavplayeralsa;
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	do { \
+		if(!(condition)) { \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #condition << std::endl; \
+			failures++; \
+		} \
+	} while(0)
+
+// keeps the frames which the virtual clock played
+class RecordingSink :
+	public SimulatedAudioSink
+{
+
+public:
+	std::vector<int16_t> played;
+
+protected:
+	void OnFramesPlayed(const char *frames, snd_pcm_uframes_t num_of_frames) {
+		const int16_t *samples = (const int16_t *)frames;
+		played.insert(played.end(), samples, samples + num_of_frames * GetStreamParams().num_of_channels);
+	}
+
+};
+
+static void SleepMs(int ms)
+{
+	std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+int main()
+{
+	std::shared_ptr<spdlog::logger> logger = std::make_shared<spdlog::logger>("test", std::make_shared<spdlog::sinks::stdout_sink_mt>());
+
+	const unsigned int frame_rate = 48000;
+	const snd_pcm_sframes_t delay_frames = 48; // 1 ms
+
+	SimulatedAudioSinkConfig config;
+	config.delay_us = 1000;
+	AlsaPcmBufferConfig buffer_config;
+	buffer_config.buffer_time_us = 100000;
+	buffer_config.periods = 4;
+
+	RecordingSink sink;
+	sink.Initialize(logger, "sim:delay_us=1000", config, buffer_config, nullptr);
+
+	AlsaPcmStreamParams params;
+	params.format = SND_PCM_FORMAT_S16_LE;
+	params.frame_rate = frame_rate;
+	params.num_of_channels = 2;
+	CHECK(sink.IsStreamParamsSupported(params));
+	sink.StartStream(params);
+
+	AudioDeviceStatus status = sink.QueryStatus();
+	CHECK(status.buffer_size_frames == 4800);
+	CHECK(status.period_size_frames == 1200);
+	CHECK(sink.GetState() == SND_PCM_STATE_PREPARED);
+
+	// fill the buffer with a ramp, so the played frames can be checked to be in order
+	const snd_pcm_sframes_t buffer_size = 4800;
+	std::vector<int16_t> frames(buffer_size * 2);
+	for(size_t i = 0; i < frames.size(); i++) {
+		frames[i] = (int16_t)(i / 2);
+	}
+	CHECK(sink.AvailUpdate() == buffer_size);
+	CHECK(sink.Write(frames.data(), buffer_size) == buffer_size);
+	CHECK(sink.Write(frames.data(), 1) == 0);
+
+	// a prepared pcm does not play, and the codec delay is not reported yet
+	snd_pcm_sframes_t delay = 0;
+	CHECK(sink.GetDelay(&delay) == 0 && delay == buffer_size);
+
+	CHECK(sink.Start() == 0);
+	SleepMs(20);
+
+	// at least 20 ms were played, and the codec delay is reported
+	AlsaPcmPositionSnapshot snapshot = sink.GetPositionSnapshot();
+	if(snapshot.state == SND_PCM_STATE_RUNNING) {
+		CHECK(snapshot.delay <= buffer_size + delay_frames - 960);
+		CHECK(snapshot.delay >= delay_frames);
+		CHECK(sink.AvailUpdate() >= buffer_size + delay_frames - snapshot.delay);
+	}
+	else {
+		std::cerr << "the sleep took longer than the buffer. position is not checked" << std::endl;
+	}
+
+	// let the buffer run empty
+	SleepMs(150);
+	CHECK(sink.GetState() == SND_PCM_STATE_XRUN);
+	CHECK(sink.AvailUpdate() == -EPIPE);
+	CHECK(sink.Write(frames.data(), 1) == -EPIPE);
+
+	// the xrun started when the last frame was played, about 100 ms after start
+	uint64_t xrun_duration_us = sink.RecoverXrun(-EPIPE);
+	CHECK(xrun_duration_us >= 60000);
+	XrunStats xrun_stats = sink.QueryXrunStats();
+	CHECK(xrun_stats.count == 1);
+	CHECK(xrun_stats.max_duration_us == xrun_duration_us);
+	CHECK(sink.GetState() == SND_PCM_STATE_PREPARED);
+	CHECK(sink.AvailUpdate() == buffer_size);
+
+	// all the frames were played, in order, and none after the xrun
+	CHECK(sink.played == frames);
+
+	if(failures > 0) {
+		std::cerr << failures << " checks failed" << std::endl;
+		return 1;
+	}
+	std::cout << "simulated audio sink test passed" << std::endl;
+	return 0;
+}